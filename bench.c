@@ -0,0 +1,1847 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "bench.h"
+#include "order_append.h"
+#include "order_archive.h"
+#include "order_book.h"
+#include "order_changes.h"
+#include "order_client.h"
+#include "order_daemon.h"
+#include "order_filter.h"
+#include "order_generate.h"
+#include "order_index.h"
+#include "order_io.h"
+#include "order_listing.h"
+#include "order_lock.h"
+#include "order_match.h"
+#include "order_parse.h"
+#include "order_pool.h"
+#include "order_render.h"
+#include "order_segment.h"
+#include "order_status.h"
+#include "order_store.h"
+#include "order_symbols.h"
+#include "order_sync.h"
+
+#define BENCH_DATA_FILE "bench_transactions.dat"
+#define BENCH_WAL_FILE "bench_transactions.wal"
+#define BENCH_DEFAULT_ORDERS 20000
+
+/* The stress test runs the real store in a scratch directory */
+#define STRESS_DIR "bench_stress.d"
+#define STRESS_DONE_FILE "stress.done"
+#define STRESS_DEFAULT_ORDERS 2000
+#define STRESS_DEFAULT_BROKERS 4
+#define STRESS_DEFAULT_MARKETS 4
+#define STRESS_SEGMENT_RECORDS 256  /* Small, so segments fill and get compacted */
+
+/* Confirmation runs on a fresh store, also in a scratch directory */
+#define CONFIRM_DIR "bench_confirm.d"
+#define CONFIRM_DEFAULT_RECORDS 1000000
+
+/* The suite: generated orders through every stage of the store, as JSON lines */
+#define SUITE_DIR "bench_suite.d"
+#define SUITE_DEFAULT_RECORDS 100000
+#define SUITE_SAVE_ORDERS 1000      /* save_transaction() syncs every order */
+#define SUITE_PAGES 1000
+
+/* The daemon under load from client processes, each keeping `depth` requests in flight */
+#define DAEMON_DIR "bench_daemon.d"
+#define DAEMON_DEFAULT_REQUESTS 5000  /* Per client */
+#define DAEMON_DEFAULT_CLIENTS 4
+#define DAEMON_DEFAULT_DEPTH 16
+#define DAEMON_SEED_RECORDS 100000
+#define DAEMON_APPEND_ORDERS 16     /* Orders per append request */
+#define DAEMON_OPS 3                /* Appends, list pages and queries */
+
+/* Group commits and a checksum scan under each I/O backend */
+#define IO_DIR "bench_io.d"
+#define IO_DEFAULT_ORDERS 100000
+#define IO_DEFAULT_BATCH 16
+#define IO_SEGMENT_RECORDS 4096     /* At most, so most of the run gets compacted and scanned */
+#define IO_SCANS 3                  /* Best of */
+
+/* The archive: a generated, fully confirmed store, compacted and then archived */
+#define ARCHIVE_DIR "bench_archive.d"
+#define ARCHIVE_DEFAULT_RECORDS 1000000
+#define ARCHIVE_SEGMENT_RECORDS 4096  /* At most; smaller for small runs, see compact_segment_records() */
+#define ARCHIVE_SCANS 3             /* Best of, cached and from disk */
+
+/* A replica synced from scratch, then again after a few changes to the primary */
+#define SYNC_DIR "bench_sync.d"
+#define SYNC_PRIMARY_DIR "primary"
+#define SYNC_REPLICA_DIR "replica"
+#define SYNC_DEFAULT_RECORDS 1000000
+#define SYNC_DEFAULT_CHANGES 1000   /* Half appends, half scattered confirmations */
+
+/* The UI's own comparison, from main.c */
+int compare_orders_desc(const void *a, const void *b);
+
+static void make_order(StockOrder *order, long n) {
+    memset(order, 0, sizeof(StockOrder));
+    order->customer_account_no = (uint32_t)(100000 + n % 900000);
+    order->timestamp = (int64_t)591667200L + n;
+    strcpy(order->broker_id, "JDS");
+    order->action = (n & 1) ? ORDER_ACTION_SELL : ORDER_ACTION_BUY;
+    order->quantity = (uint32_t)(1 + n % 9999);
+    order->price_cents = (uint32_t)(1000 + n % 1000);
+    strcpy(order->ticker, "GM");
+    order->order_type = ORDER_TYPE_LIMIT;
+}
+
+static void remove_bench_files(void) {
+    order_segments_remove(BENCH_DATA_FILE);
+    remove(BENCH_WAL_FILE);
+}
+
+/* The original save_transaction(): open, write and close per order */
+static double bench_open_close(long orders) {
+    StockOrder order;
+    long long start;
+    long n;
+
+    remove_bench_files();
+    start = order_clock_usec();
+    for (n = 0; n < orders; n++) {
+        FILE *fp = fopen(BENCH_DATA_FILE, "ab");
+        if (fp == NULL) {
+            return -1.0;
+        }
+        make_order(&order, n);
+        fwrite(&order, sizeof(StockOrder), 1, fp);
+        fclose(fp);
+    }
+    return (double)(order_clock_usec() - start);
+}
+
+static double bench_group_commit(long orders, size_t batch) {
+    OrderAppender app;
+    OrderAppendConfig config;
+    StockOrder order;
+    long long start;
+    long n;
+
+    remove_bench_files();
+    memset(&config, 0, sizeof(config));
+    config.batch_orders = batch;
+
+    start = order_clock_usec();
+    if (!order_appender_open(&app, BENCH_DATA_FILE, BENCH_WAL_FILE, &config)) {
+        return -1.0;
+    }
+    for (n = 0; n < orders; n++) {
+        make_order(&order, n);
+        if (!order_appender_append(&app, &order)) {
+            order_appender_close(&app);
+            return -1.0;
+        }
+    }
+    if (!order_appender_close(&app)) {
+        return -1.0;
+    }
+    return (double)(order_clock_usec() - start);
+}
+
+static void report(const char *name, long orders, double usec) {
+    if (usec < 0) {
+        printf("%-24s failed\n", name);
+        return;
+    }
+    printf("%-24s %10ld %12.1f %14.0f\n", name, orders, usec / 1000.0,
+           usec > 0 ? (double)orders * 1000000.0 / usec : 0.0);
+}
+
+static int bench_append(long orders) {
+    static const size_t batches[] = { 1, 8, 64, 512, 4096 };
+    size_t i;
+
+    printf("%-24s %10s %12s %14s\n", "append path", "orders", "ms", "orders/sec");
+    report("open/write/close", orders, bench_open_close(orders));
+    for (i = 0; i < sizeof(batches) / sizeof(batches[0]); i++) {
+        char name[32];
+        sprintf(name, "group commit x%lu", (unsigned long)batches[i]);
+        report(name, orders, bench_group_commit(orders, batches[i]));
+    }
+
+    remove_bench_files();
+    return 0;
+}
+
+/* CSV parse and validate only, over lines already in memory */
+static int bench_parse(long orders) {
+    static const char *tickers[] = { "GM", "IBM", "XON", "KO", "GE" };
+    char *text, *p, *end;
+    StockOrder order;
+    const char *error;
+    long long start;
+    long n, parsed = 0;
+
+    /* Each line fits in 64 bytes */
+    text = (char *)malloc((size_t)orders * 64);
+    if (text == NULL) {
+        printf("Error: Out of memory\n");
+        return 1;
+    }
+    p = text;
+    for (n = 0; n < orders; n++) {
+        p += sprintf(p, "%ld,JDS,%s,%ld,%ld.%02ld,%s,%s\n",
+                     100000 + n % 900000, (n & 1) ? "SELL" : "BUY", 1 + n % 9999,
+                     10 + n % 990, n % 100, tickers[n % 5], (n & 2) ? "LIMIT" : "MARKET");
+    }
+    end = p;
+
+    start = order_clock_usec();
+    for (p = text; p < end; ) {
+        char *newline = (char *)memchr(p, '\n', (size_t)(end - p));
+        parsed += order_parse_line(p, (size_t)(newline - p), 0, &order, &error);
+        p = newline + 1;
+    }
+
+    printf("%-24s %10s %12s %14s\n", "parse path", "orders", "ms", "orders/sec");
+    report("csv parse", parsed, (double)(order_clock_usec() - start));
+    free(text);
+    return parsed == orders ? 0 : 1;
+}
+
+static void remove_stress_files(void) {
+    static const char *files[] = {
+        TRANSACTIONS_WAL_FILE, TRANSACTIONS_LOCK_FILE,
+        TRANSACTIONS_INDEX_FILE, TRANSACTIONS_PATCH_FILE,
+        TRANSACTIONS_STATUS_FILE, TRANSACTIONS_PENDING_FILE, TRANSACTIONS_FILLS_FILE,
+        TRANSACTIONS_FILLED_FILE, TRANSACTIONS_SYMBOLS_FILE, TRANSACTIONS_BLOCKS_FILE,
+        TRANSACTIONS_SOCKET_FILE, TRANSACTIONS_CHANGES_FILE, TRANSACTIONS_REPLICA_FILE,
+        STRESS_DONE_FILE
+    };
+    size_t i;
+
+    order_segments_remove(TRANSACTIONS_FILE);
+    for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        remove(files[i]);
+    }
+}
+
+/* Broker b appends orders 0..orders-1, tagged by account and timestamp */
+static int stress_broker(int b, long orders) {
+    OrderAppender app;
+    OrderAppendConfig config;
+    StockOrder order;
+    long n;
+
+    memset(&config, 0, sizeof(config));
+    config.batch_orders = (size_t)(1 + b % 8);
+    config.on_durable = order_store_appended;
+    if (!order_appender_open(&app, TRANSACTIONS_FILE, TRANSACTIONS_WAL_FILE, &config)) {
+        return 0;
+    }
+    for (n = 0; n < orders; n++) {
+        make_order(&order, n);
+        order.customer_account_no = (uint32_t)(100000 + b);
+        order.timestamp = (int64_t)n;
+        if (!order_appender_append(&app, &order)) {
+            order_appender_close(&app);
+            return 0;
+        }
+    }
+    return order_appender_close(&app);
+}
+
+/* Confirm whatever is pending until the brokers are done and nothing is left */
+static int stress_market(long *flipped) {
+    *flipped = 0;
+    for (;;) {
+        OrderListing listing;
+        FILE *done = fopen(STRESS_DONE_FILE, "rb");
+        size_t *indices, n;
+        long confirmed = 0;
+
+        if (done != NULL) {
+            fclose(done);
+        }
+        if (!order_listing_open(&listing, 0)) {
+            return 0;
+        }
+        if (listing.total == 0) {
+            order_listing_close(&listing);
+            if (done != NULL) {
+                return 1;
+            }
+            usleep(1000);
+            continue;
+        }
+
+        /* Order doesn't matter here: take the pending list as it is */
+        indices = (size_t *)malloc(listing.total * sizeof(size_t));
+        if (indices == NULL) {
+            order_listing_close(&listing);
+            return 0;
+        }
+        for (n = 0; n < listing.total; n++) {
+            indices[n] = (size_t)listing.status.pending[n];
+        }
+        order_listing_close(&listing);
+
+        if (!confirm_transactions(indices, n, &confirmed, NULL)) {
+            free(indices);
+            return 0;
+        }
+        free(indices);
+        *flipped += confirmed;
+
+        /* Compact alongside the brokers and the other markets */
+        if (!order_segments_compact(TRANSACTIONS_FILE, NULL)) {
+            return 0;
+        }
+
+        /* Listed but already confirmed: only a broken pending list does that */
+        if (done != NULL && confirmed == 0) {
+            return 1;
+        }
+    }
+}
+
+/* Check every order arrived once, got confirmed once, and the sidecars agree */
+static int stress_verify(int brokers, long orders, size_t seeds, long flipped) {
+    OrderStore store;
+    OrderStatus status;
+    OrderIndex index;
+    unsigned char *seen;
+    long lost = 0, duplicated = 0, unconfirmed = 0;
+    size_t i;
+    int ok;
+
+    seen = (unsigned char *)calloc((size_t)brokers * (size_t)orders, 1);
+    if (seen == NULL || !open_transactions(&store)) {
+        free(seen);
+        return 0;
+    }
+    for (i = seeds; i < store.count; i++) {
+        const StockOrder *order = &store.records[i];
+        long b = (long)order->customer_account_no - 100000;
+
+        if (b < 0 || b >= brokers || order->timestamp < 0 || order->timestamp >= orders) {
+            duplicated++;  /* Not an order we wrote: a torn or misplaced record */
+            continue;
+        }
+        if (seen[b * orders + (long)order->timestamp]++) {
+            duplicated++;
+        }
+        if (!order->confirmed) {
+            unconfirmed++;
+        }
+    }
+    for (i = 0; i < (size_t)brokers * (size_t)orders; i++) {
+        lost += seen[i] == 0;
+    }
+    free(seen);
+
+    ok = order_status_open(&status, &store) && order_index_open(&index, &store);
+    printf("records %lu, lost %ld, duplicated %ld, unconfirmed %ld, confirmations %ld\n",
+           (unsigned long)store.count, lost, duplicated, unconfirmed, flipped);
+    if (ok) {
+        printf("sidecars: %lu pending, %lu indexed\n",
+               (unsigned long)status.pending_count, (unsigned long)order_index_count(&index));
+        ok = status.pending_count == 0 && order_index_count(&index) == store.count;
+        order_index_close(&index);
+        order_status_close(&status);
+    }
+    order_store_close(&store);
+
+    /* More confirmations than orders means two markets confirmed the same one */
+    return ok && lost == 0 && duplicated == 0 && unconfirmed == 0 &&
+           flipped == (long)brokers * orders;
+}
+
+static long long clock_nsec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int compare_long_long(const void *a, const void *b) {
+    long long value_a = *(const long long *)a;
+    long long value_b = *(const long long *)b;
+
+    return value_a < value_b ? -1 : (value_a > value_b ? 1 : 0);
+}
+
+/* Orders around a fixed mid price so roughly half of them cross */
+static void make_match_order(StockOrder *order, unsigned long *seed) {
+    static const char *tickers[] = {
+        "GM", "IBM", "XON", "KO", "GE", "F", "T", "MRK",
+        "PG", "DD", "MMM", "BA", "CAT", "DIS", "MO", "AA"
+    };
+    unsigned long r;
+
+    *seed = *seed * 6364136223846793005UL + 1442695040888963407UL;
+    r = *seed >> 33;
+    memset(order, 0, sizeof(StockOrder));
+    strcpy(order->ticker, tickers[r % 16]);
+    order->action = (r >> 4) & 1 ? ORDER_ACTION_SELL : ORDER_ACTION_BUY;
+    order->order_type = (r >> 5) % 10 == 0 ? ORDER_TYPE_MARKET : ORDER_TYPE_LIMIT;
+    order->quantity = (uint32_t)(1 + (r >> 9) % 1000);
+    order->price_cents = order->action == ORDER_ACTION_BUY
+                             ? (uint32_t)(9950 + (r >> 19) % 101)
+                             : (uint32_t)(10050 - (r >> 19) % 101);
+}
+
+/* Matching engine alone: per-order latency and throughput */
+static int bench_match(long orders) {
+    OrderEngine engine;
+    OrderSymbols symbols;
+    OrderCompact *input;
+    StockOrder order;
+    long long *latency, start, total;
+    unsigned long seed = 1;
+    size_t fills = 0;
+    long n;
+
+    input = (OrderCompact *)malloc((size_t)orders * sizeof(OrderCompact));
+    latency = (long long *)malloc((size_t)orders * sizeof(long long));
+    if (input == NULL || latency == NULL) {
+        free(input);
+        free(latency);
+        printf("Error: Out of memory\n");
+        return 1;
+    }
+    /* The engine sees what the matcher gives it: compact records */
+    order_symbols_init(&symbols);
+    for (n = 0; n < orders; n++) {
+        make_match_order(&order, &seed);
+        if (!order_compact(&symbols, &order, &input[n])) {
+            break;
+        }
+    }
+    order_symbols_free(&symbols);
+    if (n < orders) {
+        free(input);
+        free(latency);
+        printf("Error: Out of memory\n");
+        return 1;
+    }
+
+    order_engine_init(&engine);
+    start = clock_nsec();
+    for (n = 0; n < orders; n++) {
+        long long t0 = clock_nsec();
+        uint32_t left;
+
+        if (!order_engine_submit(&engine, (uint64_t)n, &input[n], input[n].quantity,
+                                 0, &left)) {
+            printf("Error: Out of memory\n");
+            break;
+        }
+        latency[n] = clock_nsec() - t0;
+        /* Only the count matters here; don't let the fill log grow */
+        fills += engine.fill_count;
+        engine.fill_count = 0;
+    }
+    total = clock_nsec() - start;
+
+    qsort(latency, (size_t)n, sizeof(long long), compare_long_long);
+    printf("%-24s %10s %12s %14s\n", "match path", "orders", "ms", "orders/sec");
+    report("price-time match", n, (double)total / 1000.0);
+    if (n > 0) {
+        printf("%lu fills; latency ns p50 %lld, p90 %lld, p99 %lld, p99.9 %lld, max %lld\n",
+               (unsigned long)fills, latency[n / 2], latency[n * 9 / 10],
+               latency[n * 99 / 100], latency[n * 999 / 1000], latency[n - 1]);
+    }
+
+    order_engine_free(&engine);
+    free(latency);
+    free(input);
+    return n == orders ? 0 : 1;
+}
+
+/* The transaction tables before buffering: localtime(), sprintf and printf per row */
+static void render_page_printf(FILE *out, const StockOrder *const *orders, size_t count) {
+    size_t i;
+
+    for (i = 0; i < 25; i++) {
+        fprintf(out, "\n");
+        fflush(out);
+    }
+    fprintf(out, "%-8s %-16s %-10s %-6s %-5s %-9s %-7s %-6s\n",
+            "Acct#", "Timestamp", "Broker", "Action", "Qty", "Price", "Ticker", "Type");
+    for (i = 0; i < count; i++) {
+        char timestamp_str[64];     /* Room for every field at its widest */
+        char price_str[12];
+        time_t timestamp = (time_t)orders[i]->timestamp;
+        struct tm *tm_info = localtime(&timestamp);
+
+        sprintf(timestamp_str, "%02d/%02d/%02d %02d:%02d", tm_info->tm_mon + 1,
+                tm_info->tm_mday, tm_info->tm_year % 100, tm_info->tm_hour, tm_info->tm_min);
+        sprintf(price_str, "%lu.%02lu", (unsigned long)(orders[i]->price_cents / 100),
+                (unsigned long)(orders[i]->price_cents % 100));
+        fprintf(out, "%-8lu %-16s %-10.10s %-6s %-5lu $%-8s %-7.7s %-6s\n",
+                (unsigned long)orders[i]->customer_account_no, timestamp_str,
+                orders[i]->broker_id, orders[i]->action == ORDER_ACTION_BUY ? "BUY" : "SELL",
+                (unsigned long)orders[i]->quantity, price_str, orders[i]->ticker,
+                orders[i]->order_type == ORDER_TYPE_LIMIT ? "LIMIT" : "MARKET");
+    }
+    fflush(out);
+}
+
+/* Time `pages` consecutive pages of `page` orders from a fresh copy; page 0 = full sort */
+static void page_run(const char *name, OrderView *work, const OrderView *view,
+                     size_t page, size_t pages) {
+    OrderSelection selection;
+    long long start;
+    size_t p;
+
+    memcpy((void *)work->items, view->items, view->count * sizeof(const StockOrder *));
+    order_selection_init(&selection, NULL);
+    start = clock_nsec();
+    if (page == 0) {
+        order_view_sort(work, order_listing_compare);
+    }
+    for (p = 0; page > 0 && p < pages; p++) {
+        order_selection_extend(&selection, work, (p + 1) * page, order_listing_compare);
+    }
+    printf("%-24s %10lu %12.3f\n", name, (unsigned long)view->count,
+           (double)(clock_nsec() - start) / 1000000.0);
+    order_selection_free(&selection);
+}
+
+/* Newest-first pages of n orders: full qsort against selecting just the page */
+static int bench_page_size(long records) {
+    OrderView view, work;
+    StockOrder *orders;
+    unsigned long seed = 1;
+    long n;
+    int ok = 1;
+
+    orders = (StockOrder *)malloc((size_t)records * sizeof(StockOrder));
+    order_view_init(&view, NULL);
+    order_view_init(&work, NULL);
+    for (n = 0; orders != NULL && ok && n < records; n++) {
+        seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+        make_order(&orders[n], n);
+        orders[n].timestamp = (int64_t)591667200L + (int64_t)((seed >> 33) % 100000000UL);
+        ok = order_view_push(&view, &orders[n]) && order_view_push(&work, &orders[n]);
+    }
+    if (orders == NULL || !ok) {
+        printf("Error: Out of memory\n");
+        order_view_free(&view);
+        order_view_free(&work);
+        free(orders);
+        return 1;
+    }
+
+    page_run("qsort, page 1", &work, &view, 0, 1);
+    page_run("select, page 1", &work, &view, 10, 1);
+    page_run("select, pages 1-10", &work, &view, 10, 10);
+    page_run("select, page at 50%", &work, &view, (size_t)records / 2 + 10, 1);
+
+    order_view_free(&view);
+    order_view_free(&work);
+    free(orders);
+    return 0;
+}
+
+static int bench_page(long records, int sized) {
+    long size;
+
+    printf("%-24s %10s %12s\n", "page path", "records", "ms");
+    if (sized) {
+        return bench_page_size(records);
+    }
+    for (size = 10000; size <= 10000000; size *= 10) {
+        if (bench_page_size(size) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Screens of 10 orders, a minute apart, written to the null device */
+static int bench_render(long pages) {
+    static OrderRender render;
+    const StockOrder **rows;
+    StockOrder *orders;
+    long long start;
+    long n, count = pages * 10;
+    FILE *out = fopen("/dev/null", "w");
+
+    orders = (StockOrder *)malloc((size_t)count * sizeof(StockOrder));
+    rows = (const StockOrder **)malloc((size_t)count * sizeof(StockOrder *));
+    if (out == NULL || orders == NULL || rows == NULL) {
+        printf("Error: Could not set up the benchmark\n");
+        if (out != NULL) {
+            fclose(out);
+        }
+        free(orders);
+        free(rows);
+        return 1;
+    }
+    for (n = 0; n < count; n++) {
+        make_order(&orders[n], n);
+        orders[n].timestamp = (int64_t)591667200L + n * 60;
+        rows[n] = &orders[n];
+    }
+
+    printf("%-24s %10s %12s %14s\n", "render path", "pages", "ms", "pages/sec");
+    start = order_clock_usec();
+    for (n = 0; n < pages; n++) {
+        render_page_printf(out, rows + n * 10, 10);
+    }
+    report("printf per field", pages, (double)(order_clock_usec() - start));
+
+    order_render_init(&render);
+    start = order_clock_usec();
+    for (n = 0; n < pages; n++) {
+        order_render_begin(&render);
+        order_render_orders(&render, rows + n * 10, 10);
+        order_render_flush(&render, out);
+    }
+    report("buffered page", pages, (double)(order_clock_usec() - start));
+
+    fclose(out);
+    free(rows);
+    free(orders);
+    return 0;
+}
+
+/* A fresh store of `records` pending orders after the seed set; returns the seed count */
+static int confirm_store(long records, size_t *seeds) {
+    OrderStore store;
+    OrderAppender app;
+    OrderAppendConfig config;
+    StockOrder order;
+    long n;
+
+    remove_stress_files();
+    if (!open_transactions(&store)) {
+        return 0;
+    }
+    *seeds = store.count;
+    order_store_close(&store);
+
+    memset(&config, 0, sizeof(config));
+    config.batch_orders = 4096;
+    config.on_durable = order_store_appended;
+    if (!order_appender_open(&app, TRANSACTIONS_FILE, TRANSACTIONS_WAL_FILE, &config)) {
+        return 0;
+    }
+    for (n = 0; n < records; n++) {
+        make_order(&order, n);
+        if (!order_appender_append(&app, &order)) {
+            order_appender_close(&app);
+            return 0;
+        }
+    }
+    return order_appender_close(&app);
+}
+
+/* Confirm every order of a fresh store, with 1, 2, 4 and 8 workers */
+static int bench_confirm(long records) {
+    static const int workers[] = { 1, 2, 4, 8 };
+    size_t *indices, seeds, i, w;
+    long long start;
+    int failed = 0;
+
+    indices = (size_t *)malloc((size_t)records * sizeof(size_t));
+    mkdir(CONFIRM_DIR, 0755);  /* May be left over from a failed run */
+    if (indices == NULL || chdir(CONFIRM_DIR) != 0) {
+        printf("Error: Could not set up the benchmark\n");
+        free(indices);
+        return 1;
+    }
+
+    printf("%d cores\n", order_pool_default_workers());
+    printf("%-24s %10s %12s %14s\n", "confirm path", "records", "ms", "records/sec");
+    for (w = 0; w < sizeof(workers) / sizeof(workers[0]) && !failed; w++) {
+        char name[32];
+        long confirmed = 0;
+
+        if (!confirm_store(records, &seeds)) {
+            printf("Error: Could not create the store\n");
+            failed = 1;
+            break;
+        }
+        /* In reverse, so the sort isn't free */
+        for (i = 0; i < (size_t)records; i++) {
+            indices[i] = seeds + (size_t)records - 1 - i;
+        }
+
+        sprintf(name, "%d worker%s", workers[w], workers[w] == 1 ? "" : "s");
+        order_store_set_confirm_workers(workers[w]);
+        start = order_clock_usec();
+        if (!confirm_transactions(indices, (size_t)records, &confirmed, NULL) ||
+            confirmed != records) {
+            report(name, records, -1.0);
+            failed = 1;
+            break;
+        }
+        report(name, records, (double)(order_clock_usec() - start));
+    }
+    order_store_set_confirm_workers(0);
+
+    free(indices);
+    remove_stress_files();
+    if (chdir("..") == 0) {
+        rmdir(CONFIRM_DIR);
+    }
+    return failed;
+}
+
+/* One result per line, so runs can be diffed and tracked */
+static void suite_result(const char *name, size_t items, long long usec) {
+    printf("{\"benchmark\":\"%s\",\"items\":%lu,\"usec\":%lld,\"items_per_sec\":%.0f}\n",
+           name, (unsigned long)items, usec,
+           usec > 0 ? (double)items * 1000000.0 / (double)usec : 0.0);
+}
+
+static int suite_failed(const char *name) {
+    printf("{\"benchmark\":\"%s\",\"failed\":true}\n", name);
+    return 1;
+}
+
+/* Parse the suite's and generate's [seed [pending%%]] arguments */
+static int generator_args(int argc, char *argv[], OrderGeneratorConfig *config) {
+    order_generator_defaults(config);
+    if (argc >= 3) {
+        config->seed = (uint64_t)strtoull(argv[2], NULL, 10);
+    }
+    if (argc >= 4) {
+        long pending = atol(argv[3]);
+
+        if (pending < 0 || pending > 100) {
+            printf("Error: Pending share must be 0-100\n");
+            return 0;
+        }
+        config->pending_percent = (unsigned)pending;
+    }
+    return 1;
+}
+
+static StockOrder *generate_orders(const OrderGeneratorConfig *config, long records) {
+    OrderGenerator gen;
+    StockOrder *orders;
+    long n;
+
+    orders = (StockOrder *)malloc((size_t)records * sizeof(StockOrder));
+    if (orders == NULL || !order_generator_init(&gen, config)) {
+        free(orders);
+        return NULL;
+    }
+    for (n = 0; n < records; n++) {
+        order_generator_next(&gen, &orders[n]);
+    }
+    order_generator_free(&gen);
+    return orders;
+}
+
+static int append_orders(const StockOrder *orders, long count) {
+    OrderAppender app;
+    OrderAppendConfig config;
+    long n;
+
+    memset(&config, 0, sizeof(config));
+    config.batch_orders = 4096;
+    config.on_durable = order_store_appended;
+    if (!order_appender_open(&app, TRANSACTIONS_FILE, TRANSACTIONS_WAL_FILE, &config)) {
+        return 0;
+    }
+    for (n = 0; n < count; n++) {
+        if (!order_appender_append(&app, &orders[n])) {
+            order_appender_close(&app);
+            return 0;
+        }
+    }
+    return order_appender_close(&app);
+}
+
+/* Append generated orders to the store in the current directory */
+static int bench_generate(long records, const OrderGeneratorConfig *config) {
+    OrderStore store;
+    StockOrder *orders = generate_orders(config, records);
+
+    if (orders == NULL || !open_transactions(&store)) {
+        printf("Error: Could not generate orders\n");
+        free(orders);
+        return 1;
+    }
+    order_store_close(&store);
+    if (!append_orders(orders, records)) {
+        printf("Error: Could not save the orders\n");
+        free(orders);
+        return 1;
+    }
+    printf("Appended %ld orders to %s\n", records, TRANSACTIONS_FILE);
+    free(orders);
+    return 0;
+}
+
+/* Everything after the orders are in memory; the store is in the current directory */
+static int suite_run(StockOrder *orders, long records) {
+    static OrderRender render;
+    OrderStore store;
+    OrderReader reader;
+    OrderView view;
+    OrderSelection selection;
+    StockOrder *batch, *pending;
+    size_t *indices, saved, got, streamed = 0, i;
+    long confirmed = 0;
+    long long start;
+    FILE *out;
+    int ok;
+
+    if (!open_transactions(&store)) {
+        return suite_failed("open");
+    }
+    order_store_close(&store);
+
+    /* One order, one group commit: the interactive path */
+    saved = (size_t)records < SUITE_SAVE_ORDERS ? (size_t)records : SUITE_SAVE_ORDERS;
+    start = order_clock_usec();
+    for (i = 0; i < saved; i++) {
+        if (!save_transaction(&orders[i])) {
+            return suite_failed("save_transaction");
+        }
+    }
+    suite_result("save_transaction", saved, order_clock_usec() - start);
+
+    start = order_clock_usec();
+    if (!append_orders(orders + saved, records - (long)saved)) {
+        return suite_failed("append_batch");
+    }
+    suite_result("append_batch", (size_t)records - saved, order_clock_usec() - start);
+
+    start = order_clock_usec();
+    if (!order_reader_open(&reader, TRANSACTIONS_FILE, 0, NULL)) {
+        return suite_failed("load_streamed");
+    }
+    while ((got = order_reader_next_batch(&reader, &batch)) > 0) {
+        streamed += got;
+    }
+    order_reader_close(&reader);
+    suite_result("load_streamed", streamed, order_clock_usec() - start);
+
+    start = order_clock_usec();
+    if (!open_transactions(&store)) {
+        return suite_failed("load_mapped");
+    }
+    suite_result("load_mapped", store.count, order_clock_usec() - start);
+
+    order_view_init(&view, NULL);
+    start = order_clock_usec();
+    if (!order_view_filter(&view, &store, 0)) {
+        order_view_free(&view);
+        order_store_close(&store);
+        return suite_failed("filter_pending");
+    }
+    suite_result("filter_pending", store.count, order_clock_usec() - start);
+
+    /* The sorts all start from the same filtered, unsorted orders */
+    pending = (StockOrder *)malloc((view.count + 1) * sizeof(StockOrder));
+    indices = (size_t *)malloc((view.count + 1) * sizeof(size_t));
+    out = fopen("/dev/null", "w");
+    ok = pending != NULL && indices != NULL && out != NULL;
+    for (i = 0; ok && i < view.count; i++) {
+        pending[i] = *view.items[i];
+        indices[i] = (size_t)(view.items[i] - store.records);
+    }
+
+    if (ok) {
+        start = order_clock_usec();
+        qsort(pending, view.count, sizeof(StockOrder), compare_orders_desc);
+        suite_result("sort_records", view.count, order_clock_usec() - start);
+
+        order_selection_init(&selection, NULL);
+        start = order_clock_usec();
+        ok = order_selection_extend(&selection, &view, 10, order_listing_compare);
+        order_selection_free(&selection);
+        if (ok) {
+            suite_result("select_first_page", view.count, order_clock_usec() - start);
+        }
+    }
+    if (ok) {
+        start = order_clock_usec();
+        order_view_sort(&view, order_listing_compare);
+        suite_result("sort_view", view.count, order_clock_usec() - start);
+
+        /* Every screen from the newest pending order on, wrapping if there are few */
+        order_render_init(&render);
+        start = order_clock_usec();
+        for (i = 0; ok && view.count > 0 && i < SUITE_PAGES; i++) {
+            size_t first = (i * 10) % view.count;
+            size_t rows = view.count - first < 10 ? view.count - first : 10;
+
+            order_render_begin(&render);
+            order_render_orders(&render, view.items + first, rows);
+            ok = order_render_flush(&render, out);
+        }
+        if (ok) {
+            suite_result("render_page", view.count > 0 ? SUITE_PAGES : 0, order_clock_usec() - start);
+        }
+    }
+
+    /* The original save_all_transactions(): every pending order confirmed */
+    got = view.count;
+    order_view_free(&view);
+    order_store_close(&store);
+    if (ok) {
+        start = order_clock_usec();
+        ok = confirm_transactions(indices, got, &confirmed, NULL) && confirmed == (long)got;
+        if (ok) {
+            suite_result("confirm_all", got, order_clock_usec() - start);
+        }
+    }
+
+    if (out != NULL) {
+        fclose(out);
+    }
+    free(pending);
+    free(indices);
+    return ok ? 0 : suite_failed("sort_render_confirm");
+}
+
+static int bench_suite(long records, const OrderGeneratorConfig *config) {
+    StockOrder *orders;
+    long long start;
+    int failed;
+
+    printf("{\"suite\":\"stock\",\"records\":%ld,\"seed\":%llu,\"pending_percent\":%u}\n",
+           records, (unsigned long long)config->seed, config->pending_percent);
+    start = order_clock_usec();
+    orders = generate_orders(config, records);
+    if (orders == NULL) {
+        return suite_failed("generate");
+    }
+    suite_result("generate", (size_t)records, order_clock_usec() - start);
+
+    mkdir(SUITE_DIR, 0755);  /* May be left over from a failed run */
+    if (chdir(SUITE_DIR) != 0) {
+        free(orders);
+        return suite_failed("setup");
+    }
+    remove_stress_files();
+    failed = suite_run(orders, records);
+    free(orders);
+
+    remove_stress_files();
+    if (chdir("..") == 0) {
+        rmdir(SUITE_DIR);
+    }
+    return failed;
+}
+
+static volatile sig_atomic_t daemon_stop = 0;
+
+static void stop_bench_daemon(int sig) {
+    (void)sig;
+    daemon_stop = 1;
+}
+
+/* Latency of one request, as its client saw it */
+typedef struct {
+    long long nsec;
+    int op;                         /* Index into daemon_op_names */
+} DaemonSample;
+
+static const char *const daemon_op_names[DAEMON_OPS] = { "append", "list page", "query" };
+
+/* Request n of a client: half appends, four in ten list pages, one in ten queries */
+static int daemon_request(OrderGenerator *gen, long n, unsigned char *request, size_t *length,
+                          unsigned *op) {
+    StockOrder orders[DAEMON_APPEND_ORDERS];
+    OrderFilter filter;
+    size_t i;
+
+    if (n % 10 < 5) {
+        for (i = 0; i < DAEMON_APPEND_ORDERS; i++) {
+            order_generator_next(gen, &orders[i]);
+            order_to_disk(&orders[i]);
+        }
+        memcpy(request, orders, sizeof(orders));
+        *length = sizeof(orders);
+        *op = ORDER_OP_APPEND;
+        return 0;
+    }
+    order_filter_init(&filter);
+    if (n % 10 < 9) {
+        /* Both lists, a few pages in */
+        *length = order_client_list_request(request, (int)(n & 1), &filter,
+                                            (size_t)(n % 100) * 10, 10);
+        *op = ORDER_OP_LIST;
+        return 1;
+    }
+    /* One account in one ticker, as `stock query` would ask */
+    order_generator_next(gen, &orders[0]);
+    filter.account = orders[0].customer_account_no;
+    memcpy(filter.ticker, orders[0].ticker, sizeof(filter.ticker));
+    *length = order_client_query_request(request, &filter, 0, 10);
+    *op = ORDER_OP_QUERY;
+    return 2;
+}
+
+/* Client c sends `requests` requests, never more than `depth` unanswered, and
+   writes their latencies to out_fd */
+static int daemon_client(int c, long requests, int depth, int out_fd) {
+    unsigned char request[DAEMON_APPEND_ORDERS * sizeof(StockOrder)];
+    OrderGeneratorConfig config;
+    OrderGenerator gen;
+    OrderClient client;
+    DaemonSample *samples, *sent;
+    long issued = 0, answered = 0;
+    size_t bytes = (size_t)requests * sizeof(DaemonSample);
+    int ok;
+
+    order_generator_defaults(&config);
+    config.seed += (uint64_t)c + 1;
+    samples = (DaemonSample *)malloc(bytes);
+    sent = (DaemonSample *)malloc((size_t)depth * sizeof(DaemonSample));
+    if (samples == NULL || sent == NULL || !order_generator_init(&gen, &config)) {
+        free(samples);
+        free(sent);
+        return 0;
+    }
+    ok = order_client_open(&client, TRANSACTIONS_SOCKET_FILE);
+
+    while (ok && answered < requests) {
+        const unsigned char *payload;
+        OrderFrame frame;
+
+        /* Top the pipeline up, then take the oldest reply */
+        while (ok && issued < requests && issued - answered < depth) {
+            DaemonSample *slot = &sent[issued % depth];
+            size_t length;
+            unsigned op;
+
+            slot->op = daemon_request(&gen, issued, request, &length, &op);
+            slot->nsec = clock_nsec();
+            ok = order_client_send(&client, op, request, length, NULL);
+            issued++;
+        }
+        if (ok && order_client_receive(&client, &frame, &payload) &&
+            frame.status == ORDER_STATUS_OK) {
+            const DaemonSample *slot = &sent[answered % depth];
+
+            samples[answered].nsec = clock_nsec() - slot->nsec;
+            samples[answered].op = slot->op;
+            answered++;
+        } else {
+            ok = 0;
+        }
+    }
+    order_client_close(&client);
+    order_generator_free(&gen);
+    ok = ok && write(out_fd, samples, bytes) == (ssize_t)bytes;
+    free(sent);
+    free(samples);
+    return ok;
+}
+
+/* Read a client's samples to EOF; 1 if they were all there */
+static int daemon_collect(int fd, DaemonSample *samples, long requests) {
+    size_t bytes = (size_t)requests * sizeof(DaemonSample), got = 0;
+    ssize_t n;
+
+    while ((n = read(fd, (char *)samples + got, bytes - got)) > 0) {
+        got += (size_t)n;
+        if (got == bytes) {
+            break;
+        }
+    }
+    close(fd);
+    return got == bytes;
+}
+
+static void daemon_report(const char *name, long long *nsec, size_t n) {
+    if (n == 0) {
+        return;
+    }
+    qsort(nsec, n, sizeof(long long), compare_long_long);
+    printf("%-10s %8lu  p50 %6lld  p90 %6lld  p99 %6lld  p99.9 %6lld  max %7lld us\n",
+           name, (unsigned long)n, nsec[n / 2] / 1000, nsec[n * 9 / 10] / 1000,
+           nsec[n * 99 / 100] / 1000, nsec[n * 999 / 1000] / 1000, nsec[n - 1] / 1000);
+}
+
+/* Requests per second and latency of a daemon serving `clients` processes */
+static int bench_daemon(long requests, int clients, int depth) {
+    OrderGeneratorConfig config;
+    OrderClient probe;
+    StockOrder *seeds;
+    DaemonSample *samples;
+    long long *nsec, *by_op[DAEMON_OPS], start, elapsed;
+    size_t total = (size_t)requests * (size_t)clients, counts[DAEMON_OPS], i;
+    pid_t server = -1, *pids;
+    int *pipes, c, op, status, started, failed;
+
+    order_generator_defaults(&config);
+    seeds = generate_orders(&config, DAEMON_SEED_RECORDS);
+    samples = (DaemonSample *)malloc(total * sizeof(DaemonSample));
+    nsec = (long long *)malloc(total * sizeof(long long) * (DAEMON_OPS + 1));
+    pids = (pid_t *)malloc((size_t)clients * sizeof(pid_t));
+    pipes = (int *)malloc((size_t)clients * sizeof(int));
+    mkdir(DAEMON_DIR, 0755);  /* May be left over from a failed run */
+    if (seeds == NULL || samples == NULL || nsec == NULL || pids == NULL || pipes == NULL ||
+        chdir(DAEMON_DIR) != 0) {
+        printf("Error: Could not set up the benchmark\n");
+        free(seeds);
+        free(samples);
+        free(nsec);
+        free(pids);
+        free(pipes);
+        return 1;
+    }
+    remove_stress_files();
+    failed = !append_orders(seeds, DAEMON_SEED_RECORDS);
+    free(seeds);
+
+    fflush(stdout);
+    if (!failed) {
+        server = fork();
+    }
+    if (server == 0) {
+        signal(SIGTERM, stop_bench_daemon);
+        _exit(order_daemon_run(TRANSACTIONS_SOCKET_FILE, &daemon_stop) ? 0 : 1);
+    }
+    /* Give it up to five seconds to answer */
+    for (i = 0; server > 0 && i < 500; i++) {
+        if (order_client_open(&probe, TRANSACTIONS_SOCKET_FILE)) {
+            order_client_close(&probe);
+            break;
+        }
+        usleep(10000);
+    }
+    if (server <= 0 || i == 500) {
+        printf("Error: The daemon did not start\n");
+        failed = 1;
+    }
+
+    /* Clients write their samples only once their requests are done, so the
+       pipes are drained after every client has been started */
+    start = clock_nsec();
+    for (c = 0; c < clients && !failed; c++) {
+        int fds[2];
+        pid_t pid;
+
+        if (pipe(fds) != 0) {
+            failed = 1;
+            break;
+        }
+        pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            _exit(daemon_client(c, requests, depth, fds[1]) ? 0 : 1);
+        }
+        close(fds[1]);
+        if (pid < 0) {
+            close(fds[0]);
+            failed = 1;
+            break;
+        }
+        pids[c] = pid;
+        pipes[c] = fds[0];
+    }
+    started = c;
+    for (c = 0; c < started; c++) {
+        if (!daemon_collect(pipes[c], samples + (size_t)c * (size_t)requests, requests)) {
+            failed = 1;
+        }
+    }
+    for (c = 0; c < started; c++) {
+        if (waitpid(pids[c], &status, 0) != pids[c] || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0) {
+            failed = 1;
+        }
+    }
+    elapsed = clock_nsec() - start;
+
+    if (server > 0) {
+        kill(server, SIGTERM);
+        if (waitpid(server, &status, 0) != server || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0) {
+            printf("Error: The daemon did not stop cleanly\n");
+            failed = 1;
+        }
+    }
+
+    if (!failed) {
+        printf("%d clients x %ld requests, %d in flight each, %d orders per append\n",
+               clients, requests, depth, DAEMON_APPEND_ORDERS);
+        printf("%.0f requests/sec\n", (double)total * 1e9 / (double)elapsed);
+        memset(counts, 0, sizeof(counts));
+        for (op = 0; op < DAEMON_OPS; op++) {
+            by_op[op] = nsec + total * (size_t)(op + 1);
+        }
+        for (i = 0; i < total; i++) {
+            nsec[i] = samples[i].nsec;
+            op = samples[i].op;
+            by_op[op][counts[op]++] = samples[i].nsec;
+        }
+        daemon_report("all", nsec, total);
+        for (op = 0; op < DAEMON_OPS; op++) {
+            daemon_report(daemon_op_names[op], by_op[op], counts[op]);
+        }
+        printf("OK\n");
+    } else {
+        printf("FAILED\n");
+    }
+
+    free(samples);
+    free(nsec);
+    free(pids);
+    free(pipes);
+    remove_stress_files();
+    if (chdir("..") == 0) {
+        rmdir(DAEMON_DIR);
+    }
+    return failed;
+}
+
+/* Segments of at most `largest` records, small enough that `records` fill
+   two compaction groups; 0 if they can't fill even one */
+static size_t compact_segment_records(long records, size_t largest) {
+    size_t size = (size_t)records / (2 * ORDER_SEGMENT_COMPACT_GROUP);
+
+    if ((size_t)records < ORDER_SEGMENT_COMPACT_GROUP * ORDER_SEGMENT_ALIGN) {
+        return 0;
+    }
+    size = size / ORDER_SEGMENT_ALIGN * ORDER_SEGMENT_ALIGN;
+    if (size < ORDER_SEGMENT_ALIGN) {
+        size = ORDER_SEGMENT_ALIGN;
+    }
+    return size < largest ? size : largest;
+}
+
+/* Append `count` orders in groups of `batch`; usec, or -1.  `io_calls` gets
+   the system calls the appender's queue made. */
+static long long io_append(const StockOrder *orders, long count, size_t batch,
+                           const char **backend, uint64_t *io_calls) {
+    OrderAppender app;
+    OrderAppendConfig config;
+    long long start = order_clock_usec();
+    long n;
+    int ok;
+
+    memset(&config, 0, sizeof(config));
+    config.batch_orders = batch;
+    config.on_durable = order_store_appended;
+    if (!order_appender_open(&app, TRANSACTIONS_FILE, TRANSACTIONS_WAL_FILE, &config)) {
+        return -1;
+    }
+    *backend = order_io_name(&app.io);
+    for (n = 0, ok = 1; ok && n < count; n++) {
+        ok = order_appender_append(&app, &orders[n]);
+    }
+    ok = order_appender_sync(&app) && ok;
+    *io_calls = app.io.calls;
+    ok = order_appender_close(&app) && ok;
+    return ok ? order_clock_usec() - start : -1;
+}
+
+static int bench_io(long orders, size_t batch) {
+    static const char *const backends[] = { "posix", "uring" };
+    OrderGeneratorConfig config;
+    StockOrder *generated;
+    size_t b, merged, bad, segment_records = compact_segment_records(orders, IO_SEGMENT_RECORDS);
+    int failed = 0;
+
+    if (segment_records == 0) {
+        printf("Error: At least %d orders are needed to fill a group of %d segments to verify\n",
+               ORDER_SEGMENT_COMPACT_GROUP * ORDER_SEGMENT_ALIGN, ORDER_SEGMENT_COMPACT_GROUP);
+        return 1;
+    }
+
+    /* Confirmed, so everything but the tail can be compacted and scanned */
+    order_generator_defaults(&config);
+    config.pending_percent = 0;
+    generated = generate_orders(&config, orders);
+    mkdir(IO_DIR, 0755);  /* May be left over from a failed run */
+    if (generated == NULL || chdir(IO_DIR) != 0) {
+        printf("Error: Could not set up the benchmark\n");
+        free(generated);
+        return 1;
+    }
+    order_segment_set_default_records(segment_records);
+
+    printf("%-24s %10s %12s %14s\n", "Benchmark", "Orders", "Time (ms)", "Orders/sec");
+    for (b = 0; b < sizeof(backends) / sizeof(backends[0]) && !failed; b++) {
+        const char *name = backends[b];
+        long long usec, best = -1;
+        uint64_t calls = 0;
+        char label[64];
+        int i;
+
+        setenv(ORDER_IO_ENV, backends[b], 1);
+        remove_stress_files();
+        usec = io_append(generated, orders, batch, &name, &calls);
+        snprintf(label, sizeof(label), "append %s, %lu/group", name, (unsigned long)batch);
+        report(label, orders, (double)usec);
+        /* Nothing compacted would leave nothing to verify */
+        if (usec < 0 || !order_segments_compact(TRANSACTIONS_FILE, &merged) || merged == 0) {
+            failed = 1;
+            break;
+        }
+        printf("%-24s %.1f per group, %.3f per order\n", "  I/O system calls",
+               (double)calls * (double)batch / (double)orders, (double)calls / (double)orders);
+
+        for (i = 0; i < IO_SCANS && !failed; i++) {
+            long long scan_start = order_clock_usec();
+
+            failed = !order_segments_verify(TRANSACTIONS_FILE, &bad) || bad > 0;
+            usec = order_clock_usec() - scan_start;
+            if (best < 0 || usec < best) {
+                best = usec;
+            }
+        }
+        snprintf(label, sizeof(label), "verify %s", name);
+        report(label, (long)(merged * segment_records), failed ? -1.0 : (double)best);
+    }
+    unsetenv(ORDER_IO_ENV);
+    printf("%s\n", failed ? "FAILED" : "OK");
+
+    free(generated);
+    remove_stress_files();
+    if (chdir("..") == 0) {
+        rmdir(IO_DIR);
+    }
+    return failed;
+}
+
+/* Full scans of the first `records` records, raw from the store or decoded from the archive */
+static long long scan_store(size_t records, uint64_t *checksum) {
+    OrderReader reader;
+    StockOrder *batch;
+    size_t count, seen = 0, i;
+    long long start = order_clock_usec();
+
+    *checksum = 0;
+    if (!order_reader_open(&reader, TRANSACTIONS_FILE, ORDER_ARCHIVE_BLOCK, NULL)) {
+        return -1;
+    }
+    while (seen < records && (count = order_reader_next_batch(&reader, &batch)) > 0) {
+        for (i = 0; i < count && seen < records; i++, seen++) {
+            *checksum += batch[i].price_cents * (uint64_t)batch[i].quantity;
+        }
+    }
+    order_reader_close(&reader);
+    return seen == records ? order_clock_usec() - start : -1;
+}
+
+static long long scan_archive(size_t records, uint64_t *checksum) {
+    OrderArchiveReader reader;
+    StockOrder *batch;
+    size_t count, seen = 0, i;
+    long long start = order_clock_usec();
+
+    *checksum = 0;
+    if (!order_archive_open(&reader, TRANSACTIONS_ARCHIVE_FILE)) {
+        return -1;
+    }
+    while ((count = order_archive_next_batch(&reader, &batch)) > 0) {
+        for (i = 0; i < count; i++, seen++) {
+            *checksum += batch[i].price_cents * (uint64_t)batch[i].quantity;
+        }
+    }
+    i = reader.error;
+    order_archive_close(&reader);
+    return seen == records && i == 0 ? order_clock_usec() - start : -1;
+}
+
+/* Drop a file's pages from the page cache, so the next scan reads it from disk */
+static int drop_cached(const char *path) {
+#ifdef POSIX_FADV_DONTNEED
+    int fd = open(path, O_RDONLY);
+    int ok;
+
+    if (fd < 0) {
+        return 0;
+    }
+    /* Only clean pages are dropped */
+    ok = fdatasync(fd) == 0 && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return ok;
+#else
+    (void)path;
+    return 0;
+#endif
+}
+
+/* The store's manifest and segments and the archive, all out of the page
+ * cache; 0 if this host can't drop them */
+static int drop_scan_caches(void) {
+    char path[FILENAME_MAX];
+    OrderManifest manifest;
+    size_t i;
+    int ok;
+
+    if (!order_manifest_read(&manifest, TRANSACTIONS_FILE)) {
+        return 0;
+    }
+    ok = drop_cached(TRANSACTIONS_FILE) && drop_cached(TRANSACTIONS_ARCHIVE_FILE);
+    for (i = 0; ok && i < manifest.segments; i++) {
+        /* Compacted files are named by several slots in a row */
+        if (i > 0 && manifest.slots[i].file == manifest.slots[i - 1].file) {
+            continue;
+        }
+        ok = order_segment_path(path, TRANSACTIONS_FILE, manifest.slots[i].file) &&
+             drop_cached(path);
+    }
+    order_manifest_free(&manifest);
+    return ok;
+}
+
+/* Scan both, each `cold` from disk or else from the page cache, keeping the fastest times */
+static int scan_both(size_t records, int cold, long long *raw_usec, long long *archive_usec) {
+    uint64_t raw_sum, archive_sum;
+    long long usec;
+
+    if (cold && !drop_scan_caches()) {
+        return 0;
+    }
+    usec = scan_store(records, &raw_sum);
+    if (usec >= 0 && (*raw_usec < 0 || usec < *raw_usec)) {
+        *raw_usec = usec;
+    }
+    if (cold && !drop_scan_caches()) {
+        return 0;
+    }
+    usec = scan_archive(records, &archive_sum);
+    if (usec >= 0 && (*archive_usec < 0 || usec < *archive_usec)) {
+        *archive_usec = usec;
+    }
+    return *raw_usec >= 0 && *archive_usec >= 0 && raw_sum == archive_sum;
+}
+
+/* One pair of scan times, and how the archive compares */
+static void scan_report(const char *raw_name, const char *archive_name, size_t records,
+                        long long raw_usec, long long archive_usec) {
+    report(raw_name, (long)records, (double)raw_usec);
+    report(archive_name, (long)records, (double)archive_usec);
+    printf("%-24s %.2fx the store's scan time\n", "  archive / store",
+           raw_usec > 0 ? (double)archive_usec / (double)raw_usec : 0.0);
+}
+
+/* Every archived record must come back exactly as the store holds it */
+static int archive_matches(size_t records) {
+    OrderReader store;
+    OrderArchiveReader archive;
+    StockOrder *from_store, *from_archive;
+    size_t count, seen = 0;
+    int ok;
+
+    if (!order_reader_open(&store, TRANSACTIONS_FILE, ORDER_ARCHIVE_BLOCK, NULL)) {
+        return 0;
+    }
+    if (!order_archive_open(&archive, TRANSACTIONS_ARCHIVE_FILE)) {
+        order_reader_close(&store);
+        return 0;
+    }
+    /* Both read a block of ORDER_ARCHIVE_BLOCK records at a time */
+    ok = 1;
+    while (ok && (count = order_archive_next_batch(&archive, &from_archive)) > 0) {
+        ok = order_reader_next_batch(&store, &from_store) >= count &&
+             memcmp(from_store, from_archive, count * sizeof(StockOrder)) == 0;
+        seen += count;
+    }
+    ok = ok && !archive.error && seen == records;
+    order_archive_close(&archive);
+    order_reader_close(&store);
+    return ok;
+}
+
+/* Size and scan speed of the archive against the records it was made from */
+static int bench_archive(long records, const OrderGeneratorConfig *config) {
+    OrderGeneratorConfig confirmed = *config;
+    OrderStore store;
+    StockOrder *orders;
+    size_t seeds = 0, merged, added, archived = 0;
+    uint64_t bytes;
+    long long raw_usec = -1, archive_usec = -1, raw_cold_usec = -1, archive_cold_usec = -1;
+    size_t segment_records = compact_segment_records(records, ARCHIVE_SEGMENT_RECORDS);
+    int i, cold, failed = 0;
+
+    if (segment_records == 0) {
+        printf("Error: At least %d records are needed to fill a group of %d segments to compact\n",
+               ORDER_SEGMENT_COMPACT_GROUP * ORDER_SEGMENT_ALIGN, ORDER_SEGMENT_COMPACT_GROUP);
+        return 1;
+    }
+
+    /* Only confirmed history is ever compacted, so archived */
+    confirmed.pending_percent = 0;
+    orders = generate_orders(&confirmed, records);
+    mkdir(ARCHIVE_DIR, 0755);  /* May be left over from a failed run */
+    if (orders == NULL || chdir(ARCHIVE_DIR) != 0) {
+        printf("Error: Could not set up the benchmark\n");
+        free(orders);
+        return 1;
+    }
+    remove_stress_files();
+    remove(TRANSACTIONS_ARCHIVE_FILE);
+    order_segment_set_default_records(segment_records);
+
+    if (!open_transactions(&store)) {
+        failed = 1;
+    } else {
+        seeds = store.count;
+        order_store_close(&store);
+        failed = !append_orders(orders, records) ||
+                 !order_segments_compact(TRANSACTIONS_FILE, &merged) ||
+                 !order_archive_update(TRANSACTIONS_ARCHIVE_FILE, TRANSACTIONS_FILE, &added) ||
+                 !order_archive_stat(TRANSACTIONS_ARCHIVE_FILE, &archived, &bytes) ||
+                 archived == 0;
+    }
+    free(orders);
+    if (failed) {
+        printf("Error: Could not build the archive\n");
+    }
+
+    /* From the page cache, then from disk, where the archive reads a fraction of the bytes */
+    for (i = 0; i < ARCHIVE_SCANS && !failed; i++) {
+        failed = !scan_both(archived, 0, &raw_usec, &archive_usec);
+    }
+    cold = !failed && drop_scan_caches();
+    for (i = 0; i < ARCHIVE_SCANS && cold && !failed; i++) {
+        failed = !scan_both(archived, 1, &raw_cold_usec, &archive_cold_usec);
+    }
+    if (!failed) {
+        printf("%lu of %lu records archived: %lu bytes raw, %lu archived, %.2fx smaller\n",
+               (unsigned long)archived, (unsigned long)(seeds + (size_t)records),
+               (unsigned long)(archived * sizeof(StockOrder)), (unsigned long)bytes,
+               (double)(archived * sizeof(StockOrder)) / (double)bytes);
+        scan_report("scan store, cached", "scan archive, cached", archived, raw_usec, archive_usec);
+        if (cold) {
+            scan_report("scan store, from disk", "scan archive, from disk", archived,
+                        raw_cold_usec, archive_cold_usec);
+        } else {
+            printf("%-24s skipped: the page cache can't be dropped here\n", "scans from disk");
+        }
+        failed = !archive_matches(archived);
+        printf("%s\n", failed ? "FAILED: archive differs from the store" : "OK");
+    } else if (archived > 0) {
+        printf("FAILED to scan the archive\n");
+    }
+
+    remove_stress_files();
+    remove(TRANSACTIONS_ARCHIVE_FILE);
+    if (chdir("..") == 0) {
+        rmdir(ARCHIVE_DIR);
+    }
+    return failed;
+}
+
+/* Sync the replica from the primary; usec, or -1 */
+static long long sync_replica(OrderSyncResult *result) {
+    long long start = order_clock_usec();
+    int ok = order_sync("../" SYNC_REPLICA_DIR, result);
+    long long usec = order_clock_usec() - start;
+
+    return ok ? usec : -1;
+}
+
+/* Every record of the replica as the primary has it */
+static int sync_matches(void) {
+    OrderStore primary, replica;
+    int same;
+
+    if (!order_store_open(&primary, TRANSACTIONS_FILE)) {
+        return 0;
+    }
+    if (!order_store_open(&replica, "../" SYNC_REPLICA_DIR "/" TRANSACTIONS_FILE)) {
+        order_store_close(&primary);
+        return 0;
+    }
+    same = primary.count == replica.count &&
+           memcmp(primary.records, replica.records, primary.count * sizeof(StockOrder)) == 0;
+    order_store_close(&replica);
+    order_store_close(&primary);
+    return same;
+}
+
+/* Append `appends` orders and confirm `confirms` records spread over the store */
+static int sync_change(size_t records, long appends, long confirms) {
+    OrderAppender app;
+    OrderAppendConfig config;
+    StockOrder order;
+    size_t *indices;
+    long n, confirmed = 0;
+    int ok = 1;
+
+    memset(&config, 0, sizeof(config));
+    config.batch_orders = 4096;
+    config.on_durable = order_store_appended;
+    if (!order_appender_open(&app, TRANSACTIONS_FILE, TRANSACTIONS_WAL_FILE, &config)) {
+        return 0;
+    }
+    for (n = 0; ok && n < appends; n++) {
+        make_order(&order, (long)records + n);
+        ok = order_appender_append(&app, &order);
+    }
+    ok = order_appender_close(&app) && ok;
+
+    /* Spread out, so each is a change of its own */
+    indices = (size_t *)malloc((size_t)(confirms > 0 ? confirms : 1) * sizeof(size_t));
+    if (indices == NULL) {
+        return 0;
+    }
+    for (n = 0; n < confirms; n++) {
+        indices[n] = (size_t)n * records / (size_t)confirms;
+    }
+    ok = ok && (confirms == 0 || confirm_transactions(indices, (size_t)confirms, &confirmed, NULL));
+    free(indices);
+    return ok;
+}
+
+/* One line per sync: what it sent, and how long it took */
+static void sync_report(const char *name, long long usec, const OrderSyncResult *result) {
+    report(name, usec < 0 ? 0 : (long)result->records, (double)usec);
+    if (usec >= 0) {
+        printf("%-24s %lu changes, %lu appended, %lu confirmed\n", "",
+               (unsigned long)(result->to - result->from), (unsigned long)result->appended,
+               (unsigned long)result->confirmed);
+    }
+}
+
+static int bench_sync(long records, long changes) {
+    OrderSyncResult result;
+    size_t seeds;
+    long long usec;
+    int failed = 0;
+
+    mkdir(SYNC_DIR, 0755);  /* May be left over from a failed run */
+    if (chdir(SYNC_DIR) != 0) {
+        printf("Error: Could not set up the benchmark\n");
+        return 1;
+    }
+    mkdir(SYNC_PRIMARY_DIR, 0755);
+    mkdir(SYNC_REPLICA_DIR, 0755);
+    if (chdir(SYNC_REPLICA_DIR) != 0) {
+        printf("Error: Could not set up the benchmark\n");
+        return 1;
+    }
+    remove_stress_files();
+    if (chdir("../" SYNC_PRIMARY_DIR) != 0 || !confirm_store(records, &seeds)) {
+        printf("Error: Could not create the store\n");
+        failed = 1;
+    }
+
+    printf("%-24s %10s %12s %14s\n", "Benchmark", "Records", "Time (ms)", "Records/sec");
+    if (!failed) {
+        usec = sync_replica(&result);
+        sync_report("sync from scratch", usec, &result);
+        failed = usec < 0 || !sync_matches();
+    }
+    if (!failed) {
+        usec = sync_replica(&result);
+        sync_report("sync, nothing new", usec, &result);
+        failed = usec < 0 || result.records != 0;
+    }
+    if (!failed) {
+        failed = !sync_change(seeds + (size_t)records, changes - changes / 2, changes / 2);
+    }
+    if (!failed) {
+        usec = sync_replica(&result);
+        sync_report("sync the changes", usec, &result);
+        failed = usec < 0 || !sync_matches();
+    }
+    printf("%s\n", failed ? "FAILED" : "OK");
+
+    remove_stress_files();
+    if (chdir("../" SYNC_REPLICA_DIR) == 0) {
+        remove_stress_files();
+    }
+    if (chdir("..") == 0) {
+        rmdir(SYNC_PRIMARY_DIR);
+        rmdir(SYNC_REPLICA_DIR);
+    }
+    if (chdir("..") == 0) {
+        rmdir(SYNC_DIR);
+    }
+    return failed;
+}
+
+/* Many broker and market processes on one store at once */
+static int bench_stress(long orders, int brokers, int markets) {
+    OrderStore store;
+    size_t seeds, merged, bad;
+    long flipped = 0;
+    long long start;
+    int pipe_fds[2];
+    int i, status, failed = 0;
+    FILE *done;
+
+    mkdir(STRESS_DIR, 0755);  /* May be left over from a failed run */
+    if (chdir(STRESS_DIR) != 0) {
+        printf("Error: Could not create %s\n", STRESS_DIR);
+        return 1;
+    }
+    remove_stress_files();
+    order_segment_set_default_records(STRESS_SEGMENT_RECORDS);
+
+    /* The seed data set is already confirmed */
+    if (!open_transactions(&store) || pipe(pipe_fds) != 0) {
+        printf("Error: Could not create the store\n");
+        return 1;
+    }
+    seeds = store.count;
+    order_store_close(&store);
+
+    printf("%d brokers x %ld orders, %d markets\n", brokers, orders, markets);
+    start = order_clock_usec();
+    fflush(stdout);
+
+    for (i = 0; i < markets; i++) {
+        if (fork() == 0) {
+            long confirmed;
+            int ok = stress_market(&confirmed);
+            if (write(pipe_fds[1], &confirmed, sizeof(confirmed)) != (ssize_t)sizeof(confirmed)) {
+                ok = 0;
+            }
+            _exit(ok ? 0 : 1);
+        }
+    }
+    for (i = 0; i < brokers; i++) {
+        if (fork() == 0) {
+            _exit(stress_broker(i, orders) ? 0 : 1);
+        }
+    }
+
+    for (i = 0; i < brokers; i++) {
+        wait(&status);
+        failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+    /* Only markets are left; tell them to drain what remains and stop */
+    done = fopen(STRESS_DONE_FILE, "wb");
+    if (done != NULL) {
+        fclose(done);
+    }
+    for (i = 0; i < markets; i++) {
+        long confirmed;
+
+        wait(&status);
+        failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+        if (read(pipe_fds[0], &confirmed, sizeof(confirmed)) == (ssize_t)sizeof(confirmed)) {
+            flipped += confirmed;
+        }
+    }
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    report("stress", (long)brokers * orders, (double)(order_clock_usec() - start));
+
+    if (failed > 0) {
+        printf("%d processes failed\n", failed);
+    }
+    if (!stress_verify(brokers, orders, seeds, flipped) || failed > 0) {
+        printf("FAILED\n");
+        return 1;
+    }
+
+    /* Everything is confirmed now: compact what's left and check again */
+    if (!order_segments_compact(TRANSACTIONS_FILE, &merged) ||
+        !order_segments_verify(TRANSACTIONS_FILE, &bad)) {
+        printf("FAILED to compact\n");
+        return 1;
+    }
+    printf("compacted %lu more segments, %lu bad checksums\n", (unsigned long)merged,
+           (unsigned long)bad);
+    if (bad > 0 || !stress_verify(brokers, orders, seeds, flipped)) {
+        printf("FAILED\n");
+        return 1;
+    }
+    printf("OK\n");
+
+    remove_stress_files();
+    if (chdir("..") == 0) {
+        rmdir(STRESS_DIR);
+    }
+    return 0;
+}
+
+int run_benchmarks(int argc, char *argv[]) {
+    long orders = BENCH_DEFAULT_ORDERS;
+
+    if (argc >= 2) {
+        orders = atol(argv[1]);
+    }
+    if (orders <= 0) {
+        printf("Error: Order count must be positive\n");
+        return 1;
+    }
+
+    if (argc < 1 || strcmp(argv[0], "append") == 0) {
+        return bench_append(orders);
+    }
+    if (strcmp(argv[0], "parse") == 0) {
+        return bench_parse(orders);
+    }
+    if (strcmp(argv[0], "match") == 0) {
+        return bench_match(orders);
+    }
+    if (strcmp(argv[0], "page") == 0) {
+        return bench_page(orders, argc >= 2);
+    }
+    if (strcmp(argv[0], "render") == 0) {
+        return bench_render(orders);
+    }
+    if (strcmp(argv[0], "suite") == 0 || strcmp(argv[0], "generate") == 0 ||
+        strcmp(argv[0], "archive") == 0) {
+        OrderGeneratorConfig config;
+
+        if (!generator_args(argc, argv, &config)) {
+            return 1;
+        }
+        if (strcmp(argv[0], "generate") == 0) {
+            return bench_generate(orders, &config);
+        }
+        if (strcmp(argv[0], "archive") == 0) {
+            return bench_archive(argc >= 2 ? orders : ARCHIVE_DEFAULT_RECORDS, &config);
+        }
+        return bench_suite(argc >= 2 ? orders : SUITE_DEFAULT_RECORDS, &config);
+    }
+    if (strcmp(argv[0], "confirm") == 0) {
+        return bench_confirm(argc >= 2 ? orders : CONFIRM_DEFAULT_RECORDS);
+    }
+    if (strcmp(argv[0], "io") == 0) {
+        long batch = argc >= 3 ? atol(argv[2]) : IO_DEFAULT_BATCH;
+
+        if (batch <= 0) {
+            printf("Error: Batch size must be positive\n");
+            return 1;
+        }
+        return bench_io(argc >= 2 ? orders : IO_DEFAULT_ORDERS, (size_t)batch);
+    }
+    if (strcmp(argv[0], "daemon") == 0) {
+        int clients = argc >= 3 ? atoi(argv[2]) : DAEMON_DEFAULT_CLIENTS;
+        int depth = argc >= 4 ? atoi(argv[3]) : DAEMON_DEFAULT_DEPTH;
+
+        if (clients <= 0 || depth <= 0) {
+            printf("Error: Client count and depth must be positive\n");
+            return 1;
+        }
+        return bench_daemon(argc >= 2 ? orders : DAEMON_DEFAULT_REQUESTS, clients, depth);
+    }
+    if (strcmp(argv[0], "sync") == 0) {
+        long changes = argc >= 3 ? atol(argv[2]) : SYNC_DEFAULT_CHANGES;
+
+        if (changes <= 0) {
+            printf("Error: Change count must be positive\n");
+            return 1;
+        }
+        return bench_sync(argc >= 2 ? orders : SYNC_DEFAULT_RECORDS, changes);
+    }
+    if (strcmp(argv[0], "stress") == 0) {
+        int brokers = argc >= 3 ? atoi(argv[2]) : STRESS_DEFAULT_BROKERS;
+        int markets = argc >= 4 ? atoi(argv[3]) : STRESS_DEFAULT_MARKETS;
+
+        if (brokers <= 0 || markets <= 0) {
+            printf("Error: Process counts must be positive\n");
+            return 1;
+        }
+        return bench_stress(argc >= 2 ? orders : STRESS_DEFAULT_ORDERS, brokers, markets);
+    }
+
+    printf("Unknown benchmark '%s'\n", argv[0]);
+    printf("Benchmarks: append [orders], parse [orders], match [orders], page [records], render [pages], confirm [records], suite [records [seed [pending%%]]], generate [orders [seed [pending%%]]], archive [records [seed]], daemon [requests [clients [depth]]], io [orders [batch]], sync [records [changes]], stress [orders [brokers [markets]]]\n");
+    return 1;
+}
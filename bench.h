@@ -0,0 +1,7 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Entry point for "bench" mode; argv excludes the program name and mode
+int run_benchmarks(int argc, char *argv[]);
+
+#endif // BENCH_H
@@ -1,7 +1,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "stock_order.h"
+#include <signal.h>
+#include "bench.h"
+#include "order_archive.h"
+#include "order_client.h"
+#include "order_daemon.h"
+#include "order_filter.h"
+#include "order_ingest.h"
+#include "order_io.h"
+#include "order_listing.h"
+#include "order_match.h"
+#include "order_parse.h"
+#include "order_positions.h"
+#include "order_render.h"
+#include "order_segment.h"
+#include "order_stats.h"
+#include "order_store.h"
+#include "order_submit.h"
+#include "order_sync.h"
 
 // Program mode enum
 typedef enum {
@@ -13,6 +30,16 @@ typedef enum {
 // Global mode variable
 static ProgramMode program_mode = MODE_INVALID;
 
+// Screen being drawn by the transaction tables; kept off the (small) Amiga stack
+static OrderRender screen;
+
+// Set by --connect: the store is the daemon's, reached over its socket
+static OrderClient daemon_client;
+static OrderClient *remote = NULL;
+
+// Set by SIGINT/SIGTERM to stop the daemon
+static volatile sig_atomic_t stop_daemon = 0;
+
 // Function prototypes
 void show_main_menu(void);
 void new_transaction(void);
@@ -24,21 +51,77 @@ int check_exit(const char *input);
 int str_case_cmp(const char *s1, const char *s2);
 void str_to_upper(char *str);
 int compare_orders_desc(const void *a, const void *b);
-int save_transaction(const StockOrder *order);
-int load_transactions(StockOrder *orders, int max_orders);
-int save_all_transactions(StockOrder *orders, int count);
-void initialize_data_file(void);
-void show_loading_animation(void);
+void show_progress(size_t done, size_t total);
+int run_ingest(const char *path);
+int run_positions(int argc, char *argv[]);
+void positions_report(void);
+void print_totals(const char *label, const OrderPositionTotals *totals);
+void print_totals_header(const char *label);
+int load_positions(OrderStore *store, OrderSymbols *symbols, OrderPositions *positions);
+void close_positions(OrderStore *store, OrderSymbols *symbols, OrderPositions *positions);
+int print_account_positions(const OrderPositions *positions, const OrderSymbols *symbols,
+                            uint32_t account, const char *ticker);
+void print_broker_positions(const OrderPositions *positions, const OrderSymbols *symbols,
+                            const char *broker);
+int run_stats(int argc, char *argv[]);
+void stats_report(void);
+int run_compact(void);
+int run_archive(void);
+int run_query(int argc, char *argv[]);
+int prompt_filter(OrderListing *listing, char *text, size_t size);
+int open_listing(OrderListing *listing, int confirmed);
+int save_order(const StockOrder *order);
+int run_serve(const char *path);
+int run_sync(const char *replica_dir);
+void print_usage(const char *program);
 
 int main(int argc, char *argv[]) {
     int choice;
     int running = 1;
 
+    /* Every mode can keep a stats file up to date, if asked to */
+    order_stats_from_env();
+
     /* Check command line arguments */
+    if (argc >= 2 && str_case_cmp(argv[1], "stats") == 0) {
+        return run_stats(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && str_case_cmp(argv[1], "bench") == 0) {
+        return run_benchmarks(argc - 2, argv + 2);
+    }
+    if (argc == 4 && str_case_cmp(argv[1], "broker") == 0 && strcmp(argv[2], "--ingest") == 0) {
+        return run_ingest(argv[3]);
+    }
+    if (argc >= 2 && str_case_cmp(argv[1], "positions") == 0) {
+        return run_positions(argc - 2, argv + 2);
+    }
+    if (argc == 2 && str_case_cmp(argv[1], "compact") == 0) {
+        return run_compact();
+    }
+    if (argc == 2 && str_case_cmp(argv[1], "archive") == 0) {
+        return run_archive();
+    }
+    if (argc >= 2 && str_case_cmp(argv[1], "query") == 0) {
+        return run_query(argc - 2, argv + 2);
+    }
+    if (argc == 3 && str_case_cmp(argv[1], "sync") == 0) {
+        return run_sync(argv[2]);
+    }
+    if (argc >= 2 && str_case_cmp(argv[1], "serve") == 0) {
+        return run_serve(argc >= 3 ? argv[2] : TRANSACTIONS_SOCKET_FILE);
+    }
+    if ((argc == 3 || argc == 4) && strcmp(argv[2], "--connect") == 0) {
+        const char *path = argc == 4 ? argv[3] : TRANSACTIONS_SOCKET_FILE;
+
+        if (!order_client_open(&daemon_client, path)) {
+            fprintf(stderr, "Error: No daemon is listening on %s\n", path);
+            return 1;
+        }
+        remote = &daemon_client;
+        argc = 2;
+    }
     if (argc != 2) {
-        printf("Usage: %s [broker|market]\n", argv[0]);
-        printf("  broker - Broker mode (create transactions)\n");
-        printf("  market - Market mode (confirm transactions)\n");
+        print_usage(argv[0]);
         return 1;
     }
 
@@ -49,7 +132,7 @@ int main(int argc, char *argv[]) {
         program_mode = MODE_MARKET;
     } else {
         printf("Error: Invalid mode '%s'\n", argv[1]);
-        printf("Usage: %s [broker|market]\n", argv[0]);
+        print_usage(argv[0]);
         return 1;
     }
 
@@ -93,6 +176,14 @@ int main(int argc, char *argv[]) {
                     clear_screen();
                     pending_transactions();
                     break;
+                case 4:
+                    clear_screen();
+                    positions_report();
+                    break;
+                case 5:
+                    clear_screen();
+                    stats_report();
+                    break;
                 default:
                     clear_screen();
                     printf("\nInvalid option. Please select a valid menu option.\n");
@@ -110,6 +201,14 @@ int main(int argc, char *argv[]) {
                     clear_screen();
                     pending_transactions();
                     break;
+                case 3:
+                    clear_screen();
+                    positions_report();
+                    break;
+                case 4:
+                    clear_screen();
+                    stats_report();
+                    break;
                 default:
                     clear_screen();
                     printf("\nInvalid option. Please select a valid menu option.\n");
@@ -123,6 +222,27 @@ int main(int argc, char *argv[]) {
     return 0;
 }
 
+void print_usage(const char *program) {
+    printf("Usage: %s [broker|market|positions|stats|compact|archive|query|serve|sync|bench]\n", program);
+    printf("  broker    - Broker mode (create transactions)\n");
+    printf("              broker --ingest <file|-> appends CSV orders in bulk\n");
+    printf("  market    - Market mode (confirm transactions)\n");
+    printf("              broker|market --connect [socket] works through a daemon\n");
+    printf("  serve     - serve [socket] owns the store and serves it (default %s)\n",
+           TRANSACTIONS_SOCKET_FILE);
+    printf("  sync      - sync <dir> brings the replica store in <dir> up to date\n");
+    printf("  positions - positions <account> [ticker] or positions --broker <id>\n");
+    printf("  stats     - stats [file] shows the latency file kept via %s\n",
+           ORDER_STATS_FILE_ENV);
+    printf("  compact   - Merge confirmed history into read-only segments\n");
+    printf("  archive   - Copy compacted history into %s, column by column\n",
+           TRANSACTIONS_ARCHIVE_FILE);
+    printf("  query     - query <term>... lists matching orders, e.g. query ticker=GE\n");
+    printf("              account=345678 days=7 (also broker=, from=/to=YYYY-MM-DD)\n");
+    printf("  bench     - Run storage benchmarks\n");
+    printf("Set %s=posix to use pread/pwrite instead of io_uring\n", ORDER_IO_ENV);
+}
+
 void show_main_menu(void) {
     clear_screen();
     printf("=====================================\n");
@@ -138,10 +258,14 @@ void show_main_menu(void) {
         printf("1. New transaction\n");
         printf("2. Confirmed transactions\n");
         printf("3. Pending transactions\n");
+        printf("4. Positions\n");
+        printf("5. Statistics\n");
     } else {
         /* Market mode: can confirm pending and view lists */
         printf("1. Confirmed transactions\n");
         printf("2. Pending transactions (submit)\n");
+        printf("3. Positions\n");
+        printf("4. Statistics\n");
     }
 
     printf("0. Exit\n\n");
@@ -156,14 +280,13 @@ void new_transaction(void) {
     time_t current_time;
     struct tm *local_time;
     int valid_input;
-    long account_num;
 
     /* Initialize the entire order structure */
     memset(&order, 0, sizeof(StockOrder));
 
     /* Get current Unix timestamp */
     time(&current_time);
-    order.timestamp = current_time;
+    order.timestamp = (int64_t)current_time;
 
     /* Display current date/time */
     local_time = localtime(&current_time);
@@ -189,12 +312,9 @@ void new_transaction(void) {
         input[strcspn(input, "\n")] = 0;
         if (check_exit(input)) return;
 
-        account_num = atol(input);
-        if (account_num < 100000 || account_num > 999999) {
+        if (!order_parse_account(input, strlen(input), &order.customer_account_no)) {
             printf("Error: Account number must be 6 digits\n");
             valid_input = 0;
-        } else {
-            order.customer_account_no = (uint32_t)account_num;
         }
     } while (!valid_input);
 
@@ -206,12 +326,9 @@ void new_transaction(void) {
         input[strcspn(input, "\n")] = 0;
         if (check_exit(input)) return;
 
-        if (strlen(input) < 3 || strlen(input) > 15) {
+        if (!order_parse_broker(input, strlen(input), order.broker_id)) {
             printf("Error: Broker ID must be between 3 and 15 characters\n");
             valid_input = 0;
-        } else {
-            memset(order.broker_id, 0, sizeof(order.broker_id));
-            strncpy(order.broker_id, input, sizeof(order.broker_id) - 1);
         }
     } while (!valid_input);
 
@@ -222,13 +339,8 @@ void new_transaction(void) {
         if (fgets(action_input, sizeof(action_input), stdin) == NULL) return;
         action_input[strcspn(action_input, "\n")] = 0;
         if (check_exit(action_input)) return;
-        str_to_upper(action_input);
 
-        if (strcmp(action_input, "BUY") == 0) {
-            order.action = ORDER_ACTION_BUY;
-        } else if (strcmp(action_input, "SELL") == 0) {
-            order.action = ORDER_ACTION_SELL;
-        } else {
+        if (!order_parse_action(action_input, strlen(action_input), &order.action)) {
             printf("Error: Must be BUY or SELL\n");
             valid_input = 0;
         }
@@ -242,8 +354,7 @@ void new_transaction(void) {
         input[strcspn(input, "\n")] = 0;
         if (check_exit(input)) return;
 
-        order.quantity = (uint32_t)atoi(input);
-        if (order.quantity < 1 || order.quantity > 9999) {
+        if (!order_parse_quantity(input, strlen(input), &order.quantity)) {
             printf("Error: Quantity must be between 1 and 9999\n");
             valid_input = 0;
         }
@@ -257,35 +368,9 @@ void new_transaction(void) {
         input[strcspn(input, "\n")] = 0;
         if (check_exit(input)) return;
 
-        {
-            int whole_part = 0;
-            int decimal_part = 0;
-            int i = 0;
-            int divisor = 1;
-
-            /* Parse whole part */
-            while (input[i] != '\0' && input[i] >= '0' && input[i] <= '9') {
-                whole_part = whole_part * 10 + (input[i] - '0');
-                i++;
-            }
-
-            /* Parse decimal part */
-            if (input[i] == '.') {
-                i++;
-                while (input[i] != '\0' && input[i] >= '0' && input[i] <= '9') {
-                    decimal_part = decimal_part * 10 + (input[i] - '0');
-                    divisor *= 10;
-                    i++;
-                    if (divisor > 100) break;  /* Limit to 2 decimal places */
-                }
-            }
-
-            order.price = (double)whole_part + (double)decimal_part / (double)divisor;
-
-            if (order.price < 0.01 || order.price > 9999.99) {
-                printf("Error: Price must be between $0.01 and $9999.99\n");
-                valid_input = 0;
-            }
+        if (!order_parse_price(input, strlen(input), &order.price_cents)) {
+            printf("Error: Price must be between $0.01 and $9999.99\n");
+            valid_input = 0;
         }
     } while (!valid_input);
 
@@ -297,26 +382,10 @@ void new_transaction(void) {
         input[strcspn(input, "\n")] = 0;
         if (check_exit(input)) return;
 
-        /* Convert ticker to uppercase */
-        str_to_upper(input);
-
-        if (strlen(input) < 1 || strlen(input) > 7) {
-            printf("Error: Ticker must be between 1 and 7 characters\n");
+        /* Stored upper-case */
+        if (!order_parse_ticker(input, strlen(input), order.ticker)) {
+            printf("Error: Ticker must be 1-7 letters\n");
             valid_input = 0;
-        } else {
-            /* Check if ticker contains only letters */
-            int i;
-            for (i = 0; input[i]; i++) {
-                if (input[i] < 'A' || input[i] > 'Z') {
-                    printf("Error: Ticker must contain only letters\n");
-                    valid_input = 0;
-                    break;
-                }
-            }
-            if (valid_input) {
-                memset(order.ticker, 0, sizeof(order.ticker));
-                strncpy(order.ticker, input, sizeof(order.ticker) - 1);
-            }
         }
     } while (!valid_input);
 
@@ -327,13 +396,8 @@ void new_transaction(void) {
         if (fgets(type_input, sizeof(type_input), stdin) == NULL) return;
         type_input[strcspn(type_input, "\n")] = 0;
         if (check_exit(type_input)) return;
-        str_to_upper(type_input);
 
-        if (strcmp(type_input, "LIMIT") == 0) {
-            order.order_type = ORDER_TYPE_LIMIT;
-        } else if (strcmp(type_input, "MARKET") == 0) {
-            order.order_type = ORDER_TYPE_MARKET;
-        } else {
+        if (!order_parse_type(type_input, strlen(type_input), &order.order_type)) {
             printf("Error: Must be MARKET or LIMIT\n");
             valid_input = 0;
         }
@@ -343,7 +407,7 @@ void new_transaction(void) {
     order.confirmed = 0;
 
     /* Save transaction to file */
-    if (save_transaction(&order)) {
+    if (save_order(&order)) {
         printf("\nTransaction saved successfully (pending confirmation)!\n\n");
     } else {
         printf("\nError: Could not save transaction to file.\n\n");
@@ -351,6 +415,444 @@ void new_transaction(void) {
     wait_for_enter();
 }
 
+/* Non-interactive bulk entry: one order per CSV line, see order_parse.h */
+int run_ingest(const char *path) {
+    OrderIngestStats stats;
+    FILE *in = stdin;
+    int ok;
+
+    if (strcmp(path, "-") != 0) {
+        in = fopen(path, "rb");
+        if (in == NULL) {
+            fprintf(stderr, "Error: Could not open '%s'\n", path);
+            return 1;
+        }
+    }
+
+    ok = order_ingest(in, stderr, &stats);
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    printf("Ingested %lu of %lu orders (%lu rejected)\n",
+           (unsigned long)stats.accepted, (unsigned long)stats.lines,
+           (unsigned long)stats.rejected);
+    if (!ok) {
+        fprintf(stderr, "Error: Could not save transactions to file.\n");
+        return 1;
+    }
+    return stats.rejected > 0 ? 2 : 0;
+}
+
+/* Aggregates are kept up to date by the matcher; reading them is a lookup */
+int load_positions(OrderStore *store, OrderSymbols *symbols, OrderPositions *positions) {
+    if (!open_transactions(store)) {
+        return 0;
+    }
+    if (!order_symbols_open(symbols, store)) {
+        order_store_close(store);
+        return 0;
+    }
+    if (!order_positions_open(positions, symbols, store)) {
+        order_symbols_free(symbols);
+        order_store_close(store);
+        return 0;
+    }
+    return 1;
+}
+
+void close_positions(OrderStore *store, OrderSymbols *symbols, OrderPositions *positions) {
+    order_positions_free(positions);
+    order_symbols_free(symbols);
+    order_store_close(store);
+}
+
+/* One table row: net quantity, shares traded, their value and VWAP */
+void print_totals(const char *label, const OrderPositionTotals *totals) {
+    unsigned long long shares = (unsigned long long)(totals->bought + totals->sold);
+    unsigned long long notional = (unsigned long long)(totals->buy_notional + totals->sell_notional);
+    unsigned long long vwap = shares ? (notional + shares / 2) / shares : 0;
+    char notional_str[24];
+    char vwap_str[24];
+
+    sprintf(notional_str, "%llu.%02llu", notional / 100, notional % 100);
+    sprintf(vwap_str, "%llu.%02llu", vwap / 100, vwap % 100);
+    printf("%-16.16s %+10lld %10llu %10llu $%-15s $%s\n",
+           label,
+           (long long)totals->bought - (long long)totals->sold,
+           (unsigned long long)totals->bought,
+           (unsigned long long)totals->sold,
+           notional_str,
+           vwap_str);
+}
+
+void print_totals_header(const char *label) {
+    printf("%-16s %10s %10s %10s %-16s %s\n",
+           label, "Net Qty", "Bought", "Sold", "Notional", "VWAP");
+    printf("-------------------------------------------------------------------------------\n");
+}
+
+/* Every ticker the account has traded, or just `ticker`; 0 if there are none */
+int print_account_positions(const OrderPositions *positions, const OrderSymbols *symbols,
+                            uint32_t account, const char *ticker) {
+    size_t i, shown = 0;
+
+    print_totals_header("Ticker");
+    for (i = 0; i < positions->account_count; i++) {
+        const OrderAccountPosition *entry = &positions->accounts[i];
+        const char *name = order_symbol_name(&symbols->tickers, entry->ticker);
+
+        if (entry->account == account && (ticker == NULL || strcmp(name, ticker) == 0)) {
+            print_totals(name, &entry->totals);
+            shown++;
+        }
+    }
+    if (shown == 0) {
+        printf("No fills for account %lu.\n", (unsigned long)account);
+    }
+    return shown > 0;
+}
+
+/* Totals of one broker, or of every broker that has traded */
+void print_broker_positions(const OrderPositions *positions, const OrderSymbols *symbols,
+                            const char *broker) {
+    uint32_t id;
+
+    print_totals_header("Broker");
+    if (broker != NULL) {
+        if (order_symbol_find(&symbols->brokers, broker, &id) &&
+            order_position_broker(positions, id) != NULL) {
+            print_totals(broker, order_position_broker(positions, id));
+        } else {
+            printf("No fills for broker %s.\n", broker);
+        }
+        return;
+    }
+    for (id = 0; id < positions->broker_count && id < symbols->brokers.count; id++) {
+        const OrderPositionTotals *totals = &positions->brokers[id];
+
+        if (totals->bought + totals->sold > 0) {
+            print_totals(order_symbol_name(&symbols->brokers, id), totals);
+        }
+    }
+}
+
+/* positions <account> [ticker] | positions --broker <id> */
+int run_positions(int argc, char *argv[]) {
+    OrderStore store;
+    OrderSymbols symbols;
+    OrderPositions positions;
+    char broker[16];
+    char ticker[8];
+    uint32_t account = 0;
+    int by_broker = argc == 2 && strcmp(argv[0], "--broker") == 0;
+    int found = 1;
+
+    if (by_broker) {
+        if (!order_parse_broker(argv[1], strlen(argv[1]), broker)) {
+            fprintf(stderr, "Error: Broker ID must be between 3 and 15 characters\n");
+            return 1;
+        }
+    } else if (argc < 1 || argc > 2) {
+        fprintf(stderr, "Usage: positions <account> [ticker] | positions --broker <id>\n");
+        return 1;
+    } else if (!order_parse_account(argv[0], strlen(argv[0]), &account)) {
+        fprintf(stderr, "Error: Account number must be 6 digits\n");
+        return 1;
+    } else if (argc == 2 && !order_parse_ticker(argv[1], strlen(argv[1]), ticker)) {
+        fprintf(stderr, "Error: Ticker must be 1-7 letters\n");
+        return 1;
+    }
+
+    if (!load_positions(&store, &symbols, &positions)) {
+        fprintf(stderr, "Error: Could not read positions.\n");
+        return 1;
+    }
+    if (by_broker) {
+        print_broker_positions(&positions, &symbols, broker);
+    } else {
+        found = print_account_positions(&positions, &symbols, account, argc == 2 ? ticker : NULL);
+    }
+    close_positions(&store, &symbols, &positions);
+    return found ? 0 : 2;
+}
+
+void positions_report(void) {
+    OrderStore store;
+    OrderSymbols symbols;
+    OrderPositions positions;
+    char input[256];
+    uint32_t account;
+
+    if (!load_positions(&store, &symbols, &positions)) {
+        printf("Error: Could not read positions.\n");
+        wait_for_enter();
+        return;
+    }
+
+    printf("===============================================================================\n");
+    printf("                          POSITIONS BY BROKER\n");
+    printf("===============================================================================\n\n");
+    print_broker_positions(&positions, &symbols, NULL);
+
+    for (;;) {
+        printf("\nCustomer Account No. for its positions (Enter to return): ");
+        if (fgets(input, sizeof(input), stdin) == NULL) break;
+        input[strcspn(input, "\n")] = 0;
+        if (input[0] == 0 || check_exit(input)) break;
+
+        if (!order_parse_account(input, strlen(input), &account)) {
+            printf("Error: Account number must be 6 digits\n");
+            continue;
+        }
+        printf("\n");
+        print_account_positions(&positions, &symbols, account, NULL);
+    }
+    close_positions(&store, &symbols, &positions);
+}
+
+/* Print a stats file some process keeps up to date; it is plain text already */
+int run_stats(int argc, char *argv[]) {
+    const char *path = argc >= 1 ? argv[0] : getenv(ORDER_STATS_FILE_ENV);
+    char buffer[4096];
+    size_t got;
+    FILE *fp;
+
+    if (argc > 1 || path == NULL || path[0] == 0) {
+        fprintf(stderr, "Usage: stats <file>, or set %s\n", ORDER_STATS_FILE_ENV);
+        return 1;
+    }
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Error: Could not read %s\n", path);
+        return 1;
+    }
+    while ((got = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        fwrite(buffer, 1, got, stdout);
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* Compact confirmed history now, rather than after the next submit */
+int run_compact(void) {
+    OrderStore store;
+    size_t merged, bad;
+
+    /* Bring a store from an older version up to date first */
+    if (!open_transactions(&store)) {
+        fprintf(stderr, "Error: Could not read transactions file.\n");
+        return 1;
+    }
+    order_store_close(&store);
+
+    if (!order_segments_compact(TRANSACTIONS_FILE, &merged) ||
+        !order_segments_verify(TRANSACTIONS_FILE, &bad)) {
+        fprintf(stderr, "Error: Could not compact %s\n", TRANSACTIONS_FILE);
+        return 1;
+    }
+    printf("Compacted %lu segments\n", (unsigned long)merged);
+    if (bad > 0) {
+        fprintf(stderr, "Error: %lu compacted segments fail their checksum\n", (unsigned long)bad);
+        return 1;
+    }
+    return 0;
+}
+
+/* Bring the columnar archive up to date with compacted history */
+int run_archive(void) {
+    OrderStore store;
+    size_t added, records;
+    uint64_t bytes;
+
+    if (!open_transactions(&store)) {
+        fprintf(stderr, "Error: Could not read transactions file.\n");
+        return 1;
+    }
+    order_store_close(&store);
+
+    if (!order_archive_update(TRANSACTIONS_ARCHIVE_FILE, TRANSACTIONS_FILE, &added) ||
+        !order_archive_stat(TRANSACTIONS_ARCHIVE_FILE, &records, &bytes)) {
+        fprintf(stderr, "Error: Could not update %s\n", TRANSACTIONS_ARCHIVE_FILE);
+        return 1;
+    }
+    printf("Archived %lu more orders; %s holds %lu in %lu bytes", (unsigned long)added,
+           TRANSACTIONS_ARCHIVE_FILE, (unsigned long)records, (unsigned long)bytes);
+    if (records > 0) {
+        printf(" (%.1fx smaller)", (double)records * sizeof(StockOrder) / (double)bytes);
+    }
+    printf("\n");
+    return 0;
+}
+
+/* Copy what changed since the last sync into a replica store */
+int run_sync(const char *replica_dir) {
+    OrderSyncResult result;
+
+    if (!order_sync(replica_dir, &result)) {
+        fprintf(stderr, "Error: Could not sync the replica in %s\n", replica_dir);
+        return 1;
+    }
+    if (result.from == 0) {
+        printf("Copied %s from scratch: ", replica_dir);
+    } else {
+        printf("Synced %s from change %lu: ", replica_dir, (unsigned long)result.from);
+    }
+    printf("%lu changes, %lu records sent, %lu appended, %lu confirmed; now at change %lu\n",
+           (unsigned long)(result.to - result.from), (unsigned long)result.records,
+           (unsigned long)result.appended, (unsigned long)result.confirmed,
+           (unsigned long)result.to);
+    return 0;
+}
+
+/* Matching orders, newest first, read through the block summaries */
+int run_query(int argc, char *argv[]) {
+    #define QUERY_ROWS 64   /* Rows per write; a screen's worth fits the render buffer */
+    OrderStore store;
+    OrderBlocks blocks;
+    OrderFilter filter;
+    OrderView view;
+    char terms[256];
+    size_t scanned, i, length = 0;
+    int n;
+
+    /* Terms may come as separate arguments or as one */
+    terms[0] = '\0';
+    for (n = 0; n < argc; n++) {
+        size_t term = strlen(argv[n]);
+
+        if (length + term + 2 > sizeof(terms)) {
+            fprintf(stderr, "Error: Query too long\n");
+            return 1;
+        }
+        memcpy(terms + length, argv[n], term);
+        length += term;
+        terms[length++] = ' ';
+        terms[length] = '\0';
+    }
+    if (argc == 0 || !order_filter_parse(&filter, terms, (int64_t)time(NULL))) {
+        fprintf(stderr, "Error: Terms are ticker=, account=, broker=, from=YYYY-MM-DD, to=YYYY-MM-DD and days=N\n");
+        return 1;
+    }
+
+    if (!open_transactions(&store)) {
+        fprintf(stderr, "Error: Could not read transactions file.\n");
+        return 1;
+    }
+    order_view_init(&view, NULL);
+    if (!order_blocks_open(&blocks, &store)) {
+        fprintf(stderr, "Error: Could not read %s\n", TRANSACTIONS_BLOCKS_FILE);
+        order_store_close(&store);
+        return 1;
+    }
+    if (!order_filter_scan(&filter, &blocks, &store, &view, &scanned)) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        order_view_free(&view);
+        order_blocks_close(&blocks);
+        order_store_close(&store);
+        return 1;
+    }
+    order_view_sort(&view, order_listing_compare);
+
+    order_render_init(&screen);
+    for (i = 0; i < view.count || i == 0; i += QUERY_ROWS) {
+        size_t rows = view.count - i < QUERY_ROWS ? view.count - i : QUERY_ROWS;
+
+        if (i == 0) {
+            order_render_orders(&screen, view.items, rows);
+        } else {
+            order_render_rows(&screen, view.items + i, rows);
+        }
+        order_render_flush(&screen, stdout);
+    }
+    printf("%lu orders match; read %lu of %lu blocks\n", (unsigned long)view.count,
+           (unsigned long)scanned,
+           (unsigned long)((store.count + ORDER_FILTER_BLOCK - 1) / ORDER_FILTER_BLOCK));
+
+    order_view_free(&view);
+    order_blocks_close(&blocks);
+    order_store_close(&store);
+    return 0;
+}
+
+/* From the daemon when connected to one, otherwise straight from the files */
+int open_listing(OrderListing *listing, int confirmed) {
+    if (remote != NULL) {
+        return order_listing_open_remote(listing, confirmed, remote);
+    }
+    return order_listing_open(listing, confirmed);
+}
+
+int save_order(const StockOrder *order) {
+    if (remote != NULL) {
+        return order_client_append(remote, order, 1, NULL);
+    }
+    return save_transaction(order);
+}
+
+static void handle_stop(int sig) {
+    (void)sig;
+    stop_daemon = 1;
+}
+
+/* Own the store until interrupted; broker and market --connect to it */
+int run_serve(const char *path) {
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+    printf("Serving %s on %s\n", TRANSACTIONS_FILE, path);
+    fflush(stdout);
+    if (!order_daemon_run(path, &stop_daemon)) {
+        fprintf(stderr, "Error: Could not serve on %s\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+/* Ask for a filter and list only what it matches; 0 if the listing could not be reloaded */
+int prompt_filter(OrderListing *listing, char *text, size_t size) {
+    OrderFilter filter;
+    char input[128];
+
+    printf("Filter (ticker= account= broker= from=YYYY-MM-DD to=YYYY-MM-DD days=N, blank for all): ");
+    fflush(stdout);
+    if (fgets(input, sizeof(input), stdin) == NULL) {
+        return 1;
+    }
+    input[strcspn(input, "\n")] = 0;
+    if (!order_filter_parse(&filter, input, (int64_t)time(NULL))) {
+        printf("Invalid filter. Press Enter to continue...");
+        getchar();
+        return 1;
+    }
+    if (!order_listing_filter(listing, &filter)) {
+        return 0;
+    }
+
+    /* Nothing to page through: go back to everything */
+    if (listing->total == 0 && !order_filter_is_empty(&filter)) {
+        printf("No orders match. Press Enter to continue...");
+        getchar();
+        order_filter_init(&filter);
+        input[0] = 0;
+        if (!order_listing_filter(listing, &filter)) {
+            return 0;
+        }
+    }
+    strncpy(text, input, size - 1);
+    text[size - 1] = 0;
+    return 1;
+}
+
+/* This session's own numbers */
+void stats_report(void) {
+    printf("===============================================================================\n");
+    printf("                          STATISTICS (THIS SESSION)\n");
+    printf("===============================================================================\n\n");
+    order_stats_print(stdout);
+    printf("\n");
+    wait_for_enter();
+}
+
 int check_exit(const char *input) {
     return str_case_cmp(input, "exit") == 0;
 }
@@ -389,43 +891,33 @@ int compare_orders_desc(const void *a, const void *b) {
 }
 
 void transaction_list(void) {
-    #define MAX_DISPLAY_ORDERS 50  /* Reduced from 100 to save memory */
     #define ORDERS_PER_PAGE 10
-    static StockOrder all_orders[MAX_DISPLAY_ORDERS];  /* Use static to avoid stack overflow */
-    static StockOrder orders[MAX_DISPLAY_ORDERS];  /* Filtered confirmed orders */
-    int total_count, count, i, j;
+    OrderListing listing;   /* Confirmed orders, newest first, fetched per page */
+    const StockOrder **orders;
+    int count;
     int current_page = 0;
     int total_pages;
     char navigation[10];
+    char filter_text[128] = "";
     int viewing = 1;
 
-    /* Load all transactions from file */
-    total_count = load_transactions(all_orders, MAX_DISPLAY_ORDERS);
-
-    /* Filter only confirmed transactions */
-    count = 0;
-    for (i = 0; i < total_count; i++) {
-        if (all_orders[i].confirmed == 1) {
-            orders[count] = all_orders[i];
-            count++;
-        }
+    /* Map all transactions; the timestamp index already orders them */
+    if (!open_listing(&listing, 1)) {
+        clear_screen();
+        printf("Error: Could not read transactions file.\n");
+        wait_for_enter();
+        return;
     }
+    count = (int)listing.total;
 
     if (count == 0) {
+        order_listing_close(&listing);
         clear_screen();
         printf("No transactions found.\n");
         wait_for_enter();
         return;
     }
 
-    /* Ensure count doesn't exceed array bounds */
-    if (count > MAX_DISPLAY_ORDERS) {
-        count = MAX_DISPLAY_ORDERS;
-    }
-
-    /* Sort orders by date/time descending */
-    qsort(orders, count, sizeof(StockOrder), compare_orders_desc);
-
     /* Calculate total pages */
     total_pages = (count + ORDERS_PER_PAGE - 1) / ORDERS_PER_PAGE;
 
@@ -436,51 +928,31 @@ void transaction_list(void) {
             end_index = count;
         }
 
-        clear_screen();
-
-        printf("===============================================================================\n");
-        printf("                  CONFIRMED TRANSACTIONS - Page %d of %d\n", current_page + 1, total_pages);
-        printf("===============================================================================\n\n");
-
-        /* Table header with fixed widths */
-        printf("%-8s %-16s %-10s %-6s %-5s %-9s %-7s %-6s\n",
-               "Acct#", "Timestamp", "Broker", "Action", "Qty", "Price", "Ticker", "Type");
-        printf("-------------------------------------------------------------------------------\n");
-
-        /* Display orders for current page */
-        for (i = start_index; i < end_index; i++) {
-            char timestamp_str[20];
-            struct tm *tm_info;
-
-            /* Convert Unix timestamp to tm structure */
-            tm_info = localtime(&orders[i].timestamp);
-            if (tm_info != NULL) {
-                sprintf(timestamp_str, "%02d/%02d/%02d %02d:%02d",
-                        tm_info->tm_mon + 1,
-                        tm_info->tm_mday,
-                        tm_info->tm_year % 100,
-                        tm_info->tm_hour,
-                        tm_info->tm_min);
-            } else {
-                /* Fallback if localtime fails */
-                sprintf(timestamp_str, "UNIX:%ld", (long)orders[i].timestamp);
-            }
-
-            printf("%-8lu %-16s %-10.10s %-6s %-5lu $%-8.2f %-7.7s %-6s\n",
-                (unsigned long)orders[i].customer_account_no,
-                timestamp_str,
-                orders[i].broker_id,
-                orders[i].action == ORDER_ACTION_BUY ? "BUY" : "SELL",
-                (unsigned long)orders[i].quantity,
-                orders[i].price,
-                orders[i].ticker,
-                orders[i].order_type == ORDER_TYPE_LIMIT ? "LIMIT" : "MARKET");
+        /* Fetch rows from the index only as far as this page */
+        if (!order_listing_fill(&listing, (size_t)end_index)) {
+            clear_screen();
+            printf("Error: Out of memory.\n");
+            wait_for_enter();
+            break;
+        }
+        orders = listing.view.items;
+        if (end_index > (int)listing.view.count) {
+            end_index = (int)listing.view.count;
         }
 
-        printf("\n-------------------------------------------------------------------------------\n");
-        printf("Total transactions: %d\n", count);
-        printf("Commands: [R]eload, [N]ext page, [P]revious page, [M]ain menu\n");
-        printf("Enter command: ");
+        /* The whole screen goes out in one write */
+        order_render_begin(&screen);
+        order_render_text(&screen, "===============================================================================\n");
+        order_render_format(&screen, "                  CONFIRMED TRANSACTIONS - Page %d of %d\n", current_page + 1, total_pages);
+        order_render_text(&screen, "===============================================================================\n\n");
+        if (filter_text[0] != 0) {
+            order_render_format(&screen, "Filter: %s\n\n", filter_text);
+        }
+        order_render_orders(&screen, orders + start_index, (size_t)(end_index - start_index));
+        order_render_text(&screen, "\n-------------------------------------------------------------------------------\n");
+        order_render_format(&screen, "Total transactions: %d\n", count);
+        order_render_text(&screen, "Commands: [F]ilter, [R]eload, [N]ext page, [P]revious page, [M]ain menu\nEnter command: ");
+        order_render_flush(&screen, stdout);
 
         if (fgets(navigation, sizeof(navigation), stdin) == NULL) {
             viewing = 0;
@@ -489,18 +961,29 @@ void transaction_list(void) {
         navigation[strcspn(navigation, "\n")] = 0;
         str_to_upper(navigation);
 
-        if (navigation[0] == 'R') {
+        if (navigation[0] == 'F') {
+            if (!prompt_filter(&listing, filter_text, sizeof(filter_text))) {
+                clear_screen();
+                printf("Error: Could not read transactions file.\n");
+                wait_for_enter();
+                return;
+            }
+            count = (int)listing.total;
+            if (count == 0) {
+                viewing = 0;
+                continue;
+            }
+            total_pages = (count + ORDERS_PER_PAGE - 1) / ORDERS_PER_PAGE;
+            current_page = 0;
+        } else if (navigation[0] == 'R') {
             /* Reload data from file */
-            total_count = load_transactions(all_orders, MAX_DISPLAY_ORDERS);
-
-            /* Filter only confirmed transactions */
-            count = 0;
-            for (i = 0; i < total_count; i++) {
-                if (all_orders[i].confirmed == 1) {
-                    orders[count] = all_orders[i];
-                    count++;
-                }
+            if (!order_listing_reload(&listing)) {
+                clear_screen();
+                printf("Error: Could not read transactions file.\n");
+                wait_for_enter();
+                return;
             }
+            count = (int)listing.total;
 
             if (count == 0) {
                 clear_screen();
@@ -510,9 +993,6 @@ void transaction_list(void) {
                 continue;
             }
 
-            /* Sort orders by date/time descending */
-            qsort(orders, count, sizeof(StockOrder), compare_orders_desc);
-
             /* Recalculate total pages */
             total_pages = (count + ORDERS_PER_PAGE - 1) / ORDERS_PER_PAGE;
 
@@ -544,14 +1024,13 @@ void transaction_list(void) {
             getchar();
         }
     }
+
+    order_listing_close(&listing);
 }
 
 void clear_screen(void) {
     /* Simple newlines for Amiga compatibility - avoids crashes */
-    int i;
-    for (i = 0; i < 25; i++) {
-        printf("\n");
-    }
+    fputs("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n", stdout);
     fflush(stdout);
 }
 
@@ -563,73 +1042,34 @@ void wait_for_enter(void) {
     while ((c = getchar()) != '\n' && c != EOF);
 }
 
-int save_transaction(const StockOrder *order) {
-    FILE *fp;
-
-    fp = fopen("transactions.dat", "ab");
-    if (fp == NULL) {
-        return 0;
-    }
-
-    fwrite(order, sizeof(StockOrder), 1, fp);
-    fclose(fp);
-    return 1;
-}
-
-int load_transactions(StockOrder *orders, int max_orders) {
-    FILE *fp;
-    int count = 0;
-
-    fp = fopen("transactions.dat", "rb");
-    if (fp == NULL) {
-        initialize_data_file();
-        fp = fopen("transactions.dat", "rb");
-        if (fp == NULL) {
-            return 0;
-        }
-    }
-
-    while (count < max_orders && fread(&orders[count], sizeof(StockOrder), 1, fp) == 1) {
-        count++;
-    }
-
-    fclose(fp);
-    return count;
-}
-
 void pending_transactions(void) {
-    #define MAX_DISPLAY_ORDERS 50
     #define ORDERS_PER_PAGE 10
-    static StockOrder all_orders[MAX_DISPLAY_ORDERS];  /* All orders */
-    static StockOrder pending_orders[MAX_DISPLAY_ORDERS];  /* Filtered pending orders */
-    int total_count, pending_count, i;
+    OrderListing listing;   /* Pending orders, newest first, fetched per page */
+    const StockOrder **pending_orders;
+    int pending_count;
     int current_page = 0;
     int total_pages;
     char navigation[10];
+    char filter_text[128] = "";
     int viewing = 1;
 
-    /* Load all transactions from file */
-    total_count = load_transactions(all_orders, MAX_DISPLAY_ORDERS);
-
-    /* Filter only unconfirmed transactions */
-    pending_count = 0;
-    for (i = 0; i < total_count; i++) {
-        if (all_orders[i].confirmed == 0) {
-            pending_orders[pending_count] = all_orders[i];
-            pending_count++;
-        }
+    /* Map all transactions; the timestamp index already orders them */
+    if (!open_listing(&listing, 0)) {
+        clear_screen();
+        printf("Error: Could not read transactions file.\n");
+        wait_for_enter();
+        return;
     }
+    pending_count = (int)listing.total;
 
     if (pending_count == 0) {
+        order_listing_close(&listing);
         clear_screen();
         printf("No pending transactions found.\n");
         wait_for_enter();
         return;
     }
 
-    /* Sort orders by date/time descending */
-    qsort(pending_orders, pending_count, sizeof(StockOrder), compare_orders_desc);
-
     /* Calculate total pages */
     total_pages = (pending_count + ORDERS_PER_PAGE - 1) / ORDERS_PER_PAGE;
 
@@ -640,51 +1080,31 @@ void pending_transactions(void) {
             end_index = pending_count;
         }
 
-        clear_screen();
-
-        printf("===============================================================================\n");
-        printf("                   PENDING TRANSACTIONS - Page %d of %d\n", current_page + 1, total_pages);
-        printf("===============================================================================\n\n");
-
-        /* Table header with fixed widths */
-        printf("%-8s %-16s %-10s %-6s %-5s %-9s %-7s %-6s\n",
-               "Acct#", "Timestamp", "Broker", "Action", "Qty", "Price", "Ticker", "Type");
-        printf("-------------------------------------------------------------------------------\n");
-
-        /* Display orders for current page */
-        for (i = start_index; i < end_index; i++) {
-            char timestamp_str[20];
-            struct tm *tm_info;
-
-            /* Convert Unix timestamp to tm structure */
-            tm_info = localtime(&pending_orders[i].timestamp);
-            if (tm_info != NULL) {
-                sprintf(timestamp_str, "%02d/%02d/%02d %02d:%02d",
-                        tm_info->tm_mon + 1,
-                        tm_info->tm_mday,
-                        tm_info->tm_year % 100,
-                        tm_info->tm_hour,
-                        tm_info->tm_min);
-            } else {
-                /* Fallback if localtime fails */
-                sprintf(timestamp_str, "UNIX:%ld", (long)pending_orders[i].timestamp);
-            }
-
-            printf("%-8lu %-16s %-10.10s %-6s %-5lu $%-8.2f %-7.7s %-6s\n",
-                (unsigned long)pending_orders[i].customer_account_no,
-                timestamp_str,
-                pending_orders[i].broker_id,
-                pending_orders[i].action == ORDER_ACTION_BUY ? "BUY" : "SELL",
-                (unsigned long)pending_orders[i].quantity,
-                pending_orders[i].price,
-                pending_orders[i].ticker,
-                pending_orders[i].order_type == ORDER_TYPE_LIMIT ? "LIMIT" : "MARKET");
+        /* Fetch rows from the index only as far as this page */
+        if (!order_listing_fill(&listing, (size_t)end_index)) {
+            clear_screen();
+            printf("Error: Out of memory.\n");
+            wait_for_enter();
+            break;
+        }
+        pending_orders = listing.view.items;
+        if (end_index > (int)listing.view.count) {
+            end_index = (int)listing.view.count;
         }
 
-        printf("\n-------------------------------------------------------------------------------\n");
-        printf("Total pending transactions: %d\n", pending_count);
-        printf("Commands: [S]ubmit all, [R]eload, [N]ext, [P]revious, [M]ain menu\n");
-        printf("Enter command: ");
+        /* The whole screen goes out in one write */
+        order_render_begin(&screen);
+        order_render_text(&screen, "===============================================================================\n");
+        order_render_format(&screen, "                   PENDING TRANSACTIONS - Page %d of %d\n", current_page + 1, total_pages);
+        order_render_text(&screen, "===============================================================================\n\n");
+        if (filter_text[0] != 0) {
+            order_render_format(&screen, "Filter: %s\n\n", filter_text);
+        }
+        order_render_orders(&screen, pending_orders + start_index, (size_t)(end_index - start_index));
+        order_render_text(&screen, "\n-------------------------------------------------------------------------------\n");
+        order_render_format(&screen, "Total pending transactions: %d\n", pending_count);
+        order_render_text(&screen, "Commands: [S]ubmit to market, [F]ilter, [R]eload, [N]ext, [P]revious, [M]ain menu\nEnter command: ");
+        order_render_flush(&screen, stdout);
 
         if (fgets(navigation, sizeof(navigation), stdin) == NULL) {
             viewing = 0;
@@ -694,38 +1114,74 @@ void pending_transactions(void) {
         str_to_upper(navigation);
 
         if (navigation[0] == 'S') {
-            /* Submit all pending transactions */
+            /* Submit all pending transactions to the market */
             clear_screen();
-            printf("\nSubmitting %d pending transactions...\n\n", pending_count);
-            show_loading_animation();
-
-            /* Mark all pending transactions as confirmed */
-            for (i = 0; i < total_count; i++) {
-                if (all_orders[i].confirmed == 0) {
-                    all_orders[i].confirmed = 1;
+            /* Every pending order goes, filtered out or not */
+            printf("\nSubmitting %d pending transactions...\n\n",
+                   remote != NULL ? pending_count : (int)listing.status.pending_count);
+            printf("Processing transactions...\n");
+
+            /* Match buyers against sellers on a worker; only finished orders are confirmed */
+            {
+                OrderMatchSummary summary;
+                OrderSubmit submit;
+                size_t done = 0, total = 0;
+                int ok;
+
+                if (remote != NULL) {
+                    /* The daemon matches, and compacts afterwards */
+                    ok = order_client_submit(remote, &summary);
+                } else {
+                    ok = order_submit_start(&submit);
+                    while (ok && !order_submit_poll(&submit, 100, &done, &total)) {
+                        show_progress(done, total);
+                    }
+                    if (ok) {
+                        show_progress(done, total);
+                        ok = order_submit_finish(&submit, &summary);
+                    }
+                    if (ok) {
+                        /* Newly confirmed history can now be compacted, off to one side */
+                        order_segments_compact_background(TRANSACTIONS_FILE);
+                    }
                 }
-            }
 
-            /* Save all transactions back to file */
-            if (save_all_transactions(all_orders, total_count)) {
-                printf("\n\nAll transactions confirmed successfully!\n");
-            } else {
-                printf("\n\nError confirming transactions.\n");
+                if (ok) {
+                    printf("\nTransaction processing complete!");
+                    printf("\n\nMatched %lu pending orders: %lu fills.\n",
+                           (unsigned long)summary.orders, (unsigned long)summary.fills);
+                    printf("  %lu filled, %lu market orders closed, %lu resting on the book\n",
+                           (unsigned long)summary.filled, (unsigned long)summary.closed,
+                           (unsigned long)summary.resting);
+                } else {
+                    printf("\n\nError matching transactions.\n");
+                }
             }
             wait_for_enter();
             viewing = 0;  /* Exit after submission */
+        } else if (navigation[0] == 'F') {
+            if (!prompt_filter(&listing, filter_text, sizeof(filter_text))) {
+                clear_screen();
+                printf("Error: Could not read transactions file.\n");
+                wait_for_enter();
+                return;
+            }
+            pending_count = (int)listing.total;
+            if (pending_count == 0) {
+                viewing = 0;
+                continue;
+            }
+            total_pages = (pending_count + ORDERS_PER_PAGE - 1) / ORDERS_PER_PAGE;
+            current_page = 0;
         } else if (navigation[0] == 'R') {
             /* Reload data from file */
-            total_count = load_transactions(all_orders, MAX_DISPLAY_ORDERS);
-
-            /* Filter only unconfirmed transactions */
-            pending_count = 0;
-            for (i = 0; i < total_count; i++) {
-                if (all_orders[i].confirmed == 0) {
-                    pending_orders[pending_count] = all_orders[i];
-                    pending_count++;
-                }
+            if (!order_listing_reload(&listing)) {
+                clear_screen();
+                printf("Error: Could not read transactions file.\n");
+                wait_for_enter();
+                return;
             }
+            pending_count = (int)listing.total;
 
             if (pending_count == 0) {
                 clear_screen();
@@ -735,9 +1191,6 @@ void pending_transactions(void) {
                 continue;
             }
 
-            /* Sort orders by date/time descending */
-            qsort(pending_orders, pending_count, sizeof(StockOrder), compare_orders_desc);
-
             /* Recalculate total pages */
             total_pages = (pending_count + ORDERS_PER_PAGE - 1) / ORDERS_PER_PAGE;
 
@@ -769,196 +1222,21 @@ void pending_transactions(void) {
             getchar();
         }
     }
+
+    order_listing_close(&listing);
 }
 
-void show_loading_animation(void) {
-    int i, j;
+/* Progress bar over the confirmations actually written so far */
+void show_progress(size_t done, size_t total) {
     int total_steps = 50;  /* Progress bar width */
+    int steps = total ? (int)((double)done * total_steps / (double)total) : 0;
+    char bar[64];
+    int i;
 
-    printf("Processing transactions...\n");
-    printf("[");
     for (i = 0; i < total_steps; i++) {
-        printf(" ");
+        bar[i] = i < steps ? '=' : (i == steps ? '>' : ' ');
     }
-    printf("]\r[");
+    bar[total_steps] = 0;
+    printf("\r[%s] %lu/%lu", bar, (unsigned long)done, (unsigned long)total);
     fflush(stdout);
-
-    /* 10 second animation */
-    for (i = 0; i <= total_steps; i++) {
-        /* Print progress bar */
-        for (j = 0; j < i; j++) {
-            printf("=");
-        }
-        if (i < total_steps) {
-            printf(">");
-        }
-        fflush(stdout);
-
-        /* Wait approximately 200ms (10 seconds / 50 steps) */
-        /* Adjusted for Amiga 500 (7.14 MHz 68000) */
-        {
-            long k;
-            /* Reduced iteration count for faster animation on Amiga */
-            for (k = 0; k < 50000; k++) {
-                /* Busy wait - adjusted for Amiga processor speed */
-            }
-        }
-
-        /* Move cursor back to start of progress bar */
-        printf("\r[");
-    }
-
-    printf("\nTransaction processing complete!");
-}
-
-int save_all_transactions(StockOrder *orders, int count) {
-    FILE *fp;
-
-    fp = fopen("transactions.dat", "wb");
-    if (fp == NULL) {
-        return 0;
-    }
-
-    fwrite(orders, sizeof(StockOrder), count, fp);
-    fclose(fp);
-    return 1;
-}
-
-void initialize_data_file(void) {
-    FILE *fp;
-    static StockOrder orders[10];  /* Use static to avoid stack issues */
-    int i;
-
-    /* Check if file already exists */
-    fp = fopen("transactions.dat", "rb");
-    if (fp != NULL) {
-        fclose(fp);
-        return;
-    }
-
-    /* Create file with initial data */
-    fp = fopen("transactions.dat", "wb");
-    if (fp == NULL) {
-        return;
-    }
-
-    /* Initialize all orders to 0 first */
-    memset(orders, 0, sizeof(orders));
-
-    /* Base timestamp for Oct 1, 1988 00:00:00 UTC */
-    time_t base_timestamp = 591667200L;  /* Unix timestamp for Oct 1, 1988 */
-
-    /* Order 1 - Oct 3, 1988 09:30 - GM (General Motors) */
-    orders[0].customer_account_no = 123456;
-    orders[0].timestamp = base_timestamp + (2 * 86400) + (9 * 3600) + (30 * 60);
-    strcpy(orders[0].broker_id, "MER");  /* Merrill Lynch */
-    orders[0].action = ORDER_ACTION_BUY;
-    orders[0].quantity = 100;
-    orders[0].price = 84.25;  /* Realistic GM price in 1988 */
-    strcpy(orders[0].ticker, "GM");
-    orders[0].order_type = ORDER_TYPE_LIMIT;
-    orders[0].confirmed = 1;  /* Initial orders are confirmed */
-
-    /* Order 2 - Oct 5, 1988 14:30 - IBM */
-    orders[1].customer_account_no = 234567;
-    orders[1].timestamp = base_timestamp + (4 * 86400) + (14 * 3600) + (30 * 60);
-    strcpy(orders[1].broker_id, "DLJ");  /* Donaldson, Lufkin & Jenrette */
-    orders[1].action = ORDER_ACTION_SELL;
-    orders[1].quantity = 50;
-    orders[1].price = 129.50;  /* IBM was around $125-135 in Oct 1988 */
-    strcpy(orders[1].ticker, "IBM");
-    orders[1].order_type = ORDER_TYPE_MARKET;
-    orders[1].confirmed = 1;  /* Initial orders are confirmed */
-
-    /* Order 3 - Oct 7, 1988 10:15 - GE (General Electric) */
-    orders[2].customer_account_no = 345678;
-    orders[2].timestamp = base_timestamp + (6 * 86400) + (10 * 3600) + (15 * 60);
-    strcpy(orders[2].broker_id, "GS");  /* Goldman Sachs */
-    orders[2].action = ORDER_ACTION_BUY;
-    orders[2].quantity = 200;
-    orders[2].price = 44.75;  /* GE price in 1988 */
-    strcpy(orders[2].ticker, "GE");
-    orders[2].order_type = ORDER_TYPE_LIMIT;
-    orders[2].confirmed = 1;  /* Initial orders are confirmed */
-
-    /* Order 4 - Oct 11, 1988 11:00 - XON (Exxon) */
-    orders[3].customer_account_no = 456789;
-    orders[3].timestamp = base_timestamp + (10 * 86400) + (11 * 3600);
-    strcpy(orders[3].broker_id, "MS");  /* Morgan Stanley */
-    orders[3].action = ORDER_ACTION_BUY;
-    orders[3].quantity = 150;
-    orders[3].price = 45.50;  /* Exxon price in 1988 */
-    strcpy(orders[3].ticker, "XON");
-    orders[3].order_type = ORDER_TYPE_MARKET;
-    orders[3].confirmed = 1;  /* Initial orders are confirmed */
-
-    /* Order 5 - Oct 14, 1988 15:45 - KO (Coca-Cola) */
-    orders[4].customer_account_no = 567890;
-    orders[4].timestamp = base_timestamp + (13 * 86400) + (15 * 3600) + (45 * 60);
-    strcpy(orders[4].broker_id, "BSC");  /* Bear Stearns */
-    orders[4].action = ORDER_ACTION_BUY;
-    orders[4].quantity = 300;
-    orders[4].price = 42.25;  /* KO price in 1988 */
-    strcpy(orders[4].ticker, "KO");
-    orders[4].order_type = ORDER_TYPE_LIMIT;
-    orders[4].confirmed = 1;  /* Initial orders are confirmed */
-
-    /* Order 6 - Oct 18, 1988 10:20 - F (Ford) */
-    orders[5].customer_account_no = 678901;
-    orders[5].timestamp = base_timestamp + (17 * 86400) + (10 * 3600) + (20 * 60);
-    strcpy(orders[5].broker_id, "PWJ");  /* PaineWebber */
-    orders[5].action = ORDER_ACTION_BUY;
-    orders[5].quantity = 200;
-    orders[5].price = 52.75;  /* Ford price in 1988 */
-    strcpy(orders[5].ticker, "F");
-    orders[5].order_type = ORDER_TYPE_MARKET;
-    orders[5].confirmed = 1;  /* Initial orders are confirmed */
-
-    /* Order 7 - Oct 20, 1988 13:10 - T (AT&T) */
-    orders[6].customer_account_no = 789012;
-    orders[6].timestamp = base_timestamp + (19 * 86400) + (13 * 3600) + (10 * 60);
-    strcpy(orders[6].broker_id, "LEH");  /* Lehman Brothers */
-    orders[6].action = ORDER_ACTION_SELL;
-    orders[6].quantity = 100;
-    orders[6].price = 28.50;  /* AT&T price in 1988 */
-    strcpy(orders[6].ticker, "T");
-    orders[6].order_type = ORDER_TYPE_LIMIT;
-    orders[6].confirmed = 1;  /* Initial orders are confirmed */
-
-    /* Order 8 - Oct 24, 1988 09:30 - MRK (Merck) */
-    orders[7].customer_account_no = 890123;
-    orders[7].timestamp = base_timestamp + (23 * 86400) + (9 * 3600) + (30 * 60);
-    strcpy(orders[7].broker_id, "SLB");  /* Salomon Brothers */
-    orders[7].action = ORDER_ACTION_BUY;
-    orders[7].quantity = 75;
-    orders[7].price = 58.25;  /* Merck price in 1988 */
-    strcpy(orders[7].ticker, "MRK");
-    orders[7].order_type = ORDER_TYPE_MARKET;
-    orders[7].confirmed = 1;  /* Initial orders are confirmed */
-
-    /* Order 9 - Oct 26, 1988 16:00 - PG (Procter & Gamble) */
-    orders[8].customer_account_no = 901234;
-    orders[8].timestamp = base_timestamp + (25 * 86400) + (16 * 3600);
-    strcpy(orders[8].broker_id, "DWR");  /* Dean Witter Reynolds */
-    orders[8].action = ORDER_ACTION_SELL;
-    orders[8].quantity = 125;
-    orders[8].price = 89.75;  /* P&G price in 1988 */
-    strcpy(orders[8].ticker, "PG");
-    orders[8].order_type = ORDER_TYPE_LIMIT;
-    orders[8].confirmed = 1;  /* Initial orders are confirmed */
-
-    /* Order 10 - Oct 28, 1988 11:55 - GE (General Electric) */
-    orders[9].customer_account_no = 112345;
-    orders[9].timestamp = base_timestamp + (27 * 86400) + (11 * 3600) + (55 * 60);
-    strcpy(orders[9].broker_id, "EFH");  /* E.F. Hutton */
-    orders[9].action = ORDER_ACTION_BUY;
-    orders[9].quantity = 150;
-    orders[9].price = 44.50;  /* GE price in 1988 */
-    strcpy(orders[9].ticker, "GE");
-    orders[9].order_type = ORDER_TYPE_MARKET;
-    orders[9].confirmed = 1;  /* Initial orders are confirmed */
-
-    /* Write all orders to file */
-    fwrite(orders, sizeof(StockOrder), 10, fp);
-    fclose(fp);
 }
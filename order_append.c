@@ -0,0 +1,329 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "order_append.h"
+#include "order_format.h"
+#include "order_lock.h"
+#include "order_stats.h"
+
+#define WAL_FRAME_MAGIC 0x57414C32UL  /* "WAL2" */
+
+/* A group commit is four operations; room for a few */
+#define APPEND_IO_DEPTH 16
+
+/* FNV-1a over the frame body, enough to spot a torn tail */
+static uint32_t wal_checksum(const OrderWalFrame *frame) {
+    const unsigned char *p = (const unsigned char *)&frame->record_index;
+    size_t len = sizeof(OrderWalFrame) - offsetof(OrderWalFrame, record_index);
+    uint32_t hash = 2166136261UL;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+/* The manifest as it stands, committed record count included; the caller holds the writer lock */
+static int read_committed(OrderAppender *app, size_t *committed) {
+    if (!order_manifest_reload(&app->manifest, app->data_fd)) {
+        return 0;
+    }
+    *committed = app->manifest.records;
+    return 1;
+}
+
+/* Only the count: the rest of the header belongs to the manifest.  Queued
+ * behind whatever the caller queued before; done once the queue is waited on. */
+static int queue_committed(OrderAppender *app, size_t committed) {
+    order_file_header_set_records(&app->header, committed);
+    return order_io_write(&app->io, app->data_fd, &app->header.records,
+                          sizeof(app->header.records), offsetof(OrderFileHeader, records), 0);
+}
+
+static int write_committed(OrderAppender *app, size_t committed) {
+    if (!queue_committed(app, committed) || !order_io_wait(&app->io)) {
+        return 0;
+    }
+    app->manifest.records = committed;
+    return 1;
+}
+
+long long order_clock_usec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* Make every segment the log still covers durable, then start the log afresh */
+static int wal_checkpoint(OrderAppender *app) {
+    OrderWalFrame frame;
+
+    /* Frames are logged in record order, so the first is the oldest */
+    if (pread(app->wal_fd, &frame, sizeof(frame), 0) == (ssize_t)sizeof(frame) &&
+        !order_segments_sync(&app->manifest, app->data_path, (size_t)frame.record_index,
+                             app->manifest.records)) {
+        return 0;
+    }
+    if (fsync(app->data_fd) != 0) {
+        return 0;
+    }
+    return ftruncate(app->wal_fd, 0) == 0;
+}
+
+/* Same order, ignoring a confirmation that happened after it was logged */
+static int same_order(const StockOrder *a, const StockOrder *b) {
+    StockOrder x = *a, y = *b;
+
+    x.confirmed = 0;
+    y.confirmed = 0;
+    return memcmp(&x, &y, sizeof(StockOrder)) == 0;
+}
+
+/* Re-apply every intact frame that didn't reach its segment */
+static int wal_recover(OrderAppender *app) {
+    OrderWalFrame frame;
+    StockOrder current;
+    size_t committed, end;
+    size_t replayed = 0;
+    off_t offset = 0;
+
+    if (!read_committed(app, &committed)) {
+        return 0;
+    }
+    end = committed;
+
+    while (pread(app->wal_fd, &frame, sizeof(frame), offset) == (ssize_t)sizeof(frame)) {
+        long long at = ORDER_SEGMENT_BYTE(frame.record_index);
+
+        if (frame.magic != WAL_FRAME_MAGIC || frame.checksum != wal_checksum(&frame)) {
+            break;  /* Torn tail from a crash mid-commit */
+        }
+        offset += (off_t)sizeof(frame);
+
+        /* The segment may not have made it into the manifest either */
+        if (!order_manifest_extend(&app->manifest, app->data_fd, app->data_path,
+                                   (size_t)frame.record_index + 1)) {
+            return 0;
+        }
+
+        /* A record that made it must not lose a later confirmation */
+        if (!order_segment_read(&app->segments, &current, sizeof(current), at) ||
+            !same_order(&current, &frame.order)) {
+            if (!order_segment_write(&app->segments, &frame.order, sizeof(StockOrder), at)) {
+                return 0;
+            }
+            replayed++;
+        }
+        if (frame.record_index + 1 > end) {
+            end = (size_t)frame.record_index + 1;
+        }
+    }
+
+    if (end > committed && !write_committed(app, end)) {
+        return 0;
+    }
+    if (replayed == 0 && end == committed) {
+        return ftruncate(app->wal_fd, 0) == 0;
+    }
+    return wal_checkpoint(app);
+}
+
+int order_appender_open(OrderAppender *app, const char *data_path, const char *wal_path,
+                        const OrderAppendConfig *config) {
+    memset(app, 0, sizeof(OrderAppender));
+    app->config = *config;
+    if (app->config.batch_orders == 0) {
+        app->config.batch_orders = 1;
+    }
+
+    if (strlen(data_path) >= sizeof(app->data_path)) {
+        return 0;
+    }
+    strcpy(app->data_path, data_path);
+    order_segment_file_init(&app->segments, app->data_path, &app->manifest, 1);
+
+    app->queue = (OrderWalFrame *)malloc(app->config.batch_orders * sizeof(OrderWalFrame));
+    app->staging = (StockOrder *)malloc(app->config.batch_orders * sizeof(StockOrder));
+    if (app->queue == NULL || app->staging == NULL || !order_lock_writer()) {
+        free(app->staging);
+        free(app->queue);
+        return 0;
+    }
+    /* Every group is written from these two; pinning them is only a saving */
+    order_io_open(&app->io, APPEND_IO_DEPTH);
+    order_io_register(&app->io, app->queue, app->config.batch_orders * sizeof(OrderWalFrame));
+    order_io_register(&app->io, app->staging, app->config.batch_orders * sizeof(StockOrder));
+
+    /* Create the file if needed, then make sure it is in the current format */
+    app->data_fd = open(data_path, O_RDWR | O_CREAT, 0644);
+    if (app->data_fd >= 0) {
+        close(app->data_fd);
+        app->data_fd = order_file_upgrade(data_path) ? open(data_path, O_RDWR) : -1;
+    }
+    app->wal_fd = open(wal_path, O_RDWR | O_CREAT | O_APPEND, 0644);
+
+    if (app->data_fd < 0 || app->wal_fd < 0 || !wal_recover(app)) {
+        order_unlock_writer();
+        if (app->wal_fd >= 0) {
+            close(app->wal_fd);
+        }
+        if (app->data_fd >= 0) {
+            close(app->data_fd);
+        }
+        order_io_close(&app->io);
+        order_segment_file_close(&app->segments);
+        order_manifest_free(&app->manifest);
+        free(app->staging);
+        free(app->queue);
+        return 0;
+    }
+    order_unlock_writer();
+    return 1;
+}
+
+int order_appender_append(OrderAppender *app, const StockOrder *order) {
+    OrderWalFrame *frame = &app->queue[app->queued];
+
+    /* Slot and checksum are assigned when the group is committed */
+    memset(frame, 0, sizeof(OrderWalFrame));
+    frame->magic = WAL_FRAME_MAGIC;
+    frame->order = *order;
+    order_to_disk(&frame->order);
+
+    if (app->queued++ == 0) {
+        app->oldest_usec = order_clock_usec();
+    }
+
+    if (app->queued >= app->config.batch_orders) {
+        return order_appender_sync(app);
+    }
+    return order_appender_poll(app);
+}
+
+int order_appender_poll(OrderAppender *app) {
+    if (app->queued == 0 || app->config.batch_usec <= 0) {
+        return 1;
+    }
+    if (order_clock_usec() - app->oldest_usec >= app->config.batch_usec) {
+        return order_appender_sync(app);
+    }
+    return 1;
+}
+
+/* Steps 1-3 of a group commit; the caller holds the writer lock */
+static int commit_group(OrderAppender *app) {
+    struct stat st;
+    size_t first, i;
+    size_t count = app->queued;
+    long long at;
+    int fd;
+
+    /* Place the group after everything committed so far, by any process */
+    if (!read_committed(app, &first)) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        app->queue[i].record_index = (uint64_t)(first + i);
+        app->queue[i].checksum = wal_checksum(&app->queue[i]);
+        app->staging[i] = app->queue[i].order;
+    }
+
+    /* Segments for the group first, starting new ones as they fill.  An empty
+     * segment changes nothing readers or recovery go by until the count moves. */
+    if (!order_manifest_extend(&app->manifest, app->data_fd, app->data_path, first + count)) {
+        return 0;
+    }
+
+    /* 1. One log write and one sync for the whole group; the log covers the
+     * segments until the next checkpoint */
+    order_io_write(&app->io, app->wal_fd, app->queue, count * sizeof(OrderWalFrame),
+                   ORDER_IO_APPEND, ORDER_IO_LINK);
+    order_io_sync(&app->io, app->wal_fd, ORDER_IO_DATASYNC | ORDER_IO_LINK);
+
+    /* 2. Apply to the tail segment, and 3. only then let readers see the group.
+     * Linked, so each step starts once the one before it has worked: a single
+     * system call for the lot with io_uring. */
+    if (order_segment_span(&app->segments, ORDER_SEGMENT_BYTE(first), count * sizeof(StockOrder),
+                           &fd, &at)) {
+        order_io_write(&app->io, fd, app->staging, count * sizeof(StockOrder), at, ORDER_IO_LINK);
+        if (!queue_committed(app, first + count) || !order_io_wait(&app->io)) {
+            return 0;
+        }
+        app->manifest.records = first + count;
+    } else {
+        /* The group straddles two segment files: one step at a time */
+        if (!order_io_wait(&app->io) ||
+            !order_segment_write(&app->segments, app->staging, count * sizeof(StockOrder),
+                                 ORDER_SEGMENT_BYTE(first)) ||
+            !write_committed(app, first + count)) {
+            return 0;
+        }
+    }
+    app->queued = 0;
+
+    if (app->config.on_durable != NULL) {
+        for (i = 0; i < count; i++) {
+            order_from_disk(&app->staging[i]);
+        }
+        app->config.on_durable(app->config.ctx, first, app->staging, count);
+    }
+
+    if (fstat(app->wal_fd, &st) == 0 &&
+        (size_t)st.st_size / sizeof(OrderWalFrame) >= ORDER_WAL_CHECKPOINT) {
+        return wal_checkpoint(app);
+    }
+    return 1;
+}
+
+/* Bytes a group of `count` puts on disk: log frames, then records */
+static uint64_t group_bytes(size_t count) {
+    return (uint64_t)count * (sizeof(OrderWalFrame) + sizeof(StockOrder));
+}
+
+int order_appender_sync(OrderAppender *app) {
+    uint64_t start = order_stats_clock();
+    size_t count = app->queued;
+    int ok;
+
+    if (count == 0) {
+        return 1;
+    }
+    if (!order_lock_writer()) {
+        return 0;
+    }
+    ok = commit_group(app);
+    order_unlock_writer();
+    /* Waiting for the writer lock is part of what an append costs */
+    order_stats_record(ORDER_STAT_APPEND, start, 0, group_bytes(count));
+    return ok;
+}
+
+int order_appender_close(OrderAppender *app) {
+    uint64_t start = order_stats_clock();
+    size_t count = app->queued;
+    int ok = order_lock_writer();
+
+    if (ok) {
+        ok = (app->queued == 0 || commit_group(app)) && wal_checkpoint(app);
+        order_unlock_writer();
+        if (count > 0) {
+            order_stats_record(ORDER_STAT_APPEND, start, 0, group_bytes(count));
+        }
+    }
+
+    order_io_close(&app->io);
+    free(app->staging);
+    free(app->queue);
+    close(app->wal_fd);
+    close(app->data_fd);
+    order_segment_file_close(&app->segments);
+    order_manifest_free(&app->manifest);
+    memset(app, 0, sizeof(OrderAppender));
+    return ok;
+}
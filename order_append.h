@@ -0,0 +1,63 @@
+#ifndef ORDER_APPEND_H
+#define ORDER_APPEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "order_io.h"
+#include "order_segment.h"
+#include "stock_order.h"
+
+// Write-ahead log that fronts appends to the transactions file
+#define TRANSACTIONS_WAL_FILE "transactions.wal"
+
+// Frames kept in the log before it is checkpointed and truncated
+#define ORDER_WAL_CHECKPOINT 4096
+
+// Called once a group of orders is on stable storage and in the data file
+typedef void (*OrderDurableCallback)(void *ctx, size_t first_record,
+                                     const StockOrder *orders, size_t count);
+
+// Group commit policy
+typedef struct {
+    size_t batch_orders;            // Sync once this many orders are queued
+    long batch_usec;                // ...or once the oldest queued order is this old
+    OrderDurableCallback on_durable;
+    void *ctx;
+} OrderAppendConfig;
+
+// One logged order and the record slot it belongs in
+typedef struct {
+    uint32_t magic;
+    uint32_t checksum;
+    uint64_t record_index;
+    StockOrder order;
+} OrderWalFrame;
+
+// Long-lived append handle.  Any number of processes may hold one on the
+// same file: each group is placed and written under the store's writer lock.
+// Must not be moved once open.
+typedef struct {
+    int data_fd;                    // The manifest
+    char data_path[FILENAME_MAX];
+    OrderManifest manifest;         // Re-read at every commit
+    OrderSegmentFile segments;      // Where records are written
+    OrderIo io;                     // Log, record and count writes of each group
+    OrderFileHeader header;         // The count being written
+    int wal_fd;                     // Shared by all appenders, opened O_APPEND
+    OrderAppendConfig config;
+    OrderWalFrame *queue;           // Orders waiting for the next group commit
+    StockOrder *staging;            // Contiguous copy of a group for the data file
+    size_t queued;
+    long long oldest_usec;          // When the oldest queued order arrived
+} OrderAppender;
+
+long long order_clock_usec(void);
+
+int order_appender_open(OrderAppender *app, const char *data_path, const char *wal_path,
+                        const OrderAppendConfig *config);
+int order_appender_append(OrderAppender *app, const StockOrder *order);
+int order_appender_poll(OrderAppender *app);
+int order_appender_sync(OrderAppender *app);
+int order_appender_close(OrderAppender *app);
+
+#endif // ORDER_APPEND_H
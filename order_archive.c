@@ -0,0 +1,804 @@
+#include <stdlib.h>
+#include <string.h>
+#include "order_archive.h"
+#include "order_format.h"
+#include "order_lock.h"
+#include "order_segment.h"
+#include "order_stats.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define ARCHIVE_SYNC(fp) (fflush(fp) == 0 && fsync(fileno(fp)) == 0)
+#else
+#define ARCHIVE_SYNC(fp) (fflush(fp) == 0)
+#endif
+
+#define BLOCK_MAGIC 0x4B4C4241UL  /* "ABLK" */
+#define BLOCK_HEADER_SIZE 24
+
+/* Column encodings for 32-bit values */
+#define COLUMN_FRAME 0              /* Minimum, then bit-packed offsets from it */
+#define COLUMN_DICTIONARY 1         /* Distinct values, then bit-packed indices */
+
+/* Open-addressed table for dictionaries; twice the most entries a block can have */
+#define DICT_SLOTS (2 * ORDER_ARCHIVE_BLOCK)
+#define DICT_MAX_WIDTH 16
+
+/* Spare bytes after a payload, so bit-packed values can be read a word at a time */
+#define PAYLOAD_SLACK 8
+
+/* Decoded a block at a time: seven 32-bit columns, then broker and ticker indices */
+#define ARCHIVE_COLUMNS 9
+
+/* Growable output for one block's payload */
+typedef struct {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    int failed;
+} ArchiveBuffer;
+
+/* Bounds-checked input over one block's payload */
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+    int failed;
+} ArchiveCursor;
+
+/* Distinct keys of one column, in order of first appearance */
+typedef struct {
+    uint16_t slots[DICT_SLOTS];     /* Entry + 1, 0 = empty */
+    unsigned char keys[ORDER_ARCHIVE_BLOCK * DICT_MAX_WIDTH];
+    uint32_t indices[ORDER_ARCHIVE_BLOCK];
+    size_t count;
+    size_t width;
+} ArchiveDict;
+
+/* ---- Helpers ---- */
+
+/* Plain loads where the host is little-endian: these sit in the decoding loops */
+static uint32_t load_le32(const unsigned char *p) {
+#ifdef ORDER_HOST_BIG_ENDIAN
+    return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+#else
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+#endif
+}
+
+static uint64_t load_le64(const unsigned char *p) {
+#ifdef ORDER_HOST_BIG_ENDIAN
+    return ((uint64_t)load_le32(p + 4) << 32) | load_le32(p);
+#else
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+#endif
+}
+
+static void store_le32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static void store_le64(unsigned char *p, uint64_t v) {
+    store_le32(p, (uint32_t)v);
+    store_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+static unsigned bit_width(uint32_t value) {
+    unsigned bits = 0;
+
+    while (value != 0) {
+        bits++;
+        value >>= 1;
+    }
+    return bits;
+}
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/* FNV-1a a 64-bit word at a time, so checking a block costs little next to decoding it */
+static uint32_t block_checksum(const unsigned char *data, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i = 0;
+
+    for (; i + 8 <= length; i += 8) {
+        hash ^= load_le64(data + i);
+        hash *= 1099511628211ULL;
+    }
+    for (; i < length; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+/* ---- Encoding ---- */
+
+static void buffer_reserve(ArchiveBuffer *buf, size_t extra) {
+    unsigned char *data;
+    size_t capacity;
+
+    if (buf->failed || buf->length + extra <= buf->capacity) {
+        return;
+    }
+    capacity = buf->capacity ? buf->capacity : 64 * 1024;
+    while (capacity < buf->length + extra) {
+        capacity *= 2;
+    }
+    data = (unsigned char *)realloc(buf->data, capacity);
+    if (data == NULL) {
+        buf->failed = 1;
+        return;
+    }
+    buf->data = data;
+    buf->capacity = capacity;
+}
+
+static void put_bytes(ArchiveBuffer *buf, const void *bytes, size_t length) {
+    buffer_reserve(buf, length);
+    if (!buf->failed) {
+        memcpy(buf->data + buf->length, bytes, length);
+        buf->length += length;
+    }
+}
+
+static void put_u8(ArchiveBuffer *buf, unsigned value) {
+    unsigned char byte = (unsigned char)value;
+
+    put_bytes(buf, &byte, 1);
+}
+
+static void put_le16(ArchiveBuffer *buf, unsigned value) {
+    unsigned char bytes[2];
+
+    bytes[0] = (unsigned char)value;
+    bytes[1] = (unsigned char)(value >> 8);
+    put_bytes(buf, bytes, 2);
+}
+
+static void put_le32(ArchiveBuffer *buf, uint32_t value) {
+    unsigned char bytes[4];
+
+    store_le32(bytes, value);
+    put_bytes(buf, bytes, 4);
+}
+
+static void put_le64(ArchiveBuffer *buf, uint64_t value) {
+    unsigned char bytes[8];
+
+    store_le64(bytes, value);
+    put_bytes(buf, bytes, 8);
+}
+
+static void put_varint(ArchiveBuffer *buf, uint64_t value) {
+    unsigned char bytes[10];
+    size_t n = 0;
+
+    while (value >= 0x80) {
+        bytes[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    bytes[n++] = (unsigned char)value;
+    put_bytes(buf, bytes, n);
+}
+
+/* `bits` (0-32) of every value, least significant first */
+static void put_packed(ArchiveBuffer *buf, const uint32_t *values, size_t count,
+                       uint32_t base, unsigned bits) {
+    size_t bytes = (count * bits + 7) / 8, i;
+    unsigned char *out;
+    uint64_t acc = 0;
+    unsigned pending = 0;
+
+    buffer_reserve(buf, bytes);
+    if (buf->failed || bits == 0) {
+        return;
+    }
+    out = buf->data + buf->length;
+    for (i = 0; i < count; i++) {
+        acc |= (uint64_t)(values[i] - base) << pending;
+        pending += bits;
+        while (pending >= 8) {
+            *out++ = (unsigned char)acc;
+            acc >>= 8;
+            pending -= 8;
+        }
+    }
+    if (pending > 0) {
+        *out = (unsigned char)acc;
+    }
+    buf->length += bytes;
+}
+
+static uint32_t dict_hash(const unsigned char *key, size_t width) {
+    uint32_t hash = 2166136261UL;
+    size_t i;
+
+    for (i = 0; i < width; i++) {
+        hash ^= key[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+/* Fill `dict` from `count` keys `stride` bytes apart */
+static void dict_build(ArchiveDict *dict, const unsigned char *keys, size_t stride,
+                       size_t width, size_t count) {
+    size_t i;
+
+    memset(dict->slots, 0, sizeof(dict->slots));
+    dict->count = 0;
+    dict->width = width;
+    for (i = 0; i < count; i++) {
+        const unsigned char *key = keys + i * stride;
+        size_t slot = dict_hash(key, width) & (DICT_SLOTS - 1);
+
+        for (;;) {
+            size_t entry = dict->slots[slot];
+
+            if (entry == 0) {
+                memcpy(dict->keys + dict->count * width, key, width);
+                dict->slots[slot] = (uint16_t)++dict->count;
+                dict->indices[i] = (uint32_t)(dict->count - 1);
+                break;
+            }
+            if (memcmp(dict->keys + (entry - 1) * width, key, width) == 0) {
+                dict->indices[i] = (uint32_t)(entry - 1);
+                break;
+            }
+            slot = (slot + 1) & (DICT_SLOTS - 1);
+        }
+    }
+}
+
+static void put_dictionary(ArchiveBuffer *buf, const ArchiveDict *dict, size_t count) {
+    put_le16(buf, (unsigned)dict->count);
+    put_bytes(buf, dict->keys, dict->count * dict->width);
+    put_packed(buf, dict->indices, count, 0, bit_width((uint32_t)(dict->count - 1)));
+}
+
+/* A 32-bit column: frame of reference, or a dictionary when that is smaller */
+static void put_column(ArchiveBuffer *buf, ArchiveDict *dict, const uint32_t *values, size_t count) {
+    uint32_t min = values[0], max = values[0];
+    unsigned char keys[ORDER_ARCHIVE_BLOCK * 4];
+    size_t frame_bits, dict_bits, i;
+
+    for (i = 1; i < count; i++) {
+        if (values[i] < min) {
+            min = values[i];
+        }
+        if (values[i] > max) {
+            max = values[i];
+        }
+    }
+    frame_bits = count * bit_width(max - min);
+
+    for (i = 0; i < count; i++) {
+        store_le32(keys + i * 4, values[i]);
+    }
+    dict_build(dict, keys, 4, 4, count);
+    dict_bits = dict->count * 32 + count * bit_width((uint32_t)(dict->count - 1));
+
+    if (dict_bits < frame_bits) {
+        put_u8(buf, COLUMN_DICTIONARY);
+        put_dictionary(buf, dict, count);
+    } else {
+        put_u8(buf, COLUMN_FRAME);
+        put_le32(buf, min);
+        put_u8(buf, bit_width(max - min));
+        put_packed(buf, values, count, min, bit_width(max - min));
+    }
+}
+
+/* One block of host-order records into `buf` */
+static int encode_block(ArchiveBuffer *buf, ArchiveDict *dict, uint32_t *column,
+                        const StockOrder *orders, size_t count) {
+    int64_t previous_delta = 0;
+    size_t i;
+
+    /* Timestamps: mostly increasing by similar steps, so delta-of-delta is near 0 */
+    put_le64(buf, (uint64_t)orders[0].timestamp);
+    for (i = 1; i < count; i++) {
+        int64_t delta = orders[i].timestamp - orders[i - 1].timestamp;
+
+        put_varint(buf, zigzag(delta - previous_delta));
+        previous_delta = delta;
+    }
+
+#define ENCODE_FIELD(field) \
+    do { \
+        for (i = 0; i < count; i++) { \
+            column[i] = (uint32_t)orders[i].field; \
+        } \
+        put_column(buf, dict, column, count); \
+    } while (0)
+
+    ENCODE_FIELD(customer_account_no);
+    ENCODE_FIELD(quantity);
+    ENCODE_FIELD(price_cents);
+    ENCODE_FIELD(action);
+    ENCODE_FIELD(order_type);
+    ENCODE_FIELD(confirmed);
+    ENCODE_FIELD(reserved);
+#undef ENCODE_FIELD
+
+    dict_build(dict, (const unsigned char *)orders[0].broker_id, sizeof(StockOrder),
+               sizeof(orders[0].broker_id), count);
+    put_dictionary(buf, dict, count);
+    dict_build(dict, (const unsigned char *)orders[0].ticker, sizeof(StockOrder),
+               sizeof(orders[0].ticker), count);
+    put_dictionary(buf, dict, count);
+    return !buf->failed;
+}
+
+/* ---- Decoding ---- */
+
+static const unsigned char *take(ArchiveCursor *in, size_t length) {
+    const unsigned char *p = in->p;
+
+    if (in->failed || (size_t)(in->end - in->p) < length) {
+        in->failed = 1;
+        return NULL;
+    }
+    in->p += length;
+    return p;
+}
+
+static unsigned get_u8(ArchiveCursor *in) {
+    const unsigned char *p = take(in, 1);
+
+    return p != NULL ? p[0] : 0;
+}
+
+static unsigned get_le16(ArchiveCursor *in) {
+    const unsigned char *p = take(in, 2);
+
+    return p != NULL ? (unsigned)(p[0] | (p[1] << 8)) : 0;
+}
+
+static uint32_t get_le32(ArchiveCursor *in) {
+    const unsigned char *p = take(in, 4);
+
+    return p != NULL ? load_le32(p) : 0;
+}
+
+static uint64_t get_le64(ArchiveCursor *in) {
+    const unsigned char *p = take(in, 8);
+
+    return p != NULL ? load_le64(p) : 0;
+}
+
+static uint64_t get_varint(ArchiveCursor *in) {
+    uint64_t value = 0;
+    unsigned shift = 0;
+
+    if (in->p < in->end && !(*in->p & 0x80)) {
+        return *in->p++;
+    }
+
+    while (in->p < in->end && shift < 64) {
+        unsigned char byte = *in->p++;
+
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+        shift += 7;
+    }
+    in->failed = 1;
+    return 0;
+}
+
+/* Eight values of `bits` bits are `bits` whole bytes, so within a group of
+ * eight every offset, shift and mask is a constant.  Reads a word per value,
+ * up to 8 bytes past the packed values: the payload buffer has PAYLOAD_SLACK
+ * bytes to spare. */
+#define UNPACK_ONE(bits, n) \
+    values[i + (n)] = base + (uint32_t)((load_le64(p + (n) * (bits) / 8) >> ((n) * (bits) % 8)) & \
+                                        (((uint64_t)1 << (bits)) - 1))
+
+#define UNPACK(bits) \
+    do { \
+        for (i = 0; i + 8 <= count; i += 8, p += (bits)) { \
+            UNPACK_ONE(bits, 0); UNPACK_ONE(bits, 1); UNPACK_ONE(bits, 2); UNPACK_ONE(bits, 3); \
+            UNPACK_ONE(bits, 4); UNPACK_ONE(bits, 5); UNPACK_ONE(bits, 6); UNPACK_ONE(bits, 7); \
+        } \
+        for (bit = 0; i < count; i++, bit += (bits)) { \
+            values[i] = base + (uint32_t)((load_le64(p + bit / 8) >> (bit % 8)) & \
+                                          (((uint64_t)1 << (bits)) - 1)); \
+        } \
+    } while (0)
+
+#define UNPACK_WIDTH(bits) case bits: UNPACK(bits); break
+
+static void get_packed(ArchiveCursor *in, uint32_t *values, size_t count, uint32_t base,
+                       unsigned bits) {
+    const unsigned char *p;
+    size_t i, bit;
+
+    if (bits > 32 || (p = take(in, (count * bits + 7) / 8)) == NULL) {
+        in->failed = 1;
+        return;
+    }
+    /* A loop per width, so every shift and mask is a constant */
+    switch (bits) {
+    case 0:
+        for (i = 0; i < count; i++) {
+            values[i] = base;
+        }
+        break;
+    case 8:
+        for (i = 0; i < count; i++) {
+            values[i] = base + p[i];
+        }
+        break;
+    case 16:
+        for (i = 0; i < count; i++) {
+            values[i] = base + (uint32_t)(p[2 * i] | (p[2 * i + 1] << 8));
+        }
+        break;
+    case 32:
+        for (i = 0; i < count; i++) {
+            values[i] = base + load_le32(p + 4 * i);
+        }
+        break;
+    UNPACK_WIDTH(1); UNPACK_WIDTH(2); UNPACK_WIDTH(3); UNPACK_WIDTH(4);
+    UNPACK_WIDTH(5); UNPACK_WIDTH(6); UNPACK_WIDTH(7); UNPACK_WIDTH(9);
+    UNPACK_WIDTH(10); UNPACK_WIDTH(11); UNPACK_WIDTH(12); UNPACK_WIDTH(13);
+    UNPACK_WIDTH(14); UNPACK_WIDTH(15); UNPACK_WIDTH(17); UNPACK_WIDTH(18);
+    UNPACK_WIDTH(19); UNPACK_WIDTH(20); UNPACK_WIDTH(21); UNPACK_WIDTH(22);
+    UNPACK_WIDTH(23); UNPACK_WIDTH(24); UNPACK_WIDTH(25); UNPACK_WIDTH(26);
+    UNPACK_WIDTH(27); UNPACK_WIDTH(28); UNPACK_WIDTH(29); UNPACK_WIDTH(30);
+    UNPACK_WIDTH(31);
+    }
+}
+
+#undef UNPACK_WIDTH
+#undef UNPACK
+#undef UNPACK_ONE
+
+/* Entries stay in the payload; returns them, with the indices in `indices` */
+static const unsigned char *get_dictionary(ArchiveCursor *in, uint32_t *indices, size_t count,
+                                           size_t width) {
+    size_t entries = get_le16(in), i;
+    const unsigned char *keys = take(in, entries * width);
+    unsigned bits;
+
+    if (keys == NULL || entries == 0) {
+        in->failed = 1;
+        return NULL;
+    }
+    bits = bit_width((uint32_t)(entries - 1));
+    get_packed(in, indices, count, 0, bits);
+    /* Out of range only if the width holds more than the entries */
+    if (!in->failed && ((size_t)1 << bits) > entries) {
+        uint32_t max = 0;
+
+        for (i = 0; i < count; i++) {
+            max = indices[i] > max ? indices[i] : max;
+        }
+        in->failed = max >= entries;
+    }
+    return in->failed ? NULL : keys;
+}
+
+static void get_column(ArchiveCursor *in, uint32_t *values, size_t count) {
+    if (get_u8(in) == COLUMN_DICTIONARY) {
+        const unsigned char *keys = get_dictionary(in, values, count, 4);
+        size_t i;
+
+        for (i = 0; keys != NULL && i < count; i++) {
+            values[i] = load_le32(keys + values[i] * 4);
+        }
+    } else {
+        uint32_t min = get_le32(in);
+
+        get_packed(in, values, count, min, get_u8(in));
+    }
+}
+
+/* Every column into `column` (ARCHIVE_COLUMNS blocks of values) and
+ * `timestamps`, then the records in one pass */
+static int decode_block(ArchiveCursor *in, int64_t *timestamps, uint32_t *column,
+                        StockOrder *orders, size_t count) {
+    const uint32_t *account = column, *quantity = column + ORDER_ARCHIVE_BLOCK,
+                   *price = column + 2 * ORDER_ARCHIVE_BLOCK, *action = column + 3 * ORDER_ARCHIVE_BLOCK,
+                   *type = column + 4 * ORDER_ARCHIVE_BLOCK, *confirmed = column + 5 * ORDER_ARCHIVE_BLOCK,
+                   *reserved = column + 6 * ORDER_ARCHIVE_BLOCK, *broker = column + 7 * ORDER_ARCHIVE_BLOCK,
+                   *ticker = column + 8 * ORDER_ARCHIVE_BLOCK;
+    const unsigned char *brokers, *tickers;
+    int64_t delta = 0;
+    size_t i;
+
+    timestamps[0] = (int64_t)get_le64(in);
+    for (i = 1; i < count; i++) {
+        delta += unzigzag(get_varint(in));
+        timestamps[i] = timestamps[i - 1] + delta;
+    }
+    for (i = 0; i < 7; i++) {
+        get_column(in, column + i * ORDER_ARCHIVE_BLOCK, count);
+    }
+    brokers = get_dictionary(in, column + 7 * ORDER_ARCHIVE_BLOCK, count, sizeof(orders[0].broker_id));
+    tickers = get_dictionary(in, column + 8 * ORDER_ARCHIVE_BLOCK, count, sizeof(orders[0].ticker));
+    if (in->failed || in->p != in->end) {
+        return 0;
+    }
+
+    /* Every field is written, and a record has no padding */
+    for (i = 0; i < count; i++) {
+        StockOrder *order = &orders[i];
+
+        order->timestamp = timestamps[i];
+        order->customer_account_no = account[i];
+        order->quantity = quantity[i];
+        order->price_cents = price[i];
+        order->action = (uint8_t)action[i];
+        order->order_type = (uint8_t)type[i];
+        order->confirmed = (uint8_t)confirmed[i];
+        order->reserved = (uint8_t)reserved[i];
+        memcpy(order->broker_id, brokers + broker[i] * sizeof(order->broker_id),
+               sizeof(order->broker_id));
+        memcpy(order->ticker, tickers + ticker[i] * sizeof(order->ticker), sizeof(order->ticker));
+    }
+    return 1;
+}
+
+/* ---- Files ---- */
+
+static void header_encode(unsigned char *out, size_t records, uint64_t blocks, uint64_t end) {
+    memset(out, 0, ORDER_ARCHIVE_HEADER_SIZE);
+    memcpy(out, ORDER_ARCHIVE_MAGIC, 4);
+    out[4] = ORDER_ARCHIVE_VERSION;
+    out[6] = ORDER_ARCHIVE_HEADER_SIZE;
+    store_le32(out + offsetof(OrderArchiveHeader, block_records), ORDER_ARCHIVE_BLOCK);
+    store_le64(out + offsetof(OrderArchiveHeader, records), (uint64_t)records);
+    store_le64(out + offsetof(OrderArchiveHeader, blocks), blocks);
+    store_le64(out + offsetof(OrderArchiveHeader, end), end);
+}
+
+static int header_decode(const unsigned char *in, size_t *records, uint64_t *blocks, uint64_t *end) {
+    unsigned char expected[ORDER_ARCHIVE_HEADER_SIZE];
+
+    /* Everything up to the counts must match what we would write */
+    header_encode(expected, 0, 0, 0);
+    if (memcmp(in, expected, offsetof(OrderArchiveHeader, records)) != 0) {
+        return 0;
+    }
+    *records = (size_t)load_le64(in + offsetof(OrderArchiveHeader, records));
+    *blocks = load_le64(in + offsetof(OrderArchiveHeader, blocks));
+    *end = load_le64(in + offsetof(OrderArchiveHeader, end));
+    return *end >= ORDER_ARCHIVE_HEADER_SIZE;
+}
+
+int order_archive_open(OrderArchiveReader *reader, const char *path) {
+    unsigned char header[ORDER_ARCHIVE_HEADER_SIZE];
+    uint64_t blocks, end;
+
+    memset(reader, 0, sizeof(OrderArchiveReader));
+    reader->fp = fopen(path, "rb");
+    if (reader->fp == NULL) {
+        return 0;
+    }
+    reader->batch = (StockOrder *)malloc(ORDER_ARCHIVE_BLOCK * sizeof(StockOrder));
+    reader->timestamps = (int64_t *)malloc(ORDER_ARCHIVE_BLOCK * sizeof(int64_t));
+    reader->column = (uint32_t *)malloc(ARCHIVE_COLUMNS * ORDER_ARCHIVE_BLOCK * sizeof(uint32_t));
+    if (reader->batch == NULL || reader->timestamps == NULL || reader->column == NULL ||
+        fread(header, sizeof(header), 1, reader->fp) != 1 ||
+        !header_decode(header, &reader->records, &blocks, &end)) {
+        order_archive_close(reader);
+        return 0;
+    }
+    return 1;
+}
+
+size_t order_archive_next_batch(OrderArchiveReader *reader, StockOrder **batch) {
+    uint64_t start = order_stats_clock();
+    unsigned char header[BLOCK_HEADER_SIZE];
+    ArchiveCursor in;
+    size_t count, length;
+
+    if (reader->fp == NULL || reader->error || reader->records_read >= reader->records) {
+        return 0;
+    }
+    if (fread(header, sizeof(header), 1, reader->fp) != 1 || load_le32(header) != BLOCK_MAGIC ||
+        load_le64(header + 16) != (uint64_t)reader->records_read) {
+        reader->error = 1;
+        return 0;
+    }
+    count = load_le32(header + 4);
+    length = load_le32(header + 8);
+    if (count == 0 || count > ORDER_ARCHIVE_BLOCK || count > reader->records - reader->records_read) {
+        reader->error = 1;
+        return 0;
+    }
+
+    if (length + PAYLOAD_SLACK > reader->payload_capacity) {
+        unsigned char *payload = (unsigned char *)realloc(reader->payload, length + PAYLOAD_SLACK);
+
+        if (payload == NULL) {
+            reader->error = 1;
+            return 0;
+        }
+        reader->payload = payload;
+        reader->payload_capacity = length + PAYLOAD_SLACK;
+    }
+    /* The slack is read past the last packed values, never used */
+    memset(reader->payload + length, 0, PAYLOAD_SLACK);
+    if (fread(reader->payload, 1, length, reader->fp) != length ||
+        block_checksum(reader->payload, length) != load_le32(header + 12)) {
+        reader->error = 1;
+        return 0;
+    }
+
+    in.p = reader->payload;
+    in.end = reader->payload + length;
+    in.failed = 0;
+    if (!decode_block(&in, reader->timestamps, reader->column, reader->batch, count)) {
+        reader->error = 1;
+        return 0;
+    }
+    reader->records_read += count;
+    *batch = reader->batch;
+    order_stats_record(ORDER_STAT_LOAD, start, sizeof(header) + length, 0);
+    return count;
+}
+
+void order_archive_close(OrderArchiveReader *reader) {
+    if (reader->fp != NULL) {
+        fclose(reader->fp);
+    }
+    free(reader->batch);
+    free(reader->payload);
+    free(reader->timestamps);
+    free(reader->column);
+    memset(reader, 0, sizeof(OrderArchiveReader));
+}
+
+int order_archive_stat(const char *path, size_t *records, uint64_t *bytes) {
+    unsigned char header[ORDER_ARCHIVE_HEADER_SIZE];
+    uint64_t blocks;
+    FILE *fp;
+    int ok;
+
+    *records = 0;
+    *bytes = 0;
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+    ok = fread(header, sizeof(header), 1, fp) == 1 && header_decode(header, records, &blocks, bytes);
+    fclose(fp);
+    return ok;
+}
+
+/* Records [0, end) sit in compacted segments: sealed, and every one confirmed */
+static size_t compacted_records(const OrderManifest *manifest) {
+    size_t segment = 0;
+
+    while (segment < manifest->segments && (manifest->slots[segment].flags & ORDER_SEGMENT_COMPACTED)) {
+        segment++;
+    }
+    return segment * manifest->segment_records < manifest->records ?
+           segment * manifest->segment_records : manifest->records;
+}
+
+/* Encode records [first, end) of the store onto the end of the archive */
+static int archive_append(FILE *fp, const OrderManifest *manifest, const char *data_path,
+                          size_t first, size_t end, uint64_t *blocks, uint64_t *offset) {
+    ArchiveDict *dict;
+    uint32_t *column;
+    ArchiveBuffer buf;
+    OrderSegmentFile source;
+    StockOrder *orders;
+    size_t count, i;
+    int ok = 1;
+
+    memset(&buf, 0, sizeof(buf));
+    orders = (StockOrder *)malloc(ORDER_ARCHIVE_BLOCK * sizeof(StockOrder));
+    dict = (ArchiveDict *)malloc(sizeof(ArchiveDict));
+    column = (uint32_t *)malloc(ORDER_ARCHIVE_BLOCK * sizeof(uint32_t));
+    if (orders == NULL || dict == NULL || column == NULL || fseek(fp, (long)*offset, SEEK_SET) != 0) {
+        free(orders);
+        free(dict);
+        free(column);
+        return 0;
+    }
+    order_segment_file_init(&source, data_path, manifest, 0);
+
+    for (; ok && first < end; first += count) {
+        unsigned char header[BLOCK_HEADER_SIZE];
+
+        count = end - first < ORDER_ARCHIVE_BLOCK ? end - first : ORDER_ARCHIVE_BLOCK;
+        ok = order_segment_read(&source, orders, count * sizeof(StockOrder), ORDER_SEGMENT_BYTE(first));
+        for (i = 0; ok && i < count; i++) {
+            order_from_disk(&orders[i]);
+        }
+
+        buf.length = 0;
+        ok = ok && encode_block(&buf, dict, column, orders, count);
+        if (ok) {
+            store_le32(header, BLOCK_MAGIC);
+            store_le32(header + 4, (uint32_t)count);
+            store_le32(header + 8, (uint32_t)buf.length);
+            store_le32(header + 12, block_checksum(buf.data, buf.length));
+            store_le64(header + 16, (uint64_t)first);
+            ok = fwrite(header, sizeof(header), 1, fp) == 1 &&
+                 fwrite(buf.data, 1, buf.length, fp) == buf.length;
+        }
+        if (ok) {
+            *offset += sizeof(header) + buf.length;
+            (*blocks)++;
+        }
+    }
+    order_segment_file_close(&source);
+    free(buf.data);
+    free(column);
+    free(dict);
+    free(orders);
+    return ok;
+}
+
+int order_archive_update(const char *path, const char *data_path, size_t *added) {
+    unsigned char header[ORDER_ARCHIVE_HEADER_SIZE];
+    OrderManifest manifest;
+    size_t archived = 0, end;
+    uint64_t blocks = 0, offset = ORDER_ARCHIVE_HEADER_SIZE;
+    FILE *fp;
+    int ok;
+
+    if (added != NULL) {
+        *added = 0;
+    }
+    if (!order_lock_writer()) {
+        return 0;
+    }
+    if (!order_manifest_read(&manifest, data_path)) {
+        order_unlock_writer();
+        return 0;
+    }
+
+    /* Created on first use, otherwise continued from where it stopped */
+    fp = fopen(path, "r+b");
+    if (fp == NULL) {
+        fp = fopen(path, "w+b");
+        header_encode(header, 0, 0, offset);
+        ok = fp != NULL && fwrite(header, sizeof(header), 1, fp) == 1;
+    } else {
+        ok = fread(header, sizeof(header), 1, fp) == 1 &&
+             header_decode(header, &archived, &blocks, &offset);
+    }
+
+    end = compacted_records(&manifest);
+    if (ok && end > archived) {
+        /* Blocks first, then the header that covers them */
+        ok = archive_append(fp, &manifest, data_path, archived, end, &blocks, &offset) &&
+             ARCHIVE_SYNC(fp);
+        if (ok) {
+            header_encode(header, end, blocks, offset);
+            ok = fseek(fp, 0, SEEK_SET) == 0 && fwrite(header, sizeof(header), 1, fp) == 1 &&
+                 ARCHIVE_SYNC(fp);
+        }
+        if (ok && added != NULL) {
+            *added = end - archived;
+        }
+    }
+    if (fp != NULL && fclose(fp) != 0) {
+        ok = 0;
+    }
+    order_manifest_free(&manifest);
+    order_unlock_writer();
+    return ok;
+}
@@ -0,0 +1,70 @@
+#ifndef ORDER_ARCHIVE_H
+#define ORDER_ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "stock_order.h"
+
+// Columnar copy of the store's compacted (sealed, all confirmed) history
+#define TRANSACTIONS_ARCHIVE_FILE "transactions.arc"
+
+#define ORDER_ARCHIVE_MAGIC "STKA"
+#define ORDER_ARCHIVE_VERSION 1
+#define ORDER_ARCHIVE_HEADER_SIZE 64
+
+// Records per block; blocks are encoded and decoded whole
+#define ORDER_ARCHIVE_BLOCK 4096
+
+// Archive header, little-endian on disk.  Blocks follow back to back up
+// to `end`; anything after that is a torn append and is ignored.
+typedef struct {
+    char magic[4];                  // ORDER_ARCHIVE_MAGIC
+    uint16_t version;               // ORDER_ARCHIVE_VERSION
+    uint16_t header_size;           // ORDER_ARCHIVE_HEADER_SIZE
+    uint32_t block_records;         // ORDER_ARCHIVE_BLOCK
+    uint32_t reserved0;
+    uint64_t records;               // Store records 0..records-1 are archived
+    uint64_t blocks;
+    uint64_t end;                   // File offset just past the last block
+    uint8_t reserved[24];
+} OrderArchiveHeader;
+
+// Each block: a 24-byte header (magic, records, payload bytes, FNV-1a of
+// the payload, first record number), then one column after another:
+//   timestamp    first value, then zigzag varints of the first delta and
+//                of every delta-of-delta after it
+//   account, quantity, price_cents, action, order_type, confirmed, reserved
+//                an encoding byte, then whichever is smaller for the block:
+//                frame of reference (minimum, bit width, values - minimum
+//                bit-packed; width 0 when the column is constant) or a
+//                dictionary of 32-bit values
+//   broker_id, ticker
+//                dictionary: entry count, raw entries, bit-packed indices
+
+// Forward-only reader, a block at a time, like OrderReader
+typedef struct {
+    FILE *fp;
+    size_t records;                 // Archived when opened
+    size_t records_read;
+    StockOrder *batch;              // ORDER_ARCHIVE_BLOCK decoded records
+    unsigned char *payload;         // One encoded block
+    size_t payload_capacity;
+    int64_t *timestamps;            // Scratch for the decoded columns,
+    uint32_t *column;               // a block of values each
+    int error;                      // Non-zero after a read or checksum error
+} OrderArchiveReader;
+
+int order_archive_open(OrderArchiveReader *reader, const char *path);
+size_t order_archive_next_batch(OrderArchiveReader *reader, StockOrder **batch);
+void order_archive_close(OrderArchiveReader *reader);
+
+// Append to the archive at `path` every compacted record of the store at
+// `data_path` that it doesn't hold yet.  Runs under the writer lock.
+// `added` (may be NULL) is set to the records appended.
+int order_archive_update(const char *path, const char *data_path, size_t *added);
+
+// Records held and bytes used by an archive; 0 if there is none
+int order_archive_stat(const char *path, size_t *records, uint64_t *bytes);
+
+#endif // ORDER_ARCHIVE_H
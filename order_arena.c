@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <string.h>
+#include "order_arena.h"
+
+/* Enough for any of the records and pointers kept here */
+#define ARENA_ALIGN 16
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define ARENA_HEADER ARENA_ROUND(sizeof(OrderArenaChunk))
+
+static char *chunk_data(OrderArenaChunk *chunk) {
+    return (char *)chunk + ARENA_HEADER;
+}
+
+static void *arena_resize(void *ctx, void *ptr, size_t old_size, size_t new_size);
+
+void order_arena_init(OrderArena *arena, size_t chunk_size) {
+    memset(arena, 0, sizeof(OrderArena));
+    arena->chunk_size = chunk_size ? chunk_size : ORDER_ARENA_CHUNK;
+    arena->allocator.resize = arena_resize;
+    arena->allocator.release = NULL;  /* Reclaimed wholesale */
+    arena->allocator.ctx = arena;
+}
+
+static OrderArenaChunk *arena_grow(OrderArena *arena, size_t size) {
+    size_t chunk_size = arena->chunk_size;
+    OrderArenaChunk *chunk;
+
+    if (chunk_size < size) {
+        chunk_size = ARENA_ROUND(size);
+    }
+    chunk = (OrderArenaChunk *)malloc(ARENA_HEADER + chunk_size);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->next = arena->chunks;
+    chunk->size = chunk_size;
+    chunk->used = 0;
+    arena->chunks = chunk;
+
+    /* Fewer, larger chunks as the data grows */
+    if (arena->chunk_size < ORDER_ARENA_MAX_CHUNK) {
+        arena->chunk_size *= 2;
+    }
+    return chunk;
+}
+
+void *order_arena_alloc(OrderArena *arena, size_t size) {
+    OrderArenaChunk *chunk = arena->chunks;
+    void *ptr;
+
+    size = ARENA_ROUND(size ? size : 1);
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        chunk = arena_grow(arena, size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+    }
+    ptr = chunk_data(chunk) + chunk->used;
+    chunk->used += size;
+    arena->last = ptr;
+    arena->last_size = size;
+    return ptr;
+}
+
+/* OrderAllocator.resize: the newest allocation grows in place while its chunk has room */
+static void *arena_resize(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+    OrderArena *arena = (OrderArena *)ctx;
+    OrderArenaChunk *chunk = arena->chunks;
+    void *moved;
+
+    if (ptr == NULL) {
+        return order_arena_alloc(arena, new_size);
+    }
+    if (new_size <= old_size) {
+        return ptr;
+    }
+    if (ptr == arena->last) {
+        size_t rounded = ARENA_ROUND(new_size);
+        size_t extra = rounded > arena->last_size ? rounded - arena->last_size : 0;
+
+        if (chunk->size - chunk->used >= extra) {
+            chunk->used += extra;
+            arena->last_size += extra;
+            return ptr;
+        }
+    }
+
+    /* The old copy stays until the arena is reset */
+    moved = order_arena_alloc(arena, new_size);
+    if (moved != NULL) {
+        memcpy(moved, ptr, old_size);
+    }
+    return moved;
+}
+
+void order_arena_reset(OrderArena *arena) {
+    OrderArenaChunk *chunk = arena->chunks;
+
+    if (chunk != NULL) {
+        OrderArenaChunk *older = chunk->next;
+
+        while (older != NULL) {
+            OrderArenaChunk *next = older->next;
+            free(older);
+            older = next;
+        }
+        chunk->next = NULL;
+        chunk->used = 0;
+    }
+    arena->last = NULL;
+    arena->last_size = 0;
+}
+
+void order_arena_free(OrderArena *arena) {
+    order_arena_reset(arena);
+    free(arena->chunks);
+    arena->chunks = NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef ORDER_ARENA_H
+#define ORDER_ARENA_H
+
+#include <stddef.h>
+#include "order_store.h"
+
+// First chunk of a listing's arena; each later chunk is twice the last
+#define ORDER_ARENA_CHUNK (256 * 1024)
+
+// Chunks stop doubling here, except to fit one larger request
+#define ORDER_ARENA_MAX_CHUNK (64 * 1024 * 1024)
+
+// Memory is carved from the front; the header is followed by `size` bytes
+typedef struct OrderArenaChunk {
+    struct OrderArenaChunk *next;   // Older chunk
+    size_t size;
+    size_t used;
+} OrderArenaChunk;
+
+// Region allocator: nothing is freed on its own, everything goes at once
+// on reset or free.  Must not be moved once its allocator is handed out.
+typedef struct {
+    OrderArenaChunk *chunks;        // Newest chunk first
+    size_t chunk_size;              // Size of the next chunk
+    void *last;                     // Latest allocation; the only one that grows in place
+    size_t last_size;
+    OrderAllocator allocator;       // For OrderVector, OrderView, OrderSelection...
+} OrderArena;
+
+void order_arena_init(OrderArena *arena, size_t chunk_size);
+void *order_arena_alloc(OrderArena *arena, size_t size);
+
+// Forget every allocation but keep the newest (largest) chunk for reuse
+void order_arena_reset(OrderArena *arena);
+void order_arena_free(OrderArena *arena);
+
+#endif // ORDER_ARENA_H
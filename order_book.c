@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <string.h>
+#include "order_book.h"
+
+#define SIDE_INITIAL_LEVELS 16
+
+void order_engine_init(OrderEngine *engine) {
+    memset(engine, 0, sizeof(OrderEngine));
+    engine->free_entry = ORDER_BOOK_NONE;
+}
+
+void order_engine_free(OrderEngine *engine) {
+    size_t i;
+
+    for (i = 0; i < engine->book_count; i++) {
+        free(engine->books[i].bids.levels);
+        free(engine->books[i].asks.levels);
+    }
+    free(engine->books);
+    free(engine->entries);
+    free(engine->fills);
+    order_engine_init(engine);
+}
+
+OrderBook *order_engine_book(const OrderEngine *engine, uint32_t ticker) {
+    return ticker < engine->book_count ? &engine->books[ticker] : NULL;
+}
+
+/* Make sure there is a book for every ticker id up to `ticker` */
+static int book_reserve(OrderEngine *engine, uint32_t ticker) {
+    size_t count = engine->book_count;
+    OrderBook *books;
+
+    if (ticker < count) {
+        return 1;
+    }
+    while (count <= ticker) {
+        count = count ? count * 2 : 16;
+    }
+    books = (OrderBook *)realloc(engine->books, count * sizeof(OrderBook));
+    if (books == NULL) {
+        return 0;
+    }
+    memset(books + engine->book_count, 0, (count - engine->book_count) * sizeof(OrderBook));
+    engine->books = books;
+    engine->book_count = count;
+    return 1;
+}
+
+static uint32_t entry_alloc(OrderEngine *engine) {
+    uint32_t entry = engine->free_entry;
+
+    if (entry != ORDER_BOOK_NONE) {
+        engine->free_entry = engine->entries[entry].next;
+        return entry;
+    }
+    if (engine->entry_count == engine->entry_capacity) {
+        size_t capacity = engine->entry_capacity ? engine->entry_capacity * 2 : 1024;
+        OrderBookEntry *entries;
+
+        if (capacity >= ORDER_BOOK_NONE) {
+            return ORDER_BOOK_NONE;
+        }
+        entries = (OrderBookEntry *)realloc(engine->entries, capacity * sizeof(OrderBookEntry));
+        if (entries == NULL) {
+            return ORDER_BOOK_NONE;
+        }
+        engine->entries = entries;
+        engine->entry_capacity = capacity;
+    }
+    return (uint32_t)engine->entry_count++;
+}
+
+static void entry_free(OrderEngine *engine, uint32_t entry) {
+    engine->entries[entry].next = engine->free_entry;
+    engine->free_entry = entry;
+}
+
+static int add_fill(OrderEngine *engine, const OrderFill *fill) {
+    if (engine->fill_count == engine->fill_capacity) {
+        size_t capacity = engine->fill_capacity ? engine->fill_capacity * 2 : 1024;
+        OrderFill *fills = (OrderFill *)realloc(engine->fills, capacity * sizeof(OrderFill));
+        if (fills == NULL) {
+            return 0;
+        }
+        engine->fills = fills;
+        engine->fill_capacity = capacity;
+    }
+    engine->fills[engine->fill_count++] = *fill;
+    return 1;
+}
+
+/* Find `price` on a side ordered worst first; *pos is where it is or would go */
+static int level_find(const OrderBookSide *side, uint32_t price, int ascending, size_t *pos) {
+    size_t lo = 0, hi = side->count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        uint32_t at = side->levels[mid].price_cents;
+
+        if (at == price) {
+            *pos = mid;
+            return 1;
+        }
+        if ((at < price) == (ascending != 0)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *pos = lo;
+    return 0;
+}
+
+/* Queue what is left of a limit order behind everything at its price */
+static int rest(OrderEngine *engine, OrderBookSide *side, int ascending,
+                uint32_t price, uint64_t record, uint32_t quantity) {
+    OrderBookLevel *level;
+    uint32_t entry;
+    size_t pos;
+
+    if (!level_find(side, price, ascending, &pos)) {
+        if (side->count == side->capacity) {
+            size_t capacity = side->capacity ? side->capacity * 2 : SIDE_INITIAL_LEVELS;
+            OrderBookLevel *levels = (OrderBookLevel *)realloc(side->levels,
+                                                               capacity * sizeof(OrderBookLevel));
+            if (levels == NULL) {
+                return 0;
+            }
+            side->levels = levels;
+            side->capacity = capacity;
+        }
+        /* New prices mostly land near the top, so little has to move */
+        memmove(&side->levels[pos + 1], &side->levels[pos],
+                (side->count - pos) * sizeof(OrderBookLevel));
+        side->count++;
+        level = &side->levels[pos];
+        level->price_cents = price;
+        level->head = ORDER_BOOK_NONE;
+        level->tail = ORDER_BOOK_NONE;
+        level->quantity = 0;
+    }
+    level = &side->levels[pos];
+
+    entry = entry_alloc(engine);
+    if (entry == ORDER_BOOK_NONE) {
+        return 0;
+    }
+    engine->entries[entry].record = record;
+    engine->entries[entry].remaining = quantity;
+    engine->entries[entry].next = ORDER_BOOK_NONE;
+    if (level->tail == ORDER_BOOK_NONE) {
+        level->head = entry;
+    } else {
+        engine->entries[level->tail].next = entry;
+    }
+    level->tail = entry;
+    level->quantity += quantity;
+    return 1;
+}
+
+int order_engine_submit(OrderEngine *engine, uint64_t record, const OrderCompact *order,
+                        uint32_t quantity, int64_t now, uint32_t *remaining) {
+    OrderBookSide *opposite, *own;
+    int buying = order->action == ORDER_ACTION_BUY;
+    int limit = (order->flags & ORDER_COMPACT_LIMIT) != 0;
+    OrderBook *book;
+
+    *remaining = quantity;
+    if (!book_reserve(engine, order->ticker)) {
+        return 0;
+    }
+    book = &engine->books[order->ticker];
+    opposite = buying ? &book->asks : &book->bids;
+    own = buying ? &book->bids : &book->asks;
+
+    /* Take liquidity from the best level down while the price is acceptable */
+    while (*remaining > 0 && opposite->count > 0) {
+        OrderBookLevel *level = &opposite->levels[opposite->count - 1];
+
+        if (limit && (buying ? level->price_cents > order->price_cents
+                             : level->price_cents < order->price_cents)) {
+            break;
+        }
+        while (*remaining > 0 && level->head != ORDER_BOOK_NONE) {
+            OrderBookEntry *resting = &engine->entries[level->head];
+            uint32_t take = resting->remaining < *remaining ? resting->remaining : *remaining;
+            OrderFill fill;
+
+            fill.buy_record = buying ? record : resting->record;
+            fill.sell_record = buying ? resting->record : record;
+            fill.price_cents = level->price_cents;
+            fill.quantity = take;
+            fill.timestamp = now;
+            if (!add_fill(engine, &fill)) {
+                return 0;
+            }
+
+            resting->remaining -= take;
+            level->quantity -= take;
+            *remaining -= take;
+            if (resting->remaining == 0) {
+                uint32_t done = level->head;
+                level->head = resting->next;
+                entry_free(engine, done);
+            }
+        }
+        if (level->head == ORDER_BOOK_NONE) {
+            opposite->count--;
+        }
+    }
+
+    if (*remaining > 0 && limit) {
+        return rest(engine, own, buying, order->price_cents, record, *remaining);
+    }
+    return 1;
+}
+
+const OrderBookLevel *order_book_best_bid(const OrderBook *book) {
+    return book->bids.count ? &book->bids.levels[book->bids.count - 1] : NULL;
+}
+
+const OrderBookLevel *order_book_best_ask(const OrderBook *book) {
+    return book->asks.count ? &book->asks.levels[book->asks.count - 1] : NULL;
+}
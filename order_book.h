@@ -0,0 +1,73 @@
+#ifndef ORDER_BOOK_H
+#define ORDER_BOOK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "order_symbols.h"
+
+// End of an entry chain
+#define ORDER_BOOK_NONE 0xFFFFFFFFUL
+
+// One execution between a buyer and a seller, at the resting order's price
+typedef struct {
+    uint64_t buy_record;
+    uint64_t sell_record;
+    uint32_t price_cents;
+    uint32_t quantity;
+    int64_t timestamp;              // When the match was made
+} OrderFill;
+
+// A resting order, queued at its price level
+typedef struct {
+    uint64_t record;
+    uint32_t remaining;
+    uint32_t next;                  // Next entry at the level, or on the free list
+} OrderBookEntry;
+
+// Every resting order at one price, oldest first
+typedef struct {
+    uint32_t price_cents;
+    uint32_t head;
+    uint32_t tail;
+    uint64_t quantity;              // Sum of remaining quantities
+} OrderBookLevel;
+
+// Levels of one side, worst price first so the best is always last
+typedef struct {
+    OrderBookLevel *levels;
+    size_t count;
+    size_t capacity;
+} OrderBookSide;
+
+// Limit order book for one ticker
+typedef struct {
+    OrderBookSide bids;             // Ascending price
+    OrderBookSide asks;             // Descending price
+} OrderBook;
+
+// All books, plus the entry pool they share and the fills produced
+typedef struct {
+    OrderBook *books;               // Indexed by ticker id
+    size_t book_count;
+    OrderBookEntry *entries;
+    size_t entry_count;
+    size_t entry_capacity;
+    uint32_t free_entry;
+    OrderFill *fills;
+    size_t fill_count;
+    size_t fill_capacity;
+} OrderEngine;
+
+void order_engine_init(OrderEngine *engine);
+void order_engine_free(OrderEngine *engine);
+
+// Match `quantity` of an order, appending to engine->fills.  Whatever is
+// left of a LIMIT order rests on the book; a MARKET order never rests.
+int order_engine_submit(OrderEngine *engine, uint64_t record, const OrderCompact *order,
+                        uint32_t quantity, int64_t now, uint32_t *remaining);
+
+OrderBook *order_engine_book(const OrderEngine *engine, uint32_t ticker);
+const OrderBookLevel *order_book_best_bid(const OrderBook *book);
+const OrderBookLevel *order_book_best_ask(const OrderBook *book);
+
+#endif // ORDER_BOOK_H
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "order_changes.h"
+#include "order_format.h"
+#include "order_lock.h"
+
+#define CHANGE_OFFSET(n) ((long)ORDER_CHANGES_HEADER_SIZE + (long)(n) * ORDER_CHANGE_SIZE)
+
+/* Changes written per call when confirmations are split into runs */
+#define CHANGE_CHUNK 256
+
+/* ---- Encoding ---- */
+
+static uint32_t load_le32(const unsigned char *p) {
+    return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+static uint64_t load_le64(const unsigned char *p) {
+    return ((uint64_t)load_le32(p + 4) << 32) | load_le32(p);
+}
+
+static void store_le32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static void store_le64(unsigned char *p, uint64_t v) {
+    store_le32(p, (uint32_t)v);
+    store_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+static void header_encode(unsigned char *out, const OrderChangesHeader *header) {
+    memset(out, 0, ORDER_CHANGES_HEADER_SIZE);
+    memcpy(out, ORDER_CHANGES_MAGIC, 4);
+    out[4] = ORDER_CHANGES_VERSION & 0xFF;
+    out[5] = ORDER_CHANGES_VERSION >> 8;
+    out[6] = ORDER_CHANGES_HEADER_SIZE & 0xFF;
+    out[7] = ORDER_CHANGES_HEADER_SIZE >> 8;
+    store_le32(out + 8, ORDER_CHANGE_SIZE);
+    store_le64(out + 16, header->epoch);
+    store_le64(out + 24, header->records);
+    store_le64(out + 32, header->changes);
+}
+
+/* 1 if `in` is a header this version writes */
+static int header_decode(const unsigned char *in, OrderChangesHeader *header) {
+    unsigned char expected[ORDER_CHANGES_HEADER_SIZE];
+
+    /* Everything but the counts must be what this version writes */
+    memset(header, 0, sizeof(OrderChangesHeader));
+    memcpy(header->magic, ORDER_CHANGES_MAGIC, 4);
+    header->version = ORDER_CHANGES_VERSION;
+    header->header_size = ORDER_CHANGES_HEADER_SIZE;
+    header->change_size = ORDER_CHANGE_SIZE;
+    header->epoch = load_le64(in + 16);
+    header->records = load_le64(in + 24);
+    header->changes = load_le64(in + 32);
+    header_encode(expected, header);
+    return memcmp(in, expected, sizeof(expected)) == 0;
+}
+
+static void change_encode(unsigned char *out, const OrderChange *change) {
+    store_le64(out, change->first);
+    store_le32(out + 8, change->count);
+    store_le32(out + 12, change->kind);
+}
+
+static void change_decode(OrderChange *change, const unsigned char *in) {
+    change->first = load_le64(in);
+    change->count = load_le32(in + 8);
+    change->kind = load_le32(in + 12);
+}
+
+/* ---- Writing ---- */
+
+/* Different for every file started, so a replica can tell it is looking at a new feed */
+static uint64_t new_epoch(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec) ^
+           ((uint64_t)getpid() << 48);
+}
+
+static int header_write(FILE *fp, const OrderChangesHeader *header) {
+    unsigned char encoded[ORDER_CHANGES_HEADER_SIZE];
+
+    header_encode(encoded, header);
+    return fseek(fp, 0, SEEK_SET) == 0 && fwrite(encoded, sizeof(encoded), 1, fp) == 1;
+}
+
+static FILE *changes_file_open(OrderChangesHeader *header) {
+    unsigned char encoded[ORDER_CHANGES_HEADER_SIZE];
+    FILE *fp = fopen(TRANSACTIONS_CHANGES_FILE, "r+b");
+
+    if (fp != NULL) {
+        if (fread(encoded, sizeof(encoded), 1, fp) == 1 && memcmp(encoded, ORDER_CHANGES_MAGIC, 4) == 0) {
+            if (header_decode(encoded, header)) {
+                return fp;
+            }
+            fclose(fp);
+            return NULL;  /* A version we don't understand */
+        }
+        fclose(fp);
+    }
+
+    /* Missing, or from before the header: start a new feed */
+    fp = fopen(TRANSACTIONS_CHANGES_FILE, "w+b");
+    if (fp == NULL) {
+        return NULL;
+    }
+    memset(header, 0, sizeof(OrderChangesHeader));
+    header->epoch = new_epoch();
+    if (!header_write(fp, header)) {
+        fclose(fp);
+        return NULL;
+    }
+    return fp;
+}
+
+/* Add changes after the last, then publish them with the header */
+static int changes_add(FILE *fp, OrderChangesHeader *header, const OrderChange *changes,
+                       size_t count, uint64_t records) {
+    unsigned char encoded[ORDER_CHANGE_SIZE];
+    size_t i;
+
+    if (count > 0 && fseek(fp, CHANGE_OFFSET(header->changes), SEEK_SET) != 0) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        change_encode(encoded, &changes[i]);
+        if (fwrite(encoded, sizeof(encoded), 1, fp) != 1) {
+            return 0;
+        }
+    }
+    header->changes += count;
+    header->records = records;
+    return header_write(fp, header);
+}
+
+static int changes_append_to(FILE *fp, OrderChangesHeader *header, size_t first, size_t count) {
+    OrderChange change;
+
+    change.first = (uint64_t)first;
+    change.count = (uint32_t)count;
+    change.kind = ORDER_CHANGE_APPEND;
+    return changes_add(fp, header, &change, 1, (uint64_t)(first + count));
+}
+
+int order_changes_append(size_t first_record, size_t count) {
+    OrderChangesHeader header;
+    size_t skip;
+    FILE *fp;
+    int ok;
+
+    fp = changes_file_open(&header);
+    if (fp == NULL) {
+        return 0;
+    }
+
+    /* Appends must be logged in file order; a gap is filled on the next open */
+    if (header.records < first_record || header.records >= first_record + count) {
+        fclose(fp);
+        return 1;
+    }
+    skip = (size_t)header.records - first_record;
+
+    ok = changes_append_to(fp, &header, first_record + skip, count - skip);
+    return fclose(fp) == 0 && ok;
+}
+
+int order_changes_confirm(const size_t *records, size_t count) {
+    OrderChangesHeader header;
+    OrderChange runs[CHANGE_CHUNK];
+    size_t i = 0, n = 0;
+    FILE *fp;
+    int ok = 1;
+
+    if (count == 0) {
+        return 1;
+    }
+    fp = changes_file_open(&header);
+    if (fp == NULL) {
+        return 0;
+    }
+
+    /* One change per run of neighbouring records (they come ascending).
+     * Records past the appends logged so far go out with their append. */
+    while (ok && i < count && records[i] < header.records) {
+        size_t end = i + 1;
+
+        while (end < count && records[end] == records[end - 1] + 1 && records[end] < header.records &&
+               end - i < UINT32_MAX) {
+            end++;
+        }
+        runs[n].first = (uint64_t)records[i];
+        runs[n].count = (uint32_t)(end - i);
+        runs[n].kind = ORDER_CHANGE_CONFIRM;
+        n++;
+        i = end;
+        if (n == CHANGE_CHUNK) {
+            ok = changes_add(fp, &header, runs, n, header.records);
+            n = 0;
+        }
+        /* The same record twice is one change */
+        while (i < count && records[i] <= records[i - 1]) {
+            i++;
+        }
+    }
+    ok = ok && changes_add(fp, &header, runs, n, header.records);
+    return fclose(fp) == 0 && ok;
+}
+
+static int changes_catch_up(const OrderStore *store) {
+    OrderChangesHeader header;
+    FILE *fp;
+    int ok = 1;
+
+    fp = changes_file_open(&header);
+    if (fp == NULL) {
+        return 0;
+    }
+    /* Ahead of our snapshot is fine; ahead of the file means it was replaced */
+    if (header.records > store->count && header.records > order_file_records(TRANSACTIONS_FILE)) {
+        fclose(fp);
+        remove(TRANSACTIONS_CHANGES_FILE);
+        fp = changes_file_open(&header);
+        if (fp == NULL) {
+            return 0;
+        }
+    }
+    while (ok && header.records < store->count) {
+        size_t count = store->count - (size_t)header.records;
+
+        if (count > UINT32_MAX) {
+            count = UINT32_MAX;
+        }
+        ok = changes_append_to(fp, &header, (size_t)header.records, count);
+    }
+    return fclose(fp) == 0 && ok;
+}
+
+int order_changes_open(OrderChanges *changes, const OrderStore *store) {
+    OrderChangesHeader header;
+    size_t whole;
+    int ok;
+
+    memset(changes, 0, sizeof(OrderChanges));
+
+    if (!order_lock_writer()) {
+        return 0;
+    }
+    ok = changes_catch_up(store);
+    order_unlock_writer();
+    if (!ok || !mapped_file_open(&changes->file, TRANSACTIONS_CHANGES_FILE)) {
+        return 0;
+    }
+    if (changes->file.length < ORDER_CHANGES_HEADER_SIZE) {
+        mapped_file_close(&changes->file);
+        return 0;
+    }
+    if (!header_decode((const unsigned char *)changes->file.base, &header)) {
+        mapped_file_close(&changes->file);
+        return 0;
+    }
+    changes->data = (const unsigned char *)changes->file.base + ORDER_CHANGES_HEADER_SIZE;
+    changes->count = (size_t)header.changes;
+    changes->epoch = header.epoch;
+    /* Only whole changes count, however the file was cut short */
+    whole = (changes->file.length - ORDER_CHANGES_HEADER_SIZE) / ORDER_CHANGE_SIZE;
+    if (changes->count > whole) {
+        changes->count = whole;
+    }
+    return 1;
+}
+
+void order_changes_close(OrderChanges *changes) {
+    mapped_file_close(&changes->file);
+    memset(changes, 0, sizeof(OrderChanges));
+}
+
+void order_changes_get(const OrderChanges *changes, size_t n, OrderChange *change) {
+    change_decode(change, changes->data + n * ORDER_CHANGE_SIZE);
+}
@@ -0,0 +1,67 @@
+#ifndef ORDER_CHANGES_H
+#define ORDER_CHANGES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "order_store.h"
+
+// Sidecar file: every append and confirmation, in the order they happened
+#define TRANSACTIONS_CHANGES_FILE "transactions.chg"
+
+// Kinds of change
+#define ORDER_CHANGE_APPEND 1
+#define ORDER_CHANGE_CONFIRM 2
+
+#define ORDER_CHANGES_MAGIC "STKC"
+#define ORDER_CHANGES_VERSION 1
+#define ORDER_CHANGES_HEADER_SIZE 40
+
+// Bytes on disk of one change: first, count, kind
+#define ORDER_CHANGE_SIZE 16
+
+// Header at the start of the changes file.  It and the changes after it
+// are little-endian.  A feed from before the header is started over under
+// a new epoch; one from a newer version is left alone and not used.
+typedef struct {
+    char magic[4];                  // ORDER_CHANGES_MAGIC
+    uint16_t version;               // ORDER_CHANGES_VERSION
+    uint16_t header_size;           // ORDER_CHANGES_HEADER_SIZE
+    uint32_t change_size;           // ORDER_CHANGE_SIZE
+    uint32_t reserved;
+    uint64_t epoch;                 // Picked when the file is started; sequences restart with it
+    uint64_t records;               // Appended records the feed covers
+    uint64_t changes;
+} OrderChangesHeader;
+
+// One change to a run of records.  Change n (from 0) has sequence number
+// n + 1, so "everything since sequence s" starts at change s.
+typedef struct {
+    uint64_t first;
+    uint32_t count;
+    uint32_t kind;
+} OrderChange;
+
+// The feed, mapped
+typedef struct {
+    MappedFile file;
+    const unsigned char *data;      // The encoded changes
+    size_t count;                   // The latest sequence number
+    uint64_t epoch;
+} OrderChanges;
+
+// The feed, brought up to date with the store.  Appends it missed (by an
+// older version, or while the file was gone) are added as one change.
+// Confirmations are fed before the data file is changed, so none is missed
+// (a feed started over gets a new epoch, and its replicas copy afresh).
+int order_changes_open(OrderChanges *changes, const OrderStore *store);
+void order_changes_close(OrderChanges *changes);
+
+// Change n (from 0) of an open feed, n < count
+void order_changes_get(const OrderChanges *changes, size_t n, OrderChange *change);
+
+// Keep the feed in step with the data file; the caller holds the writer
+// lock.  Confirmations go in before the records are confirmed.
+int order_changes_append(size_t first_record, size_t count);
+int order_changes_confirm(const size_t *records, size_t count);
+
+#endif // ORDER_CHANGES_H
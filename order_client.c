@@ -0,0 +1,264 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "order_client.h"
+#include "order_format.h"
+
+static int write_all(int fd, const unsigned char *p, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, p, length);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return 1;
+}
+
+static int read_all(int fd, unsigned char *p, size_t length) {
+    while (length > 0) {
+        ssize_t n = read(fd, p, length);
+
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return 1;
+}
+
+static int grow(unsigned char **data, size_t *capacity, size_t wanted) {
+    unsigned char *grown;
+
+    if (wanted <= *capacity) {
+        return 1;
+    }
+    grown = (unsigned char *)realloc(*data, wanted);
+    if (grown == NULL) {
+        return 0;
+    }
+    *data = grown;
+    *capacity = wanted;
+    return 1;
+}
+
+int order_client_open(OrderClient *client, const char *path) {
+    struct sockaddr_un addr;
+
+    memset(client, 0, sizeof(OrderClient));
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return 0;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    client->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (client->fd < 0) {
+        return 0;
+    }
+    if (connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(client->fd);
+        client->fd = -1;
+        return 0;
+    }
+    return 1;
+}
+
+void order_client_close(OrderClient *client) {
+    if (client->fd >= 0) {
+        close(client->fd);
+    }
+    free(client->payload);
+    free(client->request);
+    memset(client, 0, sizeof(OrderClient));
+    client->fd = -1;
+}
+
+int order_client_send(OrderClient *client, unsigned op, const void *payload, size_t length,
+                      uint32_t *id) {
+    OrderFrame frame;
+
+    if (length > ORDER_FRAME_MAX ||
+        !grow(&client->request, &client->request_capacity, ORDER_FRAME_HEADER_SIZE + length)) {
+        return 0;
+    }
+    frame.length = (uint32_t)length;
+    frame.op = (uint16_t)op;
+    frame.status = 0;
+    frame.id = client->next_id++;
+    order_frame_encode(client->request, &frame);
+    if (length > 0) {
+        memcpy(client->request + ORDER_FRAME_HEADER_SIZE, payload, length);
+    }
+    if (id != NULL) {
+        *id = frame.id;
+    }
+    /* Header and payload in one write, so small requests are one packet */
+    return write_all(client->fd, client->request, ORDER_FRAME_HEADER_SIZE + length);
+}
+
+int order_client_receive(OrderClient *client, OrderFrame *frame, const unsigned char **payload) {
+    unsigned char header[ORDER_FRAME_HEADER_SIZE];
+
+    if (!read_all(client->fd, header, sizeof(header))) {
+        return 0;
+    }
+    order_frame_decode(header, frame);
+    if (frame->length > ORDER_FRAME_MAX ||
+        !grow(&client->payload, &client->payload_capacity, frame->length) ||
+        !read_all(client->fd, client->payload, frame->length)) {
+        return 0;
+    }
+    *payload = client->payload;
+    return 1;
+}
+
+/* Send one request and wait for its reply; 1 only for a successful reply of at least `length` bytes */
+static int call(OrderClient *client, unsigned op, const void *request, size_t request_length,
+                size_t length, OrderFrame *frame, const unsigned char **payload) {
+    uint32_t id;
+
+    return order_client_send(client, op, request, request_length, &id) &&
+           order_client_receive(client, frame, payload) && frame->id == id &&
+           frame->status == ORDER_STATUS_OK && frame->length >= length;
+}
+
+/* Copy `rows` on-disk records out of a reply, as long as they are all there */
+static int take_rows(const OrderFrame *frame, const unsigned char *rows_start, const unsigned char *payload,
+                     size_t rows, size_t count, StockOrder *orders) {
+    size_t i;
+
+    if (rows > count ||
+        frame->length != (size_t)(rows_start - payload) + rows * sizeof(StockOrder)) {
+        return 0;
+    }
+    for (i = 0; i < rows; i++) {
+        memcpy(&orders[i], rows_start + i * sizeof(StockOrder), sizeof(StockOrder));
+        order_from_disk(&orders[i]);
+    }
+    return 1;
+}
+
+int order_client_append(OrderClient *client, const StockOrder *orders, size_t count,
+                        uint64_t *first_record) {
+    const unsigned char *payload;
+    unsigned char *request;
+    OrderFrame frame;
+    size_t i;
+    int ok;
+
+    request = (unsigned char *)malloc(count * sizeof(StockOrder));
+    if (request == NULL) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        StockOrder order = orders[i];
+
+        order_to_disk(&order);
+        memcpy(request + i * sizeof(StockOrder), &order, sizeof(StockOrder));
+    }
+    ok = call(client, ORDER_OP_APPEND, request, count * sizeof(StockOrder), 8, &frame, &payload);
+    free(request);
+    if (ok && first_record != NULL) {
+        *first_record = order_get_u64(payload);
+    }
+    return ok;
+}
+
+size_t order_client_list_request(unsigned char *out, int confirmed, const OrderFilter *filter,
+                                 size_t offset, size_t count) {
+    memset(out, 0, 4);
+    out[0] = (unsigned char)(confirmed != 0);
+    order_filter_encode(out + 4, filter);
+    order_put_u32(out + 4 + ORDER_FILTER_WIRE_SIZE, (uint32_t)offset);
+    order_put_u32(out + 8 + ORDER_FILTER_WIRE_SIZE, (uint32_t)count);
+    return 12 + ORDER_FILTER_WIRE_SIZE;
+}
+
+size_t order_client_query_request(unsigned char *out, const OrderFilter *filter,
+                                  size_t offset, size_t count) {
+    order_filter_encode(out, filter);
+    order_put_u32(out + ORDER_FILTER_WIRE_SIZE, (uint32_t)offset);
+    order_put_u32(out + ORDER_FILTER_WIRE_SIZE + 4, (uint32_t)count);
+    return 8 + ORDER_FILTER_WIRE_SIZE;
+}
+
+int order_client_list(OrderClient *client, int confirmed, const OrderFilter *filter,
+                      size_t offset, size_t count, StockOrder *orders, size_t *rows,
+                      size_t *total) {
+    unsigned char request[ORDER_CLIENT_REQUEST_MAX];
+    const unsigned char *payload;
+    OrderFrame frame;
+    size_t length = order_client_list_request(request, confirmed, filter, offset, count);
+
+    if (!call(client, ORDER_OP_LIST, request, length, 8, &frame, &payload)) {
+        return 0;
+    }
+    *total = order_get_u32(payload);
+    *rows = order_get_u32(payload + 4);
+    return take_rows(&frame, payload + 8, payload, *rows, count, orders);
+}
+
+int order_client_query(OrderClient *client, const OrderFilter *filter, size_t offset,
+                       size_t count, StockOrder *orders, size_t *rows, size_t *total,
+                       size_t *scanned) {
+    unsigned char request[ORDER_CLIENT_REQUEST_MAX];
+    const unsigned char *payload;
+    OrderFrame frame;
+    size_t length = order_client_query_request(request, filter, offset, count);
+
+    if (!call(client, ORDER_OP_QUERY, request, length, 12, &frame, &payload)) {
+        return 0;
+    }
+    *total = order_get_u32(payload);
+    *scanned = order_get_u32(payload + 4);
+    *rows = order_get_u32(payload + 8);
+    return take_rows(&frame, payload + 12, payload, *rows, count, orders);
+}
+
+int order_client_confirm(OrderClient *client, const uint64_t *records, size_t count,
+                         uint64_t *confirmed) {
+    const unsigned char *payload;
+    unsigned char *request;
+    OrderFrame frame;
+    size_t i;
+    int ok;
+
+    request = (unsigned char *)malloc(count * 8);
+    if (request == NULL) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        order_put_u64(request + i * 8, records[i]);
+    }
+    ok = call(client, ORDER_OP_CONFIRM, request, count * 8, 8, &frame, &payload);
+    free(request);
+    if (ok && confirmed != NULL) {
+        *confirmed = order_get_u64(payload);
+    }
+    return ok;
+}
+
+int order_client_submit(OrderClient *client, OrderMatchSummary *summary) {
+    const unsigned char *payload;
+    OrderFrame frame;
+
+    if (!call(client, ORDER_OP_SUBMIT, NULL, 0, ORDER_SUMMARY_WIRE_SIZE, &frame, &payload)) {
+        return 0;
+    }
+    order_summary_decode(payload, summary);
+    return 1;
+}
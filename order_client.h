@@ -0,0 +1,47 @@
+#ifndef ORDER_CLIENT_H
+#define ORDER_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "order_protocol.h"
+
+// Connection to a store daemon
+typedef struct {
+    int fd;
+    uint32_t next_id;
+    unsigned char *payload;         // Last reply received
+    size_t payload_capacity;
+    unsigned char *request;         // Request being built
+    size_t request_capacity;
+} OrderClient;
+
+int order_client_open(OrderClient *client, const char *path);
+void order_client_close(OrderClient *client);
+
+// Pipelining: send any number of requests, then receive their replies in
+// the same order.  A reply's payload stays valid until the next receive.
+int order_client_send(OrderClient *client, unsigned op, const void *payload, size_t length,
+                      uint32_t *id);
+int order_client_receive(OrderClient *client, OrderFrame *frame, const unsigned char **payload);
+
+// One request each, waiting for its reply; 1 if the daemon says it worked
+int order_client_append(OrderClient *client, const StockOrder *orders, size_t count,
+                        uint64_t *first_record);
+int order_client_list(OrderClient *client, int confirmed, const OrderFilter *filter,
+                      size_t offset, size_t count, StockOrder *orders, size_t *rows,
+                      size_t *total);
+int order_client_query(OrderClient *client, const OrderFilter *filter, size_t offset,
+                       size_t count, StockOrder *orders, size_t *rows, size_t *total,
+                       size_t *scanned);
+int order_client_confirm(OrderClient *client, const uint64_t *records, size_t count,
+                         uint64_t *confirmed);
+int order_client_submit(OrderClient *client, OrderMatchSummary *summary);
+
+// LIST and QUERY payloads for callers that pipeline; returns the length
+#define ORDER_CLIENT_REQUEST_MAX 64
+size_t order_client_list_request(unsigned char *out, int confirmed, const OrderFilter *filter,
+                                 size_t offset, size_t count);
+size_t order_client_query_request(unsigned char *out, const OrderFilter *filter,
+                                  size_t offset, size_t count);
+
+#endif // ORDER_CLIENT_H
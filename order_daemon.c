@@ -0,0 +1,645 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "order_append.h"
+#include "order_daemon.h"
+#include "order_format.h"
+#include "order_listing.h"
+#include "order_segment.h"
+
+/* Bytes taken from one connection per pass, so one busy client can't starve the rest */
+#define DAEMON_READ_CHUNK (256 * 1024)
+
+/* A client this far behind on reading its replies gets no more requests served */
+#define DAEMON_OUT_LIMIT (4 * 1024 * 1024)
+
+typedef struct {
+    int fd;
+    int closed;                     /* Dropped once this pass is over */
+    int waiting;                    /* Has appends waiting on the group commit */
+    unsigned char *in;              /* Received, not yet handled */
+    size_t in_start;
+    size_t in_length;
+    size_t in_capacity;
+    unsigned char *out;             /* Replies not yet sent */
+    size_t out_sent;
+    size_t out_length;
+    size_t out_capacity;
+} DaemonClient;
+
+/* An append's reply, completed once its group is durable */
+typedef struct {
+    size_t client;
+    size_t reply;                   /* Offset of the reply's payload in the client's output */
+    size_t offset;                  /* Its first order's place in the group */
+} DaemonAppend;
+
+typedef struct {
+    int listen_fd;
+    DaemonClient clients[ORDER_DAEMON_MAX_CLIENTS];
+    size_t client_count;
+
+    OrderAppender appender;
+    DaemonAppend appends[ORDER_DAEMON_GROUP_MAX];
+    size_t append_count;
+    size_t group_orders;
+    uint64_t group_first;           /* Set by the appender once the group is durable */
+
+    /* Views, reloaded only when the store has changed since they were made */
+    unsigned long changes;
+    OrderListing listings[2];       /* Pending, confirmed */
+    int listing_open[2];
+    unsigned long listing_changes[2];
+    OrderStore store;
+    OrderBlocks blocks;
+    int store_open;
+    unsigned long store_changes;
+} OrderDaemon;
+
+/* Only one daemon per process; it is too big for the stack */
+static OrderDaemon daemon_state;
+
+/* ---- Buffers ---- */
+
+static int buffer_grow(unsigned char **data, size_t *capacity, size_t wanted) {
+    unsigned char *grown;
+    size_t size = *capacity ? *capacity : 64 * 1024;
+
+    if (wanted <= *capacity) {
+        return 1;
+    }
+    while (size < wanted) {
+        size *= 2;
+    }
+    grown = (unsigned char *)realloc(*data, size);
+    if (grown == NULL) {
+        return 0;
+    }
+    *data = grown;
+    *capacity = size;
+    return 1;
+}
+
+/* Room for a reply with `length` bytes of payload; returns the payload's offset */
+static int reply_begin(DaemonClient *client, const OrderFrame *request, unsigned status,
+                       size_t length, size_t *offset) {
+    OrderFrame frame;
+
+    if (!buffer_grow(&client->out, &client->out_capacity,
+                     client->out_length + ORDER_FRAME_HEADER_SIZE + length)) {
+        client->closed = 1;
+        return 0;
+    }
+    frame.length = (uint32_t)length;
+    frame.op = request->op;
+    frame.status = (uint16_t)status;
+    frame.id = request->id;
+    order_frame_encode(client->out + client->out_length, &frame);
+    *offset = client->out_length + ORDER_FRAME_HEADER_SIZE;
+    client->out_length = *offset + length;
+    memset(client->out + *offset, 0, length);
+    return 1;
+}
+
+static void reply_status(DaemonClient *client, const OrderFrame *request, unsigned status) {
+    size_t offset;
+
+    reply_begin(client, request, status, 0, &offset);
+}
+
+/* ---- Views ---- */
+
+/* Has anyone, us or a process writing the store directly, changed it since? */
+static int view_stale(const OrderDaemon *daemon, unsigned long changes, size_t count) {
+    return changes != daemon->changes || order_file_records(TRANSACTIONS_FILE) != count;
+}
+
+static OrderListing *daemon_listing(OrderDaemon *daemon, int confirmed, const OrderFilter *filter) {
+    OrderListing *listing = &daemon->listings[confirmed];
+    int ok = 1;
+
+    if (!daemon->listing_open[confirmed]) {
+        ok = order_listing_open(listing, confirmed);
+        daemon->listing_open[confirmed] = ok;
+        if (ok && !order_filter_is_empty(filter)) {
+            ok = order_listing_filter(listing, filter);
+        }
+    } else if (memcmp(&listing->filter, filter, sizeof(OrderFilter)) != 0) {
+        ok = order_listing_filter(listing, filter);
+    } else if (view_stale(daemon, daemon->listing_changes[confirmed], listing->store.count)) {
+        ok = order_listing_reload(listing);
+    }
+    if (!ok) {
+        /* A failed reload has closed it already */
+        daemon->listing_open[confirmed] = 0;
+        return NULL;
+    }
+    daemon->listing_changes[confirmed] = daemon->changes;
+    return listing;
+}
+
+static int daemon_store(OrderDaemon *daemon) {
+    if (daemon->store_open && !view_stale(daemon, daemon->store_changes, daemon->store.count)) {
+        return 1;
+    }
+    if (daemon->store_open) {
+        order_blocks_close(&daemon->blocks);
+        order_store_close(&daemon->store);
+        daemon->store_open = 0;
+    }
+    if (!open_transactions(&daemon->store)) {
+        return 0;
+    }
+    if (!order_blocks_open(&daemon->blocks, &daemon->store)) {
+        order_store_close(&daemon->store);
+        return 0;
+    }
+    daemon->store_open = 1;
+    daemon->store_changes = daemon->changes;
+    return 1;
+}
+
+static void daemon_close_views(OrderDaemon *daemon) {
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (daemon->listing_open[i]) {
+            order_listing_close(&daemon->listings[i]);
+            daemon->listing_open[i] = 0;
+        }
+    }
+    if (daemon->store_open) {
+        order_blocks_close(&daemon->blocks);
+        order_store_close(&daemon->store);
+        daemon->store_open = 0;
+    }
+}
+
+/* Rows [offset, offset + count) of `items` as on-disk records */
+static void put_rows(unsigned char *out, const StockOrder *const *items, size_t count) {
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        StockOrder order = *items[i];
+
+        order_to_disk(&order);
+        memcpy(out + i * sizeof(StockOrder), &order, sizeof(StockOrder));
+    }
+}
+
+/* ---- Requests ---- */
+
+static void handle_list(OrderDaemon *daemon, DaemonClient *client, const OrderFrame *frame,
+                        const unsigned char *payload) {
+    OrderFilter filter;
+    OrderListing *listing;
+    size_t offset, count, rows = 0, reply;
+    int confirmed;
+
+    if (frame->length != 4 + ORDER_FILTER_WIRE_SIZE + 8) {
+        reply_status(client, frame, ORDER_STATUS_BAD_REQUEST);
+        return;
+    }
+    confirmed = payload[0] != 0;
+    order_filter_decode(payload + 4, &filter);
+    offset = order_get_u32(payload + 4 + ORDER_FILTER_WIRE_SIZE);
+    count = order_get_u32(payload + 8 + ORDER_FILTER_WIRE_SIZE);
+    if (count > ORDER_PROTOCOL_MAX_ROWS) {
+        count = ORDER_PROTOCOL_MAX_ROWS;
+    }
+
+    listing = daemon_listing(daemon, confirmed, &filter);
+    if (listing == NULL || !order_listing_fill(listing, offset + count)) {
+        reply_status(client, frame, ORDER_STATUS_FAILED);
+        return;
+    }
+    if (offset < listing->view.count) {
+        rows = listing->view.count - offset < count ? listing->view.count - offset : count;
+    }
+    if (reply_begin(client, frame, ORDER_STATUS_OK, 8 + rows * sizeof(StockOrder), &reply)) {
+        order_put_u32(client->out + reply, (uint32_t)listing->total);
+        order_put_u32(client->out + reply + 4, (uint32_t)rows);
+        put_rows(client->out + reply + 8, listing->view.items + offset, rows);
+    }
+}
+
+static void handle_query(OrderDaemon *daemon, DaemonClient *client, const OrderFrame *frame,
+                         const unsigned char *payload) {
+    OrderFilter filter;
+    OrderView view;
+    size_t offset, count, rows = 0, scanned, reply;
+
+    if (frame->length != ORDER_FILTER_WIRE_SIZE + 8) {
+        reply_status(client, frame, ORDER_STATUS_BAD_REQUEST);
+        return;
+    }
+    order_filter_decode(payload, &filter);
+    offset = order_get_u32(payload + ORDER_FILTER_WIRE_SIZE);
+    count = order_get_u32(payload + ORDER_FILTER_WIRE_SIZE + 4);
+    if (count > ORDER_PROTOCOL_MAX_ROWS) {
+        count = ORDER_PROTOCOL_MAX_ROWS;
+    }
+
+    order_view_init(&view, NULL);
+    if (!daemon_store(daemon) ||
+        !order_filter_scan(&filter, &daemon->blocks, &daemon->store, &view, &scanned)) {
+        order_view_free(&view);
+        reply_status(client, frame, ORDER_STATUS_FAILED);
+        return;
+    }
+    order_view_sort(&view, order_listing_compare);
+    if (offset < view.count) {
+        rows = view.count - offset < count ? view.count - offset : count;
+    }
+    if (reply_begin(client, frame, ORDER_STATUS_OK, 12 + rows * sizeof(StockOrder), &reply)) {
+        order_put_u32(client->out + reply, (uint32_t)view.count);
+        order_put_u32(client->out + reply + 4, (uint32_t)scanned);
+        order_put_u32(client->out + reply + 8, (uint32_t)rows);
+        put_rows(client->out + reply + 12, view.items + offset, rows);
+    }
+    order_view_free(&view);
+}
+
+static void handle_confirm(OrderDaemon *daemon, DaemonClient *client, const OrderFrame *frame,
+                           const unsigned char *payload) {
+    size_t count = frame->length / 8, records = order_file_records(TRANSACTIONS_FILE), reply, i;
+    size_t *indices;
+    long confirmed = 0;
+    int ok;
+
+    if (frame->length % 8 != 0 || count == 0) {
+        reply_status(client, frame, ORDER_STATUS_BAD_REQUEST);
+        return;
+    }
+    indices = (size_t *)malloc(count * sizeof(size_t));
+    if (indices == NULL) {
+        reply_status(client, frame, ORDER_STATUS_FAILED);
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        uint64_t record = order_get_u64(payload + i * 8);
+
+        if (record >= records) {
+            free(indices);
+            reply_status(client, frame, ORDER_STATUS_BAD_REQUEST);
+            return;
+        }
+        indices[i] = (size_t)record;
+    }
+    ok = confirm_transactions(indices, count, &confirmed, NULL);
+    free(indices);
+    daemon->changes++;
+    if (!ok) {
+        reply_status(client, frame, ORDER_STATUS_FAILED);
+    } else if (reply_begin(client, frame, ORDER_STATUS_OK, 8, &reply)) {
+        order_put_u64(client->out + reply, (uint64_t)confirmed);
+    }
+}
+
+static void handle_submit(OrderDaemon *daemon, DaemonClient *client, const OrderFrame *frame) {
+    OrderMatchSummary summary;
+    size_t reply;
+
+    if (frame->length != 0) {
+        reply_status(client, frame, ORDER_STATUS_BAD_REQUEST);
+        return;
+    }
+    if (!match_pending_orders(&summary, NULL)) {
+        daemon->changes++;
+        reply_status(client, frame, ORDER_STATUS_FAILED);
+        return;
+    }
+    daemon->changes++;
+    /* Newly confirmed history can now be compacted, off to one side */
+    order_segments_compact_background(TRANSACTIONS_FILE);
+    if (reply_begin(client, frame, ORDER_STATUS_OK, ORDER_SUMMARY_WIRE_SIZE, &reply)) {
+        order_summary_encode(client->out + reply, &summary);
+    }
+}
+
+/* Queue the orders for the next group commit; 0 if the group is too full to take them now */
+static int handle_append(OrderDaemon *daemon, size_t index, const OrderFrame *frame,
+                         const unsigned char *payload) {
+    DaemonClient *client = &daemon->clients[index];
+    size_t count = frame->length / sizeof(StockOrder), reply, i;
+
+    if (frame->length % sizeof(StockOrder) != 0 || count == 0 || count > ORDER_DAEMON_GROUP_MAX) {
+        reply_status(client, frame, ORDER_STATUS_BAD_REQUEST);
+        return 1;
+    }
+    if (daemon->group_orders + count > ORDER_DAEMON_GROUP_MAX) {
+        return 0;
+    }
+    if (!reply_begin(client, frame, ORDER_STATUS_OK, 8, &reply)) {
+        return 1;
+    }
+    for (i = 0; i < count; i++) {
+        StockOrder order;
+
+        memcpy(&order, payload + i * sizeof(StockOrder), sizeof(StockOrder));
+        order_from_disk(&order);
+        /* Fails only if the log can't be written; the group's replies will say so */
+        order_appender_append(&daemon->appender, &order);
+    }
+    daemon->appends[daemon->append_count].client = index;
+    daemon->appends[daemon->append_count].reply = reply;
+    daemon->appends[daemon->append_count].offset = daemon->group_orders;
+    daemon->append_count++;
+    daemon->group_orders += count;
+    client->waiting = 1;
+    return 1;
+}
+
+/* Handle every complete request buffered for one client, in order */
+static void handle_client(OrderDaemon *daemon, size_t index) {
+    DaemonClient *client = &daemon->clients[index];
+
+    while (!client->closed && client->in_length - client->in_start >= ORDER_FRAME_HEADER_SIZE &&
+           client->out_length - client->out_sent < DAEMON_OUT_LIMIT) {
+        const unsigned char *p = client->in + client->in_start;
+        const unsigned char *payload = p + ORDER_FRAME_HEADER_SIZE;
+        OrderFrame frame;
+
+        order_frame_decode(p, &frame);
+        if (frame.length > ORDER_FRAME_MAX) {
+            client->closed = 1;
+            break;
+        }
+        if (client->in_length - client->in_start < ORDER_FRAME_HEADER_SIZE + (size_t)frame.length) {
+            break;
+        }
+        /* Replies go out in request order: nothing overtakes an append still to commit */
+        if (client->waiting && frame.op != ORDER_OP_APPEND) {
+            break;
+        }
+
+        if (frame.op == ORDER_OP_APPEND) {
+            if (!handle_append(daemon, index, &frame, payload)) {
+                break;
+            }
+        } else if (frame.op == ORDER_OP_LIST) {
+            handle_list(daemon, client, &frame, payload);
+        } else if (frame.op == ORDER_OP_QUERY) {
+            handle_query(daemon, client, &frame, payload);
+        } else if (frame.op == ORDER_OP_CONFIRM) {
+            handle_confirm(daemon, client, &frame, payload);
+        } else if (frame.op == ORDER_OP_SUBMIT) {
+            handle_submit(daemon, client, &frame);
+        } else {
+            reply_status(client, &frame, ORDER_STATUS_BAD_REQUEST);
+        }
+        client->in_start += ORDER_FRAME_HEADER_SIZE + frame.length;
+    }
+}
+
+/* Called by the appender once the group is durable */
+static void daemon_appended(void *ctx, size_t first_record, const StockOrder *orders, size_t count) {
+    OrderDaemon *daemon = (OrderDaemon *)ctx;
+
+    order_store_appended(NULL, first_record, orders, count);
+    daemon->group_first = (uint64_t)first_record;
+}
+
+/* One group commit for every append taken this pass, then their replies */
+static void commit_appends(OrderDaemon *daemon) {
+    size_t i;
+    int ok;
+
+    if (daemon->append_count == 0) {
+        return;
+    }
+    ok = order_appender_sync(&daemon->appender);
+    for (i = 0; i < daemon->append_count; i++) {
+        const DaemonAppend *append = &daemon->appends[i];
+        DaemonClient *client = &daemon->clients[append->client];
+
+        if (ok) {
+            order_put_u64(client->out + append->reply, daemon->group_first + append->offset);
+        } else {
+            /* Status sits in the header just before the payload */
+            client->out[append->reply - ORDER_FRAME_HEADER_SIZE + 6] = ORDER_STATUS_FAILED;
+        }
+        client->waiting = 0;
+    }
+    daemon->append_count = 0;
+    daemon->group_orders = 0;
+    daemon->changes++;
+}
+
+/* ---- Connections ---- */
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static void accept_clients(OrderDaemon *daemon) {
+    while (daemon->client_count < ORDER_DAEMON_MAX_CLIENTS) {
+        DaemonClient *client = &daemon->clients[daemon->client_count];
+        int fd = accept(daemon->listen_fd, NULL, NULL);
+
+        if (fd < 0) {
+            return;
+        }
+        if (!set_nonblocking(fd)) {
+            close(fd);
+            continue;
+        }
+        memset(client, 0, sizeof(DaemonClient));
+        client->fd = fd;
+        daemon->client_count++;
+    }
+}
+
+static void read_client(DaemonClient *client) {
+    size_t taken = 0;
+
+    /* Drop what has been handled before taking more */
+    if (client->in_start > 0) {
+        memmove(client->in, client->in + client->in_start, client->in_length - client->in_start);
+        client->in_length -= client->in_start;
+        client->in_start = 0;
+    }
+    while (taken < DAEMON_READ_CHUNK) {
+        ssize_t n;
+
+        if (!buffer_grow(&client->in, &client->in_capacity, client->in_length + 64 * 1024)) {
+            client->closed = 1;
+            return;
+        }
+        n = read(client->fd, client->in + client->in_length, client->in_capacity - client->in_length);
+        if (n > 0) {
+            client->in_length += (size_t)n;
+            taken += (size_t)n;
+        } else if (n == 0) {
+            client->closed = 1;
+            return;
+        } else if (errno != EINTR) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                client->closed = 1;
+            }
+            return;
+        }
+    }
+}
+
+static void write_client(DaemonClient *client) {
+    while (client->out_sent < client->out_length) {
+        ssize_t n = write(client->fd, client->out + client->out_sent,
+                          client->out_length - client->out_sent);
+
+        if (n > 0) {
+            client->out_sent += (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                client->closed = 1;
+            }
+            return;
+        }
+    }
+    client->out_sent = 0;
+    client->out_length = 0;
+}
+
+static void drop_closed(OrderDaemon *daemon) {
+    size_t i = 0;
+
+    while (i < daemon->client_count) {
+        DaemonClient *client = &daemon->clients[i];
+
+        if (!client->closed) {
+            i++;
+            continue;
+        }
+        close(client->fd);
+        free(client->in);
+        free(client->out);
+        *client = daemon->clients[--daemon->client_count];
+    }
+}
+
+static int has_requests(const DaemonClient *client) {
+    const unsigned char *p = client->in + client->in_start;
+
+    return client->in_length - client->in_start >= ORDER_FRAME_HEADER_SIZE &&
+           client->in_length - client->in_start >= ORDER_FRAME_HEADER_SIZE + (size_t)order_get_u32(p) &&
+           client->out_length - client->out_sent < DAEMON_OUT_LIMIT;
+}
+
+static int listen_on(const char *path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    /* A socket nobody answers on is left over from a daemon that died */
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        close(fd);
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0 ||
+        !set_nonblocking(fd)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int order_daemon_run(const char *path, volatile sig_atomic_t *stop) {
+    static struct pollfd fds[ORDER_DAEMON_MAX_CLIENTS + 1];
+    OrderDaemon *daemon = &daemon_state;
+    OrderAppendConfig config;
+    OrderStore store;
+    int busy = 0, ok;
+    size_t i;
+
+    memset(daemon, 0, sizeof(OrderDaemon));
+
+    /* Create or upgrade the store before anyone can ask for it */
+    if (!open_transactions(&store)) {
+        return 0;
+    }
+    order_store_close(&store);
+
+    memset(&config, 0, sizeof(config));
+    config.batch_orders = ORDER_DAEMON_GROUP_MAX;
+    config.on_durable = daemon_appended;
+    config.ctx = daemon;
+    if (!order_appender_open(&daemon->appender, TRANSACTIONS_FILE, TRANSACTIONS_WAL_FILE, &config)) {
+        return 0;
+    }
+    daemon->listen_fd = listen_on(path);
+    if (daemon->listen_fd < 0) {
+        order_appender_close(&daemon->appender);
+        return 0;
+    }
+    /* A client that goes away mid-reply must not take the daemon with it */
+    signal(SIGPIPE, SIG_IGN);
+
+    while (!*stop) {
+        fds[0].fd = daemon->listen_fd;
+        fds[0].events = daemon->client_count < ORDER_DAEMON_MAX_CLIENTS ? POLLIN : 0;
+        for (i = 0; i < daemon->client_count; i++) {
+            const DaemonClient *client = &daemon->clients[i];
+
+            fds[i + 1].fd = client->fd;
+            fds[i + 1].events = (short)(POLLIN | (client->out_sent < client->out_length ? POLLOUT : 0));
+            fds[i + 1].revents = 0;
+        }
+        /* Requests already buffered are served without waiting; otherwise look at `stop` now and then */
+        if (poll(fds, daemon->client_count + 1, busy ? 0 : 500) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        for (i = 0; i < daemon->client_count; i++) {
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                read_client(&daemon->clients[i]);
+            }
+        }
+        for (i = 0; i < daemon->client_count; i++) {
+            handle_client(daemon, i);
+        }
+        commit_appends(daemon);
+
+        busy = 0;
+        for (i = 0; i < daemon->client_count; i++) {
+            write_client(&daemon->clients[i]);
+            busy |= !daemon->clients[i].closed && has_requests(&daemon->clients[i]);
+        }
+        drop_closed(daemon);
+        if (fds[0].revents & POLLIN) {
+            accept_clients(daemon);
+        }
+    }
+
+    for (i = 0; i < daemon->client_count; i++) {
+        daemon->clients[i].closed = 1;
+    }
+    drop_closed(daemon);
+    close(daemon->listen_fd);
+    unlink(path);
+    daemon_close_views(daemon);
+    ok = order_appender_close(&daemon->appender);
+    return ok;
+}
@@ -0,0 +1,20 @@
+#ifndef ORDER_DAEMON_H
+#define ORDER_DAEMON_H
+
+#include <signal.h>
+#include "order_protocol.h"
+
+// Connections served at once; more wait in the listen queue
+#define ORDER_DAEMON_MAX_CLIENTS 64
+
+// Most orders in one group commit, gathered from every connection
+#define ORDER_DAEMON_GROUP_MAX 65536
+
+// Own the store in the current directory and serve it on the Unix socket
+// at `path` until `*stop` is set, from a signal handler say.  Appends from
+// every connection that arrive together share one group commit; listings
+// and queries are answered from views kept in memory and reloaded only
+// after the store has changed.
+int order_daemon_run(const char *path, volatile sig_atomic_t *stop);
+
+#endif // ORDER_DAEMON_H
@@ -0,0 +1,300 @@
+#include <stdlib.h>
+#include <string.h>
+#include "order_fills.h"
+
+#define TRANSACTIONS_FILLS_TEMP_FILE "transactions.fil.tmp"
+#define TRANSACTIONS_FILLED_TEMP_FILE "transactions.fld.tmp"
+
+#define FILLED_ENTRY_SIZE 16
+
+/* Fills converted per chunk when upgrading an old log */
+#define FILL_CONVERT_CHUNK 1024
+
+#define FILL_OFFSET(n) ((long)ORDER_FILLS_HEADER_SIZE + (long)(n) * ORDER_FILL_SIZE)
+
+/* ---- Encoding ---- */
+
+static uint32_t load_le32(const unsigned char *p) {
+    return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+static uint64_t load_le64(const unsigned char *p) {
+    return ((uint64_t)load_le32(p + 4) << 32) | load_le32(p);
+}
+
+static void store_le32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static void store_le64(unsigned char *p, uint64_t v) {
+    store_le32(p, (uint32_t)v);
+    store_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+static void header_encode(unsigned char *out) {
+    memset(out, 0, ORDER_FILLS_HEADER_SIZE);
+    memcpy(out, ORDER_FILLS_MAGIC, 4);
+    out[4] = ORDER_FILLS_VERSION & 0xFF;
+    out[5] = ORDER_FILLS_VERSION >> 8;
+    out[6] = ORDER_FILLS_HEADER_SIZE & 0xFF;
+    out[7] = ORDER_FILLS_HEADER_SIZE >> 8;
+    store_le32(out + 8, ORDER_FILL_SIZE);
+}
+
+static void filled_header_encode(unsigned char *out, size_t entries, uint64_t fills) {
+    memset(out, 0, ORDER_FILLED_HEADER_SIZE);
+    memcpy(out, ORDER_FILLED_MAGIC, 4);
+    out[4] = ORDER_FILLED_VERSION & 0xFF;
+    out[5] = ORDER_FILLED_VERSION >> 8;
+    out[6] = ORDER_FILLED_HEADER_SIZE & 0xFF;
+    out[7] = ORDER_FILLED_HEADER_SIZE >> 8;
+    store_le32(out + 8, (uint32_t)entries);
+    store_le64(out + 16, fills);
+}
+
+static void fill_encode(unsigned char *out, const OrderFill *fill) {
+    store_le64(out, fill->buy_record);
+    store_le64(out + 8, fill->sell_record);
+    store_le32(out + 16, fill->price_cents);
+    store_le32(out + 20, fill->quantity);
+    store_le64(out + 24, (uint64_t)fill->timestamp);
+}
+
+static void fill_decode(OrderFill *fill, const unsigned char *in) {
+    fill->buy_record = load_le64(in);
+    fill->sell_record = load_le64(in + 8);
+    fill->price_cents = load_le32(in + 16);
+    fill->quantity = load_le32(in + 20);
+    fill->timestamp = (int64_t)load_le64(in + 24);
+}
+
+/* ---- Files ---- */
+
+static long file_size(FILE *fp) {
+    long size;
+
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        return -1;
+    }
+    return size;
+}
+
+/* Logs from before the header are the raw host-order structs, back to back */
+static int convert_legacy(FILE *fp) {
+    OrderFill chunk[FILL_CONVERT_CHUNK];
+    unsigned char *encoded, header[ORDER_FILLS_HEADER_SIZE];
+    size_t got, i;
+    FILE *out;
+    int ok;
+
+    encoded = (unsigned char *)malloc(FILL_CONVERT_CHUNK * ORDER_FILL_SIZE);
+    out = fopen(TRANSACTIONS_FILLS_TEMP_FILE, "wb");
+    if (encoded == NULL || out == NULL) {
+        free(encoded);
+        if (out != NULL) {
+            fclose(out);
+        }
+        return 0;
+    }
+    header_encode(header);
+    ok = fseek(fp, 0, SEEK_SET) == 0 && fwrite(header, sizeof(header), 1, out) == 1;
+    while (ok && (got = fread(chunk, sizeof(OrderFill), FILL_CONVERT_CHUNK, fp)) > 0) {
+        for (i = 0; i < got; i++) {
+            fill_encode(encoded + i * ORDER_FILL_SIZE, &chunk[i]);
+        }
+        ok = fwrite(encoded, ORDER_FILL_SIZE, got, out) == got;
+    }
+    ok = ok && !ferror(fp);
+    free(encoded);
+    if (fclose(out) != 0 || !ok || rename(TRANSACTIONS_FILLS_TEMP_FILE, TRANSACTIONS_FILLS_FILE) != 0) {
+        remove(TRANSACTIONS_FILLS_TEMP_FILE);
+        return 0;
+    }
+    return 1;
+}
+
+/* The log, checked and converted if need be, with its whole fills counted;
+   NULL with *count 0 when there is none */
+static FILE *fills_open(const char *mode, uint64_t *count, int *ok) {
+    unsigned char header[ORDER_FILLS_HEADER_SIZE], expected[ORDER_FILLS_HEADER_SIZE];
+    long size;
+    FILE *fp;
+
+    *count = 0;
+    *ok = 1;
+    fp = fopen(TRANSACTIONS_FILLS_FILE, mode);
+    if (fp == NULL) {
+        return NULL;  /* No fills yet */
+    }
+    size = file_size(fp);
+    if (size <= 0) {
+        *ok = size == 0;
+        fclose(fp);
+        return NULL;
+    }
+
+    header_encode(expected);
+    if ((size_t)size < sizeof(header) || fread(header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header, ORDER_FILLS_MAGIC, 4) != 0) {
+        /* Written before the header: convert once, then open the result */
+        *ok = size % (long)sizeof(OrderFill) == 0 && convert_legacy(fp);
+        fclose(fp);
+        return *ok ? fills_open(mode, count, ok) : NULL;
+    }
+    if (memcmp(header, expected, sizeof(header)) != 0) {
+        *ok = 0;  /* A version we don't understand */
+        fclose(fp);
+        return NULL;
+    }
+    *count = (uint64_t)(size - ORDER_FILLS_HEADER_SIZE) / ORDER_FILL_SIZE;
+    return fp;
+}
+
+int order_fill_reader_open(OrderFillReader *reader, uint64_t first) {
+    int ok;
+
+    memset(reader, 0, sizeof(OrderFillReader));
+    reader->fp = fills_open("rb", &reader->count, &ok);
+    if (reader->fp == NULL) {
+        return ok;
+    }
+    reader->next = first < reader->count ? first : reader->count;
+    if (fseek(reader->fp, FILL_OFFSET(reader->next), SEEK_SET) != 0) {
+        order_fill_reader_close(reader);
+        return 0;
+    }
+    return 1;
+}
+
+size_t order_fill_reader_next(OrderFillReader *reader, OrderFill *fills, size_t max) {
+    unsigned char encoded[ORDER_FILL_SIZE];
+    size_t got = 0;
+
+    /* Only the fills counted when opened: one torn at the end is never read */
+    while (reader->fp != NULL && got < max && reader->next < reader->count &&
+           fread(encoded, sizeof(encoded), 1, reader->fp) == 1) {
+        fill_decode(&fills[got++], encoded);
+        reader->next++;
+    }
+    return got;
+}
+
+void order_fill_reader_close(OrderFillReader *reader) {
+    if (reader->fp != NULL) {
+        fclose(reader->fp);
+    }
+    memset(reader, 0, sizeof(OrderFillReader));
+}
+
+int order_fills_append(const OrderFill *fills, size_t count) {
+    unsigned char encoded[ORDER_FILL_SIZE];
+    uint64_t whole;
+    size_t i;
+    FILE *fp;
+    int ok;
+
+    if (count == 0) {
+        return 1;
+    }
+    fp = fills_open("r+b", &whole, &ok);
+    if (fp == NULL) {
+        unsigned char header[ORDER_FILLS_HEADER_SIZE];
+
+        if (!ok) {
+            return 0;
+        }
+        fp = fopen(TRANSACTIONS_FILLS_FILE, "wb");
+        if (fp == NULL) {
+            return 0;
+        }
+        header_encode(header);
+        ok = fwrite(header, sizeof(header), 1, fp) == 1;
+    }
+
+    /* Over any fill torn by a crash */
+    ok = ok && fseek(fp, FILL_OFFSET(whole), SEEK_SET) == 0;
+    for (i = 0; ok && i < count; i++) {
+        fill_encode(encoded, &fills[i]);
+        ok = fwrite(encoded, sizeof(encoded), 1, fp) == 1;
+    }
+    return fclose(fp) == 0 && ok;
+}
+
+/* ---- Checkpoint ---- */
+
+int order_filled_load(OrderFilled **entries, size_t *count, uint64_t *fills) {
+    unsigned char header[ORDER_FILLED_HEADER_SIZE], expected[ORDER_FILLED_HEADER_SIZE];
+    unsigned char encoded[FILLED_ENTRY_SIZE];
+    size_t n, i;
+    FILE *fp;
+    int ok;
+
+    *entries = NULL;
+    *count = 0;
+    *fills = 0;
+    fp = fopen(TRANSACTIONS_FILLED_FILE, "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+    if (fread(header, sizeof(header), 1, fp) != 1) {
+        fclose(fp);
+        return 0;
+    }
+    /* Everything but the counts must be what this version writes */
+    n = load_le32(header + 8);
+    filled_header_encode(expected, n, load_le64(header + 16));
+    if (memcmp(header, expected, sizeof(header)) != 0) {
+        fclose(fp);
+        return 0;
+    }
+
+    *entries = (OrderFilled *)malloc((n + 1) * sizeof(OrderFilled));
+    ok = *entries != NULL;
+    for (i = 0; ok && i < n; i++) {
+        ok = fread(encoded, sizeof(encoded), 1, fp) == 1;
+        if (ok) {
+            (*entries)[i].record = load_le64(encoded);
+            (*entries)[i].filled = load_le32(encoded + 8);
+        }
+    }
+    fclose(fp);
+    if (!ok) {
+        free(*entries);
+        *entries = NULL;
+        return 0;
+    }
+    *count = n;
+    *fills = load_le64(header + 16);
+    return 1;
+}
+
+int order_filled_save(const OrderFilled *entries, size_t count, uint64_t fills) {
+    unsigned char header[ORDER_FILLED_HEADER_SIZE], encoded[FILLED_ENTRY_SIZE];
+    size_t i;
+    FILE *fp;
+    int ok;
+
+    if (count > UINT32_MAX) {
+        return 0;
+    }
+    fp = fopen(TRANSACTIONS_FILLED_TEMP_FILE, "wb");
+    if (fp == NULL) {
+        return 0;
+    }
+    filled_header_encode(header, count, fills);
+    ok = fwrite(header, sizeof(header), 1, fp) == 1;
+    memset(encoded, 0, sizeof(encoded));
+    for (i = 0; ok && i < count; i++) {
+        store_le64(encoded, entries[i].record);
+        store_le32(encoded + 8, entries[i].filled);
+        ok = fwrite(encoded, sizeof(encoded), 1, fp) == 1;
+    }
+    if (fclose(fp) != 0 || !ok || rename(TRANSACTIONS_FILLED_TEMP_FILE, TRANSACTIONS_FILLED_FILE) != 0) {
+        remove(TRANSACTIONS_FILLED_TEMP_FILE);
+        return 0;
+    }
+    return 1;
+}
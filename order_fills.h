@@ -0,0 +1,76 @@
+#ifndef ORDER_FILLS_H
+#define ORDER_FILLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "order_book.h"
+
+// Sidecar file: every fill ever made, in the order they were made
+#define TRANSACTIONS_FILLS_FILE "transactions.fil"
+
+#define ORDER_FILLS_MAGIC "STKF"
+#define ORDER_FILLS_VERSION 1
+#define ORDER_FILLS_HEADER_SIZE 16
+
+// Bytes per fill on disk: buy_record, sell_record, price_cents, quantity,
+// timestamp, little-endian and back to back
+#define ORDER_FILL_SIZE 32
+
+// File header, little-endian on disk; fills follow it.  A torn fill at
+// the end is ignored.
+typedef struct {
+    char magic[4];                  // ORDER_FILLS_MAGIC
+    uint16_t version;               // ORDER_FILLS_VERSION
+    uint16_t header_size;           // ORDER_FILLS_HEADER_SIZE
+    uint32_t fill_size;             // ORDER_FILL_SIZE
+    uint32_t reserved;
+} OrderFillsHeader;
+
+// Checkpoint file: how much of each pending order was filled, as of some
+// number of fills, so matching reads only the fills made since
+#define TRANSACTIONS_FILLED_FILE "transactions.fld"
+
+#define ORDER_FILLED_MAGIC "STKD"
+#define ORDER_FILLED_VERSION 1
+#define ORDER_FILLED_HEADER_SIZE 24
+
+// Checkpoint header, little-endian on disk, followed by one 16-byte entry
+// (record, filled, 0) per order
+typedef struct {
+    char magic[4];                  // ORDER_FILLED_MAGIC
+    uint16_t version;               // ORDER_FILLED_VERSION
+    uint16_t header_size;           // ORDER_FILLED_HEADER_SIZE
+    uint32_t entries;
+    uint32_t reserved;
+    uint64_t fills;                 // Fills already counted
+} OrderFilledHeader;
+
+typedef struct {
+    uint64_t record;
+    uint32_t filled;                // Shares
+} OrderFilled;
+
+// Forward-only reader over the fills, from any fill on
+typedef struct {
+    FILE *fp;                       // NULL when there are no fills yet
+    uint64_t count;                 // Whole fills in the log when opened
+    uint64_t next;                  // Number of the next fill returned
+} OrderFillReader;
+
+// Start reading at fill `first` (clamped to the end).  Fails if the log is
+// from a newer version.  Callers hold the matcher lock: a log written by an
+// older version (raw host-order fills, no header) is converted on first use.
+int order_fill_reader_open(OrderFillReader *reader, uint64_t first);
+size_t order_fill_reader_next(OrderFillReader *reader, OrderFill *fills, size_t max);
+void order_fill_reader_close(OrderFillReader *reader);
+
+// Add fills to the end of the log; the caller holds the matcher lock
+int order_fills_append(const OrderFill *fills, size_t count);
+
+// The checkpoint, or 0 if it is missing, torn or from another version.
+// `*entries` is malloc()ed.
+int order_filled_load(OrderFilled **entries, size_t *count, uint64_t *fills);
+int order_filled_save(const OrderFilled *entries, size_t count, uint64_t fills);
+
+#endif // ORDER_FILLS_H
@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "order_filter.h"
+#include "order_format.h"
+#include "order_lock.h"
+#include "order_parse.h"
+#include "order_stats.h"
+
+#define BLOCKS_MAGIC 0x424C4B31UL  /* "BLK1" */
+#define SECONDS_PER_DAY 86400
+
+#define BLOCK_OFFSET(block) ((long)sizeof(OrderBlocksHeader) + (long)((block) * sizeof(OrderBlockSummary)))
+#define BLOOM_BITS (ORDER_FILTER_BLOOM_BYTES * 8)
+
+/* Keys are tagged so a ticker never collides with an account */
+#define KEY_TICKER 'T'
+#define KEY_ACCOUNT 'A'
+
+/* ---- Filters ---- */
+
+void order_filter_init(OrderFilter *filter) {
+    memset(filter, 0, sizeof(OrderFilter));
+}
+
+int order_filter_is_empty(const OrderFilter *filter) {
+    return filter->ticker[0] == '\0' && filter->broker_id[0] == '\0' && filter->account == 0 &&
+           filter->from == 0 && filter->to == 0;
+}
+
+/* Local midnight starting the day YYYY-MM-DD */
+static int parse_day(const char *text, size_t length, int64_t *timestamp) {
+    struct tm day;
+    int year, month, mday;
+    char end;
+    char copy[16];
+    time_t t;
+
+    if (length >= sizeof(copy)) {
+        return 0;
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    if (sscanf(copy, "%4d-%2d-%2d%c", &year, &month, &mday, &end) != 3 ||
+        month < 1 || month > 12 || mday < 1 || mday > 31) {
+        return 0;
+    }
+    memset(&day, 0, sizeof(day));
+    day.tm_year = year - 1900;
+    day.tm_mon = month - 1;
+    day.tm_mday = mday;
+    day.tm_isdst = -1;
+    t = mktime(&day);
+    if (t == (time_t)-1) {
+        return 0;
+    }
+    *timestamp = (int64_t)t;
+    return 1;
+}
+
+static int parse_term(OrderFilter *filter, const char *key, size_t key_length,
+                      const char *value, size_t length, int64_t now) {
+    unsigned long days = 0;
+    size_t i;
+
+#define IS_KEY(name) (key_length == sizeof(name) - 1 && strncmp(key, name, key_length) == 0)
+    if (IS_KEY("ticker")) {
+        return order_parse_ticker(value, length, filter->ticker);
+    }
+    if (IS_KEY("account")) {
+        return order_parse_account(value, length, &filter->account);
+    }
+    if (IS_KEY("broker")) {
+        return order_parse_broker(value, length, filter->broker_id);
+    }
+    if (IS_KEY("from")) {
+        return parse_day(value, length, &filter->from);
+    }
+    if (IS_KEY("to")) {
+        /* The whole of that day */
+        if (!parse_day(value, length, &filter->to)) {
+            return 0;
+        }
+        filter->to += SECONDS_PER_DAY - 1;
+        return 1;
+    }
+    if (IS_KEY("days")) {
+        if (length == 0 || length > 5) {
+            return 0;
+        }
+        for (i = 0; i < length; i++) {
+            if (value[i] < '0' || value[i] > '9') {
+                return 0;
+            }
+            days = days * 10 + (unsigned long)(value[i] - '0');
+        }
+        filter->from = now - (int64_t)days * SECONDS_PER_DAY;
+        filter->to = now;
+        return days > 0;
+    }
+#undef IS_KEY
+    return 0;
+}
+
+int order_filter_parse(OrderFilter *filter, const char *text, int64_t now) {
+    order_filter_init(filter);
+
+    while (*text != '\0') {
+        const char *key, *equals;
+        size_t length;
+
+        while (*text == ' ' || *text == '\t' || *text == '\n') {
+            text++;
+        }
+        if (*text == '\0') {
+            break;
+        }
+        key = text;
+        length = strcspn(text, " \t\n");
+        text += length;
+
+        equals = (const char *)memchr(key, '=', length);
+        if (equals == NULL ||
+            !parse_term(filter, key, (size_t)(equals - key), equals + 1,
+                        length - (size_t)(equals - key) - 1, now)) {
+            order_filter_init(filter);
+            return 0;
+        }
+    }
+    return filter->to == 0 || filter->from <= filter->to;
+}
+
+int order_filter_match(const OrderFilter *filter, const StockOrder *order) {
+    if (filter->account != 0 && order->customer_account_no != filter->account) {
+        return 0;
+    }
+    if (filter->ticker[0] != '\0' && strncmp(order->ticker, filter->ticker, sizeof(order->ticker)) != 0) {
+        return 0;
+    }
+    if (filter->broker_id[0] != '\0' &&
+        strncmp(order->broker_id, filter->broker_id, sizeof(order->broker_id)) != 0) {
+        return 0;
+    }
+    if (order->timestamp < filter->from || (filter->to != 0 && order->timestamp > filter->to)) {
+        return 0;
+    }
+    return 1;
+}
+
+/* ---- Bloom filters ---- */
+
+/* FNV-1a over the tag and key; both halves drive the probes */
+static uint64_t bloom_hash(int tag, const void *key, size_t length) {
+    const unsigned char *p = (const unsigned char *)key;
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i;
+
+    hash ^= (unsigned char)tag;
+    hash *= 1099511628211ULL;
+    for (i = 0; i < length; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void bloom_add(uint8_t *bloom, uint64_t hash) {
+    uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+    int i;
+
+    for (i = 0; i < ORDER_FILTER_BLOOM_HASHES; i++) {
+        uint32_t bit = (h1 + (uint32_t)i * h2) % BLOOM_BITS;
+
+        bloom[bit / 8] |= (uint8_t)(1U << (bit % 8));
+    }
+}
+
+static int bloom_test(const uint8_t *bloom, uint64_t hash) {
+    uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+    int i;
+
+    for (i = 0; i < ORDER_FILTER_BLOOM_HASHES; i++) {
+        uint32_t bit = (h1 + (uint32_t)i * h2) % BLOOM_BITS;
+
+        if (!(bloom[bit / 8] & (1U << (bit % 8)))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static uint64_t ticker_hash(const char *ticker) {
+    char key[8];
+    size_t i;
+
+    /* Whatever follows the NUL is not part of the ticker */
+    memset(key, 0, sizeof(key));
+    for (i = 0; i < sizeof(key) && ticker[i] != '\0'; i++) {
+        key[i] = ticker[i];
+    }
+    return bloom_hash(KEY_TICKER, key, sizeof(key));
+}
+
+static uint64_t account_hash(uint32_t account) {
+    unsigned char key[4];
+
+    key[0] = (unsigned char)account;
+    key[1] = (unsigned char)(account >> 8);
+    key[2] = (unsigned char)(account >> 16);
+    key[3] = (unsigned char)(account >> 24);
+    return bloom_hash(KEY_ACCOUNT, key, sizeof(key));
+}
+
+/* ---- Summaries ---- */
+
+static void summary_init(OrderBlockSummary *summary) {
+    memset(summary, 0, sizeof(OrderBlockSummary));
+    summary->min_timestamp = INT64_MAX;
+    summary->max_timestamp = INT64_MIN;
+    summary->min_account = UINT32_MAX;
+    summary->max_account = 0;
+}
+
+static void summary_add(OrderBlockSummary *summary, const StockOrder *order) {
+    if (order->timestamp < summary->min_timestamp) {
+        summary->min_timestamp = order->timestamp;
+    }
+    if (order->timestamp > summary->max_timestamp) {
+        summary->max_timestamp = order->timestamp;
+    }
+    if (order->customer_account_no < summary->min_account) {
+        summary->min_account = order->customer_account_no;
+    }
+    if (order->customer_account_no > summary->max_account) {
+        summary->max_account = order->customer_account_no;
+    }
+    bloom_add(summary->bloom, ticker_hash(order->ticker));
+    bloom_add(summary->bloom, account_hash(order->customer_account_no));
+}
+
+/* Could any record of the block match?  Broker is left to the records themselves. */
+static int summary_may_match(const OrderBlockSummary *summary, const OrderFilter *filter,
+                             uint64_t ticker, uint64_t account) {
+    if (summary->max_timestamp < filter->from ||
+        (filter->to != 0 && summary->min_timestamp > filter->to)) {
+        return 0;
+    }
+    if (filter->account != 0 &&
+        (filter->account < summary->min_account || filter->account > summary->max_account ||
+         !bloom_test(summary->bloom, account))) {
+        return 0;
+    }
+    return filter->ticker[0] == '\0' || bloom_test(summary->bloom, ticker);
+}
+
+static FILE *blocks_file_open(OrderBlocksHeader *header) {
+    FILE *fp = fopen(TRANSACTIONS_BLOCKS_FILE, "r+b");
+
+    if (fp != NULL) {
+        if (fread(header, sizeof(OrderBlocksHeader), 1, fp) == 1 && header->magic == BLOCKS_MAGIC) {
+            return fp;
+        }
+        fclose(fp);
+    }
+
+    /* Missing or unrecognised: start with no summaries */
+    fp = fopen(TRANSACTIONS_BLOCKS_FILE, "w+b");
+    if (fp == NULL) {
+        return NULL;
+    }
+    memset(header, 0, sizeof(OrderBlocksHeader));
+    header->magic = BLOCKS_MAGIC;
+    if (fwrite(header, sizeof(OrderBlocksHeader), 1, fp) != 1) {
+        fclose(fp);
+        return NULL;
+    }
+    return fp;
+}
+
+/* Summarise records [first, first + count), picking up a part-filled last block */
+static int blocks_extend(FILE *fp, OrderBlocksHeader *header, size_t first,
+                         const StockOrder *orders, size_t count) {
+    OrderBlockSummary summary;
+    size_t i = 0;
+    int ok = 1;
+
+    while (ok && i < count) {
+        size_t record = first + i;
+        size_t block = record / ORDER_FILTER_BLOCK;
+        size_t n = ORDER_FILTER_BLOCK - record % ORDER_FILTER_BLOCK;
+
+        if (n > count - i) {
+            n = count - i;
+        }
+        summary_init(&summary);
+        if (record % ORDER_FILTER_BLOCK != 0) {
+            ok = fseek(fp, BLOCK_OFFSET(block), SEEK_SET) == 0 &&
+                 fread(&summary, sizeof(summary), 1, fp) == 1;
+        }
+        for (; ok && n > 0; n--, i++) {
+            summary_add(&summary, &orders[i]);
+        }
+        ok = ok && fseek(fp, BLOCK_OFFSET(block), SEEK_SET) == 0 &&
+             fwrite(&summary, sizeof(summary), 1, fp) == 1;
+    }
+
+    /* Publish the new length only after the summaries cover it */
+    if (ok) {
+        header->records = (uint64_t)(first + count);
+        ok = fseek(fp, 0, SEEK_SET) == 0 &&
+             fwrite(header, sizeof(OrderBlocksHeader), 1, fp) == 1;
+    }
+    return ok;
+}
+
+int order_blocks_append(size_t first_record, const StockOrder *orders, size_t count) {
+    OrderBlocksHeader header;
+    size_t skip;
+    FILE *fp;
+    int ok;
+
+    fp = blocks_file_open(&header);
+    if (fp == NULL) {
+        return 0;
+    }
+
+    /* Records must be summarised in file order; a gap is filled on the next open */
+    if (header.records < first_record || header.records >= first_record + count) {
+        fclose(fp);
+        return 1;
+    }
+    skip = (size_t)header.records - first_record;
+
+    ok = blocks_extend(fp, &header, first_record + skip, orders + skip, count - skip);
+    return fclose(fp) == 0 && ok;
+}
+
+/* Bring the summaries up to date with everything in the store */
+static int blocks_catch_up(const OrderStore *store) {
+    OrderBlocksHeader header;
+    FILE *fp;
+    int ok = 1;
+
+    fp = blocks_file_open(&header);
+    if (fp == NULL) {
+        return 0;
+    }
+    /* Ahead of our snapshot is fine; ahead of the file means it was replaced */
+    if (header.records > store->count && header.records > order_file_records(TRANSACTIONS_FILE)) {
+        fclose(fp);
+        remove(TRANSACTIONS_BLOCKS_FILE);
+        fp = blocks_file_open(&header);
+        if (fp == NULL) {
+            return 0;
+        }
+    }
+    if (header.records < store->count) {
+        ok = blocks_extend(fp, &header, (size_t)header.records,
+                           store->records + header.records,
+                           store->count - (size_t)header.records);
+    }
+    return fclose(fp) == 0 && ok;
+}
+
+int order_blocks_open(OrderBlocks *blocks, const OrderStore *store) {
+    const OrderBlocksHeader *header;
+    int ok;
+
+    memset(blocks, 0, sizeof(OrderBlocks));
+
+    if (!order_lock_writer()) {
+        return 0;
+    }
+    ok = blocks_catch_up(store);
+    order_unlock_writer();
+    if (!ok || !mapped_file_open(&blocks->file, TRANSACTIONS_BLOCKS_FILE)) {
+        return 0;
+    }
+    header = (const OrderBlocksHeader *)blocks->file.base;
+    blocks->blocks = (const OrderBlockSummary *)(header + 1);
+    blocks->records = (size_t)header->records;
+    if (blocks->records > store->count) {
+        blocks->records = store->count;
+    }
+    /* Only whole summaries count, however the file was cut short */
+    if (blocks->file.length < sizeof(OrderBlocksHeader) +
+            (blocks->records + ORDER_FILTER_BLOCK - 1) / ORDER_FILTER_BLOCK * sizeof(OrderBlockSummary)) {
+        blocks->records = 0;
+    }
+    return 1;
+}
+
+void order_blocks_close(OrderBlocks *blocks) {
+    mapped_file_close(&blocks->file);
+    memset(blocks, 0, sizeof(OrderBlocks));
+}
+
+int order_filter_scan(const OrderFilter *filter, const OrderBlocks *blocks,
+                      const OrderStore *store, OrderView *view, size_t *scanned) {
+    uint64_t start = order_stats_clock();
+    uint64_t ticker = ticker_hash(filter->ticker);
+    uint64_t account = account_hash(filter->account);
+    size_t record = 0, read = 0, examined = 0;
+    int ok = 1;
+
+    while (ok && record < store->count) {
+        size_t block = record / ORDER_FILTER_BLOCK;
+        size_t end = record + ORDER_FILTER_BLOCK;
+
+        if (end > store->count) {
+            end = store->count;
+        }
+        /* Records past the summaries are read whatever they hold */
+        if (end <= blocks->records &&
+            !summary_may_match(&blocks->blocks[block], filter, ticker, account)) {
+            record = end;
+            continue;
+        }
+        read++;
+        examined += end - record;
+        for (; ok && record < end; record++) {
+            if (order_filter_match(filter, &store->records[record])) {
+                ok = order_view_push(view, &store->records[record]);
+            }
+        }
+    }
+    if (scanned != NULL) {
+        *scanned = read;
+    }
+    order_stats_record(ORDER_STAT_FILTER, start, (uint64_t)examined * sizeof(StockOrder), 0);
+    return ok;
+}
@@ -0,0 +1,69 @@
+#ifndef ORDER_FILTER_H
+#define ORDER_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "order_store.h"
+
+// Sidecar file: a summary of every block of records, to skip blocks a filter can't match
+#define TRANSACTIONS_BLOCKS_FILE "transactions.blk"
+
+// Records per summarised block
+#define ORDER_FILTER_BLOCK 256
+
+// Bloom filter over each block's tickers and accounts
+#define ORDER_FILTER_BLOOM_BYTES 256
+#define ORDER_FILTER_BLOOM_HASHES 4
+
+// Header at the start of the blocks file
+typedef struct {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t records;               // Records covered by the summaries
+} OrderBlocksHeader;
+
+// One block's summary; may cover more than the block holds after a crash, never less
+typedef struct {
+    int64_t min_timestamp;
+    int64_t max_timestamp;
+    uint32_t min_account;
+    uint32_t max_account;
+    uint8_t bloom[ORDER_FILTER_BLOOM_BYTES];
+} OrderBlockSummary;
+
+// Summaries of every block, mapped
+typedef struct {
+    MappedFile file;
+    const OrderBlockSummary *blocks;
+    size_t records;                 // Records covered; any after these are scanned
+} OrderBlocks;
+
+// What a query asks for; empty and zero fields match anything
+typedef struct {
+    char ticker[8];
+    char broker_id[16];
+    uint32_t account;
+    int64_t from;                   // Timestamps [from, to]; to == 0 is open-ended
+    int64_t to;
+} OrderFilter;
+
+// Filters.  Text is space-separated terms: ticker=GE account=345678
+// broker=JDS from=YYYY-MM-DD to=YYYY-MM-DD (local days, inclusive) and
+// days=N (the last N days before `now`).
+void order_filter_init(OrderFilter *filter);
+int order_filter_parse(OrderFilter *filter, const char *text, int64_t now);
+int order_filter_is_empty(const OrderFilter *filter);
+int order_filter_match(const OrderFilter *filter, const StockOrder *order);
+
+// Block summaries, brought up to date with the store
+int order_blocks_open(OrderBlocks *blocks, const OrderStore *store);
+void order_blocks_close(OrderBlocks *blocks);
+int order_blocks_append(size_t first_record, const StockOrder *orders, size_t count);
+
+// Push every record of the store the filter matches onto `view`, in file
+// order, reading only blocks whose summary allows a match.  `scanned`
+// (may be NULL) is set to the blocks read.
+int order_filter_scan(const OrderFilter *filter, const OrderBlocks *blocks,
+                      const OrderStore *store, OrderView *view, size_t *scanned);
+
+#endif // ORDER_FILTER_H
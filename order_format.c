@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "order_format.h"
+#include "order_segment.h"
+
+/* Legacy records converted per read/write while upgrading */
+#define CONVERT_CHUNK 1024
+
+/* Largest legacy record, and how many are sampled to identify a layout */
+#define LEGACY_MAX_RECORD 64
+#define LEGACY_SAMPLE 16
+
+#ifdef ORDER_HOST_BIG_ENDIAN
+static uint16_t swap16(uint16_t v) {
+    return (uint16_t)((v >> 8) | (v << 8));
+}
+
+static uint32_t swap32(uint32_t v) {
+    return (v >> 24) | ((v >> 8) & 0x0000FF00UL) | ((v << 8) & 0x00FF0000UL) | (v << 24);
+}
+
+static uint64_t swap64(uint64_t v) {
+    return ((uint64_t)swap32((uint32_t)v) << 32) | swap32((uint32_t)(v >> 32));
+}
+#endif
+
+static uint32_t load_be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t load_le32(const unsigned char *p) {
+    return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+static uint64_t load_be64(const unsigned char *p) {
+    return ((uint64_t)load_be32(p) << 32) | load_be32(p + 4);
+}
+
+static uint64_t load_le64(const unsigned char *p) {
+    return ((uint64_t)load_le32(p + 4) << 32) | load_le32(p);
+}
+
+static double bits_to_double(uint64_t bits) {
+    double value;
+
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void order_file_header_init(OrderFileHeader *header) {
+    memset(header, 0, sizeof(OrderFileHeader));
+    memcpy(header->magic, ORDER_FILE_MAGIC, 4);
+    header->version = ORDER_FILE_VERSION;
+    header->header_size = ORDER_FILE_HEADER_SIZE;
+    header->record_size = (uint32_t)sizeof(StockOrder);
+    header->flags = ORDER_FILE_FLAG_COMMITTED;
+#ifdef ORDER_HOST_BIG_ENDIAN
+    header->version = swap16(header->version);
+    header->header_size = swap16(header->header_size);
+    header->record_size = swap32(header->record_size);
+    header->flags = swap32(header->flags);
+#endif
+}
+
+static int header_matches(const void *data, size_t length, uint16_t version) {
+    OrderFileHeader expected;
+
+    if (length < sizeof(OrderFileHeader)) {
+        return 0;
+    }
+    order_file_header_init(&expected);
+    expected.version = version;
+#ifdef ORDER_HOST_BIG_ENDIAN
+    expected.version = swap16(expected.version);
+#endif
+    return memcmp(data, &expected, offsetof(OrderFileHeader, flags)) == 0;
+}
+
+int order_file_header_valid(const void *data, size_t length) {
+    return header_matches(data, length, ORDER_FILE_VERSION);
+}
+
+size_t order_file_header_records(const void *data) {
+    OrderFileHeader header;
+
+    memcpy(&header, data, sizeof(header));
+#ifdef ORDER_HOST_BIG_ENDIAN
+    header.records = swap64(header.records);
+#endif
+    return (size_t)header.records;
+}
+
+/* Committed records in a v2 file of `length` bytes */
+static size_t v2_records(const void *data, size_t length) {
+    OrderFileHeader header;
+    size_t available;
+
+    if (length <= ORDER_FILE_HEADER_SIZE) {
+        return 0;
+    }
+    available = (length - ORDER_FILE_HEADER_SIZE) / sizeof(StockOrder);
+
+    memcpy(&header, data, sizeof(header));
+#ifdef ORDER_HOST_BIG_ENDIAN
+    header.flags = swap32(header.flags);
+    header.records = swap64(header.records);
+#endif
+    /* Files from before the count was kept are trusted up to their length */
+    if (!(header.flags & ORDER_FILE_FLAG_COMMITTED) || header.records > available) {
+        return available;
+    }
+    return (size_t)header.records;
+}
+
+void order_file_header_set_records(OrderFileHeader *header, size_t records) {
+    header->flags = ORDER_FILE_FLAG_COMMITTED;
+    header->records = (uint64_t)records;
+#ifdef ORDER_HOST_BIG_ENDIAN
+    header->flags = swap32(header->flags);
+    header->records = swap64(header->records);
+#endif
+}
+
+void order_to_disk(StockOrder *order) {
+#ifdef ORDER_HOST_BIG_ENDIAN
+    order->timestamp = (int64_t)swap64((uint64_t)order->timestamp);
+    order->customer_account_no = swap32(order->customer_account_no);
+    order->quantity = swap32(order->quantity);
+    order->price_cents = swap32(order->price_cents);
+#else
+    (void)order;
+#endif
+}
+
+void order_from_disk(StockOrder *order) {
+    /* The swap is its own inverse */
+    order_to_disk(order);
+}
+
+static size_t layout_record_size(OrderLayout layout) {
+    switch (layout) {
+        case ORDER_LAYOUT_68K:
+            return 52;
+        case ORDER_LAYOUT_68K_CONFIRMED:
+            return 56;
+        case ORDER_LAYOUT_NATIVE64:
+            return 64;
+        default:
+            return 0;
+    }
+}
+
+static void copy_text(char *dst, size_t dst_size, const unsigned char *src, size_t src_size) {
+    size_t n = src_size < dst_size - 1 ? src_size : dst_size - 1;
+
+    memset(dst, 0, dst_size);
+    memcpy(dst, src, n);
+}
+
+static void decode_legacy(OrderLayout layout, const unsigned char *p, StockOrder *order) {
+    double price;
+
+    memset(order, 0, sizeof(StockOrder));
+    if (layout == ORDER_LAYOUT_NATIVE64) {
+        order->customer_account_no = load_le32(p);
+        order->timestamp = (int64_t)load_le64(p + 8);
+        copy_text(order->broker_id, sizeof(order->broker_id), p + 16, 16);
+        order->action = (uint8_t)load_le32(p + 32);
+        order->quantity = load_le32(p + 36);
+        price = bits_to_double(load_le64(p + 40));
+        copy_text(order->ticker, sizeof(order->ticker), p + 48, 8);
+        order->order_type = (uint8_t)load_le32(p + 56);
+        order->confirmed = load_le32(p + 60) != 0;
+    } else {
+        /* 68000 layout: 32-bit time_t, 2-byte alignment, big-endian */
+        order->customer_account_no = load_be32(p);
+        order->timestamp = (int64_t)(int32_t)load_be32(p + 4);
+        copy_text(order->broker_id, sizeof(order->broker_id), p + 8, 16);
+        order->action = (uint8_t)load_be32(p + 24);
+        order->quantity = load_be32(p + 28);
+        price = bits_to_double(load_be64(p + 32));
+        copy_text(order->ticker, sizeof(order->ticker), p + 40, 8);
+        order->order_type = (uint8_t)load_be32(p + 48);
+        /* Records from before the pending workflow were all final */
+        order->confirmed = layout == ORDER_LAYOUT_68K ? 1 : load_be32(p + 52) != 0;
+    }
+    order->price_cents = price > 0.0 ? (uint32_t)(price * 100.0 + 0.5) : 0;
+}
+
+static int plausible(const StockOrder *order) {
+    size_t i;
+
+    if (order->customer_account_no < 100000 || order->customer_account_no > 999999 ||
+        order->quantity < 1 || order->quantity > 9999 ||
+        order->price_cents < 1 || order->price_cents > 999999 ||
+        order->action > ORDER_ACTION_SELL || order->order_type > ORDER_TYPE_LIMIT ||
+        order->ticker[0] == '\0' || order->broker_id[0] == '\0') {
+        return 0;
+    }
+    for (i = 0; order->ticker[i]; i++) {
+        if (order->ticker[i] < 'A' || order->ticker[i] > 'Z') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+OrderLayout order_file_layout(const char *path) {
+    static const OrderLayout candidates[] = {
+        ORDER_LAYOUT_68K, ORDER_LAYOUT_68K_CONFIRMED, ORDER_LAYOUT_NATIVE64
+    };
+    unsigned char sample[LEGACY_MAX_RECORD * LEGACY_SAMPLE];
+    OrderLayout best = ORDER_LAYOUT_UNKNOWN;
+    int best_score = 0;
+    size_t got, i, j;
+    long size;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return ORDER_LAYOUT_UNKNOWN;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        fclose(fp);
+        return ORDER_LAYOUT_UNKNOWN;
+    }
+    got = fread(sample, 1, sizeof(sample), fp);
+    fclose(fp);
+
+    if (size == 0 || order_file_header_valid(sample, got)) {
+        return ORDER_LAYOUT_SEGMENTED;
+    }
+    if (header_matches(sample, got, 2)) {
+        return ORDER_LAYOUT_V2;
+    }
+    if (got >= 4 && memcmp(sample, ORDER_FILE_MAGIC, 4) == 0) {
+        return ORDER_LAYOUT_UNKNOWN;  /* A newer version than we understand */
+    }
+
+    /* Pick the legacy layout that divides the file and decodes most sensibly */
+    for (i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+        size_t record_size = layout_record_size(candidates[i]);
+        int score = 0;
+
+        if ((size_t)size % record_size != 0) {
+            continue;
+        }
+        for (j = 0; j < LEGACY_SAMPLE && (j + 1) * record_size <= got; j++) {
+            StockOrder order;
+            decode_legacy(candidates[i], sample + j * record_size, &order);
+            score += plausible(&order);
+        }
+        if (score > best_score) {
+            best_score = score;
+            best = candidates[i];
+        }
+    }
+    return best;
+}
+
+/* Records committed in a store right now, 0 if there is none */
+size_t order_file_records(const char *path) {
+    unsigned char header[ORDER_FILE_HEADER_SIZE];
+    size_t records = 0;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+    if (fread(header, sizeof(header), 1, fp) == 1 && order_file_header_valid(header, sizeof(header))) {
+        records = order_file_header_records(header);
+    }
+    fclose(fp);
+    return records;
+}
+
+/* A finished conversion that can't be swapped in: its manifest at
+ * `temp_path` and the segments it names beside `path` */
+static void remove_conversion(const char *path, const char *temp_path) {
+    char segment_path[FILENAME_MAX];
+    OrderManifest manifest;
+    size_t i;
+
+    if (order_manifest_read(&manifest, temp_path)) {
+        for (i = 0; i < manifest.segments; i++) {
+            if (order_segment_path(segment_path, path, manifest.slots[i].file)) {
+                remove(segment_path);
+            }
+        }
+        order_manifest_free(&manifest);
+    }
+    remove(temp_path);
+}
+
+/*
+ * Stream a legacy or v2 file into segment files and a new manifest next to
+ * it, then swap the manifest in.  Record numbers are unchanged.
+ */
+static int convert_store(const char *path, OrderLayout layout) {
+    unsigned char *in_buf;
+    StockOrder *out_buf;
+    OrderSegmentBuilder *builder;
+    char temp_path[FILENAME_MAX], backup_path[FILENAME_MAX];
+    const char *suffix = layout == ORDER_LAYOUT_V2 ? ORDER_V2_SUFFIX : ORDER_LEGACY_SUFFIX;
+    size_t record_size = layout == ORDER_LAYOUT_V2 ? sizeof(StockOrder) : layout_record_size(layout);
+    size_t got, i, remaining = (size_t)-1;
+    FILE *in;
+    int ok;
+
+    if (strlen(path) + sizeof(".tmp") + sizeof(ORDER_LEGACY_SUFFIX) > sizeof(temp_path)) {
+        return 0;
+    }
+    sprintf(temp_path, "%s.tmp", path);
+    sprintf(backup_path, "%s%s", path, suffix);
+
+    in_buf = (unsigned char *)malloc(LEGACY_MAX_RECORD * CONVERT_CHUNK);
+    out_buf = (StockOrder *)malloc(CONVERT_CHUNK * sizeof(StockOrder));
+    builder = (OrderSegmentBuilder *)malloc(sizeof(OrderSegmentBuilder));
+    in = fopen(path, "rb");
+    if (in_buf == NULL || out_buf == NULL || builder == NULL || in == NULL ||
+        !order_segment_builder_open(builder, path)) {
+        if (in != NULL) {
+            fclose(in);
+        }
+        free(in_buf);
+        free(out_buf);
+        free(builder);
+        return 0;
+    }
+
+    ok = 1;
+    if (layout == ORDER_LAYOUT_V2) {
+        /* Only what was committed; a torn tail is left behind */
+        long size;
+
+        ok = fread(in_buf, ORDER_FILE_HEADER_SIZE, 1, in) == 1 &&
+             fseek(in, 0, SEEK_END) == 0 && (size = ftell(in)) >= 0 &&
+             fseek(in, ORDER_FILE_HEADER_SIZE, SEEK_SET) == 0;
+        if (ok) {
+            remaining = v2_records(in_buf, (size_t)size);
+        }
+    }
+    while (ok && remaining > 0 &&
+           (got = fread(in_buf, record_size, remaining < CONVERT_CHUNK ? remaining : CONVERT_CHUNK, in)) > 0) {
+        if (layout == ORDER_LAYOUT_V2) {
+            memcpy(out_buf, in_buf, got * sizeof(StockOrder));  /* Already in file order */
+        } else {
+            for (i = 0; i < got; i++) {
+                decode_legacy(layout, in_buf + i * record_size, &out_buf[i]);
+                order_to_disk(&out_buf[i]);
+            }
+        }
+        ok = order_segment_builder_add(builder, out_buf, got);
+        remaining -= got;
+    }
+    if (ferror(in)) {
+        ok = 0;
+    }
+    fclose(in);
+
+    /* The manifest is written once every segment is in place; a conversion
+     * that failed leaves no segments behind */
+    if (ok) {
+        ok = order_segment_builder_finish(builder, temp_path);
+    } else {
+        order_segment_builder_abandon(builder);
+    }
+    free(in_buf);
+    free(out_buf);
+    free(builder);
+
+    if (!ok) {
+        return 0;
+    }
+
+    /* Keep the original alongside */
+    if (rename(path, backup_path) != 0) {
+        remove_conversion(path, temp_path);
+        return 0;
+    }
+    if (rename(temp_path, path) != 0) {
+        rename(backup_path, path);
+        remove_conversion(path, temp_path);
+        return 0;
+    }
+    return 1;
+}
+
+/* A new, empty store */
+static int create_store(const char *path) {
+    OrderSegmentBuilder *builder;
+    int ok;
+
+    builder = (OrderSegmentBuilder *)malloc(sizeof(OrderSegmentBuilder));
+    ok = builder != NULL && order_segment_builder_open(builder, path) &&
+         order_segment_builder_finish(builder, path);
+    free(builder);
+    return ok;
+}
+
+int order_file_upgrade(const char *path) {
+    OrderLayout layout;
+    FILE *fp;
+    long size;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 1;  /* Nothing to upgrade yet */
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0) {
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+
+    /* A freshly created file just needs its header */
+    if (size == 0) {
+        return create_store(path);
+    }
+
+    layout = order_file_layout(path);
+    if (layout == ORDER_LAYOUT_SEGMENTED) {
+        return 1;
+    }
+    if (layout == ORDER_LAYOUT_UNKNOWN) {
+        return 0;
+    }
+    return convert_store(path, layout);
+}
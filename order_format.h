@@ -0,0 +1,71 @@
+#ifndef ORDER_FORMAT_H
+#define ORDER_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stock_order.h"
+
+// On-disk format of the transactions file
+#define ORDER_FILE_MAGIC "STKO"
+#define ORDER_FILE_VERSION 3
+#define ORDER_FILE_HEADER_SIZE 64
+
+// Where the original file is kept after a legacy conversion
+#define ORDER_LEGACY_SUFFIX ".v1"
+
+// ...and after converting a single-file v2 store to segments
+#define ORDER_V2_SUFFIX ".v2"
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__)
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define ORDER_HOST_BIG_ENDIAN 1
+#endif
+#elif defined(__mc68000__) || defined(__M68K__) || defined(mc68000)
+#define ORDER_HOST_BIG_ENDIAN 1
+#endif
+
+// Header flag: `records` is maintained by every writer
+#define ORDER_FILE_FLAG_COMMITTED 0x1
+
+// File header.  Since v3 the file is a manifest: the header is followed by
+// one slot per segment file (see order_segment.h) and holds no records.
+typedef struct {
+    char magic[4];                  // ORDER_FILE_MAGIC
+    uint16_t version;               // ORDER_FILE_VERSION
+    uint16_t header_size;           // ORDER_FILE_HEADER_SIZE
+    uint32_t record_size;           // sizeof(StockOrder)
+    uint32_t flags;                 // ORDER_FILE_FLAG_*
+    uint64_t records;               // Records fully written; anything after is in flight
+    uint32_t segment_records;       // Records per segment
+    uint32_t segments;              // Slots following the header
+    uint32_t next_file;             // Number the next new segment file gets
+    uint8_t reserved[28];
+} OrderFileHeader;
+
+// Record layouts written by earlier versions of the program
+typedef enum {
+    ORDER_LAYOUT_UNKNOWN,
+    ORDER_LAYOUT_SEGMENTED,         // Current format: manifest and segment files
+    ORDER_LAYOUT_V2,                // Header and records in one file
+    ORDER_LAYOUT_68K,               // 52-byte big-endian, predates `confirmed`
+    ORDER_LAYOUT_68K_CONFIRMED,     // 56-byte big-endian with `confirmed`
+    ORDER_LAYOUT_NATIVE64           // 64-byte raw struct from a 64-bit LP64 host
+} OrderLayout;
+
+void order_file_header_init(OrderFileHeader *header);
+int order_file_header_valid(const void *data, size_t length);
+
+// Committed record count
+size_t order_file_header_records(const void *data);
+void order_file_header_set_records(OrderFileHeader *header, size_t records);
+
+// Convert between host and file byte order (no-ops on little-endian hosts)
+void order_to_disk(StockOrder *order);
+void order_from_disk(StockOrder *order);
+
+// Detect the layout of a file and upgrade it to segments in place if needed
+OrderLayout order_file_layout(const char *path);
+size_t order_file_records(const char *path);
+int order_file_upgrade(const char *path);
+
+#endif // ORDER_FORMAT_H
@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+#include "order_generate.h"
+
+/* The busiest names come first, so they get the most orders under skew */
+static const char *generate_tickers[] = {
+    "GM", "IBM", "XON", "GE", "KO", "F", "T", "MRK",
+    "PG", "DD", "MMM", "BA", "CAT", "DIS", "MO", "AA",
+    "CHV", "MOB", "DOW", "EK", "HWP", "DEC", "UK", "S",
+    "JNJ", "PFE", "BMY", "AXP", "JPM", "CCI", "GTE", "BEL"
+};
+
+static const char *generate_brokers[] = {
+    "MER", "GS", "DLJ", "SLB", "PWJ", "KP", "DW", "SBH"
+};
+
+#define GENERATE_TICKER_NAMES (sizeof(generate_tickers) / sizeof(generate_tickers[0]))
+#define GENERATE_BROKERS (sizeof(generate_brokers) / sizeof(generate_brokers[0]))
+
+void order_generator_defaults(OrderGeneratorConfig *config) {
+    config->seed = 1;
+    config->tickers = 64;
+    config->accounts = 10000;
+    config->skew = 1;
+    config->start = 591667200L;  /* Oct 1, 1988 */
+    config->mean_gap = 2;
+    config->pending_percent = 20;
+}
+
+/* Same generator as the rest of the tree; only the high bits are used */
+static uint32_t generate_random(OrderGenerator *gen) {
+    gen->state = gen->state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(gen->state >> 32);
+}
+
+/* Uniform in [0, 1) */
+static double generate_unit(OrderGenerator *gen) {
+    return generate_random(gen) / 4294967296.0;
+}
+
+/* weights[k] is the sum of 1 / (i + 1)^skew for i <= k */
+static double *zipf_weights(size_t count, unsigned skew) {
+    double *weights = (double *)malloc(count * sizeof(double));
+    double total = 0.0;
+    size_t k;
+    unsigned s;
+
+    if (weights == NULL) {
+        return NULL;
+    }
+    for (k = 0; k < count; k++) {
+        double weight = 1.0;
+
+        for (s = 0; s < skew; s++) {
+            weight /= (double)(k + 1);
+        }
+        total += weight;
+        weights[k] = total;
+    }
+    return weights;
+}
+
+/* Rank drawn from cumulative weights, by binary search */
+static size_t zipf_rank(OrderGenerator *gen, const double *weights, size_t count) {
+    double target = generate_unit(gen) * weights[count - 1];
+    size_t low = 0, high = count - 1;
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+
+        if (weights[mid] <= target) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/* Names past the table are made up: a letter per base-26 digit, after "Q" */
+static void ticker_name(size_t rank, char *ticker) {
+    size_t length = 1;
+
+    if (rank < GENERATE_TICKER_NAMES) {
+        strcpy(ticker, generate_tickers[rank]);
+        return;
+    }
+    rank -= GENERATE_TICKER_NAMES;
+    ticker[0] = 'Q';
+    do {
+        ticker[length++] = (char)('A' + rank % 26);
+        rank /= 26;
+    } while (rank > 0 && length < 7);
+    ticker[length] = 0;
+}
+
+int order_generator_init(OrderGenerator *gen, const OrderGeneratorConfig *config) {
+    size_t t;
+
+    memset(gen, 0, sizeof(OrderGenerator));
+    if (config->tickers == 0 || config->accounts == 0 ||
+        config->accounts > ORDER_GENERATE_MAX_ACCOUNTS || config->pending_percent > 100 ||
+        config->skew > ORDER_GENERATE_MAX_SKEW) {
+        return 0;
+    }
+    gen->config = *config;
+    gen->state = config->seed;
+    gen->clock = config->start;
+    gen->ticker_weights = zipf_weights(config->tickers, config->skew);
+    gen->account_weights = zipf_weights(config->accounts, config->skew);
+    gen->base_prices = (uint32_t *)malloc(config->tickers * sizeof(uint32_t));
+    if (gen->ticker_weights == NULL || gen->account_weights == NULL || gen->base_prices == NULL) {
+        order_generator_free(gen);
+        return 0;
+    }
+
+    /* $5 to $150, fixed per ticker for the whole stream */
+    for (t = 0; t < config->tickers; t++) {
+        gen->base_prices[t] = 500 + generate_random(gen) % 14501;
+    }
+    return 1;
+}
+
+void order_generator_next(OrderGenerator *gen, StockOrder *order) {
+    size_t ticker = zipf_rank(gen, gen->ticker_weights, gen->config.tickers);
+    size_t account = zipf_rank(gen, gen->account_weights, gen->config.accounts);
+    uint32_t r = generate_random(gen);
+    uint32_t base = gen->base_prices[ticker];
+    uint32_t spread = base / 50;  /* Within 2% of the base price */
+
+    memset(order, 0, sizeof(StockOrder));
+
+    /* Anywhere from 0 to twice the mean gap: time never runs backwards */
+    gen->clock += (int64_t)(generate_random(gen) % (2 * (uint64_t)gen->config.mean_gap + 1));
+    order->timestamp = gen->clock;
+
+    /* Busy accounts are spread over the number space, not bunched at the start */
+    order->customer_account_no =
+        (uint32_t)(100000 + (account * 7919) % ORDER_GENERATE_MAX_ACCOUNTS);
+    strcpy(order->broker_id, generate_brokers[(account + r % 3) % GENERATE_BROKERS]);
+    ticker_name(ticker, order->ticker);
+
+    order->action = (r >> 2) & 1 ? ORDER_ACTION_SELL : ORDER_ACTION_BUY;
+    order->order_type = (r >> 3) % 10 == 0 ? ORDER_TYPE_MARKET : ORDER_TYPE_LIMIT;
+
+    /* Mostly round lots, with some odd lots */
+    order->quantity = (r >> 7) % 5 == 0 ? 1 + (r >> 10) % 99 : 100 * (1 + (r >> 10) % 20);
+    order->price_cents = base - spread + generate_random(gen) % (2 * spread + 1);
+
+    order->confirmed = generate_random(gen) % 100 >= gen->config.pending_percent;
+}
+
+void order_generator_free(OrderGenerator *gen) {
+    free(gen->ticker_weights);
+    free(gen->account_weights);
+    free(gen->base_prices);
+    gen->ticker_weights = NULL;
+    gen->account_weights = NULL;
+    gen->base_prices = NULL;
+}
@@ -0,0 +1,42 @@
+#ifndef ORDER_GENERATE_H
+#define ORDER_GENERATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stock_order.h"
+
+// Most accounts a generator can draw from (account numbers are 6 digits)
+#define ORDER_GENERATE_MAX_ACCOUNTS 900000
+
+// Steepest skew accepted; at 3 nearly every order is for the top few names
+#define ORDER_GENERATE_MAX_SKEW 3
+
+// What the synthetic order stream looks like.  The same config always
+// produces the same orders.
+typedef struct {
+    uint64_t seed;
+    size_t tickers;                 // Distinct tickers
+    size_t accounts;                // Distinct customer accounts
+    unsigned skew;                  // Zipf exponent for tickers and accounts; 0 = uniform
+    int64_t start;                  // Timestamp of the first order
+    uint32_t mean_gap;              // Mean seconds between orders; jittered, never negative
+    unsigned pending_percent;       // Share of orders left unconfirmed, 0-100
+} OrderGeneratorConfig;
+
+typedef struct {
+    OrderGeneratorConfig config;
+    uint64_t state;
+    int64_t clock;                  // Timestamp of the last order
+    double *ticker_weights;         // Cumulative Zipf weights, one per rank
+    double *account_weights;
+    uint32_t *base_prices;          // Cents, per ticker
+} OrderGenerator;
+
+// 64 tickers, 10000 accounts, skew 1, from Oct 1, 1988, 2s apart, 20% pending
+void order_generator_defaults(OrderGeneratorConfig *config);
+
+int order_generator_init(OrderGenerator *gen, const OrderGeneratorConfig *config);
+void order_generator_next(OrderGenerator *gen, StockOrder *order);
+void order_generator_free(OrderGenerator *gen);
+
+#endif // ORDER_GENERATE_H
@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "order_format.h"
+#include "order_index.h"
+#include "order_lock.h"
+
+#define TRANSACTIONS_INDEX_TEMP_FILE "transactions.idx.tmp"
+
+/* Entries fetched per read while merging the sorted run */
+#define INDEX_MERGE_CHUNK 4096
+
+static int entry_less(const OrderIndexEntry *a, const OrderIndexEntry *b) {
+    if (a->timestamp != b->timestamp) {
+        return a->timestamp < b->timestamp;
+    }
+    return a->record < b->record;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const OrderIndexEntry *entry_a = (const OrderIndexEntry *)a;
+    const OrderIndexEntry *entry_b = (const OrderIndexEntry *)b;
+
+    if (entry_less(entry_a, entry_b)) {
+        return -1;
+    } else if (entry_less(entry_b, entry_a)) {
+        return 1;
+    }
+    return 0;
+}
+
+static long file_entries(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    long size;
+
+    if (fp == NULL) {
+        return 0;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0) {
+        size = 0;
+    }
+    fclose(fp);
+    return size / (long)sizeof(OrderIndexEntry);
+}
+
+static int read_entries(const char *path, OrderIndexEntry **entries, size_t *count) {
+    long n = file_entries(path);
+    FILE *fp;
+
+    *entries = NULL;
+    *count = 0;
+    if (n == 0) {
+        return 1;
+    }
+
+    *entries = (OrderIndexEntry *)malloc((size_t)n * sizeof(OrderIndexEntry));
+    fp = fopen(path, "rb");
+    if (*entries == NULL || fp == NULL ||
+        fread(*entries, sizeof(OrderIndexEntry), (size_t)n, fp) != (size_t)n) {
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        free(*entries);
+        *entries = NULL;
+        return 0;
+    }
+    fclose(fp);
+    *count = (size_t)n;
+    return 1;
+}
+
+static int append_entries(const char *path, const OrderIndexEntry *entries, size_t count) {
+    FILE *fp;
+    int ok;
+
+    if (count == 0) {
+        return 1;
+    }
+    fp = fopen(path, "ab");
+    if (fp == NULL) {
+        return 0;
+    }
+    ok = fwrite(entries, sizeof(OrderIndexEntry), count, fp) == count;
+    return fclose(fp) == 0 && ok;
+}
+
+/*
+ * Fold the patch list and `extra` into the sorted run in one streaming
+ * pass.  Only the stragglers are held in memory; the run is read in chunks.
+ */
+static int index_merge(const OrderIndexEntry *extra, size_t extra_count) {
+    OrderIndexEntry *pending, *patch;
+    OrderIndexEntry chunk[INDEX_MERGE_CHUNK];
+    size_t patch_count, pending_count, next = 0;
+    size_t chunk_count = 0, chunk_pos = 0;
+    FILE *in, *out;
+    int ok = 1;
+
+    if (!read_entries(TRANSACTIONS_PATCH_FILE, &patch, &patch_count)) {
+        return 0;
+    }
+    pending_count = patch_count + extra_count;
+    pending = (OrderIndexEntry *)realloc(patch, (pending_count ? pending_count : 1) *
+                                                sizeof(OrderIndexEntry));
+    if (pending == NULL) {
+        free(patch);
+        return 0;
+    }
+    if (extra_count > 0) {
+        memcpy(pending + patch_count, extra, extra_count * sizeof(OrderIndexEntry));
+    }
+    qsort(pending, pending_count, sizeof(OrderIndexEntry), compare_entries);
+
+    in = fopen(TRANSACTIONS_INDEX_FILE, "rb");
+    out = fopen(TRANSACTIONS_INDEX_TEMP_FILE, "wb");
+    if (out == NULL) {
+        if (in != NULL) {
+            fclose(in);
+        }
+        free(pending);
+        return 0;
+    }
+
+    for (;;) {
+        const OrderIndexEntry *take;
+
+        if (chunk_pos == chunk_count && in != NULL) {
+            chunk_count = fread(chunk, sizeof(OrderIndexEntry), INDEX_MERGE_CHUNK, in);
+            chunk_pos = 0;
+        }
+        if (chunk_pos < chunk_count &&
+            (next == pending_count || !entry_less(&pending[next], &chunk[chunk_pos]))) {
+            take = &chunk[chunk_pos++];
+        } else if (next < pending_count) {
+            take = &pending[next++];
+        } else {
+            break;
+        }
+        if (fwrite(take, sizeof(OrderIndexEntry), 1, out) != 1) {
+            ok = 0;
+            break;
+        }
+    }
+
+    if (in != NULL) {
+        fclose(in);
+    }
+    if (fclose(out) != 0) {
+        ok = 0;
+    }
+    free(pending);
+
+    if (!ok || rename(TRANSACTIONS_INDEX_TEMP_FILE, TRANSACTIONS_INDEX_FILE) != 0) {
+        remove(TRANSACTIONS_INDEX_TEMP_FILE);
+        return 0;
+    }
+
+    /* Everything in the patch list now lives in the run */
+    out = fopen(TRANSACTIONS_PATCH_FILE, "wb");
+    if (out == NULL) {
+        return 0;
+    }
+    return fclose(out) == 0;
+}
+
+/* Add entries for consecutive records, in record order */
+static int index_add(const OrderIndexEntry *entries, size_t count) {
+    OrderIndexEntry last, *in_order, *out_of_order;
+    size_t in_count = 0, out_count = 0, i;
+    long sorted = file_entries(TRANSACTIONS_INDEX_FILE);
+    int ok;
+
+    if (count == 0) {
+        return 1;
+    }
+
+    memset(&last, 0, sizeof(last));
+    if (sorted > 0) {
+        FILE *fp = fopen(TRANSACTIONS_INDEX_FILE, "rb");
+        if (fp == NULL || fseek(fp, (sorted - 1) * (long)sizeof(OrderIndexEntry), SEEK_SET) != 0 ||
+            fread(&last, sizeof(last), 1, fp) != 1) {
+            if (fp != NULL) {
+                fclose(fp);
+            }
+            return 0;
+        }
+        fclose(fp);
+    }
+
+    in_order = (OrderIndexEntry *)malloc(count * sizeof(OrderIndexEntry));
+    out_of_order = (OrderIndexEntry *)malloc(count * sizeof(OrderIndexEntry));
+    if (in_order == NULL || out_of_order == NULL) {
+        free(in_order);
+        free(out_of_order);
+        return 0;
+    }
+
+    /* time() only moves forward, so nearly everything extends the run */
+    for (i = 0; i < count; i++) {
+        if (sorted == 0 && in_count == 0) {
+            in_order[in_count++] = last = entries[i];
+        } else if (!entry_less(&entries[i], &last)) {
+            in_order[in_count++] = last = entries[i];
+        } else {
+            out_of_order[out_count++] = entries[i];
+        }
+    }
+
+    ok = append_entries(TRANSACTIONS_INDEX_FILE, in_order, in_count);
+    if (ok) {
+        /* Many stragglers are cheaper to sort once than to trickle through the patch */
+        if (file_entries(TRANSACTIONS_PATCH_FILE) + (long)out_count > ORDER_INDEX_PATCH_LIMIT) {
+            ok = index_merge(out_of_order, out_count);
+        } else {
+            ok = append_entries(TRANSACTIONS_PATCH_FILE, out_of_order, out_count);
+        }
+    }
+    free(in_order);
+    free(out_of_order);
+    return ok;
+}
+
+static size_t index_covered(void) {
+    return (size_t)(file_entries(TRANSACTIONS_INDEX_FILE) + file_entries(TRANSACTIONS_PATCH_FILE));
+}
+
+int order_index_append(size_t first_record, const StockOrder *orders, size_t count) {
+    OrderIndexEntry *entries;
+    size_t covered = index_covered();
+    size_t skip, i;
+    int ok;
+
+    /* Records must be indexed in file order; a gap is filled on the next open */
+    if (covered < first_record || covered >= first_record + count) {
+        return 1;
+    }
+    skip = covered - first_record;
+
+    entries = (OrderIndexEntry *)malloc((count - skip) * sizeof(OrderIndexEntry));
+    if (entries == NULL) {
+        return 0;
+    }
+    for (i = skip; i < count; i++) {
+        entries[i - skip].timestamp = (int64_t)orders[i].timestamp;
+        entries[i - skip].record = (uint64_t)(first_record + i);
+    }
+    ok = index_add(entries, count - skip);
+    free(entries);
+    return ok;
+}
+
+/* Bring the sidecar files up to date with everything in the store */
+static int index_catch_up(const OrderStore *store) {
+    OrderIndexEntry *entries;
+    size_t covered = index_covered();
+    size_t i;
+    int ok;
+
+    if (covered > store->count) {
+        /* Another process may have appended since our snapshot was taken */
+        if (covered <= order_file_records(TRANSACTIONS_FILE)) {
+            return 1;
+        }
+        /* The data file was replaced underneath us: start over */
+        remove(TRANSACTIONS_INDEX_FILE);
+        remove(TRANSACTIONS_PATCH_FILE);
+        covered = 0;
+    }
+    if (covered == store->count) {
+        return 1;
+    }
+
+    entries = (OrderIndexEntry *)malloc((store->count - covered) * sizeof(OrderIndexEntry));
+    if (entries == NULL) {
+        return 0;
+    }
+    for (i = covered; i < store->count; i++) {
+        entries[i - covered].timestamp = (int64_t)store->records[i].timestamp;
+        entries[i - covered].record = (uint64_t)i;
+    }
+    ok = index_add(entries, store->count - covered);
+    free(entries);
+    return ok;
+}
+
+int order_index_open(OrderIndex *index, const OrderStore *store) {
+    int ok;
+
+    memset(index, 0, sizeof(OrderIndex));
+
+    if (!order_lock_writer()) {
+        return 0;
+    }
+    ok = index_catch_up(store);
+    order_unlock_writer();
+    if (!ok) {
+        return 0;
+    }
+    if (!mapped_file_open(&index->file, TRANSACTIONS_INDEX_FILE)) {
+        return 0;
+    }
+    index->sorted = (const OrderIndexEntry *)index->file.base;
+    index->sorted_count = index->file.length / sizeof(OrderIndexEntry);
+
+    if (!read_entries(TRANSACTIONS_PATCH_FILE, &index->patch, &index->patch_count)) {
+        mapped_file_close(&index->file);
+        return 0;
+    }
+    qsort(index->patch, index->patch_count, sizeof(OrderIndexEntry), compare_entries);
+    return 1;
+}
+
+void order_index_close(OrderIndex *index) {
+    mapped_file_close(&index->file);
+    free(index->patch);
+    memset(index, 0, sizeof(OrderIndex));
+}
+
+size_t order_index_count(const OrderIndex *index) {
+    return index->sorted_count + index->patch_count;
+}
+
+void order_index_cursor_init(OrderIndexCursor *cursor, const OrderIndex *index) {
+    cursor->index = index;
+    cursor->sorted_left = index->sorted_count;
+    cursor->patch_left = index->patch_count;
+}
+
+/*
+ * Position the cursor on the rank-th newest entry (0 = newest).  The patch
+ * list is tiny, so binary-search how many of the newest `rank` entries
+ * came from it; the rest came from the top of the sorted run.
+ */
+void order_index_cursor_seek(OrderIndexCursor *cursor, size_t rank) {
+    const OrderIndex *index = cursor->index;
+    size_t total = order_index_count(index);
+    size_t lo, hi;
+
+    if (rank >= total) {
+        cursor->sorted_left = 0;
+        cursor->patch_left = 0;
+        return;
+    }
+
+    /* from_patch must satisfy: rank - from_patch <= sorted_count */
+    lo = rank > index->sorted_count ? rank - index->sorted_count : 0;
+    hi = rank < index->patch_count ? rank : index->patch_count;
+    while (lo < hi) {
+        size_t from_patch = lo + (hi - lo + 1) / 2;
+        size_t from_sorted = rank - from_patch;
+
+        /* Taking from_patch patch entries is valid only if the last one taken
+         * is not older than the next sorted entry left behind */
+        if (from_sorted < index->sorted_count &&
+            entry_less(&index->patch[index->patch_count - from_patch],
+                       &index->sorted[index->sorted_count - from_sorted - 1])) {
+            hi = from_patch - 1;
+        } else {
+            lo = from_patch;
+        }
+    }
+
+    cursor->patch_left = index->patch_count - lo;
+    cursor->sorted_left = index->sorted_count - (rank - lo);
+}
+
+int order_index_cursor_next(OrderIndexCursor *cursor, size_t *record) {
+    const OrderIndex *index = cursor->index;
+    const OrderIndexEntry *take;
+
+    if (cursor->sorted_left == 0 && cursor->patch_left == 0) {
+        return 0;
+    }
+    if (cursor->patch_left == 0 ||
+        (cursor->sorted_left > 0 &&
+         entry_less(&index->patch[cursor->patch_left - 1],
+                    &index->sorted[cursor->sorted_left - 1]))) {
+        take = &index->sorted[--cursor->sorted_left];
+    } else {
+        take = &index->patch[--cursor->patch_left];
+    }
+    *record = (size_t)take->record;
+    return 1;
+}
@@ -0,0 +1,46 @@
+#ifndef ORDER_INDEX_H
+#define ORDER_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "order_store.h"
+
+// Sidecar files: a sorted run of entries and a short list of stragglers
+#define TRANSACTIONS_INDEX_FILE "transactions.idx"
+#define TRANSACTIONS_PATCH_FILE "transactions.ipx"
+
+// Out-of-order entries tolerated before they are merged into the run
+#define ORDER_INDEX_PATCH_LIMIT 1024
+
+// One record, keyed by its timestamp (ties broken by record number)
+typedef struct {
+    int64_t timestamp;
+    uint64_t record;
+} OrderIndexEntry;
+
+// Timestamp index over the transactions file
+typedef struct {
+    MappedFile file;                // Sorted run, oldest first
+    const OrderIndexEntry *sorted;
+    size_t sorted_count;
+    OrderIndexEntry *patch;         // Out-of-order entries, sorted on load
+    size_t patch_count;
+} OrderIndex;
+
+// Newest-first walk over an index
+typedef struct {
+    const OrderIndex *index;
+    size_t sorted_left;             // Sorted entries not yet returned
+    size_t patch_left;              // Patch entries not yet returned
+} OrderIndexCursor;
+
+int order_index_open(OrderIndex *index, const OrderStore *store);
+void order_index_close(OrderIndex *index);
+size_t order_index_count(const OrderIndex *index);
+int order_index_append(size_t first_record, const StockOrder *orders, size_t count);
+
+void order_index_cursor_init(OrderIndexCursor *cursor, const OrderIndex *index);
+void order_index_cursor_seek(OrderIndexCursor *cursor, size_t rank);
+int order_index_cursor_next(OrderIndexCursor *cursor, size_t *record);
+
+#endif // ORDER_INDEX_H
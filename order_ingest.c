@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "order_append.h"
+#include "order_ingest.h"
+#include "order_parse.h"
+#include "order_store.h"
+
+/* Input is read in blocks this size; no line may be longer */
+#define INGEST_BUFFER_SIZE (1 << 20)
+
+typedef struct {
+    OrderAppender appender;
+    OrderIngestStats *stats;
+    FILE *errors;
+    int64_t now;
+    size_t line_no;
+    int seen_first;                 /* A header is only allowed on the first line */
+} IngestState;
+
+static void reject(IngestState *state, const char *reason) {
+    state->stats->rejected++;
+    if (state->errors == NULL) {
+        return;
+    }
+    if (state->stats->rejected <= ORDER_INGEST_MAX_REPORTS) {
+        fprintf(state->errors, "line %lu: %s\n", (unsigned long)state->line_no, reason);
+    } else if (state->stats->rejected == ORDER_INGEST_MAX_REPORTS + 1) {
+        fprintf(state->errors, "(further rejected lines are only counted)\n");
+    }
+}
+
+static int ingest_line(IngestState *state, const char *line, size_t length) {
+    StockOrder order;
+    const char *error;
+    size_t i = 0;
+
+    state->line_no++;
+    while (i < length && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r')) {
+        i++;
+    }
+    if (i == length || line[i] == '#') {
+        return 1;  /* Blank line or comment */
+    }
+
+    if (!order_parse_line(line, length, state->now, &order, &error)) {
+        char c = line[i];
+        /* Let a spreadsheet-style header through */
+        if (!state->seen_first && ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'))) {
+            state->seen_first = 1;
+            return 1;
+        }
+        state->seen_first = 1;
+        state->stats->lines++;
+        reject(state, error);
+        return 1;
+    }
+    state->seen_first = 1;
+    state->stats->lines++;
+
+    if (!order_appender_append(&state->appender, &order)) {
+        return 0;
+    }
+    state->stats->accepted++;
+    return 1;
+}
+
+int order_ingest(FILE *in, FILE *errors, OrderIngestStats *stats) {
+    static char buffer[INGEST_BUFFER_SIZE];
+    OrderAppendConfig config;
+    IngestState state;
+    size_t filled = 0;
+    int skipping = 0;               /* Discarding the rest of an over-long line */
+    int ok = 1;
+
+    memset(stats, 0, sizeof(OrderIngestStats));
+    memset(&state, 0, sizeof(state));
+    state.stats = stats;
+    state.errors = errors;
+    state.now = (int64_t)time(NULL);
+
+    memset(&config, 0, sizeof(config));
+    config.batch_orders = ORDER_INGEST_BATCH;
+    config.on_durable = order_store_appended;
+    if (!order_appender_open(&state.appender, TRANSACTIONS_FILE, TRANSACTIONS_WAL_FILE,
+                             &config)) {
+        return 0;
+    }
+
+    for (;;) {
+        size_t got = fread(buffer + filled, 1, sizeof(buffer) - filled, in);
+        int at_end = got == 0;
+        char *start = buffer, *end = buffer + filled + got, *newline;
+
+        /* Walk the complete lines in place */
+        while (ok && (newline = (char *)memchr(start, '\n', (size_t)(end - start))) != NULL) {
+            if (skipping) {
+                skipping = 0;
+            } else {
+                ok = ingest_line(&state, start, (size_t)(newline - start));
+            }
+            start = newline + 1;
+        }
+        if (!ok) {
+            break;
+        }
+
+        if (at_end) {
+            if (start < end && !skipping) {
+                ok = ingest_line(&state, start, (size_t)(end - start));
+            }
+            break;
+        }
+
+        filled = (size_t)(end - start);
+        if (skipping) {
+            filled = 0;
+        } else if (filled == sizeof(buffer)) {
+            /* A line that fills the whole buffer can't be an order */
+            state.line_no++;
+            stats->lines++;
+            reject(&state, "Line too long");
+            skipping = 1;
+            filled = 0;
+        } else if (filled > 0 && start != buffer) {
+            memmove(buffer, start, filled);
+        }
+    }
+
+    if (ferror(in)) {
+        ok = 0;
+    }
+    if (!order_appender_close(&state.appender)) {
+        ok = 0;
+    }
+    return ok;
+}
@@ -0,0 +1,23 @@
+#ifndef ORDER_INGEST_H
+#define ORDER_INGEST_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Orders committed per group while ingesting
+#define ORDER_INGEST_BATCH 4096
+
+// Rejected lines reported individually before only counting them
+#define ORDER_INGEST_MAX_REPORTS 100
+
+typedef struct {
+    size_t lines;                   // Non-blank, non-comment lines seen
+    size_t accepted;                // Orders appended
+    size_t rejected;                // Lines that failed validation
+} OrderIngestStats;
+
+// Append every valid order in `in` (one CSV order per line) as pending;
+// rejected lines are reported on `errors`.  Returns 0 on an I/O failure.
+int order_ingest(FILE *in, FILE *errors, OrderIngestStats *stats);
+
+#endif // ORDER_INGEST_H
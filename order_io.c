@@ -0,0 +1,484 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "order_io.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ORDER_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+/* Largest single transfer; longer ones are split */
+#define IO_MAX_TRANSFER (1U << 30)
+
+/* ---- posix: each operation as it is queued ---- */
+
+static int posix_read(OrderIo *io, int fd, void *buf, size_t length, long long offset,
+                      unsigned flags) {
+    char *p = (char *)buf;
+
+    (void)flags;
+    while (length > 0) {
+        ssize_t n = pread(fd, p, length, (off_t)offset);
+
+        io->calls++;
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        p += n;
+        length -= (size_t)n;
+        offset += n;
+    }
+    return 1;
+}
+
+static int posix_write(OrderIo *io, int fd, const void *buf, size_t length, long long offset,
+                       unsigned flags) {
+    const char *p = (const char *)buf;
+
+    (void)flags;
+    while (length > 0) {
+        ssize_t n = offset == ORDER_IO_APPEND ? write(fd, p, length)
+                                              : pwrite(fd, p, length, (off_t)offset);
+
+        io->calls++;
+        /* Nothing written and no error would never end */
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        p += n;
+        length -= (size_t)n;
+        if (offset != ORDER_IO_APPEND) {
+            offset += n;
+        }
+    }
+    return 1;
+}
+
+static int posix_sync(OrderIo *io, int fd, unsigned flags) {
+    io->calls++;
+    return ((flags & ORDER_IO_DATASYNC) ? fdatasync(fd) : fsync(fd)) == 0;
+}
+
+static int posix_nothing(OrderIo *io) {
+    (void)io;
+    return 1;
+}
+
+static int posix_register(OrderIo *io, void *buf, size_t length) {
+    (void)io;
+    (void)buf;
+    (void)length;
+    return 0;
+}
+
+static void posix_close(OrderIo *io) {
+    (void)io;
+}
+
+static const OrderIoBackend posix_backend = {
+    "posix", posix_read, posix_write, posix_sync, posix_nothing, posix_nothing,
+    posix_register, posix_close
+};
+
+#ifdef ORDER_IO_URING
+/* ---- io_uring: whole batches per system call ---- */
+
+typedef struct {
+    int fd;
+    unsigned entries;
+    void *ring;                     /* Both rings, one mapping */
+    size_t ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_tail;
+    unsigned tail;                  /* Ours, published to sq_tail on submission */
+    unsigned sq_mask;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    struct io_uring_sqe *last;      /* Latest queued entry */
+    unsigned queued;                /* Filled in, not yet handed to the kernel */
+    unsigned in_flight;             /* Handed over, completion not yet seen */
+    struct iovec buffers[ORDER_IO_BUFFERS];
+    unsigned buffer_count;
+} UringState;
+
+/* Hand over everything queued, then wait until `complete` operations are done */
+static int uring_enter(OrderIo *io, unsigned complete) {
+    UringState *ring = (UringState *)io->ctx;
+    long n;
+
+    /* Entries are filled in before the kernel is told they exist */
+    __atomic_store_n(ring->sq_tail, ring->tail, __ATOMIC_RELEASE);
+    do {
+        n = syscall(__NR_io_uring_enter, ring->fd, ring->queued, complete,
+                    complete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        io->calls++;
+    } while (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+    if (n < 0) {
+        return 0;
+    }
+    ring->queued -= (unsigned)n;
+    ring->in_flight += (unsigned)n;
+    return 1;
+}
+
+/* Every completion the kernel has posted; the expected result rides in user_data */
+static void uring_reap(OrderIo *io) {
+    UringState *ring = (UringState *)io->ctx;
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        const struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+
+        if (cqe->res < 0 || (uint64_t)cqe->res != cqe->user_data) {
+            io->failed = 1;
+        }
+        ring->in_flight--;
+        head++;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static int uring_submit(OrderIo *io) {
+    UringState *ring = (UringState *)io->ctx;
+
+    while (ring->queued > 0) {
+        unsigned queued = ring->queued;
+
+        if (!uring_enter(io, 0) || ring->queued == queued) {
+            io->failed = 1;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Submitting and waiting are one system call when the kernel takes the lot */
+static int uring_wait(OrderIo *io) {
+    UringState *ring = (UringState *)io->ctx;
+
+    for (;;) {
+        uring_reap(io);
+        if (ring->queued == 0 && ring->in_flight == 0) {
+            break;
+        }
+        if (!uring_enter(io, ring->queued + ring->in_flight)) {
+            /* Whatever the kernel never took is dropped with the failure */
+            io->failed = 1;
+            ring->tail -= ring->queued;
+            ring->queued = 0;
+            if (ring->in_flight == 0) {
+                break;
+            }
+        }
+    }
+    return 1;
+}
+
+/* The next free entry, after draining the ring if it is full */
+static struct io_uring_sqe *uring_entry(OrderIo *io) {
+    UringState *ring = (UringState *)io->ctx;
+    struct io_uring_sqe *sqe;
+
+    if (ring->queued + ring->in_flight >= ring->entries) {
+        /* A chain cut here would carry on into whatever comes next; end it,
+         * and let the wait order the rest after it */
+        if (ring->last != NULL) {
+            ring->last->flags &= (__u8)~IOSQE_IO_LINK;
+        }
+        uring_wait(io);
+        if (io->failed) {
+            return NULL;
+        }
+    }
+    sqe = &ring->sqes[ring->tail++ & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->queued++;
+    ring->last = sqe;
+    return sqe;
+}
+
+/* Index of the registered buffer holding all of [buf, buf + length), or -1 */
+static int uring_buffer(const UringState *ring, const void *buf, size_t length) {
+    const char *p = (const char *)buf;
+    unsigned i;
+
+    for (i = 0; i < ring->buffer_count; i++) {
+        const char *base = (const char *)ring->buffers[i].iov_base;
+
+        if (p >= base && p + length <= base + ring->buffers[i].iov_len) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static int uring_transfer(OrderIo *io, int write_op, int fd, const void *buf, size_t length,
+                          long long offset, unsigned flags) {
+    UringState *ring = (UringState *)io->ctx;
+    const char *p = (const char *)buf;
+
+    do {
+        size_t part = length > IO_MAX_TRANSFER ? IO_MAX_TRANSFER : length;
+        int fixed = uring_buffer(ring, p, part);
+        struct io_uring_sqe *sqe = uring_entry(io);
+
+        if (sqe == NULL) {
+            return 0;
+        }
+        if (fixed >= 0) {
+            sqe->opcode = write_op ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+            sqe->buf_index = (__u16)fixed;
+        } else {
+            sqe->opcode = write_op ? IORING_OP_WRITE : IORING_OP_READ;
+        }
+        sqe->fd = fd;
+        sqe->addr = (__u64)(uintptr_t)p;
+        sqe->len = (__u32)part;
+        sqe->off = (__u64)offset;
+        sqe->user_data = part;
+        /* The pieces of one transfer go in order, like a single call */
+        if ((flags & ORDER_IO_LINK) || part < length) {
+            sqe->flags = IOSQE_IO_LINK;
+        }
+        p += part;
+        length -= part;
+        if (offset != ORDER_IO_APPEND) {
+            offset += (long long)part;
+        }
+    } while (length > 0);
+    return 1;
+}
+
+static int uring_read(OrderIo *io, int fd, void *buf, size_t length, long long offset,
+                      unsigned flags) {
+    return uring_transfer(io, 0, fd, buf, length, offset, flags);
+}
+
+static int uring_write(OrderIo *io, int fd, const void *buf, size_t length, long long offset,
+                       unsigned flags) {
+    return uring_transfer(io, 1, fd, buf, length, offset, flags);
+}
+
+static int uring_sync(OrderIo *io, int fd, unsigned flags) {
+    struct io_uring_sqe *sqe = uring_entry(io);
+
+    if (sqe == NULL) {
+        return 0;
+    }
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = fd;
+    sqe->fsync_flags = (flags & ORDER_IO_DATASYNC) ? IORING_FSYNC_DATASYNC : 0;
+    sqe->user_data = 0;
+    if (flags & ORDER_IO_LINK) {
+        sqe->flags = IOSQE_IO_LINK;
+    }
+    return 1;
+}
+
+/* The kernel takes the whole table at once, so it is replaced, not added to */
+static int uring_register(OrderIo *io, void *buf, size_t length) {
+    UringState *ring = (UringState *)io->ctx;
+
+    if (ring->buffer_count == ORDER_IO_BUFFERS) {
+        return 0;
+    }
+    uring_wait(io);
+    if (ring->buffer_count > 0) {
+        syscall(__NR_io_uring_register, ring->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    }
+    ring->buffers[ring->buffer_count].iov_base = buf;
+    ring->buffers[ring->buffer_count].iov_len = length;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, ring->buffers,
+                ring->buffer_count + 1) == 0) {
+        ring->buffer_count++;
+        return 1;
+    }
+    /* Over the locked-memory limit, most likely: keep the ones we had */
+    if (ring->buffer_count > 0 &&
+        syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, ring->buffers,
+                ring->buffer_count) != 0) {
+        ring->buffer_count = 0;
+    }
+    return 0;
+}
+
+static void uring_close(OrderIo *io) {
+    UringState *ring = (UringState *)io->ctx;
+
+    uring_wait(io);
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->ring, ring->ring_size);
+    close(ring->fd);
+    free(ring);
+}
+
+static const OrderIoBackend uring_backend = {
+    "io_uring", uring_read, uring_write, uring_sync, uring_submit, uring_wait,
+    uring_register, uring_close
+};
+
+/* 0 where the kernel has no io_uring, refuses it, or lacks what we rely on */
+static int uring_open(OrderIo *io, unsigned depth) {
+    struct io_uring_params params;
+    UringState *ring;
+    unsigned *sq_array;
+    char *base;
+    size_t sq_size, cq_size;
+    unsigned i;
+
+    ring = (UringState *)calloc(1, sizeof(UringState));
+    if (ring == NULL) {
+        return 0;
+    }
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, depth, &params);
+    if (ring->fd < 0) {
+        free(ring);
+        return 0;
+    }
+    /* One mapping for both rings, and writes at the file position */
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_RW_CUR_POS)) {
+        close(ring->fd);
+        free(ring);
+        return 0;
+    }
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->ring = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, ring->fd,
+                                             IORING_OFF_SQES);
+    if (ring->ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->ring != MAP_FAILED) {
+            munmap(ring->ring, ring->ring_size);
+        }
+        if (ring->sqes != MAP_FAILED) {
+            munmap(ring->sqes, ring->sqes_size);
+        }
+        close(ring->fd);
+        free(ring);
+        return 0;
+    }
+
+    base = (char *)ring->ring;
+    ring->entries = params.sq_entries;
+    ring->sq_tail = (unsigned *)(base + params.sq_off.tail);
+    ring->tail = *ring->sq_tail;
+    ring->sq_mask = *(unsigned *)(base + params.sq_off.ring_mask);
+    ring->cq_head = (unsigned *)(base + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(base + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(base + params.cq_off.cqes);
+    /* Entry i always lives in slot i, so the indirection array never changes */
+    sq_array = (unsigned *)(base + params.sq_off.array);
+    for (i = 0; i < ring->entries; i++) {
+        sq_array[i] = i;
+    }
+
+    io->backend = &uring_backend;
+    io->ctx = ring;
+    return 1;
+}
+#endif
+
+int order_io_open(OrderIo *io, unsigned depth) {
+    const char *choice = getenv(ORDER_IO_ENV);
+
+    memset(io, 0, sizeof(OrderIo));
+    if (depth == 0) {
+        depth = ORDER_IO_DEPTH;
+    }
+#ifdef ORDER_IO_URING
+    if ((choice == NULL || strcmp(choice, "posix") != 0) && uring_open(io, depth)) {
+        return 1;
+    }
+#else
+    (void)choice;
+#endif
+    io->backend = &posix_backend;
+    return 1;
+}
+
+void order_io_close(OrderIo *io) {
+    if (io->backend != NULL) {
+        io->backend->close(io);
+    }
+    memset(io, 0, sizeof(OrderIo));
+}
+
+const char *order_io_name(const OrderIo *io) {
+    return io->backend->name;
+}
+
+int order_io_read(OrderIo *io, int fd, void *buf, size_t length, long long offset,
+                  unsigned flags) {
+    io->operations++;
+    if (io->failed) {
+        return 0;
+    }
+    if (!io->backend->read(io, fd, buf, length, offset, flags)) {
+        io->failed = 1;
+    }
+    return !io->failed;
+}
+
+int order_io_write(OrderIo *io, int fd, const void *buf, size_t length, long long offset,
+                   unsigned flags) {
+    io->operations++;
+    if (io->failed) {
+        return 0;
+    }
+    if (!io->backend->write(io, fd, buf, length, offset, flags)) {
+        io->failed = 1;
+    }
+    return !io->failed;
+}
+
+int order_io_sync(OrderIo *io, int fd, unsigned flags) {
+    io->operations++;
+    if (io->failed) {
+        return 0;
+    }
+    if (!io->backend->sync(io, fd, flags)) {
+        io->failed = 1;
+    }
+    return !io->failed;
+}
+
+int order_io_submit(OrderIo *io) {
+    return !io->failed && io->backend->submit(io);
+}
+
+int order_io_wait(OrderIo *io) {
+    int ok;
+
+    io->backend->wait(io);
+    ok = !io->failed;
+    io->failed = 0;
+    return ok;
+}
+
+int order_io_register(OrderIo *io, void *buf, size_t length) {
+    return io->backend->register_buffer(io, buf, length);
+}
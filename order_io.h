@@ -0,0 +1,76 @@
+#ifndef ORDER_IO_H
+#define ORDER_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Chooses the backend for every queue opened after it is set: "uring" or
+// "posix".  Unset, io_uring is used wherever the kernel offers it.
+#define ORDER_IO_ENV "STOCK_IO"
+
+// Operations a queue holds before it has to go to the kernel
+#define ORDER_IO_DEPTH 64
+
+// Buffers a queue can have registered at once
+#define ORDER_IO_BUFFERS 4
+
+// Operation flags
+#define ORDER_IO_LINK 0x1           // The next operation starts only after this one succeeds
+#define ORDER_IO_DATASYNC 0x2       // Syncs: file data only, as fdatasync()
+
+// Offset for writes at the file position: the end, for files opened O_APPEND
+#define ORDER_IO_APPEND (-1LL)
+
+typedef struct OrderIo OrderIo;
+
+// What a backend does with queued operations
+typedef struct {
+    const char *name;
+    int (*read)(OrderIo *io, int fd, void *buf, size_t length, long long offset,
+                unsigned flags);
+    int (*write)(OrderIo *io, int fd, const void *buf, size_t length, long long offset,
+                 unsigned flags);
+    int (*sync)(OrderIo *io, int fd, unsigned flags);
+    int (*submit)(OrderIo *io);
+    int (*wait)(OrderIo *io);
+    int (*register_buffer)(OrderIo *io, void *buf, size_t length);
+    void (*close)(OrderIo *io);
+} OrderIoBackend;
+
+// Queue of reads, writes and syncs.  Queue some, submit them (they may run
+// while the caller does something else), then wait for all of them.  The
+// posix backend simply does each one as it is queued; io_uring hands a whole
+// batch to the kernel in one system call.  After an operation fails, the
+// ones not yet started are skipped and the next wait returns 0.
+struct OrderIo {
+    const OrderIoBackend *backend;
+    void *ctx;                      // The backend's
+    int failed;                     // An operation since the last wait failed
+    uint64_t calls;                 // System calls made for I/O so far
+    uint64_t operations;            // Reads, writes and syncs queued so far
+};
+
+int order_io_open(OrderIo *io, unsigned depth);
+void order_io_close(OrderIo *io);
+const char *order_io_name(const OrderIo *io);
+
+// Reads and writes must transfer exactly `length` bytes to succeed.  `buf`
+// must stay put until the wait.
+int order_io_read(OrderIo *io, int fd, void *buf, size_t length, long long offset,
+                  unsigned flags);
+int order_io_write(OrderIo *io, int fd, const void *buf, size_t length, long long offset,
+                   unsigned flags);
+int order_io_sync(OrderIo *io, int fd, unsigned flags);
+
+// Start everything queued, without waiting for it
+int order_io_submit(OrderIo *io);
+
+// Start anything still queued and wait for all of it; 1 if every operation
+// since the last wait succeeded
+int order_io_wait(OrderIo *io);
+
+// Pin a long-lived buffer so transfers within it skip the per-operation
+// page mapping.  Optional: 0 only means operations on it cost the usual.
+int order_io_register(OrderIo *io, void *buf, size_t length);
+
+#endif // ORDER_IO_H
@@ -0,0 +1,232 @@
+#include <stdlib.h>
+#include <string.h>
+#include "order_listing.h"
+#include "order_stats.h"
+
+int order_listing_compare(const void *a, const void *b) {
+    const StockOrder *order_a = *(const StockOrder * const *)a;
+    const StockOrder *order_b = *(const StockOrder * const *)b;
+
+    if (order_b->timestamp > order_a->timestamp) {
+        return 1;
+    } else if (order_b->timestamp < order_a->timestamp) {
+        return -1;
+    }
+    /* Same second: the later record is the newer order */
+    return order_b > order_a ? 1 : (order_b < order_a ? -1 : 0);
+}
+
+/* Pending orders come straight from the pending list: O(pending), not O(history).
+ * They are put in order only as far as the pages asked for. */
+static int listing_load_pending(OrderListing *listing) {
+    uint64_t start = order_stats_clock();
+    size_t i;
+
+    for (i = 0; i < listing->status.pending_count; i++) {
+        const StockOrder *order = &listing->store.records[listing->status.pending[i]];
+
+        if (order_filter_match(&listing->filter, order) &&
+            !order_view_push(&listing->candidates, order)) {
+            return 0;
+        }
+    }
+    order_stats_record(ORDER_STAT_FILTER, start, 0, 0);
+    return 1;
+}
+
+/* Filtered confirmed orders: only blocks whose summaries allow a match are read */
+static int listing_load_filtered(OrderListing *listing) {
+    size_t i, kept = 0;
+
+    if (!order_blocks_open(&listing->blocks, &listing->store)) {
+        return 0;
+    }
+    if (!order_filter_scan(&listing->filter, &listing->blocks, &listing->store,
+                           &listing->candidates, NULL)) {
+        return 0;
+    }
+    for (i = 0; i < listing->candidates.count; i++) {
+        size_t record = (size_t)(listing->candidates.items[i] - listing->store.records);
+
+        if (order_status_is_confirmed(&listing->status, record)) {
+            listing->candidates.items[kept++] = listing->candidates.items[i];
+        }
+    }
+    listing->candidates.count = kept;
+    return 1;
+}
+
+static int listing_fill_candidates(OrderListing *listing, size_t wanted) {
+    size_t i;
+
+    if (!order_selection_extend(&listing->selection, &listing->candidates, wanted,
+                                order_listing_compare)) {
+        return 0;
+    }
+    for (i = listing->view.count; i < wanted; i++) {
+        if (!order_view_push(&listing->view, listing->candidates.items[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Rows [view.count, wanted) from the daemon, copied into the arena */
+static int listing_fill_remote(OrderListing *listing, size_t wanted) {
+    while (listing->view.count < wanted) {
+        size_t count = wanted - listing->view.count, rows, total, i;
+        StockOrder *orders;
+
+        if (count > ORDER_PROTOCOL_MAX_ROWS) {
+            count = ORDER_PROTOCOL_MAX_ROWS;
+        }
+        orders = (StockOrder *)order_arena_alloc(&listing->arena, count * sizeof(StockOrder));
+        if (orders == NULL ||
+            !order_client_list(listing->client, listing->confirmed, &listing->filter,
+                               listing->view.count, count, orders, &rows, &total)) {
+            return 0;
+        }
+        /* Orders confirmed since the count was taken leave the list short */
+        if (rows == 0) {
+            break;
+        }
+        for (i = 0; i < rows; i++) {
+            if (!order_view_push(&listing->view, &orders[i])) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/* Everything but the arena, which the caller has ready */
+static int listing_start(OrderListing *listing) {
+    const OrderAllocator *allocator = &listing->arena.allocator;
+
+    order_view_init(&listing->view, allocator);
+    order_view_init(&listing->candidates, allocator);
+    order_selection_init(&listing->selection, allocator);
+    listing->total = 0;
+
+    if (listing->client != NULL) {
+        size_t rows;
+
+        /* An empty page still says how many there are */
+        return order_client_list(listing->client, listing->confirmed, &listing->filter, 0, 0,
+                                 NULL, &rows, &listing->total);
+    }
+
+    if (!open_transactions(&listing->store)) {
+        return 0;
+    }
+    if (!order_status_open(&listing->status, &listing->store)) {
+        order_store_close(&listing->store);
+        return 0;
+    }
+
+    if (!listing->confirmed || !order_filter_is_empty(&listing->filter)) {
+        if (!(listing->confirmed ? listing_load_filtered(listing) : listing_load_pending(listing))) {
+            order_blocks_close(&listing->blocks);
+            order_status_close(&listing->status);
+            order_store_close(&listing->store);
+            return 0;
+        }
+        listing->total = listing->candidates.count;
+        return 1;
+    }
+
+    if (!order_index_open(&listing->index, &listing->store)) {
+        order_status_close(&listing->status);
+        order_store_close(&listing->store);
+        return 0;
+    }
+    listing->total = listing->status.records - listing->status.pending_count;
+    order_index_cursor_init(&listing->cursor, &listing->index);
+    return 1;
+}
+
+/* The views and selection live in the arena; there is nothing to free one by one */
+static void listing_stop(OrderListing *listing) {
+    if (listing->client != NULL) {
+        return;
+    }
+    order_index_close(&listing->index);
+    order_blocks_close(&listing->blocks);
+    order_status_close(&listing->status);
+    order_store_close(&listing->store);
+}
+
+int order_listing_open(OrderListing *listing, int confirmed) {
+    memset(listing, 0, sizeof(OrderListing));
+    listing->confirmed = confirmed;
+    order_arena_init(&listing->arena, ORDER_ARENA_CHUNK);
+    if (!listing_start(listing)) {
+        order_arena_free(&listing->arena);
+        return 0;
+    }
+    return 1;
+}
+
+int order_listing_open_remote(OrderListing *listing, int confirmed, OrderClient *client) {
+    memset(listing, 0, sizeof(OrderListing));
+    listing->confirmed = confirmed;
+    listing->client = client;
+    order_arena_init(&listing->arena, ORDER_ARENA_CHUNK);
+    if (!listing_start(listing)) {
+        order_arena_free(&listing->arena);
+        return 0;
+    }
+    return 1;
+}
+
+int order_listing_reload(OrderListing *listing) {
+    listing_stop(listing);
+    order_arena_reset(&listing->arena);
+    if (!listing_start(listing)) {
+        order_arena_free(&listing->arena);
+        return 0;
+    }
+    return 1;
+}
+
+int order_listing_filter(OrderListing *listing, const OrderFilter *filter) {
+    listing->filter = *filter;
+    return order_listing_reload(listing);
+}
+
+int order_listing_fill(OrderListing *listing, size_t wanted) {
+    uint64_t start;
+    size_t record;
+
+    if (wanted > listing->total) {
+        wanted = listing->total;
+    }
+    if (listing->client != NULL) {
+        return listing_fill_remote(listing, wanted);
+    }
+    if (!listing->confirmed || !order_filter_is_empty(&listing->filter)) {
+        return listing_fill_candidates(listing, wanted);
+    }
+
+    /* Walk the index newest first, consulting only the bitmap to skip pending */
+    start = order_stats_clock();
+    while (listing->view.count < wanted && order_index_cursor_next(&listing->cursor, &record)) {
+        if (!order_status_is_confirmed(&listing->status, record)) {
+            continue;
+        }
+        if (!order_view_push(&listing->view, &listing->store.records[record])) {
+            return 0;
+        }
+    }
+    order_stats_record(ORDER_STAT_FILTER, start, 0, 0);
+    return 1;
+}
+
+int order_listing_fill_all(OrderListing *listing) {
+    return order_listing_fill(listing, listing->total);
+}
+
+void order_listing_close(OrderListing *listing) {
+    listing_stop(listing);
+    order_arena_free(&listing->arena);
+}
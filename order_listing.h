@@ -0,0 +1,48 @@
+#ifndef ORDER_LISTING_H
+#define ORDER_LISTING_H
+
+#include <stddef.h>
+#include "order_arena.h"
+#include "order_client.h"
+#include "order_filter.h"
+#include "order_index.h"
+#include "order_status.h"
+#include "order_store.h"
+
+// Newest-first list of the orders with one status, filled a page at a time
+typedef struct {
+    OrderStore store;
+    OrderIndex index;
+    OrderStatus status;
+    OrderBlocks blocks;             // Summaries, opened only to filter confirmed orders
+    OrderIndexCursor cursor;
+    OrderFilter filter;             // Kept across reloads; empty lists everything
+    OrderView view;                 // Orders fetched so far, newest first
+    OrderView candidates;           // Pending or filtered orders, sorted only as far as read
+    OrderSelection selection;       // How far that is
+    OrderArena arena;               // Backs the views and selection; emptied on reload
+    int confirmed;                  // Status being listed
+    size_t total;                   // Orders with that status
+    OrderClient *client;            // Pages come from a daemon when set
+} OrderListing;
+
+int order_listing_open(OrderListing *listing, int confirmed);
+
+// The same list, a page at a time from the daemon at the other end of `client`
+int order_listing_open_remote(OrderListing *listing, int confirmed, OrderClient *client);
+int order_listing_fill(OrderListing *listing, size_t wanted);
+int order_listing_fill_all(OrderListing *listing);
+
+// Close and reopen on the latest data, reusing the arena's memory.  On
+// failure the listing is closed.
+int order_listing_reload(OrderListing *listing);
+
+// List only the orders `filter` matches (an empty one lists them all).
+// Reloads like order_listing_reload().
+int order_listing_filter(OrderListing *listing, const OrderFilter *filter);
+void order_listing_close(OrderListing *listing);
+
+// Newest first, for qsort() over an OrderView; same-second orders by record
+int order_listing_compare(const void *a, const void *b);
+
+#endif // ORDER_LISTING_H
@@ -0,0 +1,239 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  /* For F_OFD_SETLKW */
+#endif
+#include "order_lock.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/* Byte 0 stands for the writer lock, byte 1 the matcher; record n is byte n + 2 */
+#define LOCK_WRITER_BYTE 0
+#define LOCK_MATCHER_BYTE 1
+#define LOCK_RECORD_BASE 2
+
+#ifdef F_OFD_SETLKW
+/*
+ * Open file description locks belong to the descriptor's open file, not
+ * the process.  Each thread opens the lock file for itself, so the locks
+ * keep threads apart as well as processes.
+ */
+#define LOCK_SET F_OFD_SETLKW
+
+static pthread_once_t lock_once = PTHREAD_ONCE_INIT;
+static pthread_key_t lock_key;      /* This thread's descriptor + 1; NULL = none */
+static int lock_key_ok = 0;
+
+static int thread_fd(void) {
+    return lock_key_ok ? (int)(intptr_t)pthread_getspecific(lock_key) - 1 : -1;
+}
+
+static void set_thread_fd(int fd) {
+    pthread_setspecific(lock_key, (void *)(intptr_t)(fd + 1));
+}
+
+static void close_thread_fd(void *value) {
+    close((int)(intptr_t)value - 1);
+}
+
+/* A forked child shares its parent's open file, and so its locks: it opens its own */
+static void forget_after_fork(void) {
+    int fd = thread_fd();
+
+    if (fd >= 0) {
+        close(fd);
+        set_thread_fd(-1);
+    }
+}
+
+static void lock_init(void) {
+    lock_key_ok = pthread_key_create(&lock_key, close_thread_fd) == 0 &&
+                  pthread_atfork(NULL, NULL, forget_after_fork) == 0;
+}
+
+int order_lock_open(void) {
+    int fd;
+
+    pthread_once(&lock_once, lock_init);
+    if (!lock_key_ok) {
+        return 0;
+    }
+    fd = thread_fd();
+    if (fd < 0) {
+        /* Kept for the thread's life: closing it would release every lock it holds */
+        fd = open(TRANSACTIONS_LOCK_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return 0;
+        }
+        set_thread_fd(fd);
+    }
+    return 1;
+}
+
+void order_lock_close(void) {
+    int fd = thread_fd();
+
+    if (fd >= 0) {
+        close(fd);
+        set_thread_fd(-1);
+    }
+}
+
+/* Open file description locks already exclude other threads */
+static int lock_thread(int byte) {
+    (void)byte;
+    return 1;
+}
+
+static void unlock_thread(int byte) {
+    (void)byte;
+}
+#else
+/*
+ * Plain fcntl() locks belong to the process, so they don't keep its own
+ * threads apart: the writer and matcher locks also take a mutex.
+ */
+#define LOCK_SET F_SETLKW
+
+static pthread_once_t lock_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t thread_locks[2];  /* Writer, matcher; recursive, as fcntl() is */
+static int lock_fd = -1;
+
+static void lock_init(void) {
+    pthread_mutexattr_t attr;
+    int i;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    for (i = 0; i < 2; i++) {
+        pthread_mutex_init(&thread_locks[i], &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+}
+
+int order_lock_open(void) {
+    pthread_once(&lock_once, lock_init);
+    if (lock_fd < 0) {
+        /* Opened once and kept: closing it would release every lock we hold */
+        lock_fd = open(TRANSACTIONS_LOCK_FILE, O_RDWR | O_CREAT, 0644);
+    }
+    return lock_fd >= 0;
+}
+
+void order_lock_close(void) {
+    if (lock_fd >= 0) {
+        close(lock_fd);
+        lock_fd = -1;
+    }
+}
+
+static int thread_fd(void) {
+    return lock_fd;
+}
+
+static int lock_thread(int byte) {
+    pthread_once(&lock_once, lock_init);
+    return pthread_mutex_lock(&thread_locks[byte]) == 0;
+}
+
+static void unlock_thread(int byte) {
+    pthread_mutex_unlock(&thread_locks[byte]);
+}
+#endif
+
+static int lock_range(short type, off_t start, off_t length) {
+    struct flock fl;
+
+    if (!order_lock_open()) {
+        return 0;
+    }
+
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = start;
+    fl.l_len = length;
+    fl.l_pid = 0;  /* Must be 0 for open file description locks */
+    while (fcntl(thread_fd(), LOCK_SET, &fl) != 0) {
+        if (errno != EINTR) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int order_lock_writer(void) {
+    if (!lock_thread(LOCK_WRITER_BYTE)) {
+        return 0;
+    }
+    if (!lock_range(F_WRLCK, LOCK_WRITER_BYTE, 1)) {
+        unlock_thread(LOCK_WRITER_BYTE);
+        return 0;
+    }
+    return 1;
+}
+
+void order_unlock_writer(void) {
+    lock_range(F_UNLCK, LOCK_WRITER_BYTE, 1);
+    unlock_thread(LOCK_WRITER_BYTE);
+}
+
+int order_lock_matcher(void) {
+    if (!lock_thread(LOCK_MATCHER_BYTE)) {
+        return 0;
+    }
+    if (!lock_range(F_WRLCK, LOCK_MATCHER_BYTE, 1)) {
+        unlock_thread(LOCK_MATCHER_BYTE);
+        return 0;
+    }
+    return 1;
+}
+
+void order_unlock_matcher(void) {
+    lock_range(F_UNLCK, LOCK_MATCHER_BYTE, 1);
+    unlock_thread(LOCK_MATCHER_BYTE);
+}
+
+int order_lock_records(size_t first, size_t count) {
+    return lock_range(F_WRLCK, (off_t)(LOCK_RECORD_BASE + first), (off_t)count);
+}
+
+void order_unlock_records(size_t first, size_t count) {
+    lock_range(F_UNLCK, (off_t)(LOCK_RECORD_BASE + first), (off_t)count);
+}
+#else
+/* Single-process platforms have nobody to exclude */
+int order_lock_open(void) {
+    return 1;
+}
+
+void order_lock_close(void) {
+}
+
+int order_lock_writer(void) {
+    return 1;
+}
+
+void order_unlock_writer(void) {
+}
+
+int order_lock_matcher(void) {
+    return 1;
+}
+
+void order_unlock_matcher(void) {
+}
+
+int order_lock_records(size_t first, size_t count) {
+    (void)first;
+    (void)count;
+    return 1;
+}
+
+void order_unlock_records(size_t first, size_t count) {
+    (void)first;
+    (void)count;
+}
+#endif
@@ -0,0 +1,37 @@
+#ifndef ORDER_LOCK_H
+#define ORDER_LOCK_H
+
+#include <stddef.h>
+
+// Advisory locks shared by every process and thread using the store.  They
+// live on a separate file because closing any descriptor for a file drops
+// all of a process's fcntl() locks on it, and the data file is opened all
+// over.  Where open file description locks (F_OFD_SETLKW) exist, each
+// thread opens the file for itself and the locks exclude threads too.
+// Elsewhere the writer and matcher locks also take an in-process mutex,
+// and record locks only exclude other processes: one confirmation runs at
+// a time per process.
+#define TRANSACTIONS_LOCK_FILE "transactions.lck"
+
+// Open this thread's lock file now rather than on first use.  Returns 0 if
+// it can't be opened.
+int order_lock_open(void);
+
+// Let go of this thread's lock file, so its next lock opens the one in the
+// current directory: for a thread about to work on another store.
+// Releases every lock it holds.
+void order_lock_close(void);
+
+// Exclusive: placing appends, rewriting sidecar files, creating the store
+int order_lock_writer(void);
+void order_unlock_writer(void);
+
+// Exclusive: one matching session at a time
+int order_lock_matcher(void);
+void order_unlock_matcher(void);
+
+// Exclusive per record: flipping confirmed flags
+int order_lock_records(size_t first, size_t count);
+void order_unlock_records(size_t first, size_t count);
+
+#endif // ORDER_LOCK_H
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "order_fills.h"
+#include "order_listing.h"
+#include "order_lock.h"
+#include "order_match.h"
+#include "order_positions.h"
+#include "order_store.h"
+#include "order_symbols.h"
+
+/* Fills read per chunk while totting up what each pending order has done */
+#define FILL_READ_CHUNK 1024
+
+/* Position of a record in the ascending pending list, or count if absent */
+static size_t pending_slot(const uint64_t *pending, size_t count, uint64_t record) {
+    size_t lo = 0, hi = count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (pending[mid] == record) {
+            return mid;
+        } else if (pending[mid] < record) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return count;
+}
+
+static void credit_fill(const uint64_t *pending, size_t count, uint32_t *filled,
+                        const OrderFill *fill) {
+    size_t slot = pending_slot(pending, count, fill->buy_record);
+
+    if (slot < count) {
+        filled[slot] += fill->quantity;
+    }
+    slot = pending_slot(pending, count, fill->sell_record);
+    if (slot < count) {
+        filled[slot] += fill->quantity;
+    }
+}
+
+/* Quantity already filled for each pending order, from earlier sessions: the
+   checkpoint, then the fills logged since.  *start is where the checkpoint
+   left off, *seen the fills in the log. */
+static int load_fills(const uint64_t *pending, size_t count, uint32_t *filled,
+                      uint64_t *start, uint64_t *seen) {
+    OrderFill chunk[FILL_READ_CHUNK];
+    OrderFillReader reader;
+    OrderFilled *entries;
+    size_t entry_count, got, i;
+
+    if (!order_filled_load(&entries, &entry_count, start)) {
+        *start = 0;  /* Counted again from the first fill */
+    }
+    if (!order_fill_reader_open(&reader, *start)) {
+        free(entries);
+        return 0;
+    }
+    /* Ahead of the log means the log was replaced: count it all again */
+    if (reader.next != *start) {
+        entry_count = 0;
+        *start = 0;
+        order_fill_reader_close(&reader);
+        if (!order_fill_reader_open(&reader, 0)) {
+            free(entries);
+            return 0;
+        }
+    }
+
+    for (i = 0; i < entry_count; i++) {
+        size_t slot = pending_slot(pending, count, entries[i].record);
+
+        if (slot < count) {
+            filled[slot] = entries[i].filled;
+        }
+    }
+    free(entries);
+    while ((got = order_fill_reader_next(&reader, chunk, FILL_READ_CHUNK)) > 0) {
+        for (i = 0; i < got; i++) {
+            credit_fill(pending, count, filled, &chunk[i]);
+        }
+    }
+    *seen = reader.count;
+    order_fill_reader_close(&reader);
+    return 1;
+}
+
+/* What every pending order has been filled, as of `fills` fills; orders
+   confirmed since are dropped when it is loaded */
+static int save_filled(const uint64_t *pending, size_t count, const uint32_t *filled,
+                       uint64_t fills) {
+    OrderFilled *entries;
+    size_t entry_count = 0, i;
+    int ok;
+
+    entries = (OrderFilled *)malloc((count + 1) * sizeof(OrderFilled));
+    if (entries == NULL) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        if (filled[i] > 0) {
+            entries[entry_count].record = pending[i];
+            entries[entry_count].filled = filled[i];
+            entry_count++;
+        }
+    }
+    ok = order_filled_save(entries, entry_count, fills);
+    free(entries);
+    return ok;
+}
+
+/*
+ * Pending orders are replayed oldest first with whatever quantity earlier
+ * sessions left them.  Resting orders from before never cross each other,
+ * so only orders new to the book can produce fills.  Fills are recorded
+ * before anything is confirmed: after a crash in between, the orders come
+ * back with nothing left to fill and are confirmed next time.
+ */
+int match_pending_orders(OrderMatchSummary *summary, const OrderProgress *progress) {
+    OrderListing listing;
+    OrderSymbols symbols;
+    OrderPositions positions;
+    OrderEngine engine;
+    const uint64_t *pending;
+    uint32_t *filled;
+    size_t *done;
+    size_t count, done_count = 0, i, f;
+    uint64_t fills_start = 0, fills_seen = 0;
+    int64_t now = (int64_t)time(NULL);
+    int ok;
+
+    memset(summary, 0, sizeof(OrderMatchSummary));
+    if (!order_lock_matcher()) {
+        return 0;
+    }
+    if (!order_listing_open(&listing, 0)) {
+        order_unlock_matcher();
+        return 0;
+    }
+    if (!order_listing_fill_all(&listing)) {
+        order_listing_close(&listing);
+        order_unlock_matcher();
+        return 0;
+    }
+    if (!order_symbols_open(&symbols, &listing.store)) {
+        order_listing_close(&listing);
+        order_unlock_matcher();
+        return 0;
+    }
+    if (!order_positions_catch_up(&positions, &symbols, &listing.store)) {
+        order_symbols_free(&symbols);
+        order_listing_close(&listing);
+        order_unlock_matcher();
+        return 0;
+    }
+    pending = listing.status.pending;
+    count = listing.status.pending_count;
+
+    filled = (uint32_t *)calloc(count + 1, sizeof(uint32_t));
+    done = (size_t *)malloc((count + 1) * sizeof(size_t));
+    ok = filled != NULL && done != NULL && load_fills(pending, count, filled, &fills_start, &fills_seen);
+
+    /* Time priority: the listing is newest first, so walk it backwards */
+    order_engine_init(&engine);
+    for (i = listing.view.count; ok && i-- > 0; ) {
+        const StockOrder *order = listing.view.items[i];
+        size_t record = (size_t)(order - listing.store.records);
+        size_t slot = pending_slot(pending, count, record);
+        size_t first_fill = engine.fill_count;
+        OrderCompact compact;
+        uint32_t left;
+
+        if (slot == count || filled[slot] >= order->quantity) {
+            continue;
+        }
+        ok = order_compact(&symbols, order, &compact) &&
+             order_engine_submit(&engine, record, &compact, order->quantity - filled[slot],
+                                 now, &left);
+        for (f = first_fill; ok && f < engine.fill_count; f++) {
+            credit_fill(pending, count, filled, &engine.fills[f]);
+        }
+    }
+
+    if (ok) {
+        for (i = 0; i < count; i++) {
+            const StockOrder *order = &listing.store.records[pending[i]];
+
+            if (filled[i] >= order->quantity) {
+                summary->filled++;
+            } else if (order->order_type == ORDER_TYPE_MARKET) {
+                summary->closed++;  /* Market orders take what is there, then close */
+            } else {
+                summary->resting++;
+                continue;
+            }
+            done[done_count++] = (size_t)pending[i];
+        }
+        summary->orders = count;
+        summary->fills = engine.fill_count;
+    }
+
+    /* Both sides of every fill are already interned, so these are lookups */
+    for (f = 0; ok && f < engine.fill_count; f++) {
+        const OrderFill *fill = &engine.fills[f];
+        OrderCompact buy, sell;
+
+        ok = order_compact(&symbols, &listing.store.records[fill->buy_record], &buy) &&
+             order_compact(&symbols, &listing.store.records[fill->sell_record], &sell) &&
+             order_positions_apply(&positions, fill, &buy, &sell);
+    }
+
+    ok = ok && order_fills_append(engine.fills, engine.fill_count);
+    if (ok && engine.fill_count > 0) {
+        /* A checkpoint that fails to save is caught up by the next reader */
+        positions.fills += engine.fill_count;
+        order_positions_save(&positions);
+    }
+    if (ok && (engine.fill_count > 0 || fills_seen != fills_start)) {
+        /* Before anything is confirmed, so finished orders come back with nothing left to fill */
+        save_filled(pending, count, filled, fills_seen + engine.fill_count);
+    }
+    order_listing_close(&listing);
+    ok = ok && confirm_transactions(done, done_count, NULL, progress);
+
+    order_engine_free(&engine);
+    order_positions_free(&positions);
+    order_symbols_free(&symbols);
+    free(done);
+    free(filled);
+    order_unlock_matcher();
+    return ok;
+}
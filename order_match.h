@@ -0,0 +1,23 @@
+#ifndef ORDER_MATCH_H
+#define ORDER_MATCH_H
+
+#include <stddef.h>
+#include "order_book.h"
+#include "order_fills.h"
+#include "order_store.h"
+
+// Outcome of one matching session
+typedef struct {
+    size_t orders;                  // Pending orders considered
+    size_t fills;                   // New fills
+    size_t filled;                  // Orders now completely filled
+    size_t closed;                  // MARKET orders closed with quantity left unfilled
+    size_t resting;                 // LIMIT orders left on the book, still pending
+} OrderMatchSummary;
+
+// Run every pending order through the books in time priority, record the
+// fills and confirm the orders that are finished.  Progress counts the
+// finished orders as their confirmations are written.
+int match_pending_orders(OrderMatchSummary *summary, const OrderProgress *progress);
+
+#endif // ORDER_MATCH_H
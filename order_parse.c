@@ -0,0 +1,227 @@
+#include <string.h>
+#include "order_parse.h"
+
+/* Fields in a line, without and with the optional timestamp */
+#define LINE_FIELDS 7
+#define LINE_FIELDS_MAX 8
+
+static int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static char to_upper(char c) {
+    return (c >= 'a' && c <= 'z') ? (char)(c - 32) : c;
+}
+
+/* Case-insensitive comparison against an upper-case keyword */
+static int match_word(const char *text, size_t length, const char *word) {
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        if (word[i] == '\0' || to_upper(text[i]) != word[i]) {
+            return 0;
+        }
+    }
+    return word[length] == '\0';
+}
+
+/* Digits only, stopping early once the value passes `max` */
+static int parse_digits(const char *text, size_t length, unsigned long max,
+                        unsigned long *value) {
+    unsigned long v = 0;
+    size_t i;
+
+    if (length == 0) {
+        return 0;
+    }
+    for (i = 0; i < length; i++) {
+        if (!is_digit(text[i])) {
+            return 0;
+        }
+        v = v * 10 + (unsigned long)(text[i] - '0');
+        if (v > max) {
+            return 0;
+        }
+    }
+    *value = v;
+    return 1;
+}
+
+int order_parse_account(const char *text, size_t length, uint32_t *account) {
+    unsigned long value;
+
+    if (!parse_digits(text, length, ORDER_ACCOUNT_MAX, &value) || value < ORDER_ACCOUNT_MIN) {
+        return 0;
+    }
+    *account = (uint32_t)value;
+    return 1;
+}
+
+int order_parse_broker(const char *text, size_t length, char *broker_id) {
+    if (length < ORDER_BROKER_MIN || length > ORDER_BROKER_MAX) {
+        return 0;
+    }
+    memset(broker_id, 0, ORDER_BROKER_MAX + 1);
+    memcpy(broker_id, text, length);
+    return 1;
+}
+
+int order_parse_action(const char *text, size_t length, uint8_t *action) {
+    if (match_word(text, length, "BUY")) {
+        *action = ORDER_ACTION_BUY;
+    } else if (match_word(text, length, "SELL")) {
+        *action = ORDER_ACTION_SELL;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+int order_parse_quantity(const char *text, size_t length, uint32_t *quantity) {
+    unsigned long value;
+
+    if (!parse_digits(text, length, ORDER_QUANTITY_MAX, &value) || value < 1) {
+        return 0;
+    }
+    *quantity = (uint32_t)value;
+    return 1;
+}
+
+/* Whole dollars with up to two decimal places, straight to cents */
+int order_parse_price(const char *text, size_t length, uint32_t *price_cents) {
+    unsigned long cents = 0;
+    size_t i = 0, decimals = 0;
+
+    while (i < length && is_digit(text[i])) {
+        cents = cents * 10 + (unsigned long)(text[i] - '0');
+        if (cents > ORDER_PRICE_MAX_CENTS / 100) {
+            return 0;
+        }
+        i++;
+    }
+    if (i == 0 && (length == 0 || text[0] != '.')) {
+        return 0;
+    }
+    cents *= 100;
+
+    if (i < length && text[i] == '.') {
+        i++;
+        while (i < length && is_digit(text[i])) {
+            if (++decimals > 2) {
+                return 0;
+            }
+            cents += (unsigned long)(text[i] - '0') * (decimals == 1 ? 10 : 1);
+            i++;
+        }
+    }
+    if (i != length || cents < 1 || cents > ORDER_PRICE_MAX_CENTS) {
+        return 0;
+    }
+    *price_cents = (uint32_t)cents;
+    return 1;
+}
+
+int order_parse_ticker(const char *text, size_t length, char *ticker) {
+    size_t i;
+
+    if (length < 1 || length > ORDER_TICKER_MAX) {
+        return 0;
+    }
+    memset(ticker, 0, ORDER_TICKER_MAX + 1);
+    for (i = 0; i < length; i++) {
+        char c = to_upper(text[i]);
+        if (c < 'A' || c > 'Z') {
+            return 0;
+        }
+        ticker[i] = c;
+    }
+    return 1;
+}
+
+int order_parse_type(const char *text, size_t length, uint8_t *order_type) {
+    if (match_word(text, length, "LIMIT")) {
+        *order_type = ORDER_TYPE_LIMIT;
+    } else if (match_word(text, length, "MARKET")) {
+        *order_type = ORDER_TYPE_MARKET;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static int parse_timestamp(const char *text, size_t length, int64_t *timestamp) {
+    int64_t value = 0;
+    size_t i;
+
+    /* Seconds since 1970, up to year 9999 */
+    if (length == 0 || length > 12) {
+        return 0;
+    }
+    for (i = 0; i < length; i++) {
+        if (!is_digit(text[i])) {
+            return 0;
+        }
+        value = value * 10 + (text[i] - '0');
+    }
+    *timestamp = value;
+    return 1;
+}
+
+int order_parse_line(const char *line, size_t length, int64_t now,
+                     StockOrder *order, const char **error) {
+    const char *field[LINE_FIELDS_MAX];
+    size_t field_length[LINE_FIELDS_MAX];
+    const char *p = line, *end = line + length;
+    size_t fields = 0;
+
+    /* Split on commas, trimming blanks around each field */
+    for (;;) {
+        const char *comma = (const char *)memchr(p, ',', (size_t)(end - p));
+        const char *stop = comma != NULL ? comma : end;
+
+        if (fields == LINE_FIELDS_MAX) {
+            fields++;
+            break;
+        }
+        while (p < stop && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        field[fields] = p;
+        while (stop > p && (stop[-1] == ' ' || stop[-1] == '\t' || stop[-1] == '\r')) {
+            stop--;
+        }
+        field_length[fields++] = (size_t)(stop - p);
+        if (comma == NULL) {
+            break;
+        }
+        p = comma + 1;
+    }
+    if (fields < LINE_FIELDS || fields > LINE_FIELDS_MAX) {
+        *error = "Expected 7 or 8 comma-separated fields";
+        return 0;
+    }
+
+    memset(order, 0, sizeof(StockOrder));
+    order->timestamp = now;
+    if (!order_parse_account(field[0], field_length[0], &order->customer_account_no)) {
+        *error = "Account number must be 6 digits";
+    } else if (!order_parse_broker(field[1], field_length[1], order->broker_id)) {
+        *error = "Broker ID must be between 3 and 15 characters";
+    } else if (!order_parse_action(field[2], field_length[2], &order->action)) {
+        *error = "Action must be BUY or SELL";
+    } else if (!order_parse_quantity(field[3], field_length[3], &order->quantity)) {
+        *error = "Quantity must be between 1 and 9999";
+    } else if (!order_parse_price(field[4], field_length[4], &order->price_cents)) {
+        *error = "Price must be between $0.01 and $9999.99";
+    } else if (!order_parse_ticker(field[5], field_length[5], order->ticker)) {
+        *error = "Ticker must be 1-7 letters";
+    } else if (!order_parse_type(field[6], field_length[6], &order->order_type)) {
+        *error = "Order type must be MARKET or LIMIT";
+    } else if (fields == LINE_FIELDS_MAX &&
+               !parse_timestamp(field[7], field_length[7], &order->timestamp)) {
+        *error = "Timestamp must be Unix seconds";
+    } else {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef ORDER_PARSE_H
+#define ORDER_PARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stock_order.h"
+
+// Validation limits shared by the interactive form and bulk ingest
+#define ORDER_ACCOUNT_MIN 100000
+#define ORDER_ACCOUNT_MAX 999999
+#define ORDER_BROKER_MIN 3
+#define ORDER_BROKER_MAX 15
+#define ORDER_TICKER_MAX 7
+#define ORDER_QUANTITY_MAX 9999
+#define ORDER_PRICE_MAX_CENTS 999999
+
+// Field parsers: text need not be NUL-terminated; 1 = valid, 0 = rejected
+int order_parse_account(const char *text, size_t length, uint32_t *account);
+int order_parse_broker(const char *text, size_t length, char *broker_id);
+int order_parse_action(const char *text, size_t length, uint8_t *action);
+int order_parse_quantity(const char *text, size_t length, uint32_t *quantity);
+int order_parse_price(const char *text, size_t length, uint32_t *price_cents);
+int order_parse_ticker(const char *text, size_t length, char *ticker);
+int order_parse_type(const char *text, size_t length, uint8_t *order_type);
+
+// Parse one CSV line:
+//   account,broker,action,quantity,price,ticker,type[,timestamp]
+// Orders without a timestamp get `now`.  On failure *error says why.
+int order_parse_line(const char *line, size_t length, int64_t now,
+                     StockOrder *order, const char **error);
+
+#endif // ORDER_PARSE_H
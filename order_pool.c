@@ -0,0 +1,191 @@
+#include "order_pool.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <unistd.h>
+#define ORDER_POOL_THREADS 1
+#endif
+
+#ifdef ORDER_POOL_THREADS
+/* One worker's remaining share: the owner takes from next, thieves from end */
+typedef struct {
+    pthread_mutex_t mutex;
+    size_t next;
+    size_t end;
+} PoolQueue;
+
+typedef struct {
+    PoolQueue queues[ORDER_POOL_MAX_WORKERS];
+    int workers;
+    OrderPoolTask run;
+    void *ctx;
+    const size_t *weights;
+    const OrderProgress *progress;
+    pthread_mutex_t progress_mutex;
+    size_t done;
+    size_t total;
+    int failed;                     /* Set by any worker: __atomic_* only */
+} Pool;
+
+typedef struct {
+    Pool *pool;
+    int worker;
+} PoolWorker;
+
+static int queue_take_front(PoolQueue *queue, size_t *task) {
+    int got = 0;
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->next < queue->end) {
+        *task = queue->next++;
+        got = 1;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return got;
+}
+
+static int queue_take_back(PoolQueue *queue, size_t *task) {
+    int got = 0;
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->next < queue->end) {
+        *task = --queue->end;
+        got = 1;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return got;
+}
+
+/* Own share first; then steal, starting with the next worker along */
+static int pool_next_task(Pool *pool, int worker, size_t *task) {
+    int i;
+
+    if (queue_take_front(&pool->queues[worker], task)) {
+        return 1;
+    }
+    for (i = 1; i < pool->workers; i++) {
+        if (queue_take_back(&pool->queues[(worker + i) % pool->workers], task)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void pool_report(Pool *pool, size_t task) {
+    if (pool->progress == NULL || pool->progress->report == NULL) {
+        return;
+    }
+    /* Serialised so the callback sees a steadily growing count */
+    pthread_mutex_lock(&pool->progress_mutex);
+    pool->done += pool->weights ? pool->weights[task] : 1;
+    pool->progress->report(pool->progress->ctx, pool->done, pool->total);
+    pthread_mutex_unlock(&pool->progress_mutex);
+}
+
+static void *pool_worker(void *arg) {
+    PoolWorker *self = (PoolWorker *)arg;
+    Pool *pool = self->pool;
+    size_t task;
+
+    while (!__atomic_load_n(&pool->failed, __ATOMIC_RELAXED) &&
+           pool_next_task(pool, self->worker, &task)) {
+        if (!pool->run(pool->ctx, task, self->worker)) {
+            __atomic_store_n(&pool->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        pool_report(pool, task);
+    }
+    return NULL;
+}
+
+int order_pool_default_workers(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cores < 1) {
+        return 1;
+    }
+    return cores > ORDER_POOL_MAX_WORKERS ? ORDER_POOL_MAX_WORKERS : (int)cores;
+}
+
+int order_pool_run(size_t count, int workers, OrderPoolTask run, void *ctx,
+                   const size_t *weights, const OrderProgress *progress) {
+    static Pool pool;  /* Big, and only one batch runs at a time */
+    PoolWorker self[ORDER_POOL_MAX_WORKERS];
+    pthread_t threads[ORDER_POOL_MAX_WORKERS];
+    int started, i;
+    size_t t;
+
+    if (workers <= 0) {
+        workers = order_pool_default_workers();
+    }
+    if (workers > ORDER_POOL_MAX_WORKERS) {
+        workers = ORDER_POOL_MAX_WORKERS;
+    }
+    if ((size_t)workers > count) {
+        workers = count > 0 ? (int)count : 1;
+    }
+
+    pool.workers = workers;
+    pool.run = run;
+    pool.ctx = ctx;
+    pool.weights = weights;
+    pool.progress = progress;
+    pool.done = 0;
+    pool.total = 0;
+    pool.failed = 0;
+    for (t = 0; t < count; t++) {
+        pool.total += weights ? weights[t] : 1;
+    }
+    pthread_mutex_init(&pool.progress_mutex, NULL);
+    for (i = 0; i < workers; i++) {
+        pthread_mutex_init(&pool.queues[i].mutex, NULL);
+        pool.queues[i].next = count * (size_t)i / (size_t)workers;
+        pool.queues[i].end = count * (size_t)(i + 1) / (size_t)workers;
+        self[i].pool = &pool;
+        self[i].worker = i;
+    }
+
+    /* Worker 0 is this thread; any that can't be started are stolen from */
+    for (started = 1; started < workers; started++) {
+        if (pthread_create(&threads[started], NULL, pool_worker, &self[started]) != 0) {
+            break;
+        }
+    }
+    pool_worker(&self[0]);
+    for (i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    /* Every worker is past the barrier */
+    for (i = 0; i < workers; i++) {
+        pthread_mutex_destroy(&pool.queues[i].mutex);
+    }
+    pthread_mutex_destroy(&pool.progress_mutex);
+    return !__atomic_load_n(&pool.failed, __ATOMIC_RELAXED);
+}
+#else
+int order_pool_default_workers(void) {
+    return 1;
+}
+
+/* No threads: the tasks simply run in order */
+int order_pool_run(size_t count, int workers, OrderPoolTask run, void *ctx,
+                   const size_t *weights, const OrderProgress *progress) {
+    size_t task, done = 0, total = 0;
+
+    (void)workers;
+    for (task = 0; task < count; task++) {
+        total += weights ? weights[task] : 1;
+    }
+    for (task = 0; task < count; task++) {
+        if (!run(ctx, task, 0)) {
+            return 0;
+        }
+        done += weights ? weights[task] : 1;
+        if (progress != NULL && progress->report != NULL) {
+            progress->report(progress->ctx, done, total);
+        }
+    }
+    return 1;
+}
+#endif
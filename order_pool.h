@@ -0,0 +1,25 @@
+#ifndef ORDER_POOL_H
+#define ORDER_POOL_H
+
+#include <stddef.h>
+#include "order_store.h"
+
+// Upper bound on worker threads, whatever the core count
+#define ORDER_POOL_MAX_WORKERS 32
+
+// One task of a batch; `worker` is in [0, workers) and fixed for the
+// calling thread, for per-worker scratch state.  Returns 0 on failure.
+typedef int (*OrderPoolTask)(void *ctx, size_t task, int worker);
+
+// Workers to use by default: one per online core
+int order_pool_default_workers(void);
+
+// Run tasks [0, count) on `workers` threads (0 = default) and wait for all
+// of them.  Each worker starts on its own contiguous share of the tasks,
+// in order, and steals from the far end of the others' shares when its
+// own runs out.  Once a task has failed no new ones are started.
+// `weights` (NULL = 1 each) are summed into `progress` as tasks finish.
+int order_pool_run(size_t count, int workers, OrderPoolTask run, void *ctx,
+                   const size_t *weights, const OrderProgress *progress);
+
+#endif // ORDER_POOL_H
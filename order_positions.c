@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "order_fills.h"
+#include "order_lock.h"
+#include "order_positions.h"
+
+#define TRANSACTIONS_POSITIONS_TEMP_FILE "transactions.pos.tmp"
+#define POSITION_INITIAL_SLOTS 256
+
+/* Fills read per chunk while catching up */
+#define POSITION_FILL_CHUNK 1024
+
+static uint32_t load_le32(const unsigned char *p) {
+    return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+static uint64_t load_le64(const unsigned char *p) {
+    return ((uint64_t)load_le32(p + 4) << 32) | load_le32(p);
+}
+
+static void store_le32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static void store_le64(unsigned char *p, uint64_t v) {
+    store_le32(p, (uint32_t)v);
+    store_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+static void header_encode(unsigned char *out, uint64_t fills, uint64_t accounts, uint64_t brokers) {
+    memset(out, 0, ORDER_POSITIONS_HEADER_SIZE);
+    memcpy(out, ORDER_POSITIONS_MAGIC, 4);
+    out[4] = ORDER_POSITIONS_VERSION & 0xFF;
+    out[5] = ORDER_POSITIONS_VERSION >> 8;
+    out[6] = ORDER_POSITIONS_HEADER_SIZE & 0xFF;
+    out[7] = ORDER_POSITIONS_HEADER_SIZE >> 8;
+    store_le64(out + 8, fills);
+    store_le64(out + 16, accounts);
+    store_le64(out + 24, brokers);
+}
+
+static void totals_encode(unsigned char *out, const OrderPositionTotals *totals) {
+    store_le64(out, totals->bought);
+    store_le64(out + 8, totals->sold);
+    store_le64(out + 16, totals->buy_notional);
+    store_le64(out + 24, totals->sell_notional);
+}
+
+static void totals_decode(OrderPositionTotals *totals, const unsigned char *in) {
+    totals->bought = load_le64(in);
+    totals->sold = load_le64(in + 8);
+    totals->buy_notional = load_le64(in + 16);
+    totals->sell_notional = load_le64(in + 24);
+}
+
+static size_t position_hash(uint32_t account, uint32_t ticker) {
+    uint64_t key = ((uint64_t)account << 32) | ticker;
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+void order_positions_init(OrderPositions *positions) {
+    memset(positions, 0, sizeof(OrderPositions));
+}
+
+void order_positions_free(OrderPositions *positions) {
+    free(positions->accounts);
+    free(positions->slots);
+    free(positions->brokers);
+    order_positions_init(positions);
+}
+
+static size_t find_slot(const OrderPositions *positions, uint32_t account, uint32_t ticker) {
+    size_t mask = positions->slot_count - 1;
+    size_t i = position_hash(account, ticker) & mask;
+
+    while (positions->slots[i] != 0) {
+        const OrderAccountPosition *entry = &positions->accounts[positions->slots[i] - 1];
+
+        if (entry->account == account && entry->ticker == ticker) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int grow_slots(OrderPositions *positions) {
+    size_t count = positions->slot_count ? positions->slot_count * 2 : POSITION_INITIAL_SLOTS;
+    uint32_t *old = positions->slots;
+    size_t i;
+
+    positions->slots = (uint32_t *)calloc(count, sizeof(uint32_t));
+    if (positions->slots == NULL) {
+        positions->slots = old;
+        return 0;
+    }
+    positions->slot_count = count;
+    for (i = 0; i < positions->account_count; i++) {
+        const OrderAccountPosition *entry = &positions->accounts[i];
+        positions->slots[find_slot(positions, entry->account, entry->ticker)] = (uint32_t)(i + 1);
+    }
+    free(old);
+    return 1;
+}
+
+const OrderPositionTotals *order_position_find(const OrderPositions *positions,
+                                               uint32_t account, uint32_t ticker) {
+    size_t slot;
+
+    if (positions->slot_count == 0) {
+        return NULL;
+    }
+    slot = find_slot(positions, account, ticker);
+    if (positions->slots[slot] == 0) {
+        return NULL;
+    }
+    return &positions->accounts[positions->slots[slot] - 1].totals;
+}
+
+const OrderPositionTotals *order_position_broker(const OrderPositions *positions,
+                                                 uint32_t broker) {
+    return broker < positions->broker_count ? &positions->brokers[broker] : NULL;
+}
+
+/* Totals for (account, ticker), added zeroed if this is its first fill */
+static OrderPositionTotals *account_totals(OrderPositions *positions, uint32_t account,
+                                           uint32_t ticker) {
+    OrderAccountPosition *entry;
+    size_t slot;
+
+    if ((positions->account_count + 1) * 2 > positions->slot_count && !grow_slots(positions)) {
+        return NULL;
+    }
+    slot = find_slot(positions, account, ticker);
+    if (positions->slots[slot] != 0) {
+        return &positions->accounts[positions->slots[slot] - 1].totals;
+    }
+
+    if (positions->account_count == positions->account_capacity) {
+        size_t capacity = positions->account_capacity ? positions->account_capacity * 2 : 64;
+        OrderAccountPosition *accounts = (OrderAccountPosition *)realloc(
+            positions->accounts, capacity * sizeof(OrderAccountPosition));
+        if (accounts == NULL) {
+            return NULL;
+        }
+        positions->accounts = accounts;
+        positions->account_capacity = capacity;
+    }
+    entry = &positions->accounts[positions->account_count];
+    memset(entry, 0, sizeof(OrderAccountPosition));
+    entry->account = account;
+    entry->ticker = ticker;
+    positions->slots[slot] = (uint32_t)++positions->account_count;
+    return &entry->totals;
+}
+
+static OrderPositionTotals *broker_totals(OrderPositions *positions, uint32_t broker) {
+    if (broker >= positions->broker_count) {
+        size_t count = positions->broker_count ? positions->broker_count : 16;
+        OrderPositionTotals *brokers;
+
+        while (count <= broker) {
+            count *= 2;
+        }
+        brokers = (OrderPositionTotals *)realloc(positions->brokers,
+                                                 count * sizeof(OrderPositionTotals));
+        if (brokers == NULL) {
+            return NULL;
+        }
+        memset(brokers + positions->broker_count, 0,
+               (count - positions->broker_count) * sizeof(OrderPositionTotals));
+        positions->brokers = brokers;
+        positions->broker_count = count;
+    }
+    return &positions->brokers[broker];
+}
+
+static int add_totals(OrderPositionTotals *totals, int buying, uint32_t quantity,
+                      uint64_t notional) {
+    if (totals == NULL) {
+        return 0;
+    }
+    if (buying) {
+        totals->bought += quantity;
+        totals->buy_notional += notional;
+    } else {
+        totals->sold += quantity;
+        totals->sell_notional += notional;
+    }
+    return 1;
+}
+
+int order_positions_apply(OrderPositions *positions, const OrderFill *fill,
+                          const OrderCompact *buy, const OrderCompact *sell) {
+    uint64_t notional = (uint64_t)fill->price_cents * fill->quantity;
+
+    /* One lookup at a time: each may move the arrays the last one pointed into */
+    return add_totals(account_totals(positions, buy->customer_account_no, buy->ticker),
+                      1, fill->quantity, notional) &&
+           add_totals(broker_totals(positions, buy->broker), 1, fill->quantity, notional) &&
+           add_totals(account_totals(positions, sell->customer_account_no, sell->ticker),
+                      0, fill->quantity, notional) &&
+           add_totals(broker_totals(positions, sell->broker), 0, fill->quantity, notional);
+}
+
+/* Empty aggregates if the checkpoint is missing, of another version or torn */
+static void positions_load(OrderPositions *positions) {
+    unsigned char header[ORDER_POSITIONS_HEADER_SIZE], expected[ORDER_POSITIONS_HEADER_SIZE];
+    unsigned char entry[ORDER_POSITION_ACCOUNT_SIZE];
+    uint64_t fills, accounts, brokers, i;
+    FILE *fp;
+    int ok = 1;
+
+    order_positions_init(positions);
+    fp = fopen(TRANSACTIONS_POSITIONS_FILE, "rb");
+    if (fp == NULL) {
+        return;
+    }
+    if (fread(header, sizeof(header), 1, fp) != 1) {
+        fclose(fp);
+        return;
+    }
+    /* Everything but the counts must be what this version writes */
+    fills = load_le64(header + 8);
+    accounts = load_le64(header + 16);
+    brokers = load_le64(header + 24);
+    header_encode(expected, fills, accounts, brokers);
+    if (memcmp(header, expected, sizeof(header)) != 0 || brokers > UINT32_MAX) {
+        fclose(fp);
+        return;
+    }
+
+    for (i = 0; ok && i < accounts; i++) {
+        OrderPositionTotals *totals;
+
+        ok = fread(entry, sizeof(entry), 1, fp) == 1 &&
+             (totals = account_totals(positions, load_le32(entry), load_le32(entry + 4))) != NULL;
+        if (ok) {
+            totals_decode(totals, entry + 8);
+        }
+    }
+    if (ok && brokers > 0) {
+        ok = broker_totals(positions, (uint32_t)(brokers - 1)) != NULL;
+    }
+    for (i = 0; ok && i < brokers; i++) {
+        ok = fread(entry, ORDER_POSITION_TOTALS_SIZE, 1, fp) == 1;
+        if (ok) {
+            totals_decode(&positions->brokers[i], entry);
+        }
+    }
+    fclose(fp);
+
+    /* A torn checkpoint is rebuilt from the fills */
+    if (ok) {
+        positions->fills = fills;
+    } else {
+        order_positions_free(positions);
+    }
+}
+
+int order_positions_save(const OrderPositions *positions) {
+    unsigned char header[ORDER_POSITIONS_HEADER_SIZE], entry[ORDER_POSITION_ACCOUNT_SIZE];
+    size_t i;
+    FILE *fp;
+    int ok;
+
+    fp = fopen(TRANSACTIONS_POSITIONS_TEMP_FILE, "wb");
+    if (fp == NULL) {
+        return 0;
+    }
+    header_encode(header, positions->fills, positions->account_count, positions->broker_count);
+    ok = fwrite(header, sizeof(header), 1, fp) == 1;
+    for (i = 0; ok && i < positions->account_count; i++) {
+        const OrderAccountPosition *account = &positions->accounts[i];
+
+        store_le32(entry, account->account);
+        store_le32(entry + 4, account->ticker);
+        totals_encode(entry + 8, &account->totals);
+        ok = fwrite(entry, sizeof(entry), 1, fp) == 1;
+    }
+    for (i = 0; ok && i < positions->broker_count; i++) {
+        totals_encode(entry, &positions->brokers[i]);
+        ok = fwrite(entry, ORDER_POSITION_TOTALS_SIZE, 1, fp) == 1;
+    }
+    if (fclose(fp) != 0 || !ok || rename(TRANSACTIONS_POSITIONS_TEMP_FILE, TRANSACTIONS_POSITIONS_FILE) != 0) {
+        remove(TRANSACTIONS_POSITIONS_TEMP_FILE);
+        return 0;
+    }
+    return 1;
+}
+
+/* Count one fill from the log, looking its orders up in the store */
+static int apply_logged(OrderPositions *positions, OrderSymbols *symbols,
+                        const OrderStore *store, const OrderFill *fill) {
+    OrderCompact buy, sell;
+
+    if (fill->buy_record >= store->count || fill->sell_record >= store->count) {
+        return 1;  /* Made against a data file since replaced */
+    }
+    return order_compact(symbols, &store->records[fill->buy_record], &buy) &&
+           order_compact(symbols, &store->records[fill->sell_record], &sell) &&
+           order_positions_apply(positions, fill, &buy, &sell);
+}
+
+/* Count the logged fills from `start` on; *seen is how many the log holds */
+static int count_fills(OrderPositions *positions, OrderSymbols *symbols,
+                       const OrderStore *store, uint64_t start, uint64_t *seen) {
+    OrderFill chunk[POSITION_FILL_CHUNK];
+    OrderFillReader reader;
+    size_t got, i;
+    int ok = 1;
+
+    *seen = 0;
+    if (!order_fill_reader_open(&reader, start)) {
+        return 0;
+    }
+    while (ok && (got = order_fill_reader_next(&reader, chunk, POSITION_FILL_CHUNK)) > 0) {
+        for (i = 0; ok && i < got; i++) {
+            ok = apply_logged(positions, symbols, store, &chunk[i]);
+        }
+    }
+    *seen = reader.count;
+    order_fill_reader_close(&reader);
+    return ok;
+}
+
+int order_positions_catch_up(OrderPositions *positions, OrderSymbols *symbols,
+                             const OrderStore *store) {
+    uint64_t start, seen;
+    int ok;
+
+    positions_load(positions);
+    start = positions->fills;
+    ok = count_fills(positions, symbols, store, start, &seen);
+
+    /* Ahead of the log means the log was replaced: count it all again */
+    if (ok && start > seen) {
+        order_positions_free(positions);
+        start = 0;
+        ok = count_fills(positions, symbols, store, start, &seen);
+    }
+    if (!ok) {
+        order_positions_free(positions);
+        return 0;
+    }
+    positions->fills = seen;
+    if (seen != start) {
+        order_positions_save(positions);  /* Otherwise redone by the next reader */
+    }
+    return 1;
+}
+
+int order_positions_open(OrderPositions *positions, OrderSymbols *symbols,
+                         const OrderStore *store) {
+    int ok;
+
+    order_positions_init(positions);
+    if (!order_lock_matcher()) {
+        return 0;
+    }
+    ok = order_positions_catch_up(positions, symbols, store);
+    order_unlock_matcher();
+    return ok;
+}
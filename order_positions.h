@@ -0,0 +1,80 @@
+#ifndef ORDER_POSITIONS_H
+#define ORDER_POSITIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "order_book.h"
+#include "order_store.h"
+#include "order_symbols.h"
+
+// Checkpoint file: the aggregates below, as of some number of fills
+#define TRANSACTIONS_POSITIONS_FILE "transactions.pos"
+
+// Executed shares and their value; VWAP is notional / shares
+typedef struct {
+    uint64_t bought;                // Shares
+    uint64_t sold;
+    uint64_t buy_notional;          // Cents
+    uint64_t sell_notional;
+} OrderPositionTotals;
+
+// Totals of one account in one ticker
+typedef struct {
+    uint32_t account;
+    uint32_t ticker;                // Id in OrderSymbols.tickers
+    OrderPositionTotals totals;
+} OrderAccountPosition;
+
+#define ORDER_POSITIONS_MAGIC "STKP"
+#define ORDER_POSITIONS_VERSION 1
+#define ORDER_POSITIONS_HEADER_SIZE 32
+
+// Bytes on disk of one account entry (account, ticker, then the totals)
+// and of one broker's totals
+#define ORDER_POSITION_ACCOUNT_SIZE 40
+#define ORDER_POSITION_TOTALS_SIZE 32
+
+// Header at the start of the checkpoint file.  It and everything after it
+// are little-endian; a checkpoint of another version is counted again from
+// the fills.
+typedef struct {
+    char magic[4];                  // ORDER_POSITIONS_MAGIC
+    uint16_t version;               // ORDER_POSITIONS_VERSION
+    uint16_t header_size;           // ORDER_POSITIONS_HEADER_SIZE
+    uint64_t fills;                 // Fills already counted
+    uint64_t accounts;              // Account entries that follow
+    uint64_t brokers;               // Then the totals of each broker id
+} OrderPositionsHeader;
+
+typedef struct {
+    OrderAccountPosition *accounts;
+    size_t account_count;
+    size_t account_capacity;
+    uint32_t *slots;                // Open addressing: entry + 1, 0 = empty
+    size_t slot_count;
+    OrderPositionTotals *brokers;   // Indexed by broker id
+    size_t broker_count;
+    uint64_t fills;
+} OrderPositions;
+
+void order_positions_init(OrderPositions *positions);
+void order_positions_free(OrderPositions *positions);
+
+// Count one fill against both sides' account and broker totals
+int order_positions_apply(OrderPositions *positions, const OrderFill *fill,
+                          const OrderCompact *buy, const OrderCompact *sell);
+
+// Load the checkpoint and count any fills it doesn't cover.  _catch_up is
+// for callers already holding the matcher lock; _open takes it.
+int order_positions_open(OrderPositions *positions, OrderSymbols *symbols,
+                         const OrderStore *store);
+int order_positions_catch_up(OrderPositions *positions, OrderSymbols *symbols,
+                             const OrderStore *store);
+int order_positions_save(const OrderPositions *positions);
+
+const OrderPositionTotals *order_position_find(const OrderPositions *positions,
+                                               uint32_t account, uint32_t ticker);
+const OrderPositionTotals *order_position_broker(const OrderPositions *positions,
+                                                 uint32_t broker);
+
+#endif // ORDER_POSITIONS_H
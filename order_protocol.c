@@ -0,0 +1,73 @@
+#include <string.h>
+#include "order_protocol.h"
+
+void order_put_u32(unsigned char *out, uint32_t value) {
+    out[0] = (unsigned char)value;
+    out[1] = (unsigned char)(value >> 8);
+    out[2] = (unsigned char)(value >> 16);
+    out[3] = (unsigned char)(value >> 24);
+}
+
+void order_put_u64(unsigned char *out, uint64_t value) {
+    order_put_u32(out, (uint32_t)value);
+    order_put_u32(out + 4, (uint32_t)(value >> 32));
+}
+
+uint32_t order_get_u32(const unsigned char *in) {
+    return ((uint32_t)in[3] << 24) | ((uint32_t)in[2] << 16) | ((uint32_t)in[1] << 8) | in[0];
+}
+
+uint64_t order_get_u64(const unsigned char *in) {
+    return ((uint64_t)order_get_u32(in + 4) << 32) | order_get_u32(in);
+}
+
+void order_frame_encode(unsigned char *out, const OrderFrame *frame) {
+    order_put_u32(out, frame->length);
+    out[4] = (unsigned char)frame->op;
+    out[5] = (unsigned char)(frame->op >> 8);
+    out[6] = (unsigned char)frame->status;
+    out[7] = (unsigned char)(frame->status >> 8);
+    order_put_u32(out + 8, frame->id);
+}
+
+void order_frame_decode(const unsigned char *in, OrderFrame *frame) {
+    frame->length = order_get_u32(in);
+    frame->op = (uint16_t)(in[4] | (in[5] << 8));
+    frame->status = (uint16_t)(in[6] | (in[7] << 8));
+    frame->id = order_get_u32(in + 8);
+}
+
+void order_filter_encode(unsigned char *out, const OrderFilter *filter) {
+    memcpy(out, filter->ticker, 8);
+    memcpy(out + 8, filter->broker_id, 16);
+    order_put_u32(out + 24, filter->account);
+    order_put_u64(out + 28, (uint64_t)filter->from);
+    order_put_u64(out + 36, (uint64_t)filter->to);
+}
+
+void order_filter_decode(const unsigned char *in, OrderFilter *filter) {
+    memcpy(filter->ticker, in, 8);
+    memcpy(filter->broker_id, in + 8, 16);
+    /* Names must end inside their fields, as they do in records */
+    filter->ticker[sizeof(filter->ticker) - 1] = '\0';
+    filter->broker_id[sizeof(filter->broker_id) - 1] = '\0';
+    filter->account = order_get_u32(in + 24);
+    filter->from = (int64_t)order_get_u64(in + 28);
+    filter->to = (int64_t)order_get_u64(in + 36);
+}
+
+void order_summary_encode(unsigned char *out, const OrderMatchSummary *summary) {
+    order_put_u64(out, (uint64_t)summary->orders);
+    order_put_u64(out + 8, (uint64_t)summary->fills);
+    order_put_u64(out + 16, (uint64_t)summary->filled);
+    order_put_u64(out + 24, (uint64_t)summary->closed);
+    order_put_u64(out + 32, (uint64_t)summary->resting);
+}
+
+void order_summary_decode(const unsigned char *in, OrderMatchSummary *summary) {
+    summary->orders = (size_t)order_get_u64(in);
+    summary->fills = (size_t)order_get_u64(in + 8);
+    summary->filled = (size_t)order_get_u64(in + 16);
+    summary->closed = (size_t)order_get_u64(in + 24);
+    summary->resting = (size_t)order_get_u64(in + 32);
+}
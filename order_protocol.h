@@ -0,0 +1,64 @@
+#ifndef ORDER_PROTOCOL_H
+#define ORDER_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "order_filter.h"
+#include "order_match.h"
+#include "stock_order.h"
+
+// Socket the daemon listens on, next to the store
+#define TRANSACTIONS_SOCKET_FILE "transactions.sock"
+
+// Every message is a frame: this header, little-endian, then `length`
+// bytes of payload.  Requests carry status 0; a response echoes the op
+// and id of its request.  A client may send many requests before reading
+// a response; responses come back in the order the requests were sent.
+#define ORDER_FRAME_HEADER_SIZE 12
+
+typedef struct {
+    uint32_t length;                // Payload bytes after the header
+    uint16_t op;                    // ORDER_OP_*
+    uint16_t status;                // ORDER_STATUS_* in responses
+    uint32_t id;                    // Chosen by the client
+} OrderFrame;
+
+// Largest payload either side accepts, and most rows in one response
+#define ORDER_FRAME_MAX (16 * 1024 * 1024)
+#define ORDER_PROTOCOL_MAX_ROWS 4096
+
+// Orders travel as on-disk records (48 bytes, little-endian); a filter as
+// ticker[8] broker[16] account u32 from i64 to i64.
+#define ORDER_FILTER_WIRE_SIZE 44
+
+// Requests and the payloads of their replies
+#define ORDER_OP_APPEND 1   // orders...                   -> first record u64
+#define ORDER_OP_LIST 2     // confirmed u8, pad[3], filter, offset u32, count u32
+                            //                             -> total u32, rows u32, orders...
+#define ORDER_OP_CONFIRM 3  // records u64...              -> confirmed u64
+#define ORDER_OP_QUERY 4    // filter, offset u32, count u32
+                            //                             -> total u32, blocks read u32, rows u32, orders...
+#define ORDER_OP_SUBMIT 5   // (none)                      -> orders, fills, filled, closed, resting u64
+
+#define ORDER_STATUS_OK 0
+#define ORDER_STATUS_FAILED 1       // The store operation failed
+#define ORDER_STATUS_BAD_REQUEST 2  // Unknown op or malformed payload
+
+void order_frame_encode(unsigned char *out, const OrderFrame *frame);
+void order_frame_decode(const unsigned char *in, OrderFrame *frame);
+
+// Little-endian fields
+void order_put_u32(unsigned char *out, uint32_t value);
+void order_put_u64(unsigned char *out, uint64_t value);
+uint32_t order_get_u32(const unsigned char *in);
+uint64_t order_get_u64(const unsigned char *in);
+
+void order_filter_encode(unsigned char *out, const OrderFilter *filter);
+void order_filter_decode(const unsigned char *in, OrderFilter *filter);
+
+// Summary of ORDER_OP_SUBMIT, five u64
+#define ORDER_SUMMARY_WIRE_SIZE 40
+void order_summary_encode(unsigned char *out, const OrderMatchSummary *summary);
+void order_summary_decode(const unsigned char *in, OrderMatchSummary *summary);
+
+#endif // ORDER_PROTOCOL_H
@@ -0,0 +1,253 @@
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include "order_render.h"
+#include "order_stats.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <unistd.h>
+#define ORDER_RENDER_POSIX 1
+#endif
+
+#define SECONDS_PER_DAY 86400
+
+void order_render_init(OrderRender *render) {
+    render->length = 0;
+    render->truncated = 0;
+    render->started = 0;
+    render->dates.day_start = 0;
+    render->dates.day_end = 0;
+}
+
+static void put(OrderRender *render, const char *text, size_t length) {
+    size_t room = ORDER_RENDER_CAPACITY - render->length;
+
+    if (length > room) {
+        length = room;
+        render->truncated = 1;
+    }
+    memcpy(render->text + render->length, text, length);
+    render->length += length;
+}
+
+static void put_spaces(OrderRender *render, size_t count) {
+    static const char spaces[] = "                ";
+
+    while (count > 0) {
+        size_t n = count < sizeof(spaces) - 1 ? count : sizeof(spaces) - 1;
+        put(render, spaces, n);
+        count -= n;
+    }
+}
+
+/* Like "%-<width>.<limit>s" */
+static void put_field(OrderRender *render, const char *text, size_t limit, size_t width) {
+    size_t length = 0;
+
+    while (length < limit && text[length]) {
+        length++;
+    }
+    put(render, text, length);
+    if (length < width) {
+        put_spaces(render, width - length);
+    }
+}
+
+/* Like "%-<width>lu" */
+static void put_unsigned(OrderRender *render, unsigned long value, size_t width) {
+    char digits[24];
+    size_t length = sizeof(digits);
+
+    do {
+        digits[--length] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    put_field(render, digits + length, sizeof(digits) - length, width);
+}
+
+static void put_two_digits(char *text, int value) {
+    text[0] = (char)('0' + value / 10 % 10);
+    text[1] = (char)('0' + value % 10);
+}
+
+void order_render_begin(OrderRender *render) {
+    render->length = 0;
+    render->truncated = 0;
+    render->started = order_stats_clock();
+    put(render, "\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n", ORDER_RENDER_CLEAR_LINES);
+}
+
+void order_render_text(OrderRender *render, const char *text) {
+    put(render, text, strlen(text));
+}
+
+void order_render_format(OrderRender *render, const char *format, ...) {
+    size_t room = ORDER_RENDER_CAPACITY - render->length;
+    va_list args;
+    int written;
+
+    va_start(args, format);
+    written = vsnprintf(render->text + render->length, room, format, args);
+    va_end(args);
+    if (written < 0) {
+        render->truncated = 1;
+    } else if ((size_t)written >= room) {
+        /* vsnprintf kept room for a NUL we don't need */
+        render->length = room > 0 ? ORDER_RENDER_CAPACITY - 1 : ORDER_RENDER_CAPACITY;
+        render->truncated = 1;
+    } else {
+        render->length += (size_t)written;
+    }
+}
+
+/* Look up the local day holding `timestamp`; only whole 24-hour days are kept */
+static int date_cache_fill(OrderDateCache *cache, int64_t timestamp, struct tm *local) {
+    time_t seconds = (time_t)timestamp;
+    struct tm *tm_info = localtime(&seconds);
+    struct tm midnight;
+    time_t start, end;
+
+    if (tm_info == NULL) {
+        return 0;
+    }
+    *local = *tm_info;
+    put_two_digits(cache->date, local->tm_mon + 1);
+    cache->date[2] = '/';
+    put_two_digits(cache->date + 3, local->tm_mday);
+    cache->date[5] = '/';
+    put_two_digits(cache->date + 6, local->tm_year % 100);
+    cache->date[8] = 0;
+
+    /* A day with a clock change isn't 24 hours long; it simply isn't cached */
+    midnight = *local;
+    midnight.tm_hour = midnight.tm_min = midnight.tm_sec = 0;
+    midnight.tm_isdst = -1;
+    start = mktime(&midnight);
+    midnight = *local;
+    midnight.tm_mday++;
+    midnight.tm_hour = midnight.tm_min = midnight.tm_sec = 0;
+    midnight.tm_isdst = -1;
+    end = mktime(&midnight);
+    if (start != (time_t)-1 && end != (time_t)-1 && end - start == SECONDS_PER_DAY) {
+        cache->day_start = (int64_t)start;
+        cache->day_end = (int64_t)end;
+    } else {
+        cache->day_start = cache->day_end = 0;
+    }
+    return 1;
+}
+
+void order_render_date(OrderDateCache *cache, int64_t timestamp, char *text) {
+    int hour, minute;
+
+    if (timestamp >= cache->day_start && timestamp < cache->day_end) {
+        int64_t seconds = timestamp - cache->day_start;
+        hour = (int)(seconds / 3600);
+        minute = (int)(seconds / 60 % 60);
+    } else {
+        struct tm local;
+
+        if (!date_cache_fill(cache, timestamp, &local)) {
+            /* Fallback if localtime fails */
+            sprintf(text, "UNIX:%ld", (long)timestamp);
+            return;
+        }
+        hour = local.tm_hour;
+        minute = local.tm_min;
+    }
+
+    memcpy(text, cache->date, 8);
+    text[8] = ' ';
+    put_two_digits(text + 9, hour);
+    text[11] = ':';
+    put_two_digits(text + 12, minute);
+    text[14] = 0;
+}
+
+void order_render_orders(OrderRender *render, const StockOrder *const *orders, size_t count) {
+    /* Table header with fixed widths */
+    order_render_format(render, "%-8s %-16s %-10s %-6s %-5s %-9s %-7s %-6s\n",
+                        "Acct#", "Timestamp", "Broker", "Action", "Qty", "Price", "Ticker", "Type");
+    order_render_text(render, "-------------------------------------------------------------------------------\n");
+    order_render_rows(render, orders, count);
+}
+
+void order_render_rows(OrderRender *render, const StockOrder *const *orders, size_t count) {
+    size_t i;
+
+    /* Same columns as "%-8lu %-16s %-10.10s %-6s %-5lu $%-8s %-7.7s %-6s" */
+    for (i = 0; i < count; i++) {
+        const StockOrder *order = orders[i];
+        char date[ORDER_RENDER_DATE_SIZE];
+        char price[24];
+        size_t length = sizeof(price) - 3;
+        unsigned long dollars = (unsigned long)(order->price_cents / 100);
+
+        /* Prices are whole cents; print them without going through double */
+        price[length] = '.';
+        put_two_digits(price + length + 1, (int)(order->price_cents % 100));
+        do {
+            price[--length] = (char)('0' + dollars % 10);
+            dollars /= 10;
+        } while (dollars > 0);
+        order_render_date(&render->dates, order->timestamp, date);
+
+        put_unsigned(render, (unsigned long)order->customer_account_no, 8);
+        put(render, " ", 1);
+        put_field(render, date, sizeof(date), 16);
+        put(render, " ", 1);
+        put_field(render, order->broker_id, 10, 10);
+        put(render, " ", 1);
+        put_field(render, order->action == ORDER_ACTION_BUY ? "BUY" : "SELL", 4, 6);
+        put(render, " ", 1);
+        put_unsigned(render, (unsigned long)order->quantity, 5);
+        put(render, " $", 2);
+        put_field(render, price + length, sizeof(price) - length, 8);
+        put(render, " ", 1);
+        put_field(render, order->ticker, 7, 7);
+        put(render, " ", 1);
+        put_field(render, order->order_type == ORDER_TYPE_LIMIT ? "LIMIT" : "MARKET", 6, 6);
+        put(render, "\n", 1);
+    }
+}
+
+/* A screen counts from order_render_begin() until it is written */
+static void render_record(OrderRender *render, size_t written) {
+    if (render->started != 0) {
+        order_stats_record(ORDER_STAT_RENDER, render->started, 0, written);
+        render->started = 0;
+    }
+}
+
+int order_render_flush(OrderRender *render, FILE *fp) {
+#ifdef ORDER_RENDER_POSIX
+    const char *text = render->text;
+    size_t left = render->length;
+
+    /* Anything stdio still holds goes first; then the screen, in one write() */
+    if (fflush(fp) != 0) {
+        return 0;
+    }
+    while (left > 0) {
+        ssize_t written = write(fileno(fp), text, left);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        text += written;
+        left -= (size_t)written;
+    }
+    render_record(render, render->length);
+    render->length = 0;
+    return 1;
+#else
+    int ok = fwrite(render->text, 1, render->length, fp) == render->length;
+
+    render_record(render, render->length);
+    render->length = 0;
+    return fflush(fp) == 0 && ok;
+#endif
+}
@@ -0,0 +1,54 @@
+#ifndef ORDER_RENDER_H
+#define ORDER_RENDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "stock_order.h"
+
+// Room for a whole screen: header, a page of rows and the command prompt
+#define ORDER_RENDER_CAPACITY 8192
+
+// Blank lines used to clear the screen
+#define ORDER_RENDER_CLEAR_LINES 25
+
+// Buffer size for order_render_date()
+#define ORDER_RENDER_DATE_SIZE 32
+
+// Local date of the last timestamp formatted, reused while rows stay on that day
+typedef struct {
+    int64_t day_start;              // Local midnight
+    int64_t day_end;                // Next local midnight; == day_start if not cached
+    char date[9];                   // "MM/DD/YY"
+} OrderDateCache;
+
+// One screen, formatted in memory and written out at once
+typedef struct {
+    char text[ORDER_RENDER_CAPACITY];
+    size_t length;
+    int truncated;                  // Set if the screen didn't fit
+    uint64_t started;               // order_stats_clock() at order_render_begin()
+    OrderDateCache dates;
+} OrderRender;
+
+void order_render_init(OrderRender *render);
+
+// Start a new screen, cleared the way clear_screen() does it
+void order_render_begin(OrderRender *render);
+
+void order_render_text(OrderRender *render, const char *text);
+void order_render_format(OrderRender *render, const char *format, ...);
+
+// Column headings, then one row per order in the transaction table layout
+void order_render_orders(OrderRender *render, const StockOrder *const *orders, size_t count);
+
+// The rows alone, for tables longer than one screen
+void order_render_rows(OrderRender *render, const StockOrder *const *orders, size_t count);
+
+// "MM/DD/YY HH:MM", or "UNIX:<seconds>" if there is no local time for it
+void order_render_date(OrderDateCache *cache, int64_t timestamp, char *text);
+
+// Write the screen in one go and flush it
+int order_render_flush(OrderRender *render, FILE *fp);
+
+#endif // ORDER_RENDER_H
@@ -0,0 +1,876 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "order_io.h"
+#include "order_lock.h"
+#include "order_segment.h"
+
+/* Bytes of one slot in the manifest */
+#define SLOT_SIZE 16
+
+/* Slots read per call when loading a manifest */
+#define SLOT_CHUNK 256
+
+/* Scans read a segment in pieces this big, all in flight at once */
+#define SCAN_CHUNK (256 * 1024)
+
+/* Room for ".<6 digits>" after the data path */
+#define SEGMENT_SUFFIX_SIZE 16
+
+static size_t default_segment_records = 0;
+
+static uint32_t load_le32(const unsigned char *p) {
+    return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+static void store_le32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+/* FNV-1a, as for WAL frames */
+static uint32_t segment_checksum(uint32_t hash, const void *data, size_t length) {
+    const unsigned char *p = (const unsigned char *)data;
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        hash ^= p[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+#define CHECKSUM_SEED 2166136261UL
+
+void order_segment_set_default_records(size_t records) {
+    default_segment_records = records;
+}
+
+size_t order_segment_default_records(void) {
+    size_t records = default_segment_records ? default_segment_records : ORDER_SEGMENT_RECORDS;
+
+    return (records + ORDER_SEGMENT_ALIGN - 1) / ORDER_SEGMENT_ALIGN * ORDER_SEGMENT_ALIGN;
+}
+
+int order_segment_path(char *out, const char *data_path, uint32_t file) {
+    if (strlen(data_path) + SEGMENT_SUFFIX_SIZE > FILENAME_MAX) {
+        return 0;
+    }
+    sprintf(out, "%s.%06lu", data_path, (unsigned long)file);
+    return 1;
+}
+
+static size_t segment_bytes(const OrderManifest *manifest) {
+    return manifest->segment_records * sizeof(StockOrder);
+}
+
+/* ---- Manifest ---- */
+
+static void manifest_init(OrderManifest *manifest, size_t segment_records) {
+    memset(manifest, 0, sizeof(OrderManifest));
+    manifest->segment_records = segment_records;
+}
+
+static int manifest_reserve(OrderManifest *manifest, size_t segments) {
+    OrderSegmentSlot *slots;
+    size_t capacity;
+
+    if (segments <= manifest->slot_capacity) {
+        return 1;
+    }
+    capacity = manifest->slot_capacity ? manifest->slot_capacity * 2 : SLOT_CHUNK;
+    while (capacity < segments) {
+        capacity *= 2;
+    }
+    slots = (OrderSegmentSlot *)realloc(manifest->slots, capacity * sizeof(OrderSegmentSlot));
+    if (slots == NULL) {
+        return 0;
+    }
+    manifest->slots = slots;
+    manifest->slot_capacity = capacity;
+    return 1;
+}
+
+static void slot_decode(OrderSegmentSlot *slot, const unsigned char *p) {
+    slot->file = load_le32(p);
+    slot->first = load_le32(p + 4);
+    slot->flags = load_le32(p + 8);
+    slot->checksum = load_le32(p + 12);
+}
+
+static void slot_encode(unsigned char *p, const OrderSegmentSlot *slot) {
+    store_le32(p, slot->file);
+    store_le32(p + 4, slot->first);
+    store_le32(p + 8, slot->flags);
+    store_le32(p + 12, slot->checksum);
+}
+
+static void manifest_encode_header(const OrderManifest *manifest, unsigned char *out) {
+    OrderFileHeader header;
+
+    order_file_header_init(&header);
+    order_file_header_set_records(&header, manifest->records);
+    memcpy(out, &header, sizeof(header));
+    store_le32(out + offsetof(OrderFileHeader, segment_records), (uint32_t)manifest->segment_records);
+    store_le32(out + offsetof(OrderFileHeader, segments), (uint32_t)manifest->segments);
+    store_le32(out + offsetof(OrderFileHeader, next_file), manifest->next_file);
+}
+
+/* Reads `length` bytes at `offset` of the manifest */
+typedef int (*ManifestReadFn)(void *ctx, void *buf, size_t length, long long offset);
+
+static int manifest_load(OrderManifest *manifest, ManifestReadFn read_at, void *ctx) {
+    unsigned char header[ORDER_FILE_HEADER_SIZE];
+    unsigned char chunk[SLOT_CHUNK * SLOT_SIZE];
+    size_t segments, done, i;
+
+    if (!read_at(ctx, header, sizeof(header), 0) || !order_file_header_valid(header, sizeof(header))) {
+        return 0;
+    }
+    manifest->records = order_file_header_records(header);
+    manifest->segment_records = load_le32(header + offsetof(OrderFileHeader, segment_records));
+    manifest->next_file = load_le32(header + offsetof(OrderFileHeader, next_file));
+    segments = load_le32(header + offsetof(OrderFileHeader, segments));
+
+    /* Every committed record has a segment, and segments stay page-aligned */
+    if (manifest->segment_records == 0 || manifest->segment_records % ORDER_SEGMENT_ALIGN != 0 ||
+        manifest->records > segments * manifest->segment_records ||
+        !manifest_reserve(manifest, segments)) {
+        return 0;
+    }
+
+    for (done = 0; done < segments; done += i) {
+        size_t n = segments - done < SLOT_CHUNK ? segments - done : SLOT_CHUNK;
+
+        if (!read_at(ctx, chunk, n * SLOT_SIZE, ORDER_SLOT_OFFSET(done))) {
+            return 0;
+        }
+        for (i = 0; i < n; i++) {
+            slot_decode(&manifest->slots[done + i], chunk + i * SLOT_SIZE);
+            if (manifest->slots[done + i].first > done + i) {
+                return 0;
+            }
+        }
+    }
+    manifest->segments = segments;
+    return 1;
+}
+
+static int stdio_read_at(void *ctx, void *buf, size_t length, long long offset) {
+    FILE *fp = (FILE *)ctx;
+
+    return fseek(fp, (long)offset, SEEK_SET) == 0 && fread(buf, 1, length, fp) == length;
+}
+
+int order_manifest_read(OrderManifest *manifest, const char *path) {
+    FILE *fp;
+    int ok;
+
+    manifest_init(manifest, 0);
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+    ok = manifest_load(manifest, stdio_read_at, fp);
+    fclose(fp);
+    if (!ok) {
+        order_manifest_free(manifest);
+    }
+    return ok;
+}
+
+void order_manifest_free(OrderManifest *manifest) {
+    free(manifest->slots);
+    memset(manifest, 0, sizeof(OrderManifest));
+}
+
+/* ---- Segment files ---- */
+
+void order_segment_file_init(OrderSegmentFile *file, const char *path,
+                             const OrderManifest *manifest, int writable) {
+    memset(file, 0, sizeof(OrderSegmentFile));
+    strncpy(file->path, path, sizeof(file->path) - 1);
+    file->manifest = manifest;
+    file->writable = writable;
+}
+
+/* Where record-space `offset` lives: file number, offset in it, and bytes left in its segment */
+static int segment_locate(const OrderSegmentFile *file, long long offset, uint32_t *number,
+                          long long *at, size_t *room) {
+    const OrderManifest *manifest = file->manifest;
+    long long bytes = (long long)segment_bytes(manifest);
+    size_t segment = (size_t)(offset / bytes);
+    const OrderSegmentSlot *slot;
+
+    if (offset < 0 || segment >= manifest->segments) {
+        return 0;
+    }
+    slot = &manifest->slots[segment];
+    *number = slot->file;
+    *at = (long long)(segment - slot->first) * bytes + offset % bytes;
+    *room = (size_t)(bytes - offset % bytes);
+    return 1;
+}
+
+static int segment_select(OrderSegmentFile *file, uint32_t number) {
+    char path[FILENAME_MAX];
+
+    if (file->is_open && file->file == number) {
+        return 1;
+    }
+    order_segment_file_close(file);
+    if (!order_segment_path(path, file->path, number)) {
+        return 0;
+    }
+    file->fd = open(path, file->writable ? O_RDWR : O_RDONLY);
+    if (file->fd < 0) {
+        return 0;
+    }
+    file->file = number;
+    file->is_open = 1;
+    return 1;
+}
+
+static int segment_read_at(OrderSegmentFile *file, void *buf, size_t length, long long at) {
+    char *p = (char *)buf;
+
+    while (length > 0) {
+        ssize_t n = pread(file->fd, p, length, (off_t)at);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        p += n;
+        length -= (size_t)n;
+        at += n;
+    }
+    return 1;
+}
+
+static int segment_write_at(OrderSegmentFile *file, const void *buf, size_t length, long long at) {
+    const char *p = (const char *)buf;
+
+    while (length > 0) {
+        ssize_t n = pwrite(file->fd, p, length, (off_t)at);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        p += n;
+        length -= (size_t)n;
+        at += n;
+    }
+    return 1;
+}
+
+int order_segment_read(OrderSegmentFile *file, void *buf, size_t length, long long offset) {
+    char *p = (char *)buf;
+
+    while (length > 0) {
+        uint32_t number;
+        long long at;
+        size_t room;
+
+        if (!segment_locate(file, offset, &number, &at, &room) || !segment_select(file, number)) {
+            return 0;
+        }
+        if (room > length) {
+            room = length;
+        }
+        if (!segment_read_at(file, p, room, at)) {
+            return 0;
+        }
+        p += room;
+        length -= room;
+        offset += (long long)room;
+    }
+    return 1;
+}
+
+int order_segment_write(OrderSegmentFile *file, const void *buf, size_t length,
+                        long long offset) {
+    const char *p = (const char *)buf;
+
+    while (length > 0) {
+        uint32_t number;
+        long long at;
+        size_t room;
+
+        if (!segment_locate(file, offset, &number, &at, &room) || !segment_select(file, number)) {
+            return 0;
+        }
+        if (room > length) {
+            room = length;
+        }
+        if (!segment_write_at(file, p, room, at)) {
+            return 0;
+        }
+        file->dirty = 1;
+        p += room;
+        length -= room;
+        offset += (long long)room;
+    }
+    return 1;
+}
+
+int order_segment_span(OrderSegmentFile *file, long long offset, size_t length, int *fd,
+                       long long *at) {
+    uint32_t number;
+    size_t room;
+
+    if (!segment_locate(file, offset, &number, at, &room) || room < length ||
+        !segment_select(file, number)) {
+        return 0;
+    }
+    if (file->writable) {
+        file->dirty = 1;
+    }
+    *fd = file->fd;
+    return 1;
+}
+
+int order_segment_file_sync(OrderSegmentFile *file) {
+    int ok = 1;
+
+    if (file->is_open && file->dirty) {
+        ok = fsync(file->fd) == 0;
+        file->dirty = 0;
+    }
+    return ok;
+}
+
+void order_segment_file_close(OrderSegmentFile *file) {
+    if (file->is_open) {
+        close(file->fd);
+        file->is_open = 0;
+        file->dirty = 0;
+    }
+}
+
+/* Create (or empty) a segment file */
+static int segment_create(const char *data_path, uint32_t number) {
+    char path[FILENAME_MAX];
+    FILE *fp;
+
+    if (!order_segment_path(path, data_path, number)) {
+        return 0;
+    }
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+        return 0;
+    }
+    return fclose(fp) == 0;
+}
+
+/* Open a new tail segment in memory; the previous tail is sealed */
+static int manifest_push_segment(OrderManifest *manifest) {
+    OrderSegmentSlot *slot;
+    size_t segment = manifest->segments;
+
+    if (!manifest_reserve(manifest, segment + 1)) {
+        return 0;
+    }
+    if (segment > 0) {
+        manifest->slots[segment - 1].flags |= ORDER_SEGMENT_SEALED;
+    }
+    slot = &manifest->slots[segment];
+    slot->file = manifest->next_file++;
+    slot->first = (uint32_t)segment;
+    slot->flags = 0;
+    slot->checksum = 0;
+    manifest->segments++;
+    return 1;
+}
+
+static int fd_read_at(void *ctx, void *buf, size_t length, long long offset) {
+    return pread(*(int *)ctx, buf, length, (off_t)offset) == (ssize_t)length;
+}
+
+static int fd_write_at(int fd, const void *buf, size_t length, long long offset) {
+    return pwrite(fd, buf, length, (off_t)offset) == (ssize_t)length;
+}
+
+int order_manifest_reload(OrderManifest *manifest, int fd) {
+    size_t capacity = manifest->slot_capacity;
+    OrderSegmentSlot *slots = manifest->slots;
+
+    /* Keep the slot buffer across reloads */
+    manifest_init(manifest, 0);
+    manifest->slots = slots;
+    manifest->slot_capacity = capacity;
+    return manifest_load(manifest, fd_read_at, &fd);
+}
+
+static int write_slot(int fd, const OrderManifest *manifest, size_t segment) {
+    unsigned char p[SLOT_SIZE];
+
+    slot_encode(p, &manifest->slots[segment]);
+    return fd_write_at(fd, p, sizeof(p), ORDER_SLOT_OFFSET(segment));
+}
+
+int order_manifest_extend(OrderManifest *manifest, int fd, const char *path, size_t end) {
+    while (manifest->segments * manifest->segment_records < end) {
+        unsigned char counts[8];
+        size_t segment = manifest->segments;
+
+        if (!manifest_push_segment(manifest) ||
+            !segment_create(path, manifest->slots[segment].file)) {
+            return 0;
+        }
+
+        /* The slot goes in before the count that makes it visible */
+        if ((segment > 0 && !write_slot(fd, manifest, segment - 1)) ||
+            !write_slot(fd, manifest, segment)) {
+            return 0;
+        }
+        store_le32(counts, (uint32_t)manifest->segments);
+        store_le32(counts + 4, manifest->next_file);
+        if (!fd_write_at(fd, counts, sizeof(counts), offsetof(OrderFileHeader, segments))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int order_segments_sync(const OrderManifest *manifest, const char *path, size_t first, size_t end) {
+    char segment_path[FILENAME_MAX];
+    uint32_t synced = 0;
+    int have_synced = 0;
+    size_t segment;
+
+    if (end <= first) {
+        return 1;
+    }
+    for (segment = first / manifest->segment_records;
+         segment < manifest->segments && segment * manifest->segment_records < end; segment++) {
+        uint32_t number = manifest->slots[segment].file;
+        int fd, ok;
+
+        if (have_synced && number == synced) {
+            continue;
+        }
+        if (!order_segment_path(segment_path, path, number) ||
+            (fd = open(segment_path, O_RDONLY)) < 0) {
+            return 0;
+        }
+        ok = fsync(fd) == 0;
+        close(fd);
+        if (!ok) {
+            return 0;
+        }
+        synced = number;
+        have_synced = 1;
+    }
+    return 1;
+}
+
+/* ---- Building a new store ---- */
+
+int order_segment_builder_open(OrderSegmentBuilder *builder, const char *path) {
+    memset(builder, 0, sizeof(OrderSegmentBuilder));
+    if (strlen(path) + SEGMENT_SUFFIX_SIZE > sizeof(builder->path)) {
+        return 0;
+    }
+    strcpy(builder->path, path);
+    manifest_init(&builder->manifest, order_segment_default_records());
+    order_segment_file_init(&builder->file, builder->path, &builder->manifest, 1);
+    return 1;
+}
+
+int order_segment_builder_add(OrderSegmentBuilder *builder, const StockOrder *records,
+                              size_t count) {
+    OrderManifest *manifest = &builder->manifest;
+    size_t end = manifest->records + count;
+
+    while (manifest->segments * manifest->segment_records < end) {
+        /* Each finished segment goes to disk before the next is started */
+        if (!order_segment_file_sync(&builder->file) || !manifest_push_segment(manifest) ||
+            !segment_create(builder->path, manifest->slots[manifest->segments - 1].file)) {
+            return 0;
+        }
+    }
+    if (count > 0 && !order_segment_write(&builder->file, records, count * sizeof(StockOrder),
+                                          ORDER_SEGMENT_BYTE(manifest->records))) {
+        return 0;
+    }
+    manifest->records = end;
+    return 1;
+}
+
+static int manifest_write(const OrderManifest *manifest, const char *path) {
+    unsigned char header[ORDER_FILE_HEADER_SIZE];
+    unsigned char slot[SLOT_SIZE];
+    size_t i;
+    FILE *fp;
+    int ok;
+
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+        return 0;
+    }
+    manifest_encode_header(manifest, header);
+    ok = fwrite(header, sizeof(header), 1, fp) == 1;
+    for (i = 0; ok && i < manifest->segments; i++) {
+        slot_encode(slot, &manifest->slots[i]);
+        ok = fwrite(slot, sizeof(slot), 1, fp) == 1;
+    }
+    ok = fflush(fp) == 0 && ok;
+    ok = ok && fsync(fileno(fp)) == 0;
+    return fclose(fp) == 0 && ok;
+}
+
+/* Every segment file the builder has started; each slot has its own */
+static void builder_remove_segments(OrderSegmentBuilder *builder) {
+    char segment_path[FILENAME_MAX];
+    size_t i;
+
+    for (i = 0; i < builder->manifest.segments; i++) {
+        if (order_segment_path(segment_path, builder->path, builder->manifest.slots[i].file)) {
+            remove(segment_path);
+        }
+    }
+}
+
+int order_segment_builder_finish(OrderSegmentBuilder *builder, const char *manifest_path) {
+    int ok = order_segment_file_sync(&builder->file);
+
+    order_segment_file_close(&builder->file);
+    ok = ok && manifest_write(&builder->manifest, manifest_path);
+    if (!ok) {
+        remove(manifest_path);
+        builder_remove_segments(builder);
+    }
+    order_manifest_free(&builder->manifest);
+    return ok;
+}
+
+void order_segment_builder_abandon(OrderSegmentBuilder *builder) {
+    order_segment_file_close(&builder->file);
+    builder_remove_segments(builder);
+    order_manifest_free(&builder->manifest);
+}
+
+/* ---- Compaction ---- */
+
+/* Is `number` still named by any slot? */
+static int file_referenced(const OrderManifest *manifest, uint32_t number) {
+    size_t i;
+
+    for (i = 0; i < manifest->segments; i++) {
+        if (manifest->slots[i].file == number) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int group_compacted(const OrderManifest *manifest, size_t first) {
+    size_t i;
+
+    for (i = first; i < first + ORDER_SEGMENT_COMPACT_GROUP; i++) {
+        const OrderSegmentSlot *slot = &manifest->slots[i];
+
+        if (!(slot->flags & ORDER_SEGMENT_COMPACTED) || slot->first != first ||
+            slot->file != manifest->slots[first].file) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Whole segments, one read ahead: the next segment is in flight while the
+ * caller works on the current one.  `buffers` holds two segments.
+ */
+typedef struct {
+    OrderSegmentFile file;
+    StockOrder *buffers;
+    size_t records;                 /* Per segment */
+    int current;                    /* Buffer the latest read went into */
+    int ok;                         /* The latest read was queued */
+    OrderIo io;
+} SegmentReader;
+
+static void reader_open(SegmentReader *reader, const char *path, const OrderManifest *manifest,
+                        StockOrder *buffers) {
+    order_segment_file_init(&reader->file, path, manifest, 0);
+    reader->buffers = buffers;
+    reader->records = manifest->segment_records;
+    reader->current = 1;
+    reader->ok = 0;
+    order_io_open(&reader->io, 0);
+}
+
+/* Start reading `segment` into the other buffer.  Only after the previous
+ * read is finished: it may have been in the file this one replaces. */
+static void reader_start(SegmentReader *reader, size_t segment) {
+    size_t length = reader->records * sizeof(StockOrder);
+    long long offset = ORDER_SEGMENT_BYTE(segment * reader->records);
+    long long at;
+    size_t done;
+    char *buf;
+    int fd;
+
+    reader->current ^= 1;
+    buf = (char *)(reader->buffers + (size_t)reader->current * reader->records);
+    reader->ok = order_segment_span(&reader->file, offset, length, &fd, &at);
+    for (done = 0; reader->ok && done < length; done += SCAN_CHUNK) {
+        size_t part = length - done < SCAN_CHUNK ? length - done : SCAN_CHUNK;
+
+        reader->ok = order_io_read(&reader->io, fd, buf + done, part, at + (long long)done, 0);
+    }
+    reader->ok = reader->ok && order_io_submit(&reader->io);
+}
+
+/* The segment started last, once it is all there; NULL if it couldn't be read */
+static const StockOrder *reader_finish(SegmentReader *reader) {
+    if (!order_io_wait(&reader->io)) {
+        reader->ok = 0;
+    }
+    return reader->ok ? reader->buffers + (size_t)reader->current * reader->records : NULL;
+}
+
+static void reader_close(SegmentReader *reader) {
+    order_io_close(&reader->io);  /* Waits for a read still going */
+    order_segment_file_close(&reader->file);
+}
+
+/*
+ * Copy segments [first, first + GROUP) into one new file, then point their
+ * slots at it.  Gives up, leaving everything as it was, at the first
+ * pending order.  The caller holds the writer lock.
+ */
+static int compact_group(OrderManifest *manifest, FILE *manifest_fp, const char *path,
+                         size_t first, StockOrder *buffers, int *merged) {
+    SegmentReader source;
+    OrderSegmentSlot slots[ORDER_SEGMENT_COMPACT_GROUP];
+    char new_path[FILENAME_MAX];
+    unsigned char counts[8], encoded[SLOT_SIZE];
+    uint32_t number = manifest->next_file;
+    size_t records = manifest->segment_records;
+    size_t i, j;
+    FILE *out;
+    int ok = 1;
+
+    *merged = 0;
+    if (!order_segment_path(new_path, path, number)) {
+        return 0;
+    }
+    out = fopen(new_path, "wb");
+    if (out == NULL) {
+        return 0;
+    }
+
+    reader_open(&source, path, manifest, buffers);
+    reader_start(&source, first);
+    for (i = 0; ok && i < ORDER_SEGMENT_COMPACT_GROUP; i++) {
+        size_t segment = first + i;
+        const StockOrder *buffer = reader_finish(&source);
+
+        if (i + 1 < ORDER_SEGMENT_COMPACT_GROUP) {
+            reader_start(&source, segment + 1);
+        }
+        ok = buffer != NULL;
+        for (j = 0; ok && j < records; j++) {
+            if (!buffer[j].confirmed) {
+                ok = 0;
+            }
+        }
+        if (ok) {
+            slots[i] = manifest->slots[segment];
+            slots[i].file = number;
+            slots[i].first = (uint32_t)first;
+            slots[i].flags |= ORDER_SEGMENT_COMPACTED;
+            slots[i].checksum = segment_checksum(CHECKSUM_SEED, buffer, records * sizeof(StockOrder));
+            ok = fwrite(buffer, sizeof(StockOrder), records, out) == records;
+        }
+    }
+    reader_close(&source);
+
+    ok = fflush(out) == 0 && ok;
+    ok = ok && fsync(fileno(out)) == 0;
+    if (fclose(out) != 0 || !ok) {
+        remove(new_path);
+        return 1;  /* Pending orders, most likely; try again later */
+    }
+
+    /* The new file is durable; switch the slots over, then drop the old files */
+    store_le32(counts, (uint32_t)manifest->segments);
+    store_le32(counts + 4, number + 1);
+    ok = fseek(manifest_fp, offsetof(OrderFileHeader, segments), SEEK_SET) == 0 &&
+         fwrite(counts, sizeof(counts), 1, manifest_fp) == 1;
+    for (i = 0; ok && i < ORDER_SEGMENT_COMPACT_GROUP; i++) {
+        slot_encode(encoded, &slots[i]);
+        ok = fseek(manifest_fp, (long)ORDER_SLOT_OFFSET(first + i), SEEK_SET) == 0 &&
+             fwrite(encoded, sizeof(encoded), 1, manifest_fp) == 1;
+    }
+    ok = ok && fflush(manifest_fp) == 0;
+    ok = ok && fsync(fileno(manifest_fp)) == 0;
+    if (!ok) {
+        return 0;
+    }
+    manifest->next_file = number + 1;
+
+    for (i = 0; i < ORDER_SEGMENT_COMPACT_GROUP; i++) {
+        uint32_t old = manifest->slots[first + i].file;
+
+        manifest->slots[first + i] = slots[i];
+        if (!file_referenced(manifest, old) && order_segment_path(new_path, path, old)) {
+            remove(new_path);
+        }
+    }
+    *merged = 1;
+    return 1;
+}
+
+int order_segments_compact(const char *path, size_t *merged) {
+    OrderManifest manifest;
+    StockOrder *buffers = NULL;
+    FILE *manifest_fp = NULL;
+    size_t first, done = 0;
+    int ok;
+
+    if (merged != NULL) {
+        *merged = 0;
+    }
+    if (!order_lock_writer()) {
+        return 0;
+    }
+    ok = order_manifest_read(&manifest, path);
+    if (ok) {
+        manifest_fp = fopen(path, "r+b");
+        buffers = (StockOrder *)malloc(2 * manifest.segment_records * sizeof(StockOrder));
+        ok = manifest_fp != NULL && buffers != NULL;
+    }
+
+    /* Sealed, full groups only, oldest first; stop at the first still pending */
+    for (first = 0; ok && first + ORDER_SEGMENT_COMPACT_GROUP < manifest.segments &&
+                    (first + ORDER_SEGMENT_COMPACT_GROUP) * manifest.segment_records <= manifest.records;
+         first += ORDER_SEGMENT_COMPACT_GROUP) {
+        int group_merged;
+
+        if (group_compacted(&manifest, first)) {
+            continue;
+        }
+        ok = compact_group(&manifest, manifest_fp, path, first, buffers, &group_merged);
+        if (!group_merged) {
+            break;
+        }
+        done += ORDER_SEGMENT_COMPACT_GROUP;
+    }
+
+    if (manifest_fp != NULL && fclose(manifest_fp) != 0) {
+        ok = 0;
+    }
+    free(buffers);
+    order_manifest_free(&manifest);
+    order_unlock_writer();
+    if (merged != NULL) {
+        *merged = done;
+    }
+    return ok;
+}
+
+/* The first compacted segment from `segment` on, or manifest->segments */
+static size_t next_compacted(const OrderManifest *manifest, size_t segment) {
+    while (segment < manifest->segments &&
+           !(manifest->slots[segment].flags & ORDER_SEGMENT_COMPACTED)) {
+        segment++;
+    }
+    return segment;
+}
+
+int order_segments_verify(const char *path, size_t *bad) {
+    OrderManifest manifest;
+    SegmentReader source;
+    StockOrder *buffers;
+    size_t segment, records;
+    int ok;
+
+    *bad = 0;
+    if (!order_lock_writer()) {
+        return 0;
+    }
+    ok = order_manifest_read(&manifest, path);
+    order_unlock_writer();
+    if (!ok) {
+        return 0;
+    }
+
+    /* Compacted segments never change, so no lock is needed to read them */
+    records = manifest.segment_records;
+    buffers = (StockOrder *)malloc(2 * records * sizeof(StockOrder));
+    if (buffers == NULL) {
+        order_manifest_free(&manifest);
+        return 0;
+    }
+    reader_open(&source, path, &manifest, buffers);
+    segment = next_compacted(&manifest, 0);
+    if (segment < manifest.segments) {
+        reader_start(&source, segment);
+    }
+    while (segment < manifest.segments) {
+        const StockOrder *buffer = reader_finish(&source);
+        size_t next = next_compacted(&manifest, segment + 1);
+
+        if (next < manifest.segments) {
+            reader_start(&source, next);
+        }
+        if (buffer == NULL ||
+            segment_checksum(CHECKSUM_SEED, buffer, records * sizeof(StockOrder)) !=
+                manifest.slots[segment].checksum) {
+            (*bad)++;
+        }
+        segment = next;
+    }
+    reader_close(&source);
+    free(buffers);
+    order_manifest_free(&manifest);
+    return 1;
+}
+
+void order_segments_compact_background(const char *path) {
+    pid_t child = fork();
+
+    if (child == 0) {
+        /* Detach twice so nobody has to reap the compactor */
+        if (fork() == 0) {
+            order_segments_compact(path, NULL);
+        }
+        _exit(0);
+    }
+    if (child > 0) {
+        while (waitpid(child, NULL, 0) < 0 && errno == EINTR) {
+        }
+    }
+}
+
+int order_segments_remove(const char *path) {
+    OrderManifest manifest;
+    char segment_path[FILENAME_MAX];
+    size_t i;
+
+    if (order_manifest_read(&manifest, path)) {
+        for (i = 0; i < manifest.segments; i++) {
+            /* Compacted files are named by several slots in a row */
+            if (i > 0 && manifest.slots[i].file == manifest.slots[i - 1].file) {
+                continue;
+            }
+            if (order_segment_path(segment_path, path, manifest.slots[i].file)) {
+                remove(segment_path);
+            }
+        }
+        order_manifest_free(&manifest);
+    }
+    return remove(path) == 0;
+}
@@ -0,0 +1,130 @@
+#ifndef ORDER_SEGMENT_H
+#define ORDER_SEGMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "order_format.h"
+
+// Records per segment in new stores
+#define ORDER_SEGMENT_RECORDS 65536
+
+// Segment sizes are a multiple of this, so every segment starts on a page
+// boundary (256 records = 12 KiB) and the segments map as one array
+#define ORDER_SEGMENT_ALIGN 256
+
+// Sealed, fully confirmed segments are merged this many at a time, on
+// multiples of this many segments
+#define ORDER_SEGMENT_COMPACT_GROUP 16
+
+// Slot flags
+#define ORDER_SEGMENT_SEALED 0x1        // A later segment exists; no more appends
+#define ORDER_SEGMENT_COMPACTED 0x2     // Merged, read-only and checksummed
+
+// Manifest entry: which file holds one segment's records.  Segment s
+// covers records [s * segment_records, (s + 1) * segment_records) and
+// starts (s - first) * segment_records records into its file.
+typedef struct {
+    uint32_t file;                  // File number: "<data path>.<file, 6 digits>"
+    uint32_t first;                 // First segment held by that file
+    uint32_t flags;
+    uint32_t checksum;              // FNV-1a of the segment's records, once compacted
+} OrderSegmentSlot;
+
+// The data file is the manifest: a header, then one slot per segment
+typedef struct {
+    size_t records;                 // Committed records
+    size_t segment_records;
+    size_t segments;
+    uint32_t next_file;             // Number the next new segment file gets
+    OrderSegmentSlot *slots;        // Host order
+    size_t slot_capacity;
+} OrderManifest;
+
+#define ORDER_SLOT_OFFSET(segment) \
+    ((long long)ORDER_FILE_HEADER_SIZE + (long long)(segment) * 16LL)
+
+// Byte offset of a record in the store's record space, before segmenting
+#define ORDER_SEGMENT_BYTE(record) ((long long)(record) * (long long)sizeof(StockOrder))
+
+// Records per segment used when a store is created; 0 = ORDER_SEGMENT_RECORDS
+void order_segment_set_default_records(size_t records);
+size_t order_segment_default_records(void);
+
+// "<data path>.<file, 6 digits>"; 0 if it would not fit FILENAME_MAX
+int order_segment_path(char *out, const char *data_path, uint32_t file);
+
+// Read a store's manifest.  Writers hold the writer lock; readers take it
+// around the read so no slot is seen half rewritten.
+int order_manifest_read(OrderManifest *manifest, const char *path);
+void order_manifest_free(OrderManifest *manifest);
+
+// One segment file open at a time, for reads and writes anywhere in the
+// record space.  Writes past the last segment fail: see order_manifest_extend().
+typedef struct {
+    char path[FILENAME_MAX];        // The data file's
+    const OrderManifest *manifest;
+    int writable;
+    uint32_t file;                  // Number of the file open, if is_open
+    int is_open;
+    int dirty;                      // Written since the last sync
+    int fd;
+} OrderSegmentFile;
+
+void order_segment_file_init(OrderSegmentFile *file, const char *path,
+                             const OrderManifest *manifest, int writable);
+int order_segment_read(OrderSegmentFile *file, void *buf, size_t length, long long offset);
+int order_segment_write(OrderSegmentFile *file, const void *buf, size_t length,
+                        long long offset);
+int order_segment_file_sync(OrderSegmentFile *file);
+void order_segment_file_close(OrderSegmentFile *file);
+
+// Re-read the manifest through an open descriptor of the data file
+int order_manifest_reload(OrderManifest *manifest, int fd);
+
+// Add segments (and their files) until records [0, end) all have one,
+// sealing the previous tail.  The caller holds the writer lock.
+int order_manifest_extend(OrderManifest *manifest, int fd, const char *path, size_t end);
+
+// For callers doing their own I/O: the descriptor and file offset of
+// `length` bytes at record-space `offset`, if they lie in one segment.  The
+// descriptor stays open until another file is selected or this one closed;
+// a writable file counts as written.
+int order_segment_span(OrderSegmentFile *file, long long offset, size_t length, int *fd,
+                       long long *at);
+
+// fsync() every segment file holding records [first, end)
+int order_segments_sync(const OrderManifest *manifest, const char *path, size_t first, size_t end);
+
+// Write a new store from records in file order: segment files first, then
+// the manifest at `manifest_path`, which may be a temporary name
+typedef struct {
+    OrderManifest manifest;
+    OrderSegmentFile file;
+    char path[FILENAME_MAX];
+} OrderSegmentBuilder;
+
+int order_segment_builder_open(OrderSegmentBuilder *builder, const char *path);
+int order_segment_builder_add(OrderSegmentBuilder *builder, const StockOrder *records,
+                              size_t count);
+// Write the manifest.  If that or any segment fails, nothing the builder
+// wrote is left behind.
+int order_segment_builder_finish(OrderSegmentBuilder *builder, const char *manifest_path);
+// Give up instead of finishing: every segment file written so far is removed
+void order_segment_builder_abandon(OrderSegmentBuilder *builder);
+
+// Merge sealed groups of segments whose orders are all confirmed.  Takes
+// the writer lock.  `merged` (may be NULL) is set to the segments merged.
+int order_segments_compact(const char *path, size_t *merged);
+
+// The same in a detached child process, so the caller doesn't wait for it.
+// Not a thread: the store's locks belong to the whole process.
+void order_segments_compact_background(const char *path);
+
+// Check every compacted segment against its checksum; `bad` counts mismatches
+int order_segments_verify(const char *path, size_t *bad);
+
+// Delete a store: every segment file its manifest names, then the manifest
+int order_segments_remove(const char *path);
+
+#endif // ORDER_SEGMENT_H
@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "order_stats.h"
+
+#if defined(__GNUC__)
+#define STATS_ADD(target, value) __atomic_fetch_add(&(target), (value), __ATOMIC_RELAXED)
+#define STATS_LOAD(target) __atomic_load_n(&(target), __ATOMIC_RELAXED)
+#else
+/* No atomics: fine for the single-threaded builds that lack them */
+#define STATS_ADD(target, value) ((target) += (value))
+#define STATS_LOAD(target) (target)
+#endif
+
+#define STATS_SUB_COUNT (1u << ORDER_STATS_SUB_BITS)
+#define STATS_TEMP_SUFFIX ".tmp"
+#define STATS_PATH_SIZE 256
+
+static OrderStatHistogram histograms[ORDER_STAT_COUNT];
+
+static const char *stat_names[ORDER_STAT_COUNT] = {
+    "append", "load", "filter", "sort", "confirm", "render"
+};
+
+/* Periodic dump; off while dump_path is empty */
+static char dump_path[STATS_PATH_SIZE];
+static uint64_t dump_interval_nsec;
+static uint64_t next_dump_nsec;
+static int exit_dump_registered = 0;
+
+uint64_t order_stats_clock(void) {
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#else
+    return (uint64_t)clock() * (1000000000ULL / CLOCKS_PER_SEC);
+#endif
+}
+
+static unsigned highest_bit(uint64_t value) {
+#if defined(__GNUC__)
+    return 63u - (unsigned)__builtin_clzll(value);
+#else
+    unsigned bit = 0;
+
+    while (value >>= 1) {
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+static size_t stats_bucket(uint64_t value) {
+    unsigned shift;
+
+    if (value < STATS_SUB_COUNT) {
+        return (size_t)value;
+    }
+    shift = highest_bit(value) - ORDER_STATS_SUB_BITS;
+    return ((size_t)(shift + 1) << ORDER_STATS_SUB_BITS) +
+           (size_t)((value >> shift) - STATS_SUB_COUNT);
+}
+
+/* Largest value that lands in `bucket` */
+static uint64_t stats_bucket_bound(size_t bucket) {
+    unsigned shift;
+    uint64_t mantissa;
+
+    if (bucket < STATS_SUB_COUNT) {
+        return (uint64_t)bucket;
+    }
+    shift = (unsigned)(bucket >> ORDER_STATS_SUB_BITS) - 1;
+    mantissa = (uint64_t)(bucket & (STATS_SUB_COUNT - 1)) + STATS_SUB_COUNT;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+static void stats_dump_due(uint64_t now) {
+    uint64_t due = STATS_LOAD(next_dump_nsec);
+
+    if (now < due) {
+        return;
+    }
+#if defined(__GNUC__)
+    /* Only the thread that moves the deadline on does the dump */
+    if (!__atomic_compare_exchange_n(&next_dump_nsec, &due, now + dump_interval_nsec, 0,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return;
+    }
+#else
+    next_dump_nsec = now + dump_interval_nsec;
+#endif
+    order_stats_dump(dump_path);
+}
+
+void order_stats_record(OrderStatOp op, uint64_t start, uint64_t bytes_read,
+                        uint64_t bytes_written) {
+    OrderStatHistogram *histogram = &histograms[op];
+    uint64_t now = order_stats_clock();
+    uint64_t elapsed = now > start ? now - start : 0;
+    uint64_t max = STATS_LOAD(histogram->max_nsec);
+
+    STATS_ADD(histogram->count, 1);
+    STATS_ADD(histogram->total_nsec, elapsed);
+    STATS_ADD(histogram->bytes_read, bytes_read);
+    STATS_ADD(histogram->bytes_written, bytes_written);
+    STATS_ADD(histogram->buckets[stats_bucket(elapsed)], 1);
+    while (elapsed > max) {
+#if defined(__GNUC__)
+        if (__atomic_compare_exchange_n(&histogram->max_nsec, &max, elapsed, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+#else
+        histogram->max_nsec = elapsed;
+        break;
+#endif
+    }
+
+    if (dump_path[0] != 0) {
+        stats_dump_due(now);
+    }
+}
+
+uint64_t order_stats_percentile(OrderStatOp op, double quantile) {
+    const OrderStatHistogram *histogram = &histograms[op];
+    uint64_t count = STATS_LOAD(histogram->count);
+    uint64_t max = STATS_LOAD(histogram->max_nsec);
+    uint64_t target, seen = 0;
+    size_t bucket;
+
+    if (count == 0) {
+        return 0;
+    }
+    target = (uint64_t)(quantile * (double)count);
+    if ((double)target < quantile * (double)count) {
+        target++;
+    }
+    if (target == 0) {
+        target = 1;
+    }
+    for (bucket = 0; bucket < ORDER_STATS_BUCKETS; bucket++) {
+        seen += STATS_LOAD(histogram->buckets[bucket]);
+        if (seen >= target) {
+            uint64_t bound = stats_bucket_bound(bucket);
+            return bound < max ? bound : max;
+        }
+    }
+    return max;
+}
+
+const char *order_stats_name(OrderStatOp op) {
+    return op < ORDER_STAT_COUNT ? stat_names[op] : "?";
+}
+
+void order_stats_print(FILE *fp) {
+    int op;
+
+    /* Times in microseconds */
+    fprintf(fp, "%-8s %10s %10s %10s %10s %10s %14s %14s\n",
+            "op", "count", "p50 us", "p99 us", "p999 us", "max us", "bytes read", "bytes written");
+    for (op = 0; op < ORDER_STAT_COUNT; op++) {
+        const OrderStatHistogram *histogram = &histograms[op];
+
+        fprintf(fp, "%-8s %10llu %10.1f %10.1f %10.1f %10.1f %14llu %14llu\n",
+                stat_names[op],
+                (unsigned long long)STATS_LOAD(histogram->count),
+                order_stats_percentile((OrderStatOp)op, 0.50) / 1000.0,
+                order_stats_percentile((OrderStatOp)op, 0.99) / 1000.0,
+                order_stats_percentile((OrderStatOp)op, 0.999) / 1000.0,
+                STATS_LOAD(histogram->max_nsec) / 1000.0,
+                (unsigned long long)STATS_LOAD(histogram->bytes_read),
+                (unsigned long long)STATS_LOAD(histogram->bytes_written));
+    }
+}
+
+int order_stats_dump(const char *path) {
+    char temp[STATS_PATH_SIZE + sizeof(STATS_TEMP_SUFFIX)];
+    FILE *fp;
+    int ok;
+
+    if (strlen(path) >= STATS_PATH_SIZE) {
+        return 0;
+    }
+    strcpy(temp, path);
+    strcat(temp, STATS_TEMP_SUFFIX);
+
+    /* Readers see the old table or the new one, never half of one */
+    fp = fopen(temp, "w");
+    if (fp == NULL) {
+        return 0;
+    }
+    order_stats_print(fp);
+    ok = fflush(fp) == 0 && !ferror(fp);
+    ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+        remove(temp);
+        return 0;
+    }
+    return rename(temp, path) == 0;
+}
+
+static void stats_exit_dump(void) {
+    if (dump_path[0] != 0) {
+        order_stats_dump(dump_path);
+    }
+}
+
+int order_stats_set_dump(const char *path, long interval_sec) {
+    if (path == NULL || path[0] == 0 || strlen(path) >= STATS_PATH_SIZE) {
+        dump_path[0] = 0;
+        return path == NULL || path[0] == 0;
+    }
+    if (interval_sec <= 0) {
+        interval_sec = ORDER_STATS_DEFAULT_INTERVAL;
+    }
+    strcpy(dump_path, path);
+    dump_interval_nsec = (uint64_t)interval_sec * 1000000000ULL;
+    next_dump_nsec = order_stats_clock() + dump_interval_nsec;
+
+    if (!exit_dump_registered) {
+        exit_dump_registered = atexit(stats_exit_dump) == 0;
+    }
+    return exit_dump_registered;
+}
+
+void order_stats_from_env(void) {
+    const char *path = getenv(ORDER_STATS_FILE_ENV);
+    const char *interval = getenv(ORDER_STATS_INTERVAL_ENV);
+
+    if (path != NULL && path[0] != 0) {
+        order_stats_set_dump(path, interval != NULL ? atol(interval) : 0);
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef ORDER_STATS_H
+#define ORDER_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Environment variable naming a file the stats are dumped to, periodically
+// and at exit; STOCK_STATS_INTERVAL sets the period in seconds
+#define ORDER_STATS_FILE_ENV "STOCK_STATS_FILE"
+#define ORDER_STATS_INTERVAL_ENV "STOCK_STATS_INTERVAL"
+#define ORDER_STATS_DEFAULT_INTERVAL 10
+
+// Timed operations on the hot paths
+typedef enum {
+    ORDER_STAT_APPEND,              // One group commit
+    ORDER_STAT_LOAD,                // Mapping the store, or one streamed batch
+    ORDER_STAT_FILTER,              // Picking the orders a listing shows
+    ORDER_STAT_SORT,                // Full sorts and incremental selections
+    ORDER_STAT_CONFIRM,             // One confirmation batch
+    ORDER_STAT_RENDER,              // One screen, from first text to written
+    ORDER_STAT_COUNT
+} OrderStatOp;
+
+// Log-linear buckets, HDR style: values below 2^SUB_BITS are exact, above
+// that each power of two is split into 2^SUB_BITS buckets, so any value
+// is within 1/16 of its bucket's bounds
+#define ORDER_STATS_SUB_BITS 4
+#define ORDER_STATS_BUCKETS ((64 - ORDER_STATS_SUB_BITS + 1) << ORDER_STATS_SUB_BITS)
+
+// Latencies in nanoseconds.  Updated with relaxed atomic adds, so any
+// thread may record; a snapshot taken meanwhile may be off by a sample.
+typedef struct {
+    uint64_t count;
+    uint64_t total_nsec;
+    uint64_t max_nsec;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t buckets[ORDER_STATS_BUCKETS];
+} OrderStatHistogram;
+
+// Monotonic clock in nanoseconds; take one before the operation
+uint64_t order_stats_clock(void);
+
+// Count one operation that began at `start`
+void order_stats_record(OrderStatOp op, uint64_t start, uint64_t bytes_read,
+                        uint64_t bytes_written);
+
+// Smallest bucket bound at or above `quantile` (0-1) of the samples; 0 when empty
+uint64_t order_stats_percentile(OrderStatOp op, double quantile);
+
+// Operation names as printed: "append", "load", ...
+const char *order_stats_name(OrderStatOp op);
+
+// Table of count, p50, p99, p999, max and bytes for every operation
+void order_stats_print(FILE *fp);
+
+// Write the table to `path` through a temporary file and a rename
+int order_stats_dump(const char *path);
+
+// Dump to `path` every `interval_sec` seconds while recording, and at
+// exit.  Returns 0 if the exit dump could not be registered.
+int order_stats_set_dump(const char *path, long interval_sec);
+
+// The same, from ORDER_STATS_FILE_ENV and ORDER_STATS_INTERVAL_ENV if set
+void order_stats_from_env(void);
+
+#endif // ORDER_STATS_H
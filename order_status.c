@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "order_format.h"
+#include "order_lock.h"
+#include "order_status.h"
+
+#define TRANSACTIONS_PENDING_TEMP_FILE "transactions.pnd.tmp"
+#define STATUS_MAGIC 0x53544231UL  /* "STB1" */
+
+#define STATUS_BYTE(record) ((long)sizeof(OrderStatusHeader) + (long)((record) / 8))
+#define STATUS_MASK(record) (1U << ((record) % 8))
+
+static FILE *status_file_open(OrderStatusHeader *header) {
+    FILE *fp = fopen(TRANSACTIONS_STATUS_FILE, "r+b");
+
+    if (fp != NULL) {
+        if (fread(header, sizeof(OrderStatusHeader), 1, fp) == 1 && header->magic == STATUS_MAGIC) {
+            return fp;
+        }
+        fclose(fp);
+    }
+
+    /* Missing or unrecognised: start an empty bitmap */
+    fp = fopen(TRANSACTIONS_STATUS_FILE, "w+b");
+    if (fp == NULL) {
+        return NULL;
+    }
+    memset(header, 0, sizeof(OrderStatusHeader));
+    header->magic = STATUS_MAGIC;
+    if (fwrite(header, sizeof(OrderStatusHeader), 1, fp) != 1) {
+        fclose(fp);
+        return NULL;
+    }
+    remove(TRANSACTIONS_PENDING_FILE);
+    return fp;
+}
+
+static int status_set_bit(FILE *fp, size_t record, int fresh) {
+    int byte = 0;
+
+    if (fseek(fp, STATUS_BYTE(record), SEEK_SET) != 0) {
+        return 0;
+    }
+    /* A record opening a new byte must not inherit bits left by a crash */
+    if (!fresh || record % 8 != 0) {
+        byte = fgetc(fp);
+        if (byte == EOF) {
+            byte = 0;
+        }
+        if (fseek(fp, STATUS_BYTE(record), SEEK_SET) != 0) {
+            return 0;
+        }
+    }
+    byte |= (int)STATUS_MASK(record);
+    return fputc(byte, fp) != EOF;
+}
+
+/* Append bits for records [first, first + count) from their confirmed fields */
+static int status_extend(FILE *fp, OrderStatusHeader *header, size_t first,
+                         const StockOrder *orders, size_t count) {
+    uint64_t pending_block[256];
+    size_t pending_used = 0, i;
+    FILE *pending = fopen(TRANSACTIONS_PENDING_FILE, "ab");
+    int ok = pending != NULL;
+
+    for (i = 0; ok && i < count; i++) {
+        size_t record = first + i;
+
+        if (orders[i].confirmed) {
+            ok = status_set_bit(fp, record, 1);
+        } else {
+            /* Bits beyond the end read back as zero, but the byte must exist */
+            if (record % 8 == 0) {
+                ok = fseek(fp, STATUS_BYTE(record), SEEK_SET) == 0 && fputc(0, fp) != EOF;
+            }
+            pending_block[pending_used++] = (uint64_t)record;
+            if (pending_used == sizeof(pending_block) / sizeof(pending_block[0])) {
+                ok = ok && fwrite(pending_block, sizeof(uint64_t), pending_used, pending) == pending_used;
+                pending_used = 0;
+            }
+        }
+    }
+    if (ok && pending_used > 0) {
+        ok = fwrite(pending_block, sizeof(uint64_t), pending_used, pending) == pending_used;
+    }
+    if (pending != NULL && fclose(pending) != 0) {
+        ok = 0;
+    }
+
+    /* Publish the new length only after the bits and pending entries exist */
+    if (ok) {
+        header->records = (uint64_t)(first + count);
+        ok = fseek(fp, 0, SEEK_SET) == 0 &&
+             fwrite(header, sizeof(OrderStatusHeader), 1, fp) == 1;
+    }
+    return ok;
+}
+
+int order_status_append(size_t first_record, const StockOrder *orders, size_t count) {
+    OrderStatusHeader header;
+    size_t skip;
+    FILE *fp;
+    int ok;
+
+    fp = status_file_open(&header);
+    if (fp == NULL) {
+        return 0;
+    }
+
+    /* Records must be tracked in file order; a gap is filled on the next open */
+    if (header.records < first_record || header.records >= first_record + count) {
+        fclose(fp);
+        return 1;
+    }
+    skip = (size_t)header.records - first_record;
+
+    ok = status_extend(fp, &header, first_record + skip, orders + skip, count - skip);
+    return fclose(fp) == 0 && ok;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t value_a = *(const uint64_t *)a;
+    uint64_t value_b = *(const uint64_t *)b;
+
+    return value_a < value_b ? -1 : (value_a > value_b ? 1 : 0);
+}
+
+static int read_pending(uint64_t **pending, size_t *count) {
+    FILE *fp = fopen(TRANSACTIONS_PENDING_FILE, "rb");
+    long size;
+
+    *pending = NULL;
+    *count = 0;
+    if (fp == NULL) {
+        return 1;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        fclose(fp);
+        return 0;
+    }
+    *count = (size_t)size / sizeof(uint64_t);
+    if (*count > 0) {
+        *pending = (uint64_t *)malloc(*count * sizeof(uint64_t));
+        if (*pending == NULL || fread(*pending, sizeof(uint64_t), *count, fp) != *count) {
+            free(*pending);
+            *pending = NULL;
+            *count = 0;
+            fclose(fp);
+            return 0;
+        }
+    }
+    fclose(fp);
+    return 1;
+}
+
+static int write_pending(const uint64_t *pending, size_t count) {
+    FILE *fp = fopen(TRANSACTIONS_PENDING_TEMP_FILE, "wb");
+    int ok;
+
+    if (fp == NULL) {
+        return 0;
+    }
+    ok = fwrite(pending, sizeof(uint64_t), count, fp) == count;
+    if (fclose(fp) != 0 || !ok || rename(TRANSACTIONS_PENDING_TEMP_FILE, TRANSACTIONS_PENDING_FILE) != 0) {
+        remove(TRANSACTIONS_PENDING_TEMP_FILE);
+        return 0;
+    }
+    return 1;
+}
+
+int order_status_confirm(const size_t *records, size_t count) {
+    OrderStatusHeader header;
+    uint64_t *pending;
+    size_t pending_count, kept = 0, i, j = 0;
+    FILE *fp;
+    int ok = 1;
+
+    if (count == 0) {
+        return 1;
+    }
+
+    fp = status_file_open(&header);
+    if (fp == NULL) {
+        return 0;
+    }
+    for (i = 0; ok && i < count; i++) {
+        if (records[i] < header.records) {
+            ok = status_set_bit(fp, records[i], 0);
+        }
+    }
+    if (fclose(fp) != 0 || !ok) {
+        return 0;
+    }
+
+    /* Drop the confirmed records from the pending list (both ascending) */
+    if (!read_pending(&pending, &pending_count)) {
+        return 0;
+    }
+    for (i = 0; i < pending_count; i++) {
+        while (j < count && (uint64_t)records[j] < pending[i]) {
+            j++;
+        }
+        if (j < count && (uint64_t)records[j] == pending[i]) {
+            continue;
+        }
+        pending[kept++] = pending[i];
+    }
+    ok = write_pending(pending, kept);
+    free(pending);
+    return ok;
+}
+
+/* Bring the sidecars up to date with everything in the store */
+static int status_catch_up(const OrderStore *store) {
+    OrderStatusHeader header;
+    FILE *fp;
+    int ok = 1;
+
+    fp = status_file_open(&header);
+    if (fp == NULL) {
+        return 0;
+    }
+    /* Ahead of our snapshot is fine; ahead of the file means it was replaced */
+    if (header.records > store->count && header.records > order_file_records(TRANSACTIONS_FILE)) {
+        /* The data file was replaced underneath us: start over */
+        fclose(fp);
+        remove(TRANSACTIONS_STATUS_FILE);
+        fp = status_file_open(&header);
+        if (fp == NULL) {
+            return 0;
+        }
+    }
+    if (header.records < store->count) {
+        ok = status_extend(fp, &header, (size_t)header.records,
+                           store->records + header.records,
+                           store->count - (size_t)header.records);
+    }
+    return fclose(fp) == 0 && ok;
+}
+
+int order_status_open(OrderStatus *status, const OrderStore *store) {
+    const OrderStatusHeader *header;
+    size_t i, kept = 0;
+    int ok;
+
+    memset(status, 0, sizeof(OrderStatus));
+
+    if (!order_lock_writer()) {
+        return 0;
+    }
+    ok = status_catch_up(store);
+    order_unlock_writer();
+    if (!ok) {
+        return 0;
+    }
+    if (!mapped_file_open(&status->file, TRANSACTIONS_STATUS_FILE)) {
+        return 0;
+    }
+    header = (const OrderStatusHeader *)status->file.base;
+    status->bits = (const unsigned char *)status->file.base + sizeof(OrderStatusHeader);
+    status->records = (size_t)header->records;
+    if (status->records > store->count) {
+        status->records = store->count;
+    }
+
+    if (!read_pending(&status->pending, &status->pending_count)) {
+        mapped_file_close(&status->file);
+        return 0;
+    }
+    qsort(status->pending, status->pending_count, sizeof(uint64_t), compare_u64);
+
+    /* The data file is authoritative: skip anything confirmed behind our back */
+    for (i = 0; i < status->pending_count; i++) {
+        uint64_t record = status->pending[i];
+
+        if (record < status->records && !store->records[record].confirmed &&
+            (kept == 0 || status->pending[kept - 1] != record)) {
+            status->pending[kept++] = record;
+        }
+    }
+    status->pending_count = kept;
+    return 1;
+}
+
+void order_status_close(OrderStatus *status) {
+    mapped_file_close(&status->file);
+    free(status->pending);
+    memset(status, 0, sizeof(OrderStatus));
+}
+
+int order_status_is_confirmed(const OrderStatus *status, size_t record) {
+    if (record >= status->records) {
+        return 0;
+    }
+    return (status->bits[record / 8] & STATUS_MASK(record)) != 0;
+}
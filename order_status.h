@@ -0,0 +1,36 @@
+#ifndef ORDER_STATUS_H
+#define ORDER_STATUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "order_store.h"
+
+// Sidecar files: one confirmed bit per record, and the pending record numbers
+#define TRANSACTIONS_STATUS_FILE "transactions.bit"
+#define TRANSACTIONS_PENDING_FILE "transactions.pnd"
+
+// Header at the start of the status bitmap file
+typedef struct {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t records;               // Records covered by the bitmap
+} OrderStatusHeader;
+
+// Confirmed/pending state of every record
+typedef struct {
+    MappedFile file;
+    const unsigned char *bits;      // Bit set = confirmed
+    size_t records;
+    uint64_t *pending;              // Pending record numbers, ascending
+    size_t pending_count;
+} OrderStatus;
+
+int order_status_open(OrderStatus *status, const OrderStore *store);
+void order_status_close(OrderStatus *status);
+int order_status_is_confirmed(const OrderStatus *status, size_t record);
+
+// Keep the sidecars in step with the data file
+int order_status_append(size_t first_record, const StockOrder *orders, size_t count);
+int order_status_confirm(const size_t *records, size_t count);
+
+#endif // ORDER_STATUS_H
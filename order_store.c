@@ -0,0 +1,962 @@
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "order_append.h"
+#include "order_changes.h"
+#include "order_filter.h"
+#include "order_format.h"
+#include "order_index.h"
+#include "order_lock.h"
+#include "order_pool.h"
+#include "order_stats.h"
+#include "order_status.h"
+#include "order_store.h"
+#include "order_symbols.h"
+
+/* Granularity at which confirmations are coalesced into one write */
+#define CONFIRM_PAGE_SIZE 4096
+
+/* Orders in the data set a new file starts with */
+#define SEED_ORDERS 10
+
+/* Records per confirmation shard: small enough to spread, big enough to batch */
+#define CONFIRM_SHARD_RECORDS 4096
+
+/* Workers confirming in parallel; 0 = one per core */
+static int confirm_workers = 0;
+
+/* Ranges this short are sorted outright when selecting */
+#define VIEW_SELECT_CUTOFF 32
+
+static void *store_resize(const OrderAllocator *allocator, void *ptr,
+                          size_t old_size, size_t new_size) {
+    if (allocator != NULL && allocator->resize != NULL) {
+        return allocator->resize(allocator->ctx, ptr, old_size, new_size);
+    }
+    return realloc(ptr, new_size);
+}
+
+static void store_release(const OrderAllocator *allocator, void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return;
+    }
+    if (allocator != NULL) {
+        if (allocator->release != NULL) {
+            allocator->release(allocator->ctx, ptr, size);
+        }
+        return;
+    }
+    free(ptr);
+}
+
+void order_vector_init(OrderVector *vec, const OrderAllocator *allocator) {
+    vec->items = NULL;
+    vec->count = 0;
+    vec->capacity = 0;
+    vec->allocator = allocator;
+}
+
+int order_vector_reserve(OrderVector *vec, size_t capacity) {
+    StockOrder *items;
+
+    if (capacity <= vec->capacity) {
+        return 1;
+    }
+
+    items = (StockOrder *)store_resize(vec->allocator, vec->items,
+                                       vec->capacity * sizeof(StockOrder),
+                                       capacity * sizeof(StockOrder));
+    if (items == NULL) {
+        return 0;
+    }
+    vec->items = items;
+    vec->capacity = capacity;
+    return 1;
+}
+
+int order_vector_push(OrderVector *vec, const StockOrder *order) {
+    if (vec->count == vec->capacity) {
+        /* Grow geometrically so pushes stay amortized O(1) */
+        size_t capacity = vec->capacity ? vec->capacity * 2 : ORDER_READER_BATCH;
+        if (!order_vector_reserve(vec, capacity)) {
+            return 0;
+        }
+    }
+    vec->items[vec->count++] = *order;
+    return 1;
+}
+
+void order_vector_clear(OrderVector *vec) {
+    vec->count = 0;
+}
+
+void order_vector_free(OrderVector *vec) {
+    store_release(vec->allocator, vec->items, vec->capacity * sizeof(StockOrder));
+    vec->items = NULL;
+    vec->count = 0;
+    vec->capacity = 0;
+}
+
+/* A consistent copy of the manifest: compaction rewrites it in place */
+static int read_manifest(OrderManifest *manifest, const char *path) {
+    int ok;
+
+    if (!order_lock_writer()) {
+        return 0;
+    }
+    ok = order_manifest_read(manifest, path);
+    order_unlock_writer();
+    return ok;
+}
+
+int order_reader_open(OrderReader *reader, const char *path, size_t batch_size,
+                      const OrderAllocator *allocator) {
+    memset(reader, 0, sizeof(OrderReader));
+    reader->allocator = allocator;
+    reader->batch_size = batch_size ? batch_size : ORDER_READER_BATCH;
+
+    if (!read_manifest(&reader->manifest, path)) {
+        return 0;
+    }
+    order_segment_file_init(&reader->file, path, &reader->manifest, 0);
+
+    reader->batch = (StockOrder *)store_resize(allocator, NULL, 0,
+                                               reader->batch_size * sizeof(StockOrder));
+    if (reader->batch == NULL) {
+        order_manifest_free(&reader->manifest);
+        return 0;
+    }
+    reader->is_open = 1;
+    return 1;
+}
+
+size_t order_reader_next_batch(OrderReader *reader, StockOrder **batch) {
+    uint64_t start = order_stats_clock();
+    size_t count, i;
+    long long offset;
+
+    if (!reader->is_open || reader->records_read >= reader->manifest.records) {
+        return 0;
+    }
+
+    count = reader->manifest.records - reader->records_read;
+    if (count > reader->batch_size) {
+        count = reader->batch_size;
+    }
+    offset = ORDER_SEGMENT_BYTE(reader->records_read);
+    if (!order_segment_read(&reader->file, reader->batch, count * sizeof(StockOrder), offset)) {
+        /* Compacted away since we opened: the same records are in the new file */
+        order_segment_file_close(&reader->file);
+        order_manifest_free(&reader->manifest);
+        if (!read_manifest(&reader->manifest, reader->file.path) ||
+            !order_segment_read(&reader->file, reader->batch, count * sizeof(StockOrder), offset)) {
+            reader->error = 1;
+            reader->is_open = 0;
+            return 0;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        order_from_disk(&reader->batch[i]);
+    }
+    reader->records_read += count;
+    *batch = reader->batch;
+    order_stats_record(ORDER_STAT_LOAD, start, count * sizeof(StockOrder), 0);
+    return count;
+}
+
+void order_reader_close(OrderReader *reader) {
+    order_segment_file_close(&reader->file);
+    order_manifest_free(&reader->manifest);
+    reader->is_open = 0;
+    store_release(reader->allocator, reader->batch,
+                  reader->batch_size * sizeof(StockOrder));
+    reader->batch = NULL;
+}
+
+void order_store_appended(void *ctx, size_t first_record,
+                          const StockOrder *orders, size_t count) {
+    (void)ctx;
+    /* Failures here are repaired by the catch-up when the sidecars are next opened */
+    order_index_append(first_record, orders, count);
+    order_status_append(first_record, orders, count);
+    order_symbols_append(first_record, orders, count);
+    order_blocks_append(first_record, orders, count);
+    order_changes_append(first_record, count);
+}
+
+int save_transaction(const StockOrder *order) {
+    /* Kept open for the life of the process; each order is its own group */
+    static OrderAppender appender;
+    static int appender_open = 0;
+
+    if (!appender_open) {
+        OrderAppendConfig config;
+
+        memset(&config, 0, sizeof(config));
+        config.batch_orders = 1;
+        config.on_durable = order_store_appended;
+        if (!order_appender_open(&appender, TRANSACTIONS_FILE, TRANSACTIONS_WAL_FILE, &config)) {
+            return 0;
+        }
+        appender_open = 1;
+    }
+
+    return order_appender_append(&appender, order);
+}
+
+int mapped_file_open(MappedFile *file, const char *path) {
+    struct stat st;
+    void *base;
+    FILE *fp;
+    long size;
+    int fd;
+
+    memset(file, 0, sizeof(MappedFile));
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return 0;
+    }
+
+    /* An empty file cannot be mapped; it simply has no contents */
+    if (st.st_size == 0) {
+        close(fd);
+        return 1;
+    }
+
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base != MAP_FAILED) {
+        file->base = base;
+        file->length = (size_t)st.st_size;
+        file->mapped = 1;
+        return 1;
+    }
+
+    /* mmap() failed: fall back to a heap copy */
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        fclose(fp);
+        return 0;
+    }
+    if (size > 0) {
+        file->base = malloc((size_t)size);
+        if (file->base == NULL || fread(file->base, 1, (size_t)size, fp) != (size_t)size) {
+            free(file->base);
+            file->base = NULL;
+            fclose(fp);
+            return 0;
+        }
+        file->length = (size_t)size;
+    }
+    fclose(fp);
+    return 1;
+}
+
+void mapped_file_close(MappedFile *file) {
+    if (file->mapped) {
+        munmap(file->base, file->length);
+    } else
+    free(file->base);
+    memset(file, 0, sizeof(MappedFile));
+}
+
+/* Copy every committed record into one buffer */
+static int store_read_segments(MappedFile *file, const OrderManifest *manifest, const char *path) {
+    OrderSegmentFile segments;
+    size_t length = manifest->records * sizeof(StockOrder);
+    int ok;
+
+    file->base = malloc(length);
+    if (file->base == NULL) {
+        return 0;
+    }
+    order_segment_file_init(&segments, path, manifest, 0);
+    ok = order_segment_read(&segments, file->base, length, 0);
+    order_segment_file_close(&segments);
+    if (!ok) {
+        free(file->base);
+        file->base = NULL;
+        return 0;
+    }
+    file->length = length;
+    return 1;
+}
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/*
+ * Reserve address space for the whole store, then map each file's run of
+ * segments into its place, so the records are one array as before.  Needs
+ * segments to be whole pages, which they are on 4 KiB-page hosts.
+ */
+static int store_map_segments(MappedFile *file, const OrderManifest *manifest, const char *path) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t segment_bytes = manifest->segment_records * sizeof(StockOrder);
+    size_t length = manifest->records * sizeof(StockOrder);
+    size_t first, last;
+    char *base;
+
+    if (segment_bytes % page != 0) {
+        return 0;
+    }
+    length = (length + page - 1) / page * page;
+    base = (char *)mmap(NULL, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return 0;
+    }
+
+    for (first = 0; first * segment_bytes < length; first = last) {
+        const OrderSegmentSlot *slot = &manifest->slots[first];
+        char segment_path[FILENAME_MAX];
+        size_t start = first * segment_bytes, run;
+        void *mapped;
+        int fd;
+
+        /* Consecutive segments of one compacted file map in one go */
+        last = first + 1;
+        while (last * segment_bytes < length && manifest->slots[last].file == slot->file) {
+            last++;
+        }
+        run = last * segment_bytes < length ? last * segment_bytes - start : length - start;
+
+        if (!order_segment_path(segment_path, path, slot->file) ||
+            (fd = open(segment_path, O_RDONLY)) < 0) {
+            munmap(base, length);
+            return 0;
+        }
+        mapped = mmap(base + start, run, PROT_READ, MAP_SHARED | MAP_FIXED, fd,
+                      (off_t)((first - slot->first) * segment_bytes));
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            munmap(base, length);
+            return 0;
+        }
+    }
+
+    file->base = base;
+    file->length = length;
+    file->mapped = 1;
+    return 1;
+}
+
+int order_store_open(OrderStore *store, const char *path) {
+    uint64_t start = order_stats_clock();
+    OrderManifest manifest;
+    int ok = 0;
+
+    memset(store, 0, sizeof(OrderStore));
+
+    /* Under the writer lock, so compaction can't remove a file before it's mapped */
+    if (!order_lock_writer()) {
+        return 0;
+    }
+    if (order_manifest_read(&manifest, path)) {
+        ok = 1;
+        if (manifest.records > 0) {
+            ok = store_map_segments(&store->file, &manifest, path);
+            if (!ok) {
+                /* mmap() failed: fall back to a heap copy */
+                ok = store_read_segments(&store->file, &manifest, path);
+            }
+        }
+        /* Only what appenders have published: a snapshot nobody else can disturb */
+        store->count = manifest.records;
+        order_manifest_free(&manifest);
+    }
+    order_unlock_writer();
+    if (!ok) {
+        return 0;
+    }
+    store->records = (const StockOrder *)store->file.base;
+
+#ifdef ORDER_HOST_BIG_ENDIAN
+    /* Records are little-endian on disk: decode a private copy */
+    {
+        StockOrder *copy = (StockOrder *)malloc(store->count * sizeof(StockOrder) + 1);
+        size_t i;
+
+        if (copy == NULL) {
+            mapped_file_close(&store->file);
+            return 0;
+        }
+        memcpy(copy, store->records, store->count * sizeof(StockOrder));
+        for (i = 0; i < store->count; i++) {
+            order_from_disk(&copy[i]);
+        }
+        store->decoded = copy;
+        store->records = copy;
+    }
+#endif
+    /* Mapped pages are only read as they're touched; this counts the whole file */
+    order_stats_record(ORDER_STAT_LOAD, start, store->file.length, 0);
+    return 1;
+}
+
+void order_store_close(OrderStore *store) {
+    free(store->decoded);
+    mapped_file_close(&store->file);
+    memset(store, 0, sizeof(OrderStore));
+}
+
+void order_view_init(OrderView *view, const OrderAllocator *allocator) {
+    view->items = NULL;
+    view->count = 0;
+    view->capacity = 0;
+    view->allocator = allocator;
+}
+
+int order_view_push(OrderView *view, const StockOrder *order) {
+    if (view->count == view->capacity) {
+        size_t capacity = view->capacity ? view->capacity * 2 : ORDER_READER_BATCH;
+        const StockOrder **items;
+
+        items = (const StockOrder **)store_resize(view->allocator, (void *)view->items,
+                                                  view->capacity * sizeof(const StockOrder *),
+                                                  capacity * sizeof(const StockOrder *));
+        if (items == NULL) {
+            return 0;
+        }
+        view->items = items;
+        view->capacity = capacity;
+    }
+    view->items[view->count++] = order;
+    return 1;
+}
+
+int order_view_filter(OrderView *view, const OrderStore *store, int confirmed) {
+    uint64_t start = order_stats_clock();
+    size_t i;
+
+    view->count = 0;
+    for (i = 0; i < store->count; i++) {
+        if (store->records[i].confirmed == confirmed &&
+            !order_view_push(view, &store->records[i])) {
+            return 0;
+        }
+    }
+    order_stats_record(ORDER_STAT_FILTER, start, 0, 0);
+    return 1;
+}
+
+size_t order_store_count_status(const OrderStore *store, int confirmed) {
+    size_t i, count = 0;
+
+    for (i = 0; i < store->count; i++) {
+        if (store->records[i].confirmed == confirmed) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void order_view_sort(OrderView *view, int (*compare)(const void *, const void *)) {
+    uint64_t start = order_stats_clock();
+
+    /* Only pointers move; the records themselves stay in the mapping */
+    qsort((void *)view->items, view->count, sizeof(const StockOrder *), compare);
+    order_stats_record(ORDER_STAT_SORT, start, 0, 0);
+}
+
+static void view_swap(const StockOrder **items, size_t a, size_t b) {
+    const StockOrder *item = items[a];
+    items[a] = items[b];
+    items[b] = item;
+}
+
+void order_selection_init(OrderSelection *selection, const OrderAllocator *allocator) {
+    memset(selection, 0, sizeof(OrderSelection));
+    selection->allocator = allocator;
+}
+
+void order_selection_free(OrderSelection *selection) {
+    store_release(selection->allocator, selection->pivots,
+                  selection->pivot_capacity * sizeof(size_t));
+    order_selection_init(selection, selection->allocator);
+}
+
+static int selection_push(OrderSelection *selection, size_t pivot) {
+    if (selection->pivot_count == selection->pivot_capacity) {
+        size_t capacity = selection->pivot_capacity ? selection->pivot_capacity * 2 : 64;
+        size_t *pivots = (size_t *)store_resize(selection->allocator, selection->pivots,
+                                                selection->pivot_capacity * sizeof(size_t),
+                                                capacity * sizeof(size_t));
+        if (pivots == NULL) {
+            return 0;
+        }
+        selection->pivots = pivots;
+        selection->pivot_capacity = capacity;
+    }
+    selection->pivots[selection->pivot_count++] = pivot;
+    return 1;
+}
+
+/* Partition items[lo, hi) around a median-of-three pivot; returns where it lands */
+static size_t selection_partition(const StockOrder **items, size_t lo, size_t hi,
+                                  int (*compare)(const void *, const void *)) {
+    size_t mid = lo + (hi - lo) / 2, last = hi - 1, store = lo, i;
+
+    if (compare(&items[mid], &items[lo]) < 0) view_swap(items, mid, lo);
+    if (compare(&items[last], &items[lo]) < 0) view_swap(items, last, lo);
+    if (compare(&items[mid], &items[last]) < 0) view_swap(items, mid, last);
+    /* The median is now at `last` */
+    for (i = lo; i < last; i++) {
+        if (compare(&items[i], &items[last]) < 0) {
+            view_swap(items, i, store++);
+        }
+    }
+    view_swap(items, store, last);
+    return store;
+}
+
+/*
+ * Incremental quicksort: each partition pivot lands where it belongs, and
+ * the stack remembers them, so the next page only partitions the range
+ * between the end of the last page and the nearest pivot past it.  Paging
+ * through k orders costs O(n + k log k) in all, not O(n log n) up front.
+ */
+static int selection_extend(OrderSelection *selection, OrderView *view, size_t wanted,
+                            int (*compare)(const void *, const void *)) {
+    const StockOrder **items = view->items;
+    size_t end = view->count;
+
+    if (wanted > end) {
+        wanted = end;
+    }
+
+    /* Paging deep into the list: sorting everything left is no dearer */
+    if (wanted > selection->sorted && wanted - selection->sorted > (end - selection->sorted) / 2) {
+        qsort((void *)(items + selection->sorted), end - selection->sorted,
+              sizeof(const StockOrder *), compare);
+        selection->sorted = end;
+        selection->pivot_count = 0;
+        return 1;
+    }
+
+    while (selection->sorted < wanted) {
+        size_t top = selection->pivot_count ? selection->pivots[selection->pivot_count - 1] : end;
+
+        if (top - selection->sorted <= VIEW_SELECT_CUTOFF) {
+            qsort((void *)(items + selection->sorted), top - selection->sorted,
+                  sizeof(const StockOrder *), compare);
+            /* The pivot bounding the range was already in place */
+            selection->sorted = top < end ? top + 1 : end;
+            if (selection->pivot_count) {
+                selection->pivot_count--;
+            }
+        } else if (!selection_push(selection,
+                                   selection_partition(items, selection->sorted, top, compare))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int order_selection_extend(OrderSelection *selection, OrderView *view, size_t wanted,
+                           int (*compare)(const void *, const void *)) {
+    uint64_t start;
+    int ok;
+
+    /* Pages already in order cost nothing and aren't worth a sample */
+    if (wanted <= selection->sorted) {
+        return 1;
+    }
+    start = order_stats_clock();
+    ok = selection_extend(selection, view, wanted, compare);
+    order_stats_record(ORDER_STAT_SORT, start, 0, 0);
+    return ok;
+}
+
+void order_view_free(OrderView *view) {
+    store_release(view->allocator, (void *)view->items,
+                  view->capacity * sizeof(const StockOrder *));
+    order_view_init(view, view->allocator);
+}
+
+int open_transactions(OrderStore *store) {
+    int ok;
+
+    memset(store, 0, sizeof(OrderStore));
+    if (!order_lock_writer()) {
+        return 0;
+    }
+    /* Files written by earlier versions are converted once, on first use;
+     * on the very first run the file is created with the initial data set */
+    ok = order_file_upgrade(TRANSACTIONS_FILE) && initialize_data_file();
+    order_unlock_writer();
+
+    return ok && order_store_open(store, TRANSACTIONS_FILE);
+}
+
+static int compare_record_index(const void *a, const void *b) {
+    size_t index_a = *(const size_t *)a;
+    size_t index_b = *(const size_t *)b;
+
+    if (index_a < index_b) {
+        return -1;
+    } else if (index_a > index_b) {
+        return 1;
+    }
+    return 0;
+}
+
+static void report_progress(const OrderProgress *progress, size_t done, size_t total) {
+    if (progress != NULL && progress->report != NULL) {
+        progress->report(progress->ctx, done, total);
+    }
+}
+
+/* A confirmation split into shards; each worker has its own segment file and span */
+typedef struct {
+    size_t *records;                /* Sorted record numbers */
+    size_t *shard_start;            /* Shard s is records[shard_start[s], shard_start[s + 1]) */
+    size_t *shard_size;
+    OrderManifest manifest;         /* Where each record lives */
+    OrderSegmentFile files[ORDER_POOL_MAX_WORKERS];
+    long confirmed[ORDER_POOL_MAX_WORKERS];
+    uint64_t bytes_read[ORDER_POOL_MAX_WORKERS];
+    uint64_t bytes_written[ORDER_POOL_MAX_WORKERS];
+    unsigned char *spans;           /* One span buffer per worker */
+} ConfirmBatch;
+
+/* Large enough for one page plus a field straddling its end */
+#define CONFIRM_SPAN_SIZE (CONFIRM_PAGE_SIZE + sizeof(StockOrder))
+
+static long confirm_page(size_t record) {
+    /* Segments are whole pages, so a page never spans two files */
+    return (long)((ORDER_SEGMENT_BYTE(record) + offsetof(StockOrder, confirmed)) / CONFIRM_PAGE_SIZE);
+}
+
+/* Flip the flags of records[first, end); shards never share a page or a record lock */
+static int confirm_shard(void *ctx, size_t shard, int worker) {
+    ConfirmBatch *batch = (ConfirmBatch *)ctx;
+    const size_t field = offsetof(StockOrder, confirmed);
+    const size_t *records = batch->records;
+    unsigned char *span = batch->spans + (size_t)worker * CONFIRM_SPAN_SIZE;
+    OrderSegmentFile *file = &batch->files[worker];
+    size_t first, last, span_records, flipped, i;
+    size_t end = batch->shard_start[shard + 1];
+
+    for (first = batch->shard_start[shard]; first < end; first = last + 1) {
+        long page = confirm_page(records[first]);
+        long span_start = (long)(ORDER_SEGMENT_BYTE(records[first]) + field);
+        long span_end;
+
+        /* Gather every record whose confirmed field starts in this page */
+        last = first;
+        while (last + 1 < end && confirm_page(records[last + 1]) == page) {
+            last++;
+        }
+        span_end = (long)(ORDER_SEGMENT_BYTE(records[last]) + field + 1);
+
+        /* Another market process may be confirming the same records */
+        span_records = records[last] - records[first] + 1;
+        if (!order_lock_records(records[first], span_records)) {
+            return 0;
+        }
+
+        /* Read-modify-write the span so unrelated bytes are preserved */
+        if (!order_segment_read(file, span, (size_t)(span_end - span_start), span_start)) {
+            order_unlock_records(records[first], span_records);
+            return 0;
+        }
+        flipped = 0;
+        for (i = first; i <= last; i++) {
+            long at = (long)(ORDER_SEGMENT_BYTE(records[i]) + field) - span_start;
+
+            if (i > first && records[i] == records[i - 1]) {
+                continue;
+            }
+            /* A single byte, so no byte-order concerns */
+            if (span[at] == 0) {
+                span[at] = 1;
+                flipped++;
+            }
+        }
+        /* Already confirmed elsewhere: leave the page (and a sealed segment) alone */
+        if (flipped > 0 &&
+            !order_segment_write(file, span, (size_t)(span_end - span_start), span_start)) {
+            order_unlock_records(records[first], span_records);
+            return 0;
+        }
+        batch->confirmed[worker] += (long)flipped;
+        batch->bytes_read[worker] += (uint64_t)(span_end - span_start);
+        if (flipped > 0) {
+            batch->bytes_written[worker] += (uint64_t)(span_end - span_start);
+        }
+        order_unlock_records(records[first], span_records);
+    }
+    return 1;
+}
+
+/* Cut the sorted records into shards of about CONFIRM_SHARD_RECORDS, on page boundaries */
+static size_t confirm_shards(ConfirmBatch *batch, size_t count) {
+    size_t shards = 0, i = 0;
+
+    while (i < count) {
+        size_t end = i + CONFIRM_SHARD_RECORDS < count ? i + CONFIRM_SHARD_RECORDS : count;
+
+        while (end < count && confirm_page(batch->records[end]) == confirm_page(batch->records[end - 1])) {
+            end++;
+        }
+        batch->shard_start[shards] = i;
+        batch->shard_size[shards] = end - i;
+        shards++;
+        i = end;
+    }
+    batch->shard_start[shards] = count;
+    return shards;
+}
+
+void order_store_set_confirm_workers(int workers) {
+    confirm_workers = workers;
+}
+
+/*
+ * The sorted records are cut into shards of whole pages, which a pool of
+ * workers confirms in parallel; each shard is committed by its own writes
+ * under its own record locks.  The change feed is written first, and the
+ * status sidecar once every worker is done.
+ */
+int confirm_transactions(size_t *record_indices, size_t count, long *confirmed_count,
+                         const OrderProgress *progress) {
+    static ConfirmBatch batch;  /* Only one confirmation runs at a time per process */
+    uint64_t start = order_stats_clock(), bytes_read = 0, bytes_written = 0;
+    size_t shards, max_shards = count / CONFIRM_SHARD_RECORDS + 2;
+    long confirmed = 0;
+    int workers = confirm_workers > 0 ? confirm_workers : order_pool_default_workers();
+    int ok, i;
+
+    if (confirmed_count != NULL) {
+        *confirmed_count = 0;
+    }
+    if (count == 0) {
+        return 1;
+    }
+    if (workers > ORDER_POOL_MAX_WORKERS) {
+        workers = ORDER_POOL_MAX_WORKERS;
+    }
+
+    memset(&batch, 0, sizeof(batch));
+    batch.records = record_indices;
+    batch.shard_start = (size_t *)malloc(max_shards * sizeof(size_t));
+    batch.shard_size = (size_t *)malloc(max_shards * sizeof(size_t));
+    batch.spans = (unsigned char *)malloc((size_t)workers * CONFIRM_SPAN_SIZE);
+    /* Fail before starting any worker if the lock file can't be opened */
+    ok = batch.shard_start != NULL && batch.shard_size != NULL && batch.spans != NULL &&
+         order_lock_open() && read_manifest(&batch.manifest, TRANSACTIONS_FILE);
+    for (i = 0; i < ORDER_POOL_MAX_WORKERS; i++) {
+        /* Each worker keeps its own descriptor for the whole batch */
+        order_segment_file_init(&batch.files[i], TRANSACTIONS_FILE, &batch.manifest, 1);
+    }
+
+    if (ok) {
+        /* Visit records in file order so each page is contiguous in the list */
+        qsort(record_indices, count, sizeof(size_t), compare_record_index);
+        /* Into the change feed before the data file: a confirmation cut
+         * short is only sent to replicas again, one never fed would be lost */
+        ok = order_lock_writer();
+        if (ok) {
+            ok = order_changes_confirm(record_indices, count);
+            order_unlock_writer();
+        }
+    }
+    if (ok) {
+        shards = confirm_shards(&batch, count);
+        report_progress(progress, 0, count);
+        ok = order_pool_run(shards, workers, confirm_shard, &batch, batch.shard_size, progress);
+    }
+
+    for (i = 0; i < ORDER_POOL_MAX_WORKERS; i++) {
+        order_segment_file_close(&batch.files[i]);
+        confirmed += batch.confirmed[i];
+        bytes_read += batch.bytes_read[i];
+        bytes_written += batch.bytes_written[i];
+    }
+    order_manifest_free(&batch.manifest);
+    free(batch.shard_start);
+    free(batch.shard_size);
+    free(batch.spans);
+    if (confirmed_count != NULL) {
+        *confirmed_count = confirmed;
+    }
+
+    /* The data file is authoritative; a stale bitmap is corrected on open */
+    if (ok && order_lock_writer()) {
+        order_status_confirm(record_indices, count);
+        order_unlock_writer();
+    }
+    order_stats_record(ORDER_STAT_CONFIRM, start, bytes_read, bytes_written);
+    return ok;
+}
+
+int initialize_data_file(void) {
+    OrderSegmentBuilder *builder;
+    FILE *fp;
+    OrderVector seeds;          /* On the heap, off the (small) Amiga stack */
+    StockOrder *orders;
+    int i, ok;
+
+    /* Check if file already exists */
+    fp = fopen(TRANSACTIONS_FILE, "rb");
+    if (fp != NULL) {
+        fclose(fp);
+        return 1;
+    }
+
+    /* Create file with initial data */
+    order_vector_init(&seeds, NULL);
+    if (!order_vector_reserve(&seeds, SEED_ORDERS)) {
+        return 0;
+    }
+    orders = seeds.items;
+
+    /* Initialize all orders to 0 first */
+    memset(orders, 0, SEED_ORDERS * sizeof(StockOrder));
+
+    /* Base timestamp for Oct 1, 1988 00:00:00 UTC */
+    int64_t base_timestamp = 591667200L;  /* Unix timestamp for Oct 1, 1988 */
+
+    /* Order 1 - Oct 3, 1988 09:30 - GM (General Motors) */
+    orders[0].customer_account_no = 123456;
+    orders[0].timestamp = base_timestamp + (2 * 86400) + (9 * 3600) + (30 * 60);
+    strcpy(orders[0].broker_id, "MER");  /* Merrill Lynch */
+    orders[0].action = ORDER_ACTION_BUY;
+    orders[0].quantity = 100;
+    orders[0].price_cents = 8425;  /* Realistic GM price in 1988 */
+    strcpy(orders[0].ticker, "GM");
+    orders[0].order_type = ORDER_TYPE_LIMIT;
+    orders[0].confirmed = 1;  /* Initial orders are confirmed */
+
+    /* Order 2 - Oct 5, 1988 14:30 - IBM */
+    orders[1].customer_account_no = 234567;
+    orders[1].timestamp = base_timestamp + (4 * 86400) + (14 * 3600) + (30 * 60);
+    strcpy(orders[1].broker_id, "DLJ");  /* Donaldson, Lufkin & Jenrette */
+    orders[1].action = ORDER_ACTION_SELL;
+    orders[1].quantity = 50;
+    orders[1].price_cents = 12950;  /* IBM was around $125-135 in Oct 1988 */
+    strcpy(orders[1].ticker, "IBM");
+    orders[1].order_type = ORDER_TYPE_MARKET;
+    orders[1].confirmed = 1;  /* Initial orders are confirmed */
+
+    /* Order 3 - Oct 7, 1988 10:15 - GE (General Electric) */
+    orders[2].customer_account_no = 345678;
+    orders[2].timestamp = base_timestamp + (6 * 86400) + (10 * 3600) + (15 * 60);
+    strcpy(orders[2].broker_id, "GS");  /* Goldman Sachs */
+    orders[2].action = ORDER_ACTION_BUY;
+    orders[2].quantity = 200;
+    orders[2].price_cents = 4475;  /* GE price in 1988 */
+    strcpy(orders[2].ticker, "GE");
+    orders[2].order_type = ORDER_TYPE_LIMIT;
+    orders[2].confirmed = 1;  /* Initial orders are confirmed */
+
+    /* Order 4 - Oct 11, 1988 11:00 - XON (Exxon) */
+    orders[3].customer_account_no = 456789;
+    orders[3].timestamp = base_timestamp + (10 * 86400) + (11 * 3600);
+    strcpy(orders[3].broker_id, "MS");  /* Morgan Stanley */
+    orders[3].action = ORDER_ACTION_BUY;
+    orders[3].quantity = 150;
+    orders[3].price_cents = 4550;  /* Exxon price in 1988 */
+    strcpy(orders[3].ticker, "XON");
+    orders[3].order_type = ORDER_TYPE_MARKET;
+    orders[3].confirmed = 1;  /* Initial orders are confirmed */
+
+    /* Order 5 - Oct 14, 1988 15:45 - KO (Coca-Cola) */
+    orders[4].customer_account_no = 567890;
+    orders[4].timestamp = base_timestamp + (13 * 86400) + (15 * 3600) + (45 * 60);
+    strcpy(orders[4].broker_id, "BSC");  /* Bear Stearns */
+    orders[4].action = ORDER_ACTION_BUY;
+    orders[4].quantity = 300;
+    orders[4].price_cents = 4225;  /* KO price in 1988 */
+    strcpy(orders[4].ticker, "KO");
+    orders[4].order_type = ORDER_TYPE_LIMIT;
+    orders[4].confirmed = 1;  /* Initial orders are confirmed */
+
+    /* Order 6 - Oct 18, 1988 10:20 - F (Ford) */
+    orders[5].customer_account_no = 678901;
+    orders[5].timestamp = base_timestamp + (17 * 86400) + (10 * 3600) + (20 * 60);
+    strcpy(orders[5].broker_id, "PWJ");  /* PaineWebber */
+    orders[5].action = ORDER_ACTION_BUY;
+    orders[5].quantity = 200;
+    orders[5].price_cents = 5275;  /* Ford price in 1988 */
+    strcpy(orders[5].ticker, "F");
+    orders[5].order_type = ORDER_TYPE_MARKET;
+    orders[5].confirmed = 1;  /* Initial orders are confirmed */
+
+    /* Order 7 - Oct 20, 1988 13:10 - T (AT&T) */
+    orders[6].customer_account_no = 789012;
+    orders[6].timestamp = base_timestamp + (19 * 86400) + (13 * 3600) + (10 * 60);
+    strcpy(orders[6].broker_id, "LEH");  /* Lehman Brothers */
+    orders[6].action = ORDER_ACTION_SELL;
+    orders[6].quantity = 100;
+    orders[6].price_cents = 2850;  /* AT&T price in 1988 */
+    strcpy(orders[6].ticker, "T");
+    orders[6].order_type = ORDER_TYPE_LIMIT;
+    orders[6].confirmed = 1;  /* Initial orders are confirmed */
+
+    /* Order 8 - Oct 24, 1988 09:30 - MRK (Merck) */
+    orders[7].customer_account_no = 890123;
+    orders[7].timestamp = base_timestamp + (23 * 86400) + (9 * 3600) + (30 * 60);
+    strcpy(orders[7].broker_id, "SLB");  /* Salomon Brothers */
+    orders[7].action = ORDER_ACTION_BUY;
+    orders[7].quantity = 75;
+    orders[7].price_cents = 5825;  /* Merck price in 1988 */
+    strcpy(orders[7].ticker, "MRK");
+    orders[7].order_type = ORDER_TYPE_MARKET;
+    orders[7].confirmed = 1;  /* Initial orders are confirmed */
+
+    /* Order 9 - Oct 26, 1988 16:00 - PG (Procter & Gamble) */
+    orders[8].customer_account_no = 901234;
+    orders[8].timestamp = base_timestamp + (25 * 86400) + (16 * 3600);
+    strcpy(orders[8].broker_id, "DWR");  /* Dean Witter Reynolds */
+    orders[8].action = ORDER_ACTION_SELL;
+    orders[8].quantity = 125;
+    orders[8].price_cents = 8975;  /* P&G price in 1988 */
+    strcpy(orders[8].ticker, "PG");
+    orders[8].order_type = ORDER_TYPE_LIMIT;
+    orders[8].confirmed = 1;  /* Initial orders are confirmed */
+
+    /* Order 10 - Oct 28, 1988 11:55 - GE (General Electric) */
+    orders[9].customer_account_no = 112345;
+    orders[9].timestamp = base_timestamp + (27 * 86400) + (11 * 3600) + (55 * 60);
+    strcpy(orders[9].broker_id, "EFH");  /* E.F. Hutton */
+    orders[9].action = ORDER_ACTION_BUY;
+    orders[9].quantity = 150;
+    orders[9].price_cents = 4450;  /* GE price in 1988 */
+    strcpy(orders[9].ticker, "GE");
+    orders[9].order_type = ORDER_TYPE_MARKET;
+    orders[9].confirmed = 1;  /* Initial orders are confirmed */
+
+    /* Write the orders to the first segment, then the manifest */
+    for (i = 0; i < SEED_ORDERS; i++) {
+        order_to_disk(&orders[i]);
+    }
+    builder = (OrderSegmentBuilder *)malloc(sizeof(OrderSegmentBuilder));
+    ok = builder != NULL && order_segment_builder_open(builder, TRANSACTIONS_FILE);
+    if (ok) {
+        /* A seed cut short leaves nothing, so the next run starts over */
+        ok = order_segment_builder_add(builder, orders, SEED_ORDERS);
+        if (ok) {
+            ok = order_segment_builder_finish(builder, TRANSACTIONS_FILE);
+        } else {
+            order_segment_builder_abandon(builder);
+        }
+    }
+    free(builder);
+    order_vector_free(&seeds);
+    return ok;
+}
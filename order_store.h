@@ -0,0 +1,124 @@
+#ifndef ORDER_STORE_H
+#define ORDER_STORE_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "order_segment.h"
+#include "stock_order.h"
+
+// Data file: the manifest of the segment files holding every order ever
+// entered.  The store is read and written with POSIX I/O (open/pread/pwrite,
+// mmap, fsync, fork), so it needs a POSIX host.
+#define TRANSACTIONS_FILE "transactions.dat"
+
+// Default number of records fetched per streaming batch
+#define ORDER_READER_BATCH 256
+
+// Allocator used by growable order buffers (NULL members = stdlib)
+typedef struct {
+    void *(*resize)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+    void (*release)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+} OrderAllocator;
+
+// Told how much of a long operation is committed; may be called from a worker thread
+typedef struct {
+    void (*report)(void *ctx, size_t done, size_t total);
+    void *ctx;
+} OrderProgress;
+
+// Growable array of orders
+typedef struct {
+    StockOrder *items;
+    size_t count;
+    size_t capacity;
+    const OrderAllocator *allocator;
+} OrderVector;
+
+// Chunked, forward-only reader over the transactions file.  Must not be
+// moved once open.
+typedef struct {
+    OrderManifest manifest;         // Segments and committed count when opened
+    OrderSegmentFile file;
+    int is_open;
+    StockOrder *batch;              // Buffer reused for every batch
+    size_t batch_size;              // Records per batch
+    size_t records_read;            // Records returned so far
+    int error;                      // Non-zero after a read error
+    const OrderAllocator *allocator;
+} OrderReader;
+
+// Read-only file contents, mapped where mmap() exists and copied otherwise
+typedef struct {
+    void *base;
+    size_t length;
+    int mapped;                     // 1 if base came from mmap()
+} MappedFile;
+
+// Read-only view of the whole transactions file as an array of records
+typedef struct {
+    const StockOrder *records;      // Records in file order
+    size_t count;                   // Number of complete records
+    MappedFile file;                // Every segment, mapped side by side
+    StockOrder *decoded;            // Host-order copy on big-endian hosts
+} OrderStore;
+
+// Subset of a store's records, referenced by pointer rather than copied
+typedef struct {
+    const StockOrder **items;
+    size_t count;
+    size_t capacity;
+    const OrderAllocator *allocator;
+} OrderView;
+
+// Progress of putting a view in order a page at a time
+typedef struct {
+    size_t sorted;                  // Items [0, sorted) are in their final places
+    size_t *pivots;                 // Placed pivots beyond `sorted`, nearest last
+    size_t pivot_count;
+    size_t pivot_capacity;
+    const OrderAllocator *allocator;
+} OrderSelection;
+
+// Order vectors
+void order_vector_init(OrderVector *vec, const OrderAllocator *allocator);
+int order_vector_reserve(OrderVector *vec, size_t capacity);
+int order_vector_push(OrderVector *vec, const StockOrder *order);
+void order_vector_clear(OrderVector *vec);
+void order_vector_free(OrderVector *vec);
+
+// Streaming reader: open, fetch batches until 0 is returned, close
+int order_reader_open(OrderReader *reader, const char *path, size_t batch_size,
+                      const OrderAllocator *allocator);
+size_t order_reader_next_batch(OrderReader *reader, StockOrder **batch);
+void order_reader_close(OrderReader *reader);
+
+// Mapped files, the mapped store and pointer views over it
+int mapped_file_open(MappedFile *file, const char *path);
+void mapped_file_close(MappedFile *file);
+int order_store_open(OrderStore *store, const char *path);
+void order_store_close(OrderStore *store);
+size_t order_store_count_status(const OrderStore *store, int confirmed);
+void order_view_init(OrderView *view, const OrderAllocator *allocator);
+int order_view_push(OrderView *view, const StockOrder *order);
+int order_view_filter(OrderView *view, const OrderStore *store, int confirmed);
+void order_view_sort(OrderView *view, int (*compare)(const void *, const void *));
+
+// Sorting a view only as far as it is read
+void order_selection_init(OrderSelection *selection, const OrderAllocator *allocator);
+int order_selection_extend(OrderSelection *selection, OrderView *view, size_t wanted,
+                           int (*compare)(const void *, const void *));
+void order_selection_free(OrderSelection *selection);
+void order_view_free(OrderView *view);
+
+// Store operations
+int save_transaction(const StockOrder *order);
+void order_store_appended(void *ctx, size_t first_record,
+                          const StockOrder *orders, size_t count);
+int open_transactions(OrderStore *store);
+int confirm_transactions(size_t *record_indices, size_t count, long *confirmed_count,
+                         const OrderProgress *progress);
+void order_store_set_confirm_workers(int workers);
+int initialize_data_file(void);
+
+#endif // ORDER_STORE_H
@@ -0,0 +1,112 @@
+#include <string.h>
+#include "order_submit.h"
+
+#ifdef ORDER_SUBMIT_THREADS
+#include <errno.h>
+#include <sys/time.h>
+#include <time.h>
+
+static void submit_progress(void *ctx, size_t done, size_t total) {
+    OrderSubmit *submit = (OrderSubmit *)ctx;
+
+    pthread_mutex_lock(&submit->mutex);
+    submit->done = done;
+    submit->total = total;
+    pthread_cond_signal(&submit->changed);
+    pthread_mutex_unlock(&submit->mutex);
+}
+
+static void *submit_worker(void *arg) {
+    OrderSubmit *submit = (OrderSubmit *)arg;
+    OrderMatchSummary summary;
+    OrderProgress progress;
+    int ok;
+
+    progress.report = submit_progress;
+    progress.ctx = submit;
+    ok = match_pending_orders(&summary, &progress);
+
+    pthread_mutex_lock(&submit->mutex);
+    submit->summary = summary;
+    submit->ok = ok;
+    submit->finished = 1;
+    pthread_cond_signal(&submit->changed);
+    pthread_mutex_unlock(&submit->mutex);
+    return NULL;
+}
+
+int order_submit_start(OrderSubmit *submit) {
+    memset(submit, 0, sizeof(OrderSubmit));
+    if (pthread_mutex_init(&submit->mutex, NULL) != 0) {
+        return 0;
+    }
+    if (pthread_cond_init(&submit->changed, NULL) != 0) {
+        pthread_mutex_destroy(&submit->mutex);
+        return 0;
+    }
+    if (pthread_create(&submit->thread, NULL, submit_worker, submit) != 0) {
+        pthread_cond_destroy(&submit->changed);
+        pthread_mutex_destroy(&submit->mutex);
+        return 0;
+    }
+    return 1;
+}
+
+int order_submit_poll(OrderSubmit *submit, long timeout_ms, size_t *done, size_t *total) {
+    struct timeval now;
+    struct timespec until;
+    size_t seen_done, seen_total;
+    int finished;
+
+    gettimeofday(&now, NULL);
+    until.tv_sec = now.tv_sec + timeout_ms / 1000;
+    until.tv_nsec = (long)now.tv_usec * 1000 + (timeout_ms % 1000) * 1000000L;
+    if (until.tv_nsec >= 1000000000L) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&submit->mutex);
+    seen_done = submit->done;
+    seen_total = submit->total;
+    while (!submit->finished && submit->done == seen_done && submit->total == seen_total) {
+        if (pthread_cond_timedwait(&submit->changed, &submit->mutex, &until) == ETIMEDOUT) {
+            break;
+        }
+    }
+    *done = submit->done;
+    *total = submit->total;
+    finished = submit->finished;
+    pthread_mutex_unlock(&submit->mutex);
+    return finished;
+}
+
+int order_submit_finish(OrderSubmit *submit, OrderMatchSummary *summary) {
+    pthread_join(submit->thread, NULL);
+    pthread_cond_destroy(&submit->changed);
+    pthread_mutex_destroy(&submit->mutex);
+    *summary = submit->summary;
+    return submit->ok;
+}
+#else
+/* No threads: the whole session runs up front and polling just reports it */
+int order_submit_start(OrderSubmit *submit) {
+    memset(submit, 0, sizeof(OrderSubmit));
+    submit->ok = match_pending_orders(&submit->summary, NULL);
+    submit->done = submit->total = submit->summary.filled + submit->summary.closed;
+    submit->finished = 1;
+    return 1;
+}
+
+int order_submit_poll(OrderSubmit *submit, long timeout_ms, size_t *done, size_t *total) {
+    (void)timeout_ms;
+    *done = submit->done;
+    *total = submit->total;
+    return submit->finished;
+}
+
+int order_submit_finish(OrderSubmit *submit, OrderMatchSummary *summary) {
+    *summary = submit->summary;
+    return submit->ok;
+}
+#endif
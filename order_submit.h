@@ -0,0 +1,38 @@
+#ifndef ORDER_SUBMIT_H
+#define ORDER_SUBMIT_H
+
+#include <stddef.h>
+#include "order_match.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define ORDER_SUBMIT_THREADS 1
+#endif
+
+// A matching session run on a worker thread.  The store's locks are held
+// per process, so one submission at a time: nothing else in this process
+// may touch the store until order_submit_finish() returns.  Without
+// threads the session runs inside order_submit_start().
+typedef struct {
+    OrderMatchSummary summary;
+    int ok;
+    int finished;
+    size_t done;                    // Orders whose confirmations are written
+    size_t total;                   // Orders to confirm; 0 while still matching
+#ifdef ORDER_SUBMIT_THREADS
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+#endif
+} OrderSubmit;
+
+int order_submit_start(OrderSubmit *submit);
+
+// Wait up to `timeout_ms` for progress, then report it.  Returns 1 once
+// the session has finished.
+int order_submit_poll(OrderSubmit *submit, long timeout_ms, size_t *done, size_t *total);
+
+// Wait for the session; returns its success and summary
+int order_submit_finish(OrderSubmit *submit, OrderMatchSummary *summary);
+
+#endif // ORDER_SUBMIT_H
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "order_format.h"
+#include "order_lock.h"
+#include "order_symbols.h"
+
+#define SYMBOLS_MAGIC 0x53594D31UL  /* "SYM1" */
+#define SYMBOL_INITIAL_SLOTS 64
+#define SYMBOL_MAX_WIDTH 16
+
+/* NUL-padded copy of a name, so equal names are equal bytes */
+static void pack_name(char *key, const char *name, size_t width) {
+    size_t i;
+
+    memset(key, 0, width);
+    for (i = 0; i < width && name[i]; i++) {
+        key[i] = name[i];
+    }
+}
+
+/* Multiplicative hash over the packed name, one 64-bit word at a time */
+static size_t hash_name(const char *key, size_t width) {
+    uint64_t hash = 0;
+    size_t i;
+
+    for (i = 0; i < width; i += 8) {
+        uint64_t word;
+        memcpy(&word, key + i, 8);
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+    }
+    return (size_t)(hash >> 32);
+}
+
+static void table_init(OrderSymbolTable *table, size_t width) {
+    memset(table, 0, sizeof(OrderSymbolTable));
+    table->width = width;
+}
+
+static void table_free(OrderSymbolTable *table) {
+    free(table->names);
+    free(table->slots);
+    table_init(table, table->width);
+}
+
+static size_t find_slot(const OrderSymbolTable *table, const char *key) {
+    size_t mask = table->slot_count - 1;
+    size_t i = hash_name(key, table->width) & mask;
+
+    while (table->slots[i] != 0 &&
+           memcmp(table->names + (table->slots[i] - 1) * table->width, key, table->width) != 0) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int grow_slots(OrderSymbolTable *table) {
+    size_t count = table->slot_count ? table->slot_count * 2 : SYMBOL_INITIAL_SLOTS;
+    uint32_t *old = table->slots;
+    size_t i;
+
+    table->slots = (uint32_t *)calloc(count, sizeof(uint32_t));
+    if (table->slots == NULL) {
+        table->slots = old;
+        return 0;
+    }
+    table->slot_count = count;
+    for (i = 0; i < table->count; i++) {
+        table->slots[find_slot(table, table->names + i * table->width)] = (uint32_t)(i + 1);
+    }
+    free(old);
+    return 1;
+}
+
+void order_symbols_init(OrderSymbols *symbols) {
+    table_init(&symbols->tickers, 8);
+    table_init(&symbols->brokers, 16);
+}
+
+void order_symbols_free(OrderSymbols *symbols) {
+    table_free(&symbols->tickers);
+    table_free(&symbols->brokers);
+}
+
+int order_symbol_find(const OrderSymbolTable *table, const char *name, uint32_t *id) {
+    char key[SYMBOL_MAX_WIDTH];
+    size_t slot;
+
+    if (table->slot_count == 0) {
+        return 0;
+    }
+    pack_name(key, name, table->width);
+    slot = find_slot(table, key);
+    if (table->slots[slot] == 0) {
+        return 0;
+    }
+    *id = table->slots[slot] - 1;
+    return 1;
+}
+
+int order_symbol_intern(OrderSymbolTable *table, const char *name, uint32_t *id) {
+    char key[SYMBOL_MAX_WIDTH];
+
+    if (order_symbol_find(table, name, id)) {
+        return 1;
+    }
+    if (table->count > ORDER_SYMBOL_MAX) {
+        return 0;
+    }
+    if ((table->count + 1) * 2 > table->slot_count && !grow_slots(table)) {
+        return 0;
+    }
+    if (table->count == table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : 32;
+        char *names = (char *)realloc(table->names, capacity * table->width);
+        if (names == NULL) {
+            return 0;
+        }
+        table->names = names;
+        table->capacity = capacity;
+    }
+
+    pack_name(key, name, table->width);
+    memcpy(table->names + table->count * table->width, key, table->width);
+    table->slots[find_slot(table, key)] = (uint32_t)(table->count + 1);
+    *id = (uint32_t)table->count++;
+    return 1;
+}
+
+const char *order_symbol_name(const OrderSymbolTable *table, uint32_t id) {
+    /* Packed names keep their NUL: tickers have 7 chars at most, broker IDs 15 */
+    return id < table->count ? table->names + id * table->width : "";
+}
+
+int order_compact(OrderSymbols *symbols, const StockOrder *order, OrderCompact *compact) {
+    uint32_t ticker, broker;
+
+    if (!order_symbol_intern(&symbols->tickers, order->ticker, &ticker) ||
+        !order_symbol_intern(&symbols->brokers, order->broker_id, &broker)) {
+        return 0;
+    }
+    compact->timestamp = order->timestamp;
+    compact->customer_account_no = order->customer_account_no;
+    compact->price_cents = order->price_cents;
+    compact->quantity = (uint16_t)order->quantity;  /* At most ORDER_QUANTITY_MAX */
+    compact->ticker = (uint16_t)ticker;
+    compact->broker = (uint16_t)broker;
+    compact->action = order->action;
+    compact->flags = (uint8_t)((order->order_type == ORDER_TYPE_LIMIT ? ORDER_COMPACT_LIMIT : 0) |
+                               (order->confirmed ? ORDER_COMPACT_CONFIRMED : 0));
+    return 1;
+}
+
+/* Open the sidecar and load every symbol in it; *end is where the next entry goes */
+static FILE *symbols_file_open(OrderSymbols *symbols, OrderSymbolsHeader *header, long *end) {
+    OrderSymbolEntry entry;
+    FILE *fp = fopen(TRANSACTIONS_SYMBOLS_FILE, "r+b");
+    uint32_t id;
+
+    order_symbols_init(symbols);
+    if (fp != NULL) {
+        if (fread(header, sizeof(OrderSymbolsHeader), 1, fp) == 1 && header->magic == SYMBOLS_MAGIC) {
+            *end = (long)sizeof(OrderSymbolsHeader);
+            /* A torn entry at the tail is simply written over */
+            while (fread(&entry, sizeof(entry), 1, fp) == 1) {
+                OrderSymbolTable *table = entry.kind == ORDER_SYMBOL_TICKER ? &symbols->tickers
+                                                                           : &symbols->brokers;
+                if (!order_symbol_intern(table, entry.name, &id)) {
+                    fclose(fp);
+                    order_symbols_free(symbols);
+                    return NULL;
+                }
+                *end += (long)sizeof(entry);
+            }
+            return fp;
+        }
+        fclose(fp);
+    }
+
+    /* Missing or unrecognised: start an empty list */
+    fp = fopen(TRANSACTIONS_SYMBOLS_FILE, "w+b");
+    if (fp == NULL) {
+        return NULL;
+    }
+    memset(header, 0, sizeof(OrderSymbolsHeader));
+    header->magic = SYMBOLS_MAGIC;
+    if (fwrite(header, sizeof(OrderSymbolsHeader), 1, fp) != 1) {
+        fclose(fp);
+        return NULL;
+    }
+    *end = (long)sizeof(OrderSymbolsHeader);
+    return fp;
+}
+
+static int write_entry(FILE *fp, int kind, const char *name, size_t width) {
+    OrderSymbolEntry entry;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.kind = (uint8_t)kind;
+    pack_name(entry.name, name, width);
+    return fwrite(&entry, sizeof(entry), 1, fp) == 1;
+}
+
+/* Intern the symbols of records [first, first + count) and list the new ones */
+static int symbols_extend(FILE *fp, OrderSymbolsHeader *header, long end, OrderSymbols *symbols,
+                          size_t first, const StockOrder *orders, size_t count) {
+    size_t tickers = symbols->tickers.count, brokers = symbols->brokers.count;
+    uint32_t id;
+    size_t i;
+    int ok = fseek(fp, end, SEEK_SET) == 0;
+
+    for (i = 0; ok && i < count; i++) {
+        ok = order_symbol_intern(&symbols->tickers, orders[i].ticker, &id) &&
+             order_symbol_intern(&symbols->brokers, orders[i].broker_id, &id);
+    }
+    for (i = tickers; ok && i < symbols->tickers.count; i++) {
+        ok = write_entry(fp, ORDER_SYMBOL_TICKER, order_symbol_name(&symbols->tickers, (uint32_t)i), 8);
+    }
+    for (i = brokers; ok && i < symbols->brokers.count; i++) {
+        ok = write_entry(fp, ORDER_SYMBOL_BROKER, order_symbol_name(&symbols->brokers, (uint32_t)i), 16);
+    }
+
+    /* Publish the new coverage only after the entries exist */
+    if (ok) {
+        header->records = (uint64_t)(first + count);
+        ok = fseek(fp, 0, SEEK_SET) == 0 &&
+             fwrite(header, sizeof(OrderSymbolsHeader), 1, fp) == 1;
+    }
+    return ok;
+}
+
+int order_symbols_append(size_t first_record, const StockOrder *orders, size_t count) {
+    OrderSymbolsHeader header;
+    OrderSymbols symbols;
+    size_t skip;
+    long end;
+    FILE *fp;
+    int ok;
+
+    fp = symbols_file_open(&symbols, &header, &end);
+    if (fp == NULL) {
+        return 0;
+    }
+
+    /* Records must be covered in file order; a gap is filled on the next open */
+    if (header.records < first_record || header.records >= first_record + count) {
+        order_symbols_free(&symbols);
+        fclose(fp);
+        return 1;
+    }
+    skip = (size_t)header.records - first_record;
+
+    ok = symbols_extend(fp, &header, end, &symbols, first_record + skip,
+                        orders + skip, count - skip);
+    order_symbols_free(&symbols);
+    return fclose(fp) == 0 && ok;
+}
+
+/* Load the tables, listing anything in the store the sidecar hasn't seen */
+static int symbols_catch_up(OrderSymbols *symbols, const OrderStore *store) {
+    OrderSymbolsHeader header;
+    long end;
+    FILE *fp;
+    int ok = 1;
+
+    fp = symbols_file_open(symbols, &header, &end);
+    if (fp == NULL) {
+        return 0;
+    }
+    /* Ahead of our snapshot is fine; ahead of the file means it was replaced */
+    if (header.records > store->count && header.records > order_file_records(TRANSACTIONS_FILE)) {
+        fclose(fp);
+        order_symbols_free(symbols);
+        remove(TRANSACTIONS_SYMBOLS_FILE);
+        fp = symbols_file_open(symbols, &header, &end);
+        if (fp == NULL) {
+            return 0;
+        }
+    }
+    if (header.records < store->count) {
+        ok = symbols_extend(fp, &header, end, symbols, (size_t)header.records,
+                            store->records + header.records,
+                            store->count - (size_t)header.records);
+    }
+    if (fclose(fp) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        order_symbols_free(symbols);
+    }
+    return ok;
+}
+
+int order_symbols_open(OrderSymbols *symbols, const OrderStore *store) {
+    int ok;
+
+    order_symbols_init(symbols);
+    if (!order_lock_writer()) {
+        return 0;
+    }
+    ok = symbols_catch_up(symbols, store);
+    order_unlock_writer();
+    return ok;
+}
@@ -0,0 +1,75 @@
+#ifndef ORDER_SYMBOLS_H
+#define ORDER_SYMBOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "order_store.h"
+
+// Sidecar file: every ticker and broker ID seen, in order of first use
+#define TRANSACTIONS_SYMBOLS_FILE "transactions.sym"
+
+// Ids fit the 16-bit fields of OrderCompact
+#define ORDER_SYMBOL_MAX 65535
+
+// Header at the start of the symbols file
+typedef struct {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t records;               // Data records whose symbols are all listed
+} OrderSymbolsHeader;
+
+// One symbol in the file; ids are implicit, counted per kind
+typedef struct {
+    uint8_t kind;                   // ORDER_SYMBOL_TICKER or ORDER_SYMBOL_BROKER
+    uint8_t reserved[7];
+    char name[16];                  // NUL-padded
+} OrderSymbolEntry;
+
+#define ORDER_SYMBOL_TICKER 0
+#define ORDER_SYMBOL_BROKER 1
+
+// Names to dense ids.  Names are compared as packed, NUL-padded words.
+typedef struct {
+    char *names;                    // count * width bytes
+    size_t width;                   // 8 for tickers, 16 for brokers
+    size_t count;
+    size_t capacity;
+    uint32_t *slots;                // Open addressing: id + 1, 0 = empty
+    size_t slot_count;
+} OrderSymbolTable;
+
+typedef struct {
+    OrderSymbolTable tickers;
+    OrderSymbolTable brokers;
+} OrderSymbols;
+
+// Compact in-memory record: symbols by id, 24 bytes instead of 48
+typedef struct {
+    int64_t timestamp;
+    uint32_t customer_account_no;
+    uint32_t price_cents;
+    uint16_t quantity;
+    uint16_t ticker;                // Id in OrderSymbols.tickers
+    uint16_t broker;                // Id in OrderSymbols.brokers
+    uint8_t action;
+    uint8_t flags;                  // ORDER_COMPACT_*
+} OrderCompact;
+
+#define ORDER_COMPACT_LIMIT 0x1
+#define ORDER_COMPACT_CONFIRMED 0x2
+
+// Tables held only in memory
+void order_symbols_init(OrderSymbols *symbols);
+void order_symbols_free(OrderSymbols *symbols);
+int order_symbol_find(const OrderSymbolTable *table, const char *name, uint32_t *id);
+int order_symbol_intern(OrderSymbolTable *table, const char *name, uint32_t *id);
+const char *order_symbol_name(const OrderSymbolTable *table, uint32_t id);
+
+// Tables backed by the sidecar, brought up to date with the store
+int order_symbols_open(OrderSymbols *symbols, const OrderStore *store);
+int order_symbols_append(size_t first_record, const StockOrder *orders, size_t count);
+
+// Interns the order's symbols if they are new
+int order_compact(OrderSymbols *symbols, const StockOrder *order, OrderCompact *compact);
+
+#endif // ORDER_SYMBOLS_H
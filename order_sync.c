@@ -0,0 +1,430 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "order_append.h"
+#include "order_archive.h"
+#include "order_changes.h"
+#include "order_filter.h"
+#include "order_format.h"
+#include "order_index.h"
+#include "order_lock.h"
+#include "order_match.h"
+#include "order_positions.h"
+#include "order_protocol.h"
+#include "order_status.h"
+#include "order_store.h"
+#include "order_symbols.h"
+#include "order_sync.h"
+
+#define SYNC_REQUEST_MAGIC 0x53595131UL  /* "SYQ1" */
+#define SYNC_STREAM_MAGIC 0x53594E31UL   /* "SYN1" */
+#define REPLICA_MAGIC 0x52455031UL       /* "REP1" */
+
+#define SYNC_REQUEST_SIZE 24            /* magic, pad, epoch, sequence */
+#define SYNC_HEADER_SIZE 32             /* magic, pad, epoch, from, to */
+#define SYNC_RUN_SIZE 16                /* first, count; count 0 ends the stream */
+
+#define TRANSACTIONS_REPLICA_TEMP_FILE "transactions.rep.tmp"
+
+static int write_all(int fd, const void *buf, size_t length) {
+    const char *p = (const char *)buf;
+
+    while (length > 0) {
+        ssize_t n = write(fd, p, length);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return 1;
+}
+
+static int read_all(int fd, void *buf, size_t length) {
+    char *p = (char *)buf;
+
+    while (length > 0) {
+        ssize_t n = read(fd, p, length);
+
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return 1;
+}
+
+/* ---- Primary ---- */
+
+static int compare_change_first(const void *a, const void *b) {
+    uint64_t first_a = ((const OrderChange *)a)->first;
+    uint64_t first_b = ((const OrderChange *)b)->first;
+
+    return first_a < first_b ? -1 : (first_a > first_b ? 1 : 0);
+}
+
+/* Changes [from, to) as runs of records, sorted, each record in one run only */
+static size_t merge_runs(OrderChange *runs, size_t count) {
+    size_t i, merged = 0;
+
+    qsort(runs, count, sizeof(OrderChange), compare_change_first);
+    for (i = 0; i < count; i++) {
+        OrderChange *last = merged > 0 ? &runs[merged - 1] : NULL;
+        uint64_t end = runs[i].first + runs[i].count;
+
+        if (last != NULL && runs[i].first <= last->first + last->count &&
+            end - last->first <= UINT32_MAX) {
+            if (end > last->first + last->count) {
+                last->count = (uint32_t)(end - last->first);
+            }
+            continue;
+        }
+        runs[merged++] = runs[i];
+    }
+    return merged;
+}
+
+static int send_run(int fd, const OrderStore *store, const OrderChange *run) {
+    static StockOrder chunk[ORDER_SYNC_CHUNK];
+    unsigned char header[SYNC_RUN_SIZE];
+    size_t done, i;
+
+    order_put_u64(header, run->first);
+    order_put_u64(header + 8, run->count);
+    if (!write_all(fd, header, sizeof(header))) {
+        return 0;
+    }
+    for (done = 0; done < run->count; done += ORDER_SYNC_CHUNK) {
+        size_t n = run->count - done < ORDER_SYNC_CHUNK ? run->count - done : ORDER_SYNC_CHUNK;
+
+        for (i = 0; i < n; i++) {
+            chunk[i] = store->records[run->first + done + i];
+            order_to_disk(&chunk[i]);
+        }
+        if (!write_all(fd, chunk, n * sizeof(StockOrder))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int order_sync_send(int fd) {
+    unsigned char request[SYNC_REQUEST_SIZE], header[SYNC_HEADER_SIZE], end[SYNC_RUN_SIZE];
+    OrderStore store;
+    OrderChanges changes;
+    OrderChange *runs = NULL;
+    uint64_t epoch, sequence;
+    size_t from, to, count = 0, i;
+    int ok;
+
+    if (!read_all(fd, request, sizeof(request)) || order_get_u32(request) != SYNC_REQUEST_MAGIC) {
+        return 0;
+    }
+    epoch = order_get_u64(request + 8);
+    sequence = order_get_u64(request + 16);
+
+    if (!open_transactions(&store)) {
+        return 0;
+    }
+    if (!order_changes_open(&changes, &store)) {
+        order_store_close(&store);
+        return 0;
+    }
+
+    /* Another feed, or one behind the replica: start the replica over */
+    from = epoch == changes.epoch && sequence <= changes.count ? (size_t)sequence : 0;
+    /* Stop at the first change to records our snapshot doesn't have yet */
+    for (to = from; to < changes.count; to++) {
+        OrderChange change;
+
+        order_changes_get(&changes, to, &change);
+        if (change.first + change.count > store.count) {
+            break;
+        }
+    }
+    ok = 1;
+    if (to > from) {
+        runs = (OrderChange *)malloc((to - from) * sizeof(OrderChange));
+        ok = runs != NULL;
+        if (ok) {
+            for (i = from; i < to; i++) {
+                order_changes_get(&changes, i, &runs[i - from]);
+            }
+            count = merge_runs(runs, to - from);
+        }
+    }
+
+    memset(header, 0, sizeof(header));
+    order_put_u32(header, SYNC_STREAM_MAGIC);
+    order_put_u64(header + 8, changes.epoch);
+    order_put_u64(header + 16, from);
+    order_put_u64(header + 24, to);
+    ok = ok && write_all(fd, header, sizeof(header));
+    for (i = 0; ok && i < count; i++) {
+        ok = send_run(fd, &store, &runs[i]);
+    }
+    memset(end, 0, sizeof(end));
+    ok = ok && write_all(fd, end, sizeof(end));
+
+    free(runs);
+    order_changes_close(&changes);
+    order_store_close(&store);
+    return ok;
+}
+
+/* ---- Replica ---- */
+
+/* Record numbers waiting to be confirmed */
+typedef struct {
+    size_t *items;
+    size_t count;
+    size_t capacity;
+} RecordList;
+
+static int record_list_push(RecordList *list, size_t record) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        size_t *grown = (size_t *)realloc(list->items, capacity * sizeof(size_t));
+
+        if (grown == NULL) {
+            return 0;
+        }
+        list->items = grown;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = record;
+    return 1;
+}
+
+/* 1 with the replica's place in the feed; epoch 0 for a directory that is
+ * not a replica yet.  0 if it holds a store that isn't one. */
+static int replica_read(uint64_t *epoch, uint64_t *sequence) {
+    unsigned char state[24];
+    FILE *fp = fopen(TRANSACTIONS_REPLICA_FILE, "rb");
+
+    *epoch = 0;
+    *sequence = 0;
+    if (fp == NULL) {
+        fp = fopen(TRANSACTIONS_FILE, "rb");
+        if (fp != NULL) {
+            fclose(fp);
+            return 0;
+        }
+        return 1;
+    }
+    if (fread(state, sizeof(state), 1, fp) == 1 && order_get_u32(state) == REPLICA_MAGIC) {
+        *epoch = order_get_u64(state + 8);
+        *sequence = order_get_u64(state + 16);
+    }
+    fclose(fp);
+    return 1;
+}
+
+/* Replaced whole, and only once the changes it counts are on disk */
+static int replica_write(uint64_t epoch, uint64_t sequence) {
+    unsigned char state[24];
+    FILE *fp = fopen(TRANSACTIONS_REPLICA_TEMP_FILE, "wb");
+    int ok;
+
+    if (fp == NULL) {
+        return 0;
+    }
+    memset(state, 0, sizeof(state));
+    order_put_u32(state, REPLICA_MAGIC);
+    order_put_u64(state + 8, epoch);
+    order_put_u64(state + 16, sequence);
+    ok = fwrite(state, sizeof(state), 1, fp) == 1 && fflush(fp) == 0 &&
+         fsync(fileno(fp)) == 0;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(TRANSACTIONS_REPLICA_TEMP_FILE, TRANSACTIONS_REPLICA_FILE) != 0) {
+        remove(TRANSACTIONS_REPLICA_TEMP_FILE);
+        return 0;
+    }
+    return 1;
+}
+
+/* The store and everything derived from it, for a copy from scratch */
+static void replica_remove(void) {
+    static const char *files[] = {
+        TRANSACTIONS_WAL_FILE, TRANSACTIONS_INDEX_FILE, TRANSACTIONS_PATCH_FILE,
+        TRANSACTIONS_STATUS_FILE, TRANSACTIONS_PENDING_FILE, TRANSACTIONS_FILLS_FILE,
+        TRANSACTIONS_FILLED_FILE, TRANSACTIONS_SYMBOLS_FILE, TRANSACTIONS_BLOCKS_FILE,
+        TRANSACTIONS_CHANGES_FILE, TRANSACTIONS_POSITIONS_FILE, TRANSACTIONS_ARCHIVE_FILE,
+        TRANSACTIONS_REPLICA_FILE
+    };
+    size_t i;
+
+    order_segments_remove(TRANSACTIONS_FILE);
+    for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        remove(files[i]);
+    }
+}
+
+/* Apply one run: records we have are only ever confirmed since, the rest are new */
+static int receive_run(int fd, uint64_t first, uint64_t count, OrderAppender *app,
+                       const OrderStore *store, RecordList *confirms, OrderSyncResult *result) {
+    static StockOrder chunk[ORDER_SYNC_CHUNK];
+    size_t done, i;
+
+    for (done = 0; done < count; done += ORDER_SYNC_CHUNK) {
+        size_t n = count - done < ORDER_SYNC_CHUNK ? (size_t)(count - done) : ORDER_SYNC_CHUNK;
+
+        if (!read_all(fd, chunk, n * sizeof(StockOrder))) {
+            return 0;
+        }
+        for (i = 0; i < n; i++) {
+            size_t record = (size_t)first + done + i;
+
+            order_from_disk(&chunk[i]);
+            if (record < store->count) {
+                if (chunk[i].confirmed && !store->records[record].confirmed &&
+                    !record_list_push(confirms, record)) {
+                    return 0;
+                }
+            } else if (record == store->count + result->appended) {
+                if (!order_appender_append(app, &chunk[i])) {
+                    return 0;
+                }
+                result->appended++;
+            } else {
+                return 0;  /* A gap: the replica was written to by someone else */
+            }
+        }
+        result->records += n;
+    }
+    return 1;
+}
+
+int order_sync_receive(int fd, OrderSyncResult *result) {
+    unsigned char request[SYNC_REQUEST_SIZE], header[SYNC_HEADER_SIZE], run[SYNC_RUN_SIZE];
+    OrderAppendConfig config;
+    OrderAppender app;
+    OrderStore store;
+    RecordList confirms;
+    uint64_t epoch, sequence;
+    long confirmed = 0;
+    int ok;
+
+    memset(result, 0, sizeof(OrderSyncResult));
+    if (!replica_read(&epoch, &sequence)) {
+        return 0;
+    }
+    memset(request, 0, sizeof(request));
+    order_put_u32(request, SYNC_REQUEST_MAGIC);
+    order_put_u64(request + 8, epoch);
+    order_put_u64(request + 16, sequence);
+    if (!write_all(fd, request, sizeof(request)) || !read_all(fd, header, sizeof(header)) ||
+        order_get_u32(header) != SYNC_STREAM_MAGIC) {
+        return 0;
+    }
+    result->epoch = order_get_u64(header + 8);
+    result->from = order_get_u64(header + 16);
+    result->to = order_get_u64(header + 24);
+    if (result->epoch != epoch || result->from != sequence) {
+        if (result->from != 0) {
+            return 0;
+        }
+        replica_remove();
+    }
+
+    memset(&config, 0, sizeof(config));
+    config.batch_orders = ORDER_SYNC_CHUNK;
+    config.on_durable = order_store_appended;
+    if (!order_appender_open(&app, TRANSACTIONS_FILE, TRANSACTIONS_WAL_FILE, &config)) {
+        return 0;
+    }
+    if (!order_store_open(&store, TRANSACTIONS_FILE)) {
+        order_appender_close(&app);
+        return 0;
+    }
+    memset(&confirms, 0, sizeof(confirms));
+
+    ok = 1;
+    while (ok && (ok = read_all(fd, run, sizeof(run))) && order_get_u64(run + 8) > 0) {
+        ok = receive_run(fd, order_get_u64(run), order_get_u64(run + 8), &app, &store,
+                         &confirms, result);
+    }
+    ok = order_appender_close(&app) && ok;
+    if (ok && confirms.count > 0) {
+        ok = confirm_transactions(confirms.items, confirms.count, &confirmed, NULL);
+        result->confirmed = (size_t)confirmed;
+    }
+    free(confirms.items);
+    order_store_close(&store);
+    return ok && replica_write(result->epoch, result->to);
+}
+
+/* 1 if the child exited with success */
+static int sync_wait(pid_t child) {
+    int status;
+
+    while (waitpid(child, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return 0;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int order_sync(const char *replica_dir, OrderSyncResult *result) {
+    pid_t sender, receiver = -1;
+    int fds[2], results[2], ok;
+
+    memset(result, 0, sizeof(OrderSyncResult));
+    mkdir(replica_dir, 0755);  /* Fine if it is there already */
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        return 0;
+    }
+    if (pipe(results) != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    fflush(stdout);
+    sender = fork();
+    if (sender == 0) {
+        close(fds[1]);
+        close(results[0]);
+        close(results[1]);
+        _exit(order_sync_send(fds[0]) ? 0 : 1);
+    }
+    if (sender > 0) {
+        receiver = fork();
+        if (receiver == 0) {
+            /* This side becomes the replica; its locks are the replica's */
+            close(fds[0]);
+            close(results[0]);
+            order_lock_close();
+            ok = chdir(replica_dir) == 0 && order_sync_receive(fds[1], result) &&
+                 write_all(results[1], result, sizeof(OrderSyncResult));
+            _exit(ok ? 0 : 1);
+        }
+    }
+
+    /* Both sides run in children, so our directory and locks are untouched */
+    close(fds[0]);
+    close(fds[1]);
+    close(results[1]);
+    ok = receiver > 0 && read_all(results[0], result, sizeof(OrderSyncResult));
+    close(results[0]);
+    if (sender > 0) {
+        ok = sync_wait(sender) && ok;
+    }
+    if (receiver > 0) {
+        ok = sync_wait(receiver) && ok;
+    }
+    return ok;
+}
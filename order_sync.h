@@ -0,0 +1,39 @@
+#ifndef ORDER_SYNC_H
+#define ORDER_SYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Kept in a replica's directory: the primary's feed it follows, and the
+// sequence number it has applied up to
+#define TRANSACTIONS_REPLICA_FILE "transactions.rep"
+
+// Records sent per write of the stream
+#define ORDER_SYNC_CHUNK 4096
+
+// What one sync did
+typedef struct {
+    uint64_t epoch;                 // Of the primary's feed
+    uint64_t from;                  // Sequence the replica started at; 0 = copied from scratch
+    uint64_t to;                    // Sequence it is at now
+    size_t records;                 // Records sent, each at most once
+    size_t appended;
+    size_t confirmed;
+} OrderSyncResult;
+
+// The primary's side, in its directory: read what a replica asks for on
+// `fd` and stream it every record changed since, as it is now
+int order_sync_send(int fd);
+
+// The replica's side, in its directory: ask for the changes since its
+// sequence number and apply them.  Applying the same records twice changes
+// nothing, so a sync cut short is simply run again.  A replica of a
+// different feed (the primary's store was replaced) is wiped and copied afresh.
+int order_sync_receive(int fd, OrderSyncResult *result);
+
+// Both ends: bring the replica in `replica_dir` (created if need be) up to
+// date with the store in the current directory.  Each side runs in a child
+// process; the caller's directory and locks are left as they were.
+int order_sync(const char *replica_dir, OrderSyncResult *result);
+
+#endif // ORDER_SYNC_H
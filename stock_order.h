@@ -17,16 +17,22 @@ typedef enum {
 } OrderType;
 
 // Stock order structure
+// This is also the on-disk record (format v2): every field sits at its
+// natural alignment with no padding, multi-byte fields are little-endian.
 typedef struct {
-    uint32_t customer_account_no;  // Customer account number
-    time_t timestamp;               // Unix timestamp of the order
-    char broker_id[16];             // Broker ID (e.g., "JDS")
-    OrderAction action;             // BUY or SELL
+    int64_t timestamp;              // Unix timestamp of the order
+    uint32_t customer_account_no;   // Customer account number
     uint32_t quantity;              // Number of shares
-    double price;                   // Price per share in dollars
+    uint32_t price_cents;           // Price per share in cents
+    uint8_t action;                 // OrderAction: BUY or SELL
+    uint8_t order_type;             // OrderType: LIMIT, or MARKET
+    uint8_t confirmed;              // 0 = unconfirmed, 1 = confirmed
+    uint8_t reserved;               // Always 0
+    char broker_id[16];             // Broker ID (e.g., "JDS")
     char ticker[8];                 // Stock ticker symbol (e.g., "GM")
-    OrderType order_type;           // LIMIT, or MARKET
-    int confirmed;                  // 0 = unconfirmed, 1 = confirmed
 } StockOrder;
 
+// Fails to compile if a compiler ever pads the record
+typedef char stock_order_size_check[(sizeof(StockOrder) == 48) ? 1 : -1];
+
 #endif // STOCK_ORDER_H